@@ -0,0 +1,399 @@
+/**
+ * @file usb_descriptor.c
+ * @brief Descriptors and standard requests of the emulated CMSIS-DAP device
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * WinUSB mode exposes a CMSIS-DAP v2 bulk interface, with the BOS and
+ * MS OS 2.0 descriptors that let Windows bind WinUSB on its own.
+ * HID mode exposes a CMSIS-DAP v1 interrupt interface.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "components/USBIP/usb_descriptor.h"
+#include "main/dap_configuration.h"
+
+#include "lwip/sockets.h" // htonl
+
+#define USB_DESC_DEVICE           0x01
+#define USB_DESC_CONFIGURATION    0x02
+#define USB_DESC_STRING           0x03
+#define USB_DESC_INTERFACE        0x04
+#define USB_DESC_ENDPOINT         0x05
+#define USB_DESC_DEVICE_QUALIFIER 0x06
+#define USB_DESC_BOS              0x0F
+#define USB_DESC_HID              0x21
+#define USB_DESC_HID_REPORT       0x22
+
+#define LO(x) ((uint8_t)((x) & 0xFF))
+#define HI(x) ((uint8_t)(((x) >> 8) & 0xFF))
+
+#if (USE_USB_3_0 == 1)
+    #define USBD0_BCD_USB 0x0300
+    #define USBD0_MAX_PACKET0 0x09 // 2^9 = 512
+    #define USBD0_SPEED USBIP_SPEED_SUPER
+#else
+    #define USBD0_BCD_USB 0x0210 // 2.1 for the BOS descriptor
+    #define USBD0_MAX_PACKET0 0x40
+    #define USBD0_SPEED USBIP_SPEED_HIGH
+#endif
+
+#if (USE_WINUSB == 1)
+    #define USBD0_INTERFACE_CLASS 0xFF
+    #define USBD0_EP_TYPE 0x02 // bulk
+    #define USBD0_EP_SIZE USB_ENDPOINT_SIZE
+    #define USBD0_EP_INTERVAL 0
+#else
+    #define USBD0_INTERFACE_CLASS 0x03
+    #define USBD0_EP_TYPE 0x03 // interrupt
+    #define USBD0_EP_SIZE DAP_PACKET_SIZE_DEFAULT
+    #define USBD0_EP_INTERVAL 1
+#endif
+
+
+static const uint8_t kUSBd0DeviceDescriptor[] = {
+    18,                   // bLength
+    USB_DESC_DEVICE,      // bDescriptorType
+    LO(USBD0_BCD_USB), HI(USBD0_BCD_USB),
+    0x00,                 // bDeviceClass, given by the interface
+    0x00,                 // bDeviceSubClass
+    0x00,                 // bDeviceProtocol
+    USBD0_MAX_PACKET0,    // bMaxPacketSize0
+    LO(USBD0_DEV_DESC_IDVENDOR), HI(USBD0_DEV_DESC_IDVENDOR),
+    LO(USBD0_DEV_DESC_IDPRODUCT), HI(USBD0_DEV_DESC_IDPRODUCT),
+    LO(USBD0_DEV_DESC_BCDDEVICE), HI(USBD0_DEV_DESC_BCDDEVICE),
+    0x01,                 // iManufacturer
+    0x02,                 // iProduct
+    0x03,                 // iSerialNumber
+    0x01,                 // bNumConfigurations
+};
+
+
+static const uint8_t kUSBd0DeviceQualifier[] = {
+    10,
+    USB_DESC_DEVICE_QUALIFIER,
+    0x00, 0x02,           // bcdUSB 2.0
+    0x00, 0x00, 0x00,
+    0x40,                 // bMaxPacketSize0
+    0x01,                 // bNumConfigurations
+    0x00,
+};
+
+
+#if (USE_WINUSB == 0)
+static const uint8_t kUSBd0HidReport[] = {
+    0x06, 0x00, 0xFF,     // Usage Page (Vendor Defined)
+    0x09, 0x01,           // Usage (Vendor Usage 1)
+    0xA1, 0x01,           // Collection (Application)
+    0x15, 0x00,           //   Logical Minimum (0)
+    0x26, 0xFF, 0x00,     //   Logical Maximum (255)
+    0x75, 0x08,           //   Report Size (8)
+    0x95, (uint8_t)DAP_PACKET_SIZE_DEFAULT, // Report Count
+    0x09, 0x01,           //   Usage (Vendor Usage 1)
+    0x81, 0x02,           //   Input (Data, Var, Abs)
+    0x95, (uint8_t)DAP_PACKET_SIZE_DEFAULT, // Report Count
+    0x09, 0x01,           //   Usage (Vendor Usage 1)
+    0x91, 0x02,           //   Output (Data, Var, Abs)
+    0xC0,                 // End Collection
+};
+#endif
+
+
+#if (USE_USB_3_0 == 1)
+    #define USBD0_EP_COMPANION 6, 0x30, 0x00, 0x00, 0x00, 0x00,
+    #define USBD0_EP_COMPANION_SIZE 6
+#else
+    #define USBD0_EP_COMPANION
+    #define USBD0_EP_COMPANION_SIZE 0
+#endif
+
+#if (USE_WINUSB == 1)
+    #define USBD0_HID_SIZE 0
+#else
+    #define USBD0_HID_SIZE 9
+#endif
+
+#define USBD0_CONFIG_SIZE (9 + 9 + USBD0_HID_SIZE + 2 * (7 + USBD0_EP_COMPANION_SIZE))
+
+static const uint8_t kUSBd0ConfigDescriptor[] = {
+    9,
+    USB_DESC_CONFIGURATION,
+    LO(USBD0_CONFIG_SIZE), HI(USBD0_CONFIG_SIZE),
+    0x01,                 // bNumInterfaces
+    0x01,                 // bConfigurationValue
+    0x00,                 // iConfiguration
+    0x80,                 // bmAttributes, bus powered
+    0x32,                 // bMaxPower
+
+    9,
+    USB_DESC_INTERFACE,
+    0x00,                 // bInterfaceNumber
+    0x00,                 // bAlternateSetting
+    0x02,                 // bNumEndpoints
+    USBD0_INTERFACE_CLASS,
+    0x00,                 // bInterfaceSubClass
+    0x00,                 // bInterfaceProtocol
+    0x04,                 // iInterface
+
+#if (USE_WINUSB == 0)
+    9,
+    USB_DESC_HID,
+    0x11, 0x01,           // bcdHID 1.11
+    0x00,                 // bCountryCode
+    0x01,                 // bNumDescriptors
+    USB_DESC_HID_REPORT,
+    LO(sizeof(kUSBd0HidReport)), HI(sizeof(kUSBd0HidReport)),
+#endif
+
+    7,
+    USB_DESC_ENDPOINT,
+    USBD0_EP_DAP_OUT,
+    USBD0_EP_TYPE,
+    LO(USBD0_EP_SIZE), HI(USBD0_EP_SIZE),
+    USBD0_EP_INTERVAL,
+    USBD0_EP_COMPANION
+
+    7,
+    USB_DESC_ENDPOINT,
+    USBD0_EP_DAP_IN,
+    USBD0_EP_TYPE,
+    LO(USBD0_EP_SIZE), HI(USBD0_EP_SIZE),
+    USBD0_EP_INTERVAL,
+    USBD0_EP_COMPANION
+};
+
+
+#if (USE_WINUSB == 1)
+// MS OS 2.0 descriptor set: WINUSB compatible ID and the CMSIS-DAP v2 interface GUID
+#define MS_OS_20_NAME "DeviceInterfaceGUIDs"
+#define MS_OS_20_GUID "{CDB3B5AD-293B-4663-AA36-1AAE46463776}"
+#define MS_OS_20_NAME_SIZE ((sizeof(MS_OS_20_NAME)) * 2)     // with NUL
+#define MS_OS_20_GUID_SIZE ((sizeof(MS_OS_20_GUID) + 1) * 2) // REG_MULTI_SZ, two NULs
+#define MS_OS_20_PROPERTY_SIZE (10 + MS_OS_20_NAME_SIZE + MS_OS_20_GUID_SIZE)
+#define MS_OS_20_SET_SIZE (10 + 20 + MS_OS_20_PROPERTY_SIZE)
+
+static const uint8_t kUSBd0BOS[] = {
+    5,
+    USB_DESC_BOS,
+#if (USE_USB_3_0 == 1)
+    LO(5 + 28 + 10), HI(5 + 28 + 10),
+    0x02,                 // bNumDeviceCaps
+    // SuperSpeed USB device capability
+    10, 0x10, 0x03,
+    0x00,                 // bmAttributes
+    0x0E, 0x00,           // wSpeedsSupported, full/high/super
+    0x01,                 // bFunctionalitySupport
+    0x0A,                 // bU1DevExitLat
+    0xFF, 0x07,           // wU2DevExitLat
+#else
+    LO(5 + 28), HI(5 + 28),
+    0x01,                 // bNumDeviceCaps
+#endif
+    // Microsoft OS 2.0 platform capability
+    28, 0x10, 0x05,
+    0x00,
+    0xDF, 0x60, 0xDD, 0xD8, 0x89, 0x45, 0xC7, 0x4C,
+    0x9C, 0xD2, 0x65, 0x9D, 0x9E, 0x64, 0x8A, 0x9F,
+    0x00, 0x00, 0x03, 0x06, // dwWindowsVersion, Windows 8.1
+    LO(MS_OS_20_SET_SIZE), HI(MS_OS_20_SET_SIZE),
+    USBD0_MS_OS_20_VENDOR_CODE,
+    0x00,                 // bAltEnumCode
+};
+#endif
+
+
+static const char *kUSBd0Strings[] = {
+    NULL, // language IDs
+    "windowsair",
+    "Wireless CMSIS-DAP",
+    "1234",
+#if (USE_WINUSB == 1)
+    "CMSIS-DAP v2",
+#else
+    "CMSIS-DAP",
+#endif
+};
+
+
+static uint32_t put_utf16(uint8_t *buf, const char *str, uint32_t count) {
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        buf[i * 2] = (uint8_t)str[i];
+        buf[i * 2 + 1] = 0;
+    }
+    return count * 2;
+}
+
+
+static int copy_descriptor(uint8_t *buf, uint32_t max, const uint8_t *desc, uint32_t len) {
+    len = len > max ? max : len;
+    memcpy(buf, desc, len);
+    return len;
+}
+
+
+static int get_string_descriptor(uint8_t index, uint8_t *buf, uint32_t max) {
+    uint8_t desc[2 + 2 * 64];
+    uint32_t len;
+
+    if (index >= sizeof(kUSBd0Strings) / sizeof(kUSBd0Strings[0]))
+        return -1;
+
+    if (index == 0) {
+        desc[2] = 0x09; // English (United States)
+        desc[3] = 0x04;
+        len = 4;
+    } else {
+        len = 2 + put_utf16(desc + 2, kUSBd0Strings[index], strlen(kUSBd0Strings[index]));
+    }
+
+    desc[0] = len;
+    desc[1] = USB_DESC_STRING;
+    return copy_descriptor(buf, max, desc, len);
+}
+
+
+#if (USE_WINUSB == 1)
+static int get_ms_os_20_descriptor(uint8_t *buf, uint32_t max) {
+    uint8_t desc[MS_OS_20_SET_SIZE];
+    uint8_t *p = desc;
+
+    memset(desc, 0, sizeof(desc));
+
+    // set header
+    *p++ = 10; *p++ = 0;
+    *p++ = 0x00; *p++ = 0x00;                // MS_OS_20_SET_HEADER_DESCRIPTOR
+    *p++ = 0x00; *p++ = 0x00; *p++ = 0x03; *p++ = 0x06;
+    *p++ = LO(MS_OS_20_SET_SIZE); *p++ = HI(MS_OS_20_SET_SIZE);
+
+    // compatible ID
+    *p++ = 20; *p++ = 0;
+    *p++ = 0x03; *p++ = 0x00;                // MS_OS_20_FEATURE_COMPATBLE_ID
+    memcpy(p, "WINUSB", 6);
+    p += 16;
+
+    // registry property
+    *p++ = LO(MS_OS_20_PROPERTY_SIZE); *p++ = HI(MS_OS_20_PROPERTY_SIZE);
+    *p++ = 0x04; *p++ = 0x00;                // MS_OS_20_FEATURE_REG_PROPERTY
+    *p++ = 0x07; *p++ = 0x00;                // REG_MULTI_SZ
+    *p++ = LO(MS_OS_20_NAME_SIZE); *p++ = HI(MS_OS_20_NAME_SIZE);
+    p += put_utf16(p, MS_OS_20_NAME, sizeof(MS_OS_20_NAME));
+    *p++ = LO(MS_OS_20_GUID_SIZE); *p++ = HI(MS_OS_20_GUID_SIZE);
+    put_utf16(p, MS_OS_20_GUID, sizeof(MS_OS_20_GUID)); // the last NUL is already zero
+
+    return copy_descriptor(buf, max, desc, sizeof(desc));
+}
+#endif
+
+
+static int get_descriptor(const uint8_t *setup, uint8_t *buf, uint32_t max) {
+    uint8_t type = setup[3];
+    uint8_t index = setup[2];
+
+    switch (type) {
+    case USB_DESC_DEVICE:
+        return copy_descriptor(buf, max, kUSBd0DeviceDescriptor, sizeof(kUSBd0DeviceDescriptor));
+    case USB_DESC_CONFIGURATION:
+        return copy_descriptor(buf, max, kUSBd0ConfigDescriptor, sizeof(kUSBd0ConfigDescriptor));
+    case USB_DESC_STRING:
+        return get_string_descriptor(index, buf, max);
+    case USB_DESC_DEVICE_QUALIFIER:
+        return copy_descriptor(buf, max, kUSBd0DeviceQualifier, sizeof(kUSBd0DeviceQualifier));
+#if (USE_WINUSB == 1)
+    case USB_DESC_BOS:
+        return copy_descriptor(buf, max, kUSBd0BOS, sizeof(kUSBd0BOS));
+#else
+    case USB_DESC_HID_REPORT:
+        return copy_descriptor(buf, max, kUSBd0HidReport, sizeof(kUSBd0HidReport));
+#endif
+    default:
+        return -1;
+    }
+}
+
+
+int usb_handle_control(const uint8_t *setup, uint8_t *buf, uint32_t max) {
+    uint8_t request_type = setup[0];
+    uint8_t request = setup[1];
+    uint16_t wIndex = setup[4] | (setup[5] << 8);
+    uint16_t wLength = setup[6] | (setup[7] << 8);
+
+    max = wLength < max ? wLength : max;
+
+    switch (request_type & USB_REQ_TYPE_MASK) {
+    case USB_REQ_TYPE_STANDARD:
+        switch (request) {
+        case USB_REQ_GET_DESCRIPTOR:
+            return get_descriptor(setup, buf, max);
+        case USB_REQ_GET_STATUS:
+            memset(buf, 0, 2);
+            return max < 2 ? max : 2;
+        case USB_REQ_GET_CONFIGURATION:
+            buf[0] = 0x01;
+            return max < 1 ? max : 1;
+        case USB_REQ_GET_INTERFACE:
+            buf[0] = 0x00;
+            return max < 1 ? max : 1;
+        case USB_REQ_SET_ADDRESS:
+        case USB_REQ_SET_CONFIGURATION:
+        case USB_REQ_SET_INTERFACE:
+        case USB_REQ_CLEAR_FEATURE:
+        case USB_REQ_SET_FEATURE:
+            return 0;
+        default:
+            return -1;
+        }
+
+    case USB_REQ_TYPE_VENDOR:
+#if (USE_WINUSB == 1)
+        if (request == USBD0_MS_OS_20_VENDOR_CODE && wIndex == 0x07)
+            return get_ms_os_20_descriptor(buf, max);
+#endif
+        return -1;
+
+    case USB_REQ_TYPE_CLASS:
+#if (USE_WINUSB == 0)
+        if (request == USB_HID_REQ_SET_IDLE)
+            return 0;
+#endif
+        return -1;
+
+    default:
+        return -1;
+    }
+}
+
+
+void usb_device_info(usbip_stage1_usb_device *dev) {
+    memset(dev, 0, sizeof(usbip_stage1_usb_device));
+
+    strcpy(dev->path, "/sys/devices/pci0000:00/0000:00:01.2/usb1/1-1");
+    strcpy(dev->busid, "1-1");
+
+    dev->busnum = htonl(1);
+    dev->devnum = htonl(1);
+    dev->speed = htonl(USBD0_SPEED);
+
+    dev->idVendor = htons(USBD0_DEV_DESC_IDVENDOR);
+    dev->idProduct = htons(USBD0_DEV_DESC_IDPRODUCT);
+    dev->bcdDevice = htons(USBD0_DEV_DESC_BCDDEVICE);
+
+    dev->bDeviceClass = 0x00;
+    dev->bDeviceSubClass = 0x00;
+    dev->bDeviceProtocol = 0x00;
+    dev->bConfigurationValue = 0x01;
+    dev->bNumConfigurations = 0x01;
+    dev->bNumInterfaces = 0x01;
+}
+
+
+void usb_interface_info(usbip_stage1_usb_interface *intf) {
+    intf->bInterfaceClass = USBD0_INTERFACE_CLASS;
+    intf->bInterfaceSubClass = 0x00;
+    intf->bInterfaceProtocol = 0x00;
+    intf->padding = 0x00;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file usb_descriptor.h
+ * @brief Descriptors and standard requests of the emulated CMSIS-DAP device
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#ifndef __USB_DESCRIPTOR_H__
+#define __USB_DESCRIPTOR_H__
+
+#include <stdint.h>
+
+#include "components/USBIP/usbip_defs.h"
+
+#define USBD0_DEV_DESC_IDVENDOR  0xC251
+#define USBD0_DEV_DESC_IDPRODUCT 0xF00A
+#define USBD0_DEV_DESC_BCDDEVICE 0x0100
+
+// DAP packets go through EP1 in both directions
+#define USBD0_EP_DAP_OUT 0x01
+#define USBD0_EP_DAP_IN  0x81
+
+// Vendor request that returns the MS OS 2.0 descriptor set
+#define USBD0_MS_OS_20_VENDOR_CODE 0x01
+
+#define USB_REQ_GET_STATUS        0x00
+#define USB_REQ_CLEAR_FEATURE     0x01
+#define USB_REQ_SET_FEATURE       0x03
+#define USB_REQ_SET_ADDRESS       0x05
+#define USB_REQ_GET_DESCRIPTOR    0x06
+#define USB_REQ_GET_CONFIGURATION 0x08
+#define USB_REQ_SET_CONFIGURATION 0x09
+#define USB_REQ_GET_INTERFACE     0x0A
+#define USB_REQ_SET_INTERFACE     0x0B
+
+#define USB_HID_REQ_GET_REPORT 0x01
+#define USB_HID_REQ_SET_REPORT 0x09
+#define USB_HID_REQ_SET_IDLE   0x0A
+
+#define USB_REQ_TYPE_MASK     0x60
+#define USB_REQ_TYPE_STANDARD 0x00
+#define USB_REQ_TYPE_CLASS    0x20
+#define USB_REQ_TYPE_VENDOR   0x40
+
+/**
+ * @brief Fill the device summary of OP_REP_DEVLIST and OP_REP_IMPORT
+ *
+ */
+void usb_device_info(usbip_stage1_usb_device *dev);
+void usb_interface_info(usbip_stage1_usb_interface *intf);
+
+/**
+ * @brief Answer a standard, HID class or MS OS 2.0 vendor request on EP0
+ *
+ * @param setup 8 byte setup packet
+ * @param buf data stage of an IN request
+ * @param max room in buf
+ * @return bytes of the IN data stage (0 for OUT requests), -1 to stall
+ */
+int usb_handle_control(const uint8_t *setup, uint8_t *buf, uint32_t max);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file usbip_defs.h
+ * @brief USB/IP protocol messages, see Documentation/usb/usbip_protocol.rst of Linux
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * All fields are big endian on the wire.
+ *
+ */
+#ifndef __USBIP_DEFS_H__
+#define __USBIP_DEFS_H__
+
+#include <stdint.h>
+
+#define USBIP_VERSION 0x0111
+
+// Stage 1: device list and import, before the connection carries URBs
+#define USBIP_OP_REQ_DEVLIST 0x8005
+#define USBIP_OP_REP_DEVLIST 0x0005
+#define USBIP_OP_REQ_IMPORT  0x8003
+#define USBIP_OP_REP_IMPORT  0x0003
+
+// Stage 2: URB traffic
+#define USBIP_CMD_SUBMIT 0x00000001
+#define USBIP_CMD_UNLINK 0x00000002
+#define USBIP_RET_SUBMIT 0x00000003
+#define USBIP_RET_UNLINK 0x00000004
+
+#define USBIP_DIR_OUT 0
+#define USBIP_DIR_IN  1
+
+#define USBIP_BUSID_SIZE 32
+#define USBIP_PATH_SIZE  256
+
+// URB status, negated Linux errno
+#define USBIP_STATUS_OK         0
+#define USBIP_STATUS_ECONNRESET (-104) // unlinked
+#define USBIP_STATUS_EPIPE      (-32)  // stall
+
+// Linux usb_device_speed
+#define USBIP_SPEED_FULL  2
+#define USBIP_SPEED_HIGH  3
+#define USBIP_SPEED_SUPER 5
+
+
+typedef struct
+{
+    uint16_t version;
+    uint16_t command;
+    uint32_t status;
+} __attribute__((packed)) usbip_stage1_header;
+
+
+typedef struct
+{
+    char path[USBIP_PATH_SIZE];
+    char busid[USBIP_BUSID_SIZE];
+
+    uint32_t busnum;
+    uint32_t devnum;
+    uint32_t speed;
+
+    uint16_t idVendor;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+
+    uint8_t bDeviceClass;
+    uint8_t bDeviceSubClass;
+    uint8_t bDeviceProtocol;
+    uint8_t bConfigurationValue;
+    uint8_t bNumConfigurations;
+    uint8_t bNumInterfaces;
+} __attribute__((packed)) usbip_stage1_usb_device;
+
+
+typedef struct
+{
+    uint8_t bInterfaceClass;
+    uint8_t bInterfaceSubClass;
+    uint8_t bInterfaceProtocol;
+    uint8_t padding;
+} __attribute__((packed)) usbip_stage1_usb_interface;
+
+
+typedef struct
+{
+    usbip_stage1_header header;
+    char busid[USBIP_BUSID_SIZE];
+} __attribute__((packed)) usbip_stage1_request_import;
+
+
+typedef struct
+{
+    uint32_t command;
+    uint32_t seqnum;
+    uint32_t devid;
+    uint32_t direction;
+    uint32_t ep;
+} __attribute__((packed)) usbip_stage2_header_basic;
+
+
+typedef struct
+{
+    uint32_t transfer_flags;
+    int32_t data_length;
+    int32_t start_frame;
+    int32_t number_of_packets;
+    int32_t interval;
+    uint8_t setup[8];
+} __attribute__((packed)) usbip_cmd_submit;
+
+
+typedef struct
+{
+    int32_t status;
+    int32_t data_length;
+    int32_t start_frame;
+    int32_t number_of_packets;
+    int32_t error_count;
+    uint8_t padding[8];
+} __attribute__((packed)) usbip_ret_submit;
+
+
+typedef struct
+{
+    uint32_t seqnum;
+    uint8_t padding[24];
+} __attribute__((packed)) usbip_cmd_unlink;
+
+
+typedef struct
+{
+    int32_t status;
+    uint8_t padding[24];
+} __attribute__((packed)) usbip_ret_unlink;
+
+
+// Every stage 2 message starts with this 48 byte header
+typedef struct
+{
+    usbip_stage2_header_basic base;
+    union {
+        usbip_cmd_submit cmd_submit;
+        usbip_ret_submit ret_submit;
+        usbip_cmd_unlink cmd_unlink;
+        usbip_ret_unlink ret_unlink;
+    } u;
+} __attribute__((packed)) usbip_stage2_header;
+
+#endif
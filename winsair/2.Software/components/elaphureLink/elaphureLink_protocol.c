@@ -1,71 +1,619 @@
+#include "sdkconfig.h"
+
 #include "components/elaphureLink/elaphureLink_protocol.h"
+#include "components/DAP/include/DAP.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/wifi_configuration.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include <lwip/netdb.h>
 
-extern int kSock;
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
-int usbip_network_send(int s, const void *dataptr, size_t size, int flags) 
+// Sent on whichever transport carries the session, s and flags are unused
+int usbip_network_send(int s, const void *dataptr, size_t size, int flags)
 {
-    return send(s, dataptr, size, flags);
+    return transport_send(dataptr, size);
 }
-extern void malloc_dap_ringbuf();
-extern void free_dap_ringbuf();
+uint8_t* el_process_buffer = NULL;
 
-extern uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response);
+// Holds the head of a request that was split across TCP segments
+static uint8_t *el_request_buffer = NULL;
+static size_t el_request_len = 0;
+
+// Holds the start of a handshake that was split across TCP segments
+static uint8_t el_handshake_prefix[sizeof(el_request_handshake_caps) + EL_CAPS_MAX_LENGTH];
+static size_t el_handshake_prefix_len = 0;
+
+// Responses collected for one send
+typedef struct {
+    uint8_t *buf;      // NULL until the first response is written
+    size_t len;
+    uint8_t *fallback; // staging buffer used when the data has to be copied
+} el_tx_stage_t;
+
+static el_tx_stage_t el_response = { NULL, 0, NULL };
+// ID_DAP_QueueCommands packets held until a non-queued request arrives
+static uint8_t *el_queue_buffer = NULL;
+static size_t el_queue_len = 0;
+
+el_session_caps_t el_session_caps = {
+    .packet_size = DAP_PACKET_SIZE_DEFAULT,
+    .packet_count = 0,
+    .queue_commands = 1,
+    .compression = 0,
+    .pipeline_depth = 1,
+    .side_channel = 0,
+};
+
+static void el_session_caps_reset() {
+    el_session_caps.packet_size = DAP_PACKET_SIZE_DEFAULT;
+    el_session_caps.packet_count = 0; // keep what DAP.c reports
+    el_session_caps.queue_commands = 1;
+    el_session_caps.compression = 0;  // no compression scheme is implemented
+    el_session_caps.pipeline_depth = 1;
+    el_session_caps.side_channel = 0;
+}
+
+
+size_t el_process_buffer_size() {
+    return EL_PROCESS_BUFFER_SIZE + DAP_PACKET_SIZE * 2 + EL_QUEUE_BUFFER_SIZE;
+}
 
-uint8_t* el_process_buffer = NULL;
 
 void el_process_buffer_malloc() {
     if (el_process_buffer != NULL)
         return;
 
-    free_dap_ringbuf();
+    // the packet size may have changed in the handshake
+    dap_ringbuf_resize(el_session_caps.packet_size);
 
-    el_process_buffer = malloc(1500);
+    // [responses, one segment + one packet][split request][queued commands]
+    el_process_buffer = session_arena_alloc(el_process_buffer_size());
+    if (el_process_buffer != NULL) {
+        el_request_buffer = el_process_buffer + EL_PROCESS_BUFFER_SIZE + DAP_PACKET_SIZE;
+        el_queue_buffer = el_request_buffer + DAP_PACKET_SIZE;
+    }
+
+    el_request_len = 0;
+    el_queue_len = 0;
+    el_response.buf = NULL;
+    el_response.len = 0;
+    el_response.fallback = el_process_buffer;
 }
 
 
 void el_process_buffer_free() {
     if (el_process_buffer != NULL) {
-        free(el_process_buffer);
+        // handed back by session_arena_reset()
         el_process_buffer = NULL;
+        el_request_buffer = NULL;
+        el_queue_buffer = NULL;
     }
+
+    el_handshake_prefix_len = 0;
+    el_session_caps_reset();
+    kDapPacketCount = el_session_caps.packet_count;
 }
 
 
-int el_handshake_process(int fd, void *buffer, size_t len) {
-    if (len != sizeof(el_request_handshake)) {
+static uint32_t el_side_channel_supported() {
+    uint32_t mask = 0;
+#if (USE_UART_BRIDGE == 1)
+    mask |= EL_SIDE_CHANNEL_UART;
+#endif
+    return mask;
+}
+
+
+static size_t el_put_capability(uint8_t *buf, uint16_t type, uint32_t value) {
+    el_capability *cap = (el_capability *)buf;
+
+    cap->type = htons(type);
+    cap->length = htons(sizeof(uint32_t));
+    value = htonl(value);
+    memcpy(cap->value, &value, sizeof(uint32_t));
+
+    return sizeof(el_capability) + sizeof(uint32_t);
+}
+
+
+/*
+ * Parse the capability block of the proxy, agree on every known entry
+ * and write the answer to `out`. Returns the length of the answer.
+ */
+static size_t el_capability_negotiate(const uint8_t *caps, size_t len, uint8_t *out) {
+    uint32_t requested[EL_CAP_SIDE_CHANNEL + 1];
+    uint32_t present = 0;
+    uint32_t slots, value;
+    size_t pos = 0, out_len = 0;
+    uint16_t type, length;
+
+    while (pos + sizeof(el_capability) <= len) {
+        const el_capability *cap = (const el_capability *)(caps + pos);
+        type = ntohs(cap->type);
+        length = ntohs(cap->length);
+        if (pos + sizeof(el_capability) + length > len)
+            break;
+
+        if (type >= EL_CAP_PACKET_SIZE && type <= EL_CAP_SIDE_CHANNEL && length == sizeof(uint32_t)) {
+            memcpy(&value, cap->value, sizeof(uint32_t));
+            requested[type] = ntohl(value);
+            present |= 1 << type;
+        }
+        pos += sizeof(el_capability) + length;
+    }
+
+    if (present & (1 << EL_CAP_PACKET_SIZE)) {
+        value = requested[EL_CAP_PACKET_SIZE];
+        value = value > DAP_PACKET_SIZE_MAX ? DAP_PACKET_SIZE_MAX : value;
+        value = value < 64 ? 64 : value;
+        el_session_caps.packet_size = value;
+    }
+
+    // packets the probe can hold for this packet size
+#if (USE_EL_PIPELINE == 1)
+    slots = dap_ringbuf_slots(el_session_caps.packet_size);
+#elif defined CONFIG_LWIP_TCP_WND_DEFAULT
+    // requests wait in the TCP receive window
+    slots = CONFIG_LWIP_TCP_WND_DEFAULT / el_session_caps.packet_size;
+#else
+    slots = 1;
+#endif
+
+    if (present & (1 << EL_CAP_PACKET_COUNT)) {
+        value = requested[EL_CAP_PACKET_COUNT];
+        value = value > slots ? slots : value;
+        value = value > 255 ? 255 : value; // DAP_Info packet count is one byte
+        el_session_caps.packet_count = value < 1 ? 1 : value;
+    }
+
+    if (present & (1 << EL_CAP_QUEUE_COMMANDS))
+        el_session_caps.queue_commands = requested[EL_CAP_QUEUE_COMMANDS] ? 1 : 0;
+
+    if (present & (1 << EL_CAP_PIPELINE_DEPTH)) {
+        value = requested[EL_CAP_PIPELINE_DEPTH];
+        value = value > slots ? slots : value;
+        el_session_caps.pipeline_depth = value < 1 ? 1 : value;
+    }
+
+    if (present & (1 << EL_CAP_SIDE_CHANNEL))
+        el_session_caps.side_channel = requested[EL_CAP_SIDE_CHANNEL] & el_side_channel_supported();
+
+    // answer every capability we know and the proxy asked for
+    if (present & (1 << EL_CAP_PACKET_SIZE))
+        out_len += el_put_capability(out + out_len, EL_CAP_PACKET_SIZE, el_session_caps.packet_size);
+    if (present & (1 << EL_CAP_PACKET_COUNT))
+        out_len += el_put_capability(out + out_len, EL_CAP_PACKET_COUNT, el_session_caps.packet_count);
+    if (present & (1 << EL_CAP_QUEUE_COMMANDS))
+        out_len += el_put_capability(out + out_len, EL_CAP_QUEUE_COMMANDS, el_session_caps.queue_commands);
+    if (present & (1 << EL_CAP_COMPRESSION))
+        out_len += el_put_capability(out + out_len, EL_CAP_COMPRESSION, el_session_caps.compression);
+    if (present & (1 << EL_CAP_PIPELINE_DEPTH))
+        out_len += el_put_capability(out + out_len, EL_CAP_PIPELINE_DEPTH, el_session_caps.pipeline_depth);
+    if (present & (1 << EL_CAP_SIDE_CHANNEL))
+        out_len += el_put_capability(out + out_len, EL_CAP_SIDE_CHANNEL, el_session_caps.side_channel);
+
+    return out_len;
+}
+
+
+// Length of the handshake at the start of buf, 0 if more bytes are needed to tell
+static int el_handshake_length(const uint8_t *buf, size_t len) {
+    const uint32_t head[2] = { htonl(EL_LINK_IDENTIFIER), htonl(EL_COMMAND_HANDSHAKE) };
+    const el_request_handshake_caps *req = (const el_request_handshake_caps *)buf;
+    uint32_t caps_len;
+
+    if (memcmp(buf, head, MIN(len, sizeof(head))) != 0) {
+        return -1;
+    }
+    if (len < sizeof(el_request_handshake)) {
+        return 0;
+    }
+    if (ntohl(req->base.el_proxy_version) < EL_PROXY_VERSION_CAPS) {
+        return sizeof(el_request_handshake);
+    }
+
+    if (len < sizeof(el_request_handshake_caps)) {
+        return 0;
+    }
+    caps_len = ntohl(req->el_caps_length);
+    if (caps_len > EL_CAPS_MAX_LENGTH) {
         return -1;
     }
+    if (len < sizeof(el_request_handshake_caps) + caps_len) {
+        return 0;
+    }
+    return sizeof(el_request_handshake_caps) + caps_len;
+}
+
+
+int el_handshake_process(int fd, void *buffer, size_t len) {
+    size_t have = el_handshake_prefix_len;
+    size_t copy = MIN(sizeof(el_handshake_prefix) - have, len);
+    int used;
+
+    // the held start of the handshake and what came now, in one place
+    memcpy(el_handshake_prefix + have, buffer, copy);
+    used = el_handshake_length(el_handshake_prefix, have + copy);
+    if (used <= 0) {
+        // hold it as long as it can still become a handshake
+        el_handshake_prefix_len = used == 0 ? have + copy : 0;
+        return used;
+    }
+    el_handshake_prefix_len = 0;
+
+    el_request_handshake* req = (el_request_handshake*)el_handshake_prefix;
+
+    el_session_caps_reset();
+
+    if (ntohl(req->el_proxy_version) < EL_PROXY_VERSION_CAPS) {
+        // legacy proxy, no capability block. Whatever follows is DAP data
+        // that came in the same segment.
+        el_response_handshake res;
+        res.el_link_identifier = htonl(EL_LINK_IDENTIFIER);
+        res.command = htonl(EL_COMMAND_HANDSHAKE);
+        res.el_dap_version = htonl(EL_DAP_VERSION);
+
+        usbip_network_send(fd, &res, sizeof(el_response_handshake), 0);
+    } else {
+        el_request_handshake_caps *req_caps = (el_request_handshake_caps *)el_handshake_prefix;
+        uint32_t caps_len = ntohl(req_caps->el_caps_length);
+
+        uint8_t res_buf[sizeof(el_response_handshake_caps) +
+                        (sizeof(el_capability) + sizeof(uint32_t)) * EL_CAP_SIDE_CHANNEL];
+        el_response_handshake_caps *res = (el_response_handshake_caps *)res_buf;
+        size_t res_caps_len = el_capability_negotiate(req_caps->el_caps, caps_len, res->el_caps);
+
+        res->base.el_link_identifier = htonl(EL_LINK_IDENTIFIER);
+        res->base.command = htonl(EL_COMMAND_HANDSHAKE);
+        res->base.el_dap_version = htonl(EL_DAP_VERSION_CAPS);
+        res->el_caps_length = htonl(res_caps_len);
+
+        usbip_network_send(fd, res_buf, sizeof(el_response_handshake_caps) + res_caps_len, 0);
+    }
+
+    // kDapPacketSize follows in el_process_buffer_malloc()
+    kDapPacketCount = el_session_caps.packet_count;
+
+    // the held part came with earlier segments
+    return used - (int)have;
+}
+
+
+// Number of bytes needed by a sequence of `bits` bits
+#define EL_BITS_TO_BYTES(bits) (((bits) + 7) / 8)
+
+static int el_dap_command_length(const uint8_t *buf, size_t len, int nested)
+{
+    size_t need, i;
+    uint32_t count, bits;
+    int sub_len;
 
-    el_request_handshake* req = (el_request_handshake*)buffer;
+    if (len < 1)
+        return 0;
 
-    if (ntohl(req->el_link_identifier) != EL_LINK_IDENTIFIER) {
+    switch (buf[0]) {
+    case ID_DAP_Disconnect:
+    case ID_DAP_TransferAbort:
+    case ID_DAP_ResetTarget:
+    case ID_DAP_SWO_Status:
+        return 1;
+
+    case ID_DAP_Info:
+    case ID_DAP_Connect:
+    case ID_DAP_SWD_Configure:
+    case ID_DAP_JTAG_IDCODE:
+    case ID_DAP_SWO_Transport:
+    case ID_DAP_SWO_Mode:
+    case ID_DAP_SWO_Control:
+    case ID_DAP_SWO_ExtendedStatus:
+        need = 2;
+        break;
+
+    case ID_DAP_HostStatus:
+    case ID_DAP_Delay:
+    case ID_DAP_SWO_Data:
+        need = 3;
+        break;
+
+    case ID_DAP_SWJ_Clock:
+    case ID_DAP_SWO_Baudrate:
+        need = 5;
+        break;
+
+    case ID_DAP_TransferConfigure:
+    case ID_DAP_WriteABORT:
+        need = 6;
+        break;
+
+    case ID_DAP_SWJ_Pins:
+        need = 7;
+        break;
+
+    case ID_DAP_SWJ_Sequence:
+        if (len < 2)
+            return 0;
+        bits = buf[1] ? buf[1] : 256;
+        need = 2 + EL_BITS_TO_BYTES(bits);
+        break;
+
+    case ID_DAP_JTAG_Configure:
+        if (len < 2)
+            return 0;
+        need = 2 + buf[1];
+        break;
+
+    case ID_DAP_Transfer:
+        // [cmd, index, count, {request, (data)} * count]
+        if (len < 3)
+            return 0;
+        count = buf[2];
+        need = 3;
+        for (i = 0; i < count; i++) {
+            if (need >= len)
+                return 0;
+            // write data, or the match value of a read
+            if (!(buf[need] & DAP_TRANSFER_RnW) || (buf[need] & DAP_TRANSFER_MATCH_VALUE))
+                need += 4;
+            need += 1;
+        }
+        break;
+
+    case ID_DAP_TransferBlock:
+        // [cmd, index, count(2), request, (data * count)]
+        if (len < 5)
+            return 0;
+        count = buf[2] | (buf[3] << 8);
+        need = 5;
+        if (!(buf[4] & DAP_TRANSFER_RnW))
+            need += count * 4;
+        break;
+
+    case ID_DAP_SWD_Sequence:
+        // [cmd, count, {info, (data)} * count]
+        if (len < 2)
+            return 0;
+        count = buf[1];
+        need = 2;
+        for (i = 0; i < count; i++) {
+            if (need >= len)
+                return 0;
+            bits = buf[need] & 0x3F;
+            bits = bits ? bits : 64;
+            // output data only when SWDIO is driven by the probe
+            if (!(buf[need] & 0x80))
+                need += EL_BITS_TO_BYTES(bits);
+            need += 1;
+        }
+        break;
+
+    case ID_DAP_JTAG_Sequence:
+        // [cmd, count, {info, tdi data} * count]
+        if (len < 2)
+            return 0;
+        count = buf[1];
+        need = 2;
+        for (i = 0; i < count; i++) {
+            if (need >= len)
+                return 0;
+            bits = buf[need] & 0x3F;
+            bits = bits ? bits : 64;
+            need += 1 + EL_BITS_TO_BYTES(bits);
+        }
+        break;
+
+    case ID_DAP_QueueCommands:
+    case ID_DAP_ExecuteCommands:
+        // [cmd, number, commands...], commands can not be nested
+        if (nested)
+            return -1;
+        if (len < 2)
+            return 0;
+        count = buf[1];
+        need = 2;
+        for (i = 0; i < count; i++) {
+            sub_len = el_dap_command_length(buf + need, len - need, 1);
+            if (sub_len <= 0)
+                return sub_len;
+            need += sub_len;
+        }
+        break;
+
+    default:
+        // vendor or unknown command
         return -1;
     }
 
-    if (ntohl(req->command) != EL_COMMAND_HANDSHAKE) {
+    if (need > kDapPacketSize)
         return -1;
+
+    return need > len ? 0 : (int)need;
+}
+
+
+int el_dap_request_length(const uint8_t *buffer, size_t len) {
+    int ret = el_dap_command_length(buffer, len, 0);
+
+    // A request never exceeds one packet, so it can not be completed any more
+    if (ret == 0 && len >= kDapPacketSize)
+        return -1;
+
+    return ret;
+}
+
+
+// Where the next response goes, with room for one full packet
+static uint8_t *el_tx_stage_tail(el_tx_stage_t *stage) {
+    if (stage->buf == NULL) {
+        // write straight into a buffer the transport sends from
+        stage->buf = transport_tx_buffer_get();
+        if (stage->buf == NULL)
+            stage->buf = stage->fallback;
     }
 
-    el_response_handshake res;
-    res.el_link_identifier = htonl(EL_LINK_IDENTIFIER);
-    res.command = htonl(EL_COMMAND_HANDSHAKE);
-    res.el_dap_version = htonl(EL_DAP_VERSION);
+    return stage->buf + stage->len;
+}
+
 
-    usbip_network_send(fd, &res, sizeof(el_response_handshake), 0);
+static void el_tx_stage_flush(el_tx_stage_t *stage) {
+    if (stage->len > 0) {
+        if (stage->buf != stage->fallback)
+            transport_tx_buffer_send(stage->len);
+        else
+            transport_send(stage->buf, stage->len);
+    }
 
-    return 0;
+    // an unused zero-copy buffer stays with the pool for the next call
+    stage->buf = NULL;
+    stage->len = 0;
 }
 
 
-void el_dap_data_process(void* buffer, size_t len) {
-    int res = 1;// = DAP_ExecuteCommand(buffer, (uint8_t *)el_process_buffer);
+static void el_dap_response_flush() {
+    el_tx_stage_flush(&el_response);
+}
+
+
+static void el_dap_run(const uint8_t *request, size_t len) {
+#if (USE_EL_PIPELINE == 1)
+    // hand over to the DAP task, the response goes out through el_dap_complete
+    handle_dap_data_request(request, len > kDapPacketSize ? kDapPacketSize : len);
+#else
+    // the buffer has room for one more full size response past a segment
+    int res = dap_execute_command(request, el_tx_stage_tail(&el_response));
     res &= 0xFFFF;
 
-    usbip_network_send(kSock, el_process_buffer, res, 0);
+    el_response.len += res;
+    if (el_response.len >= EL_PROCESS_BUFFER_SIZE)
+        el_dap_response_flush();
+#endif
+}
+
+
+// Run the queued commands back to back, in the order they arrived
+static void el_dap_queue_flush() {
+    size_t pos = 0;
+    int req_len;
+
+    while (pos < el_queue_len) {
+        req_len = el_dap_request_length(el_queue_buffer + pos, el_queue_len - pos);
+        if (req_len <= 0)
+            req_len = el_queue_len - pos;
+
+        el_dap_run(el_queue_buffer + pos, req_len);
+        pos += req_len;
+    }
+
+    el_queue_len = 0;
+}
+
+
+static void el_dap_execute(uint8_t *request, size_t len) {
+    if (request[0] == ID_DAP_QueueCommands && !el_session_caps.queue_commands) {
+        // queueing turned off by the proxy, run it right away
+        request[0] = ID_DAP_ExecuteCommands;
+    } else if (request[0] == ID_DAP_QueueCommands && len <= kDapPacketSize) {
+        // no response until the queue is closed by a non-queued request
+        if (el_queue_len + len > EL_QUEUE_BUFFER_SIZE)
+            el_dap_queue_flush();
+
+        memcpy(el_queue_buffer + el_queue_len, request, len);
+        el_queue_buffer[el_queue_len] = ID_DAP_ExecuteCommands;
+        el_queue_len += len;
+        return;
+    }
+
+    el_dap_queue_flush();
+    el_dap_run(request, len);
+}
+
+
+void el_dap_data_process(void* buffer, size_t len) {
+    uint8_t *data = (uint8_t *)buffer;
+    int req_len;
+
+    if (el_process_buffer == NULL)
+        return;
+
+    // Complete the request left over from the previous segment first
+    if (el_request_len > 0) {
+        size_t copy = kDapPacketSize - el_request_len;
+        copy = copy > len ? len : copy;
+        memcpy(el_request_buffer + el_request_len, data, copy);
+
+        req_len = el_dap_request_length(el_request_buffer, el_request_len + copy);
+        if (req_len == 0) {
+            // still incomplete, wait for the next segment
+            el_request_len += copy;
+            return;
+        } else if (req_len < 0) {
+            // can not be framed, hand over what we have
+            req_len = el_request_len + copy;
+        }
+
+        el_dap_execute(el_request_buffer, req_len);
+
+        data += req_len - el_request_len;
+        len -= req_len - el_request_len;
+        el_request_len = 0;
+    }
+
+    while (len > 0) {
+        req_len = el_dap_request_length(data, len);
+        if (req_len == 0) {
+            // partial request at the end of the segment
+            memcpy(el_request_buffer, data, len);
+            el_request_len = len;
+            break;
+        } else if (req_len < 0) {
+            // can not be framed, treat the rest of the segment as one request
+            req_len = len;
+        }
+
+        el_dap_execute(data, req_len);
+
+        data += req_len;
+        len -= req_len;
+    }
+
+    el_dap_response_flush();
+}
+
+
+#if (USE_EL_PIPELINE == 1)
+// Responses of the send stage. The response part of el_process_buffer is
+// not used by the receive side in pipeline mode, so it is the fallback.
+static el_tx_stage_t el_tx_stage = { NULL, 0, NULL };
+
+void el_dap_complete() {
+    int res;
+
+    if (el_process_buffer == NULL)
+        return;
+    el_tx_stage.fallback = el_process_buffer;
+
+    // coalesce every response that is ready into as few sends as possible
+    while (1) {
+        if (el_tx_stage.len >= EL_PROCESS_BUFFER_SIZE)
+            el_tx_stage_flush(&el_tx_stage);
+
+        res = dap_response_take(el_tx_stage_tail(&el_tx_stage));
+        if (res < 0)
+            break;
+        el_tx_stage.len += res;
+    }
+
+    el_tx_stage_flush(&el_tx_stage);
 }
+#endif
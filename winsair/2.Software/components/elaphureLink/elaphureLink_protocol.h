@@ -10,12 +10,18 @@
 
 #define EL_COMMAND_HANDSHAKE 0x00000000
 
+// Responses are staged until about one TCP segment worth of data is ready
+#define EL_PROCESS_BUFFER_SIZE 1500
+
+// Bytes of ID_DAP_QueueCommands packets held back before they are run anyway
+#define EL_QUEUE_BUFFER_SIZE 2048
+
 
 typedef struct
 {
     uint32_t el_link_identifier;
     uint32_t command;
-    uint32_t el_proxy_version
+    uint32_t el_proxy_version;
 } __attribute__((packed)) el_request_handshake;
 
 
@@ -23,31 +29,146 @@ typedef struct
 {
     uint32_t el_link_identifier;
     uint32_t command;
-    uint32_t el_dap_version
+    uint32_t el_dap_version;
 } __attribute__((packed)) el_response_handshake;
 
 
+/*
+ * Capability negotiation
+ *
+ * A proxy with el_proxy_version >= EL_PROXY_VERSION_CAPS appends a capability
+ * block to the handshake: a 32-bit length followed by el_capability entries.
+ * The probe answers with el_dap_version = EL_DAP_VERSION_CAPS and a block that
+ * holds the agreed value of every capability it knows. Unknown entries are left
+ * out of the answer, so new capabilities can be added on either side.
+ * Proxies that send the plain 12-byte handshake (el_proxy_version below
+ * EL_PROXY_VERSION_CAPS) get the plain answer and the defaults below. An older
+ * proxy may send its first DAP request in the same segment as the handshake.
+ *
+ * All integers are big endian.
+ */
+#define EL_PROXY_VERSION_CAPS 0x00000002
+#define EL_DAP_VERSION_CAPS   0x00000002
+
+// Largest capability block accepted from the proxy
+#define EL_CAPS_MAX_LENGTH 256
+
+enum el_capability_t
+{
+    EL_CAP_PACKET_SIZE = 0x0001,    // u32, DAP packet size, default DAP_PACKET_SIZE_DEFAULT
+    EL_CAP_PACKET_COUNT = 0x0002,   // u32, DAP packet count reported through DAP_Info
+    EL_CAP_QUEUE_COMMANDS = 0x0003, // u32, 1: ID_DAP_QueueCommands are held (default 1)
+    EL_CAP_COMPRESSION = 0x0004,    // u32, bitmask of response compression schemes (default 0)
+    EL_CAP_PIPELINE_DEPTH = 0x0005, // u32, requests that can be in flight before the probe stalls
+    EL_CAP_SIDE_CHANNEL = 0x0006,   // u32, bitmask of el_side_channel_t
+};
+
+enum el_side_channel_t
+{
+    EL_SIDE_CHANNEL_SWO = 1 << 0,
+    EL_SIDE_CHANNEL_UART = 1 << 1,
+};
+
+typedef struct
+{
+    uint16_t type;
+    uint16_t length; // length of value
+    uint8_t value[];
+} __attribute__((packed)) el_capability;
+
+
+typedef struct
+{
+    el_request_handshake base;
+    uint32_t el_caps_length;
+    uint8_t el_caps[];
+} __attribute__((packed)) el_request_handshake_caps;
+
+
+typedef struct
+{
+    el_response_handshake base;
+    uint32_t el_caps_length;
+    uint8_t el_caps[];
+} __attribute__((packed)) el_response_handshake_caps;
+
+
+// Result of the negotiation, valid for the current session
+typedef struct
+{
+    uint32_t packet_size;
+    uint32_t packet_count;
+    uint32_t queue_commands;
+    uint32_t compression;
+    uint32_t pipeline_depth;
+    uint32_t side_channel;
+} el_session_caps_t;
+
+extern el_session_caps_t el_session_caps;
+
+
 /**
  * @brief elahpureLink Proxy handshake phase process
+ * The session capabilities (el_session_caps) are negotiated here. A handshake
+ * split across segments is held until it is complete.
  *
  * @param fd socket fd
  * @param buffer packet buffer
  * @param len packet length
- * @return 0 on Success, other on failed.
+ * @return bytes of the handshake in this buffer, the rest of it is DAP data.
+ *         0 if the data so far is the start of a handshake, < 0 on failed.
  */
 int el_handshake_process(int fd, void* buffer, size_t len);
 
 
+/**
+ * @brief Get the length of the DAP request at the head of a byte stream
+ *
+ * @param buffer stream data
+ * @param len number of bytes available
+ * @return request length, 0 if more data is needed to complete the request,
+ *         -1 if the length can not be determined (unknown or oversized command).
+ */
+int el_dap_request_length(const uint8_t* buffer, size_t len);
+
+
 /**
  * @brief Process dap data and send to socket
  *
+ * The data is treated as a byte stream: a request split across several calls
+ * is reassembled, and every complete request is executed. All responses
+ * produced by one call are sent back together.
+ * ID_DAP_QueueCommands packets are held and run as ID_DAP_ExecuteCommands,
+ * back to back, when the next non-queued request arrives.
+ *
  * @param buffer dap data buffer
  * @param len dap data length
  */
 void el_dap_data_process(void* buffer, size_t len);
 
 
+/**
+ * @brief Send every response the DAP task has ready, coalesced into as few
+ * sends as possible (network send stage, USE_EL_PIPELINE)
+ *
+ */
+void el_dap_complete();
+
+
+/**
+ * @brief Session arena bytes taken by the buffers of one connection
+ *
+ */
+size_t el_process_buffer_size();
+/**
+ * @brief Carve the connection buffers from the session arena
+ *
+ */
 void el_process_buffer_malloc();
+/**
+ * @brief Drop the connection buffers, the memory returns with session_arena_reset()
+ *
+ */
 void el_process_buffer_free();
 
-#endif
\ No newline at end of file
+#endif
@@ -1,31 +1,39 @@
 /**
  * @file DAP_handle.c
  * @brief Handle DAP packets and transaction push
- * @version 0.5
+ * @version 0.6
  * @change: 2020.02.04 first version
  *          2020.11.11 support WinUSB mode
  *          2021.02.17 support SWO
  *          2021.10.03 try to handle unlink behavior
+ *          2026.10.17 elaphureLink pipeline stages
+ *          2026.10.17 lock-free packet queues
+ *          2026.10.17 observer reads between controller requests
+ *          2026.10.17 request backlog of the event loop
  *
  * @copyright Copyright (c) 2021
  *
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
 
 #include "main/DAP_handle.h"
 #include "main/dap_configuration.h"
 #include "main/wifi_configuration.h"
+#include "main/session_arena.h"
+#include "main/observer.h"
+#include "main/timer.h"
+#include "main/net_loop.h"
 
+#include "components/DAP/include/DAP.h"
 
 
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/ringbuf.h"
-#include "freertos/semphr.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -38,118 +46,514 @@
     #define DAP_BUFFER_NUM 20
 #endif
 
-#if (USE_WINUSB == 1)
 typedef struct
 {
     uint32_t length;
     uint8_t buf[DAP_PACKET_SIZE];
 } DapPacket_t;
-#else
+
+// Slots only carry kDapPacketSize bytes of the packet buffer
+#define DAP_HANDLE_HEADER_SIZE (offsetof(DapPacket_t, buf))
+// The queue budget is fixed, jumbo packets get fewer slots
+#define DAP_RINGBUF_SIZE ((DAP_HANDLE_HEADER_SIZE + DAP_PACKET_SIZE_DEFAULT) * DAP_BUFFER_NUM)
+// Slots and indices do not share cache lines
+#define DAP_QUEUE_ALIGN 32
+#define DAP_QUEUE_ROUND(x) (((x) + DAP_QUEUE_ALIGN - 1) & ~(DAP_QUEUE_ALIGN - 1))
+
+
+// Single producer, single consumer queue of fixed size packet slots.
+// Only the producer writes head and only the consumer writes tail. Both run over
+// [0, 2 * num), so a full queue differs from an empty one and no index jumps on wrap.
 typedef struct
 {
-    uint8_t buf[DAP_PACKET_SIZE];
-} DapPacket_t;
-#endif
+    volatile uint32_t head __attribute__((aligned(DAP_QUEUE_ALIGN)));
+    volatile uint32_t tail __attribute__((aligned(DAP_QUEUE_ALIGN)));
+    uint8_t *slots __attribute__((aligned(DAP_QUEUE_ALIGN))); // NULL while the queue is unused
+    uint8_t *storage;
+    uint32_t num;
+    uint32_t stride;
+    TaskHandle_t *consumer;         // notified when a slot is committed
+    volatile TaskHandle_t producer; // set while the producer waits for a free slot
+    volatile uint16_t layout;       // packet size the consumer has to lay out for, 0 if none
+} dap_queue_t;
 
-#define DAP_HANDLE_SIZE (sizeof(DapPacket_t))
 
-
-extern int kSock;
 extern TaskHandle_t kDAPTaskHandle;
+extern TaskHandle_t kDAPSendTaskHandle;
 
 int kRestartDAPHandle = NO_SIGNAL;
+uint16_t kDapPacketSize = DAP_PACKET_SIZE_DEFAULT;
+uint8_t kDapPacketCount = 0;
 
 
-static DapPacket_t DAPDataProcessed;
-static int dap_respond = 0;
-
 // SWO Trace
 static uint8_t *swo_data_to_send = NULL;
 static uint32_t swo_data_num;
 
 // DAP handle
-static RingbufHandle_t dap_dataIN_handle = NULL;
-static RingbufHandle_t dap_dataOUT_handle = NULL;
-static SemaphoreHandle_t data_response_mux = NULL;
+static dap_queue_t dap_dataIN = { .consumer = &kDAPTaskHandle };
+static dap_queue_t dap_dataOUT = { .consumer = &kDAPSendTaskHandle };
+// DAP.c may write DAP_PACKET_SIZE bytes, more than a slot holds below that size
+static uint8_t *dap_response_scratch = NULL;
+
+// Packet size asked for by dap_ringbuf_resize() and the task waiting for it
+static volatile uint16_t dap_layout_size = DAP_PACKET_SIZE_DEFAULT;
+static volatile TaskHandle_t dap_layout_waiter = NULL;
+
+#if (USE_EVENT_LOOP == 1)
+// Requests the event loop could not queue without waiting, [length(2), data]
+// each in arrival order. Holds about one receive batch of small requests, a
+// client that keeps more than the DAP packet count in flight may overflow it.
+#define DAP_BACKLOG_SIZE 3072
+
+static uint8_t *dap_backlog = NULL;
+static uint32_t dap_backlog_head = 0; // next request to queue
+static uint32_t dap_backlog_len = 0;  // written by the loop only
+static uint8_t dap_backlog_overflow = 0;
+static volatile uint8_t dap_backlog_wake = 0; // the loop waits for a free slot or the layout
+#endif
+
+
+uint32_t dap_ringbuf_slots(uint32_t packet_size) {
+    uint32_t num = DAP_RINGBUF_SIZE / DAP_QUEUE_ROUND(DAP_HANDLE_HEADER_SIZE + packet_size);
+    return num < 2 ? 2 : num;
+}
+
+// Lay the slots out for packet_size and drop what is queued. Only the consumer
+// does this, while the producer waits, so no side sees a half changed queue.
+// The storage never changes size.
+static void dap_queue_layout(dap_queue_t *q, uint16_t packet_size) {
+    q->stride = DAP_QUEUE_ROUND(DAP_HANDLE_HEADER_SIZE + packet_size);
+    q->num = dap_ringbuf_slots(packet_size);
+    q->head = q->tail = 0;
+    q->slots = q->storage;
+}
+
+static size_t dap_queue_storage_size() {
+    size_t size = DAP_QUEUE_ROUND(DAP_HANDLE_HEADER_SIZE + DAP_PACKET_SIZE) * 2;
+    return size > DAP_RINGBUF_SIZE ? size : DAP_RINGBUF_SIZE;
+}
+
+static void dap_queue_create(dap_queue_t *q) {
+    // carved once, later calls reuse it
+    if (q->storage != NULL)
+        return;
+
+    q->storage = session_arena_alloc(dap_queue_storage_size());
+    if (q->storage != NULL)
+        dap_queue_layout(q, kDapPacketSize);
+}
+
+static inline uint32_t dap_queue_next(const dap_queue_t *q, uint32_t pos) {
+    return pos + 1 == 2 * q->num ? 0 : pos + 1;
+}
+
+static inline DapPacket_t *dap_queue_slot(const dap_queue_t *q, uint32_t pos) {
+    return (DapPacket_t *)(q->slots + (pos < q->num ? pos : pos - q->num) * q->stride);
+}
+
+// Free slot for the producer to fill in place, NULL if the queue is full
+static inline DapPacket_t *dap_queue_reserve(dap_queue_t *q) {
+    uint32_t head = q->head;
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    if (q->slots == NULL || (head >= tail ? head - tail : head + 2 * q->num - tail) >= q->num)
+        return NULL;
+
+    return dap_queue_slot(q, head);
+}
+
+// Publish the reserved slot to the consumer
+static inline void dap_queue_commit(dap_queue_t *q) {
+    __atomic_store_n(&q->head, dap_queue_next(q, q->head), __ATOMIC_RELEASE);
+
+    if (*q->consumer)
+        xTaskNotifyGive(*q->consumer);
+}
+
+// Oldest committed slot, NULL if the queue is empty
+static inline DapPacket_t *dap_queue_peek(dap_queue_t *q) {
+    uint32_t tail = q->tail;
+
+    if (q->slots == NULL || __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail)
+        return NULL;
+
+    return dap_queue_slot(q, tail);
+}
+
+// Hand the peeked slot back to the producer
+static inline void dap_queue_release(dap_queue_t *q) {
+    TaskHandle_t producer;
 
+    __atomic_store_n(&q->tail, dap_queue_next(q, q->tail), __ATOMIC_RELEASE);
+
+    producer = q->producer;
+    if (producer)
+        xTaskNotifyGive(producer);
+}
+
+// Block the producer until a slot is free, give up when the handle is restarted
+static DapPacket_t *dap_queue_reserve_wait(dap_queue_t *q) {
+    DapPacket_t *slot;
+
+    while ((slot = dap_queue_reserve(q)) == NULL && q->slots && kRestartDAPHandle == NO_SIGNAL) {
+        q->producer = xTaskGetCurrentTaskHandle();
+        // the consumer may have released a slot before it could see us
+        if ((slot = dap_queue_reserve(q)) == NULL)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        q->producer = NULL;
+        if (slot)
+            break;
+    }
+
+    return slot;
+}
+
+uint32_t dap_ringbuf_storage_size() {
+#if (USE_EVENT_LOOP == 1)
+    return dap_queue_storage_size() * 2 + DAP_PACKET_SIZE + DAP_BACKLOG_SIZE;
+#else
+    return dap_queue_storage_size() * 2 + DAP_PACKET_SIZE;
+#endif
+}
 
 void malloc_dap_ringbuf() {
-    if (data_response_mux && xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
-    {
-        if (dap_dataIN_handle == NULL) {
-            dap_dataIN_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
-        }
-        if (dap_dataOUT_handle == NULL) {
-            dap_dataOUT_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
+    dap_queue_create(&dap_dataIN);
+    dap_queue_create(&dap_dataOUT);
+    if (dap_response_scratch == NULL)
+        dap_response_scratch = session_arena_alloc(DAP_PACKET_SIZE);
+#if (USE_EVENT_LOOP == 1)
+    if (dap_backlog == NULL)
+        dap_backlog = session_arena_alloc(DAP_BACKLOG_SIZE);
+#endif
+}
+
+void dap_ringbuf_resize_start(uint16_t packet_size) {
+#if (USE_EVENT_LOOP == 1)
+    // the producer owns the backlog, its requests are dropped with the queued ones
+    dap_backlog_head = dap_backlog_len = 0;
+    dap_backlog_overflow = 0;
+#endif
+    dap_layout_size = packet_size;
+    dap_layout_waiter = xTaskGetCurrentTaskHandle();
+    kRestartDAPHandle = RESET_HANDLE;
+    if (kDAPTaskHandle)
+        xTaskNotifyGive(kDAPTaskHandle);
+}
+
+int dap_ringbuf_resize_done() {
+    if (kRestartDAPHandle == NO_SIGNAL)
+        return 1;
+    // it may be waiting for a response slot and miss the first wakeup
+    if (kDAPTaskHandle)
+        xTaskNotifyGive(kDAPTaskHandle);
+    return 0;
+}
+
+void dap_ringbuf_resize(uint16_t packet_size) {
+    dap_ringbuf_resize_start(packet_size);
+
+    // nothing may be queued before both queues are laid out again
+    while (!dap_ringbuf_resize_done())
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+}
+
+// The DAP task side of dap_ringbuf_resize()
+static void dap_ringbuf_layout() {
+    uint16_t size = dap_layout_size;
+    TaskHandle_t waiter;
+
+    // we consume the requests, their producer waits in dap_ringbuf_resize()
+    dap_queue_layout(&dap_dataIN, size);
+
+    // the responses are laid out by the send task, which consumes them
+    if (kDAPSendTaskHandle) {
+        __atomic_store_n(&dap_dataOUT.layout, size, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&dap_dataOUT.layout, __ATOMIC_ACQUIRE)) {
+            xTaskNotifyGive(kDAPSendTaskHandle);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
         }
+    } else {
+        dap_queue_layout(&dap_dataOUT, size);
+    }
 
-        xSemaphoreGive(data_response_mux);
+    kDapPacketSize = size;
+    waiter = dap_layout_waiter;
+    dap_layout_waiter = NULL;
+    kRestartDAPHandle = NO_SIGNAL;
+    if (waiter)
+        xTaskNotifyGive(waiter);
+#if (USE_EVENT_LOOP == 1)
+    if (dap_backlog_wake) {
+        dap_backlog_wake = 0;
+        net_loop_wake();
     }
+#endif
 }
 
-void free_dap_ringbuf() {
-    if (data_response_mux && xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE) {
-        if (dap_dataIN_handle) {
-            vRingbufferDelete(dap_dataIN_handle);
+void dap_response_sync() {
+    uint16_t size = __atomic_load_n(&dap_dataOUT.layout, __ATOMIC_ACQUIRE);
+
+    if (size == 0)
+        return;
+
+    dap_queue_layout(&dap_dataOUT, size);
+    __atomic_store_n(&dap_dataOUT.layout, 0, __ATOMIC_RELEASE);
+    if (kDAPTaskHandle)
+        xTaskNotifyGive(kDAPTaskHandle);
+}
+
+
+// DAP.c reports its buffer size and count, the host must see the negotiated ones.
+// Its timestamp clock is that of DAP_config.h, the timestamps come from get_timer_count.
+static void dap_info_fixup(const uint8_t *request, uint8_t *response)
+{
+    if (request[0] != ID_DAP_Info)
+        return;
+
+    if (request[1] == DAP_ID_PACKET_SIZE && response[1] == 2) {
+        response[2] = (uint8_t)(kDapPacketSize >> 0);
+        response[3] = (uint8_t)(kDapPacketSize >> 8);
+    } else if (request[1] == DAP_ID_PACKET_COUNT && response[1] == 1 && kDapPacketCount) {
+        response[2] = kDapPacketCount;
+    } else if (request[1] == DAP_ID_TIMESTAMP_CLOCK && response[1] == 4) {
+        response[2] = (uint8_t)(TIMER_CLOCK_HZ >> 0);
+        response[3] = (uint8_t)(TIMER_CLOCK_HZ >> 8);
+        response[4] = (uint8_t)(TIMER_CLOCK_HZ >> 16);
+        response[5] = (uint8_t)(TIMER_CLOCK_HZ >> 24);
+    }
+}
+
+
+uint32_t dap_execute_command(const uint8_t *request, uint8_t *response)
+{
+    uint32_t num, n, cnt;
+
+    if (request[0] != ID_DAP_ExecuteCommands && request[0] != ID_DAP_QueueCommands) {
+        num = DAP_ProcessCommand(request, response);
+        dap_info_fixup(request, response);
+        return num;
+    }
+
+    // the loop of DAP_ExecuteCommand, so that a DAP_Info in it is seen too
+    *response++ = *request++;
+    cnt = *request++;
+    *response++ = (uint8_t)cnt;
+    num = (2U << 16) | 2U;
+    while (cnt--) {
+        n = DAP_ProcessCommand(request, response);
+        dap_info_fixup(request, response);
+        num += n;
+        request += (uint16_t)(n >> 16);
+        response += (uint16_t)n;
+    }
+
+    return num;
+}
+
+
+#if (USE_EVENT_LOOP == 1)
+static void dap_queue_put(DapPacket_t *slot, const uint8_t *buf, uint32_t length)
+{
+    memcpy(slot->buf, buf, length);
+    slot->length = length;
+    dap_queue_commit(&dap_dataIN);
+}
+
+int dap_request_flush()
+{
+    DapPacket_t *slot;
+    uint32_t length;
+
+    while (dap_backlog_len > 0) {
+        // held back until the queues are laid out again, the DAP task wakes the loop then
+        if (kRestartDAPHandle != NO_SIGNAL) {
+            dap_backlog_wake = 1;
+            if (kRestartDAPHandle != NO_SIGNAL)
+                break;
         }
-        if (dap_dataOUT_handle) {
-            vRingbufferDelete(dap_dataOUT_handle);
+        slot = dap_queue_reserve(&dap_dataIN);
+        if (slot == NULL) {
+            // the DAP task wakes the loop once it frees a slot
+            dap_backlog_wake = 1;
+            if ((slot = dap_queue_reserve(&dap_dataIN)) == NULL)
+                break;
         }
+        dap_backlog_wake = 0;
 
-        dap_dataIN_handle = dap_dataOUT_handle = NULL;
-        xSemaphoreGive(data_response_mux);
+        length = dap_backlog[dap_backlog_head] | (dap_backlog[dap_backlog_head + 1] << 8);
+        dap_queue_put(slot, dap_backlog + dap_backlog_head + 2, length);
+        dap_backlog_head += 2 + length;
+        if (dap_backlog_head == dap_backlog_len)
+            dap_backlog_head = dap_backlog_len = 0;
     }
 
+    if (dap_backlog_overflow)
+        return -1;
+    return dap_backlog_len > 0 ? 1 : 0;
 }
 
+// The event loop does not wait for a slot, the request joins the backlog
+static int dap_request_backlog(const uint8_t *buf, uint32_t length)
+{
+    DapPacket_t *slot;
+
+    if (dap_backlog_overflow)
+        return 0;
+    if (dap_backlog_len == 0 && kRestartDAPHandle == NO_SIGNAL &&
+        (slot = dap_queue_reserve(&dap_dataIN)) != NULL) {
+        dap_queue_put(slot, buf, length);
+        return 1;
+    }
 
+    if (dap_backlog_head > 0) {
+        // the queued part is not needed any more
+        memmove(dap_backlog, dap_backlog + dap_backlog_head, dap_backlog_len - dap_backlog_head);
+        dap_backlog_len -= dap_backlog_head;
+        dap_backlog_head = 0;
+    }
+    if (dap_backlog == NULL || dap_backlog_len + 2 + length > DAP_BACKLOG_SIZE) {
+        dap_backlog_overflow = 1;
+        return 0;
+    }
+    dap_backlog[dap_backlog_len] = (uint8_t)length;
+    dap_backlog[dap_backlog_len + 1] = (uint8_t)(length >> 8);
+    memcpy(dap_backlog + dap_backlog_len + 2, buf, length);
+    dap_backlog_len += 2 + length;
+    return 1;
+}
+#endif
 
+int handle_dap_data_request(const uint8_t *buf, uint32_t length)
+{
+    DapPacket_t *slot;
 
+    if (length > kDapPacketSize)
+        return 0;
 
+#if (USE_EVENT_LOOP == 1)
+    if (net_loop_current())
+        return dap_request_backlog(buf, length);
+#endif
 
+    slot = dap_queue_reserve_wait(&dap_dataIN);
+    if (slot == NULL)
+        return 0;
 
+    memcpy(slot->buf, buf, length);
+    slot->length = length;
+    dap_queue_commit(&dap_dataIN);
+    return 1;
+}
 
-// SWO Data Queue Transfer
-//   buf:    pointer to buffer with data
-//   num:    number of bytes to transfer
-void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
+
+int dap_response_take(uint8_t *buf)
 {
-    swo_data_to_send = buf;
-    swo_data_num = num;
-}
+    DapPacket_t *slot;
+    int length;
+
+    slot = dap_queue_peek(&dap_dataOUT);
+    if (slot == NULL)
+        return -1;
 
+    length = slot->length;
+    // a slot holds kDapPacketSize bytes, never copy past it
+    if (length > kDapPacketSize)
+        length = kDapPacketSize;
+    memcpy(buf, slot->buf, length);
+    dap_queue_release(&dap_dataOUT);
+
+    return length;
+}
 
 
-void handle_dap_unlink()
+void DAP_Thread(void *argument)
 {
-    // `USBIP_CMD_UNLINK` means calling `usb_unlink_urb()` or `usb_kill_urb()`.
-    // Note that execution of an URB is inherently an asynchronous operation, and there may be
-    // synchronization problems in the following solutions.
-
-    // One of the reasons this happens is that the host wants to abort the URB transfer operation
-    // as soon as possible. USBIP network fluctuations will also cause this error, but I don't know
-    // whether this is the main reason.
-
-    // Unlink may be applied to zero length URB of "DIR_IN", or a URB containing data.
-    // In the case of unlink, for the new "DIR_IN" request, it may always return an older response,
-    // which will lead to panic. This code is a compromise for eliminating the lagging response
-    // caused by UNLINK. It will clean up the buffers that may have data for return to the host.
-    // In general, we assume that there is at most one piece of data that has not yet been returned.
-    if (dap_respond > 0)
+    malloc_dap_ringbuf();
+
+    int resLength;
+    DapPacket_t *request;
+    DapPacket_t *response;
+    uint8_t *out;
+
+    if (dap_dataIN.storage == NULL || dap_dataOUT.storage == NULL || dap_response_scratch == NULL)
     {
-        DapPacket_t *item;
-        size_t packetSize = 0;
-        item = (DapPacket_t *)xRingbufferReceiveUpTo(dap_dataOUT_handle, &packetSize,
-                                                     pdMS_TO_TICKS(10), DAP_HANDLE_SIZE);
-        if (packetSize == DAP_HANDLE_SIZE)
+        os_printf("Can not create DAP queue!\r\n");
+        vTaskDelete(NULL);
+    }
+
+    for (;;)
+    {
+        // a wakeup may have been taken while waiting for a response slot
+        if (kRestartDAPHandle == NO_SIGNAL && dap_queue_peek(&dap_dataIN) == NULL
+#if (USE_OBSERVER == 1)
+            && !observer_pending()
+#endif
+        )
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (kRestartDAPHandle == RESET_HANDLE)
         {
-            if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
-            {
-                --dap_respond;
-                xSemaphoreGive(data_response_mux);
+            dap_ringbuf_layout();
+            continue;
+        }
+
+        // one notification may stand for several requests
+        while ((request = dap_queue_peek(&dap_dataIN)) != NULL)
+        {
+            response = dap_queue_reserve_wait(&dap_dataOUT);
+            if (response == NULL)
+                break;
+
+#if (USE_OBSERVER == 1)
+            observer_snoop((uint8_t *)request->buf);
+#endif
+            // straight into the response slot when it has room for all DAP.c may write
+            out = kDapPacketSize >= DAP_PACKET_SIZE ? (uint8_t *)response->buf : dap_response_scratch;
+            resLength = dap_execute_command((uint8_t *)request->buf, out);
+            resLength &= 0xFFFF; // res length in lower 16 bits
+            if (resLength > kDapPacketSize)
+                resLength = kDapPacketSize; // the host asked for more than a packet
+            if (out != response->buf)
+                memcpy(response->buf, out, resLength);
+
+            dap_queue_release(&dap_dataIN); // process done.
+#if (USE_EVENT_LOOP == 1)
+            if (dap_backlog_wake) {
+                dap_backlog_wake = 0;
+                net_loop_wake();
             }
+#endif
+
+            // now prepare to reply
+            response->length = resLength;
+            dap_queue_commit(&dap_dataOUT);
 
-            vRingbufferReturnItem(dap_dataOUT_handle, (void *)item);
+#if (USE_OBSERVER == 1)
+            // at most one observer read between two controller requests
+            observer_schedule();
+#endif
+            if (kRestartDAPHandle != NO_SIGNAL)
+                break;
         }
+#if (USE_OBSERVER == 1)
+        observer_schedule();
+#endif
     }
-}
\ No newline at end of file
+}
+
+
+
+
+
+
+
+
+// SWO Data Queue Transfer
+//   buf:    pointer to buffer with data
+//   num:    number of bytes to transfer
+void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
+{
+    swo_data_to_send = buf;
+    swo_data_num = num;
+}
@@ -1,18 +1,96 @@
 #ifndef __DAP_HANDLE_H__
 #define __DAP_HANDLE_H__
 
-
+#include <stdint.h>
 
 enum reset_handle_t
 {
     NO_SIGNAL = 0,
     RESET_HANDLE = 1,
-    DELETE_HANDLE = 2,
 };
 
 
-void handle_dap_unlink();
-
 int fast_reply(uint8_t *buf, uint32_t length);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Queue one DAP request for the DAP task (network receive stage)
+ *
+ * Waits for a free slot, except on the event loop task, where the request
+ * goes to a backlog that dap_request_flush() queues later.
+ *
+ * @param buf request data
+ * @param length request length, no more than kDapPacketSize
+ * @return 1 if the request was queued, 0 if it was dropped as it is too
+ *         long, the session is restarting or the backlog is full
+ */
+int handle_dap_data_request(const uint8_t *buf, uint32_t length);
+
+/**
+ * @brief Queue what the backlog of the event loop holds, as far as there
+ *        are free slots. The DAP task wakes the loop when it frees one.
+ *
+ * @return 0 if the backlog is empty, 1 if requests still wait, -1 if a
+ *         request was lost as the backlog was full
+ */
+int dap_request_flush();
+
+/**
+ * @brief Take one processed DAP response (network send stage)
+ *
+ * @param buf buffer of at least kDapPacketSize bytes
+ * @return response length, -1 if no response is pending.
+ */
+int dap_response_take(uint8_t *buf);
+
+/**
+ * @brief DAP_ExecuteCommand() wrapper, DAP_Info reports the negotiated packet size and count
+ *
+ */
+uint32_t dap_execute_command(const uint8_t *request, uint8_t *response);
+
+void DAP_Thread(void *argument);
+
+/**
+ * @brief Carve the queues from the session arena on first use, later calls reuse them
+ *
+ */
+void malloc_dap_ringbuf();
+/**
+ * @brief Session arena bytes taken by the request and response queues
+ *
+ */
+uint32_t dap_ringbuf_storage_size();
+/**
+ * @brief Number of packets the request and response queues hold for a given packet size
+ *
+ */
+uint32_t dap_ringbuf_slots(uint32_t packet_size);
+/**
+ * @brief Use packet_size from now on, pending packets are dropped (network receive stage)
+ *
+ * The DAP task lays the request queue out again and the send task the
+ * response queue, each the consumer of its queue. Returns once both are
+ * done and kDapPacketSize is packet_size.
+ */
+void dap_ringbuf_resize(uint16_t packet_size);
+/**
+ * @brief dap_ringbuf_resize() without the wait, for the event loop task
+ *
+ * Requests of the loop are held in its backlog until the queues are laid
+ * out again. kDapPacketSize changes only then.
+ */
+void dap_ringbuf_resize_start(uint16_t packet_size);
+/**
+ * @brief Whether the queues are laid out again after dap_ringbuf_resize_start()
+ *
+ * @return 1 once done, 0 while the DAP task or the send task still work on it
+ */
+int dap_ringbuf_resize_done();
+/**
+ * @brief Apply a re-layout of the response queue asked for by the DAP task,
+ *        the send task calls it before it takes responses
+ *
+ */
+void dap_response_sync();
+
+#endif
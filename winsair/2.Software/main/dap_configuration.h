@@ -5,7 +5,9 @@
  * @brief Specify the use of WINUSB
  *
  */
+#ifndef USE_WINUSB
 #define USE_WINUSB 1
+#endif
 
 /**
  * @brief Enable this option, no need to physically connect MOSI and MISO
@@ -14,6 +16,16 @@
 #define USE_SPI_SIO 1
 
 
+/**
+ * @brief Overlap network receive, DAP command execution and network send
+ * of the elaphureLink data phase, each stage runs on its own task.
+ *
+ */
+#ifndef USE_EL_PIPELINE
+#define USE_EL_PIPELINE 1
+#endif
+
+
 /**
  * @brief Specify to enable USB 3.0
  *
@@ -34,10 +46,23 @@
 /// 1024 for High-speed USB HID and 512 for High-speed USB WinUSB.
 
 #if (USE_WINUSB == 1)
-    #define DAP_PACKET_SIZE 512U // 512 for WinUSB.
+    #define DAP_PACKET_SIZE_DEFAULT 512U // 512 for WinUSB.
 #else
-    #define DAP_PACKET_SIZE 255U // 255 for USB HID
+    #define DAP_PACKET_SIZE_DEFAULT 255U // 255 for USB HID
 #endif
 
+/// Largest packet size a network transport can negotiate at runtime (elaphureLink handshake).
+/// Keep it below the TCP MSS (1440) so that a packet fits in one segment.
+#define DAP_PACKET_SIZE_MAX 1400U
+
+/// Size of the DAP packet buffers. The packet size in use is kDapPacketSize,
+/// which starts at DAP_PACKET_SIZE_DEFAULT and is reported through DAP_Info.
+#define DAP_PACKET_SIZE DAP_PACKET_SIZE_MAX
+
+#include <stdint.h>
+extern uint16_t kDapPacketSize;
+// Packet count reported through DAP_Info, 0 to keep the DAP_PACKET_COUNT of DAP.c
+extern uint8_t kDapPacketCount;
+
 
 #endif
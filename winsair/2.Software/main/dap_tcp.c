@@ -0,0 +1,224 @@
+/**
+ * @file dap_tcp.c
+ * @brief CMSIS-DAP over TCP, the framing of the OpenOCD cmsis_dap_tcp backend
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include <string.h>
+#include <stdint.h>
+#include <sys/param.h>
+
+#include "main/dap_tcp.h"
+#include "main/dap_configuration.h"
+#include "main/wifi_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
+
+// a request split across segments, carved from the session arena
+static uint8_t *dap_tcp_rx_buffer = NULL;
+static size_t dap_tcp_rx_len = 0;
+static size_t dap_tcp_rx_need = 0;
+
+// start of the first header while it is not known to be one
+static uint8_t dap_tcp_prefix[DAP_TCP_HEADER_SIZE];
+static size_t dap_tcp_prefix_len = 0;
+
+// responses of one wakeup of the send task go out in one write
+static uint8_t dap_tcp_tx_buffer[2 * (DAP_TCP_HEADER_SIZE + DAP_PACKET_SIZE)];
+
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void dap_tcp_put_header(uint8_t *p, uint16_t length)
+{
+    p[0] = (uint8_t)(DAP_TCP_SIGNATURE >> 0);
+    p[1] = (uint8_t)(DAP_TCP_SIGNATURE >> 8);
+    p[2] = (uint8_t)(DAP_TCP_SIGNATURE >> 16);
+    p[3] = (uint8_t)(DAP_TCP_SIGNATURE >> 24);
+    p[4] = (uint8_t)(length >> 0);
+    p[5] = (uint8_t)(length >> 8);
+    p[6] = DAP_TCP_TYPE_RESPONSE;
+    p[7] = 0;
+}
+
+int dap_tcp_request_length(const uint8_t *header)
+{
+    uint16_t length = header[4] | (header[5] << 8);
+
+    if (get_le32(header) != DAP_TCP_SIGNATURE || header[6] != DAP_TCP_TYPE_REQUEST)
+        return -1;
+    if (length > DAP_TCP_PACKET_SIZE)
+        return -1;
+
+    return length;
+}
+
+static void dap_tcp_request(const uint8_t *request, size_t len)
+{
+    if (len == 0)
+        return;
+    // the host pads to the packet size at most, the tail carries no command
+    handle_dap_data_request(request, len > kDapPacketSize ? kDapPacketSize : len);
+}
+
+
+int dap_tcp_handshake(const uint8_t *buf, size_t len)
+{
+    static const uint8_t signature[4] = {
+        (uint8_t)(DAP_TCP_SIGNATURE >> 0), (uint8_t)(DAP_TCP_SIGNATURE >> 8),
+        (uint8_t)(DAP_TCP_SIGNATURE >> 16), (uint8_t)(DAP_TCP_SIGNATURE >> 24),
+    };
+    uint8_t header[DAP_TCP_HEADER_SIZE];
+    size_t have = dap_tcp_prefix_len;
+    size_t copy = MIN(DAP_TCP_HEADER_SIZE - have, len);
+
+    memcpy(header, dap_tcp_prefix, have);
+    memcpy(header + have, buf, copy);
+
+    if (have + copy < DAP_TCP_HEADER_SIZE)
+    {
+        // too short to tell, hold it as long as it could be the signature
+        if (memcmp(header, signature, MIN(have + copy, sizeof(signature))) != 0)
+        {
+            dap_tcp_prefix_len = 0;
+            return -1;
+        }
+        memcpy(dap_tcp_prefix, header, have + copy);
+        dap_tcp_prefix_len = have + copy;
+        return 1;
+    }
+
+    dap_tcp_prefix_len = 0;
+    if (dap_tcp_request_length(header) < 0)
+        return -1;
+
+    dap_tcp_rx_buffer = session_arena_alloc(dap_tcp_session_buffer_size());
+    if (dap_tcp_rx_buffer == NULL)
+        return -1;
+    // the part of the header held back comes first, the stream goes on from there
+    memcpy(dap_tcp_rx_buffer, header, have);
+    dap_tcp_rx_len = have;
+
+    // the packet size may differ from the previous session
+    dap_ringbuf_resize(MIN(DAP_TCP_PACKET_SIZE, DAP_PACKET_SIZE));
+
+    os_printf("CMSIS-DAP TCP client\r\n");
+    return 0;
+}
+
+
+int dap_tcp_handshake_held(void)
+{
+    return dap_tcp_prefix_len > 0;
+}
+
+
+int dap_tcp_data_process(const uint8_t *buf, size_t len)
+{
+    const uint8_t *data = buf;
+    size_t copy;
+    int payload;
+
+    if (dap_tcp_rx_buffer == NULL)
+        return -1;
+
+    while (len > 0)
+    {
+        // whole request in the segment, run it from there
+        if (dap_tcp_rx_len == 0 && len >= DAP_TCP_HEADER_SIZE)
+        {
+            payload = dap_tcp_request_length(data);
+            if (payload < 0)
+                goto bad;
+            if (len >= DAP_TCP_HEADER_SIZE + payload)
+            {
+                dap_tcp_request(data + DAP_TCP_HEADER_SIZE, payload);
+                data += DAP_TCP_HEADER_SIZE + payload;
+                len -= DAP_TCP_HEADER_SIZE + payload;
+                continue;
+            }
+        }
+
+        // header first, then the payload it announces
+        if (dap_tcp_rx_len < DAP_TCP_HEADER_SIZE)
+        {
+            copy = MIN(DAP_TCP_HEADER_SIZE - dap_tcp_rx_len, len);
+            memcpy(dap_tcp_rx_buffer + dap_tcp_rx_len, data, copy);
+            dap_tcp_rx_len += copy;
+            data += copy;
+            len -= copy;
+            if (dap_tcp_rx_len < DAP_TCP_HEADER_SIZE)
+                break;
+
+            payload = dap_tcp_request_length(dap_tcp_rx_buffer);
+            if (payload < 0)
+                goto bad;
+            dap_tcp_rx_need = DAP_TCP_HEADER_SIZE + payload;
+        }
+
+        copy = MIN(dap_tcp_rx_need - dap_tcp_rx_len, len);
+        memcpy(dap_tcp_rx_buffer + dap_tcp_rx_len, data, copy);
+        dap_tcp_rx_len += copy;
+        data += copy;
+        len -= copy;
+
+        if (dap_tcp_rx_len == dap_tcp_rx_need)
+        {
+            dap_tcp_request(dap_tcp_rx_buffer + DAP_TCP_HEADER_SIZE, dap_tcp_rx_need - DAP_TCP_HEADER_SIZE);
+            dap_tcp_rx_len = 0;
+        }
+    }
+
+    return 0;
+
+bad:
+    // there is no way to find the next header in the stream
+    os_printf("CMSIS-DAP TCP: bad packet header\r\n");
+    dap_tcp_rx_len = 0;
+    return -1;
+}
+
+
+void dap_tcp_complete()
+{
+    size_t len = 0;
+    int res;
+
+    while (1)
+    {
+        if (len + DAP_TCP_HEADER_SIZE + kDapPacketSize > sizeof(dap_tcp_tx_buffer))
+        {
+            transport_send(dap_tcp_tx_buffer, len);
+            len = 0;
+        }
+
+        res = dap_response_take(dap_tcp_tx_buffer + len + DAP_TCP_HEADER_SIZE);
+        if (res < 0)
+            break;
+        dap_tcp_put_header(dap_tcp_tx_buffer + len, res);
+        len += DAP_TCP_HEADER_SIZE + res;
+    }
+
+    if (len > 0)
+        transport_send(dap_tcp_tx_buffer, len);
+}
+
+
+size_t dap_tcp_session_buffer_size()
+{
+    return DAP_TCP_HEADER_SIZE + DAP_TCP_PACKET_SIZE;
+}
+
+
+void dap_tcp_session_free()
+{
+    // handed back by session_arena_reset()
+    dap_tcp_rx_buffer = NULL;
+    dap_tcp_rx_len = 0;
+    dap_tcp_prefix_len = 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file dap_tcp.h
+ * @brief CMSIS-DAP over TCP, the framing of the OpenOCD cmsis_dap_tcp backend
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Every DAP request and response is prefixed with an 8 byte header, all
+ * fields little endian:
+ *
+ *   uint32_t signature;   "DAP\0"
+ *   uint16_t length;      payload bytes, header not included
+ *   uint8_t  packet_type; request or response
+ *   uint8_t  reserved;
+ *
+ * Requests go through the same DAP task as USB/IP and elaphureLink, so no
+ * proxy is needed between OpenOCD and the probe.
+ */
+#ifndef __DAP_TCP_H__
+#define __DAP_TCP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DAP_TCP_SIGNATURE      0x00504144
+#define DAP_TCP_HEADER_SIZE    8
+#define DAP_TCP_TYPE_REQUEST   0x01
+#define DAP_TCP_TYPE_RESPONSE  0x02
+
+// Packet size reported through DAP_Info, the same as OpenOCD uses for TCP
+#define DAP_TCP_PACKET_SIZE 1024U
+
+/**
+ * @brief Payload length of the request behind a header
+ *
+ * @return -1 if the header is not a CMSIS-DAP TCP request
+ */
+int dap_tcp_request_length(const uint8_t *header);
+
+/**
+ * @brief Write the header of a response with a payload of length bytes
+ *
+ */
+void dap_tcp_put_header(uint8_t *header, uint16_t length);
+
+/**
+ * @brief Check whether the first data of a session is a CMSIS-DAP TCP
+ *        request, and set the session up for it if so. A header split
+ *        across segments is held until it is complete.
+ *
+ * @return 0 if the client speaks CMSIS-DAP TCP, 1 if the data so far is
+ *         the start of a header, < 0 if it is something else
+ */
+int dap_tcp_handshake(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Whether dap_tcp_handshake() holds the start of a header
+ */
+int dap_tcp_handshake_held(void);
+
+/**
+ * @brief Queue every complete request of the stream for the DAP task, a
+ *        request split across segments is kept until the rest arrives
+ *
+ * @return < 0 if the stream is not CMSIS-DAP TCP framed
+ */
+int dap_tcp_data_process(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Frame and send every pending DAP response (network send stage)
+ *
+ */
+void dap_tcp_complete();
+
+size_t dap_tcp_session_buffer_size();
+void dap_tcp_session_free();
+
+#endif
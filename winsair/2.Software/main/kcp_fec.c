@@ -0,0 +1,196 @@
+/**
+ * @file kcp_fec.c
+ * @brief XOR parity FEC between KCP output and the UDP socket
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Header, all fields big endian:
+ *   type     1 byte  KCP_FEC_TYPE_*
+ *   count    1 byte  data: group size N, parity: datagrams in this group,
+ *                    hello: requested or accepted group size
+ *   index    1 byte  position in the group
+ *   reserved 1 byte
+ *   group    2 byte  group number
+ *   length   2 byte  data: payload length, parity: XOR of payload lengths
+ */
+#include <string.h>
+
+#include "main/kcp_fec.h"
+
+static void put_header(char *out, uint8_t type, uint8_t count, uint8_t index, uint16_t group, uint16_t length)
+{
+    out[0] = type;
+    out[1] = count;
+    out[2] = index;
+    out[3] = 0;
+    out[4] = group >> 8;
+    out[5] = group & 0xFF;
+    out[6] = length >> 8;
+    out[7] = length & 0xFF;
+}
+
+static void xor_into(uint8_t *dst, const uint8_t *src, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+void kcp_fec_init(kcp_fec_t *fec, int group_size)
+{
+    memset(fec, 0, sizeof(*fec));
+    if (group_size > KCP_FEC_MAX_GROUP)
+        group_size = KCP_FEC_MAX_GROUP;
+    if (group_size < 0)
+        group_size = 0;
+    fec->group_size = group_size;
+}
+
+int kcp_fec_hello(int group_size, char *out)
+{
+    put_header(out, KCP_FEC_TYPE_HELLO, group_size, 0, 0, 0);
+    return KCP_FEC_HEADER_SIZE;
+}
+
+int kcp_fec_parse_hello(const char *buf, int len)
+{
+    if (len != KCP_FEC_HEADER_SIZE || (uint8_t)buf[0] != KCP_FEC_TYPE_HELLO)
+        return -1;
+    return (uint8_t)buf[1];
+}
+
+
+int kcp_fec_encode(kcp_fec_t *fec, const char *buf, int len, char *out)
+{
+    if (fec->group_size == 0) {
+        memcpy(out, buf, len);
+        return len;
+    }
+
+    put_header(out, KCP_FEC_TYPE_DATA, fec->group_size, fec->tx_index, fec->tx_group, len);
+    memcpy(out + KCP_FEC_HEADER_SIZE, buf, len);
+
+    if (fec->tx_index == 0) {
+        memcpy(fec->tx_parity, buf, len);
+        fec->tx_len_xor = len;
+        fec->tx_max_len = len;
+    } else {
+        if (len > fec->tx_max_len) {
+            memset(fec->tx_parity + fec->tx_max_len, 0, len - fec->tx_max_len);
+            fec->tx_max_len = len;
+        }
+        xor_into(fec->tx_parity, (const uint8_t *)buf, len);
+        fec->tx_len_xor ^= len;
+    }
+    fec->tx_index++;
+    return KCP_FEC_HEADER_SIZE + len;
+}
+
+int kcp_fec_parity(kcp_fec_t *fec, int flush, char *out)
+{
+    if (fec->group_size == 0 || fec->tx_index == 0)
+        return 0;
+    if (fec->tx_index < fec->group_size && !flush)
+        return 0;
+
+    put_header(out, KCP_FEC_TYPE_PARITY, fec->tx_index, fec->tx_index, fec->tx_group, fec->tx_len_xor);
+    memcpy(out + KCP_FEC_HEADER_SIZE, fec->tx_parity, fec->tx_max_len);
+
+    fec->parity_sent++;
+    fec->tx_group++;
+    fec->tx_index = 0;
+    return KCP_FEC_HEADER_SIZE + fec->tx_max_len;
+}
+
+
+/*
+ * Slot of `group`, NULL if the group is too old to be tracked
+ */
+static kcp_fec_rx_group_t *rx_group(kcp_fec_t *fec, uint16_t group)
+{
+    kcp_fec_rx_group_t *g = &fec->rx[group % KCP_FEC_RX_GROUPS];
+
+    if (g->valid && g->group == group)
+        return g;
+    if (g->valid && (int16_t)(group - g->group) < 0)
+        return NULL;
+
+    g->group = group;
+    g->valid = 1;
+    g->size = 0;
+    g->count = 0;
+    g->parity = 0;
+    g->recovered = 0;
+    g->len_xor = 0;
+    g->mask = 0;
+    memset(g->xor_buf, 0, sizeof(g->xor_buf));
+    return g;
+}
+
+static void try_recover(kcp_fec_t *fec, kcp_fec_rx_group_t *g, kcp_fec_input_t input, void *user)
+{
+    int i;
+
+    if (!g->parity || g->recovered || g->count + 1 != g->size)
+        return;
+    if (g->len_xor == 0 || g->len_xor > KCP_FEC_MTU)
+        return;
+
+    // every other datagram and the parity are folded into xor_buf already
+    for (i = 0; i < g->size; i++) {
+        if (!(g->mask & (1UL << i)))
+            break;
+    }
+    g->mask |= 1UL << i;
+    g->count++;
+    g->recovered = 1;
+    fec->recovered++;
+    input((const char *)g->xor_buf, g->len_xor, user);
+}
+
+int kcp_fec_decode(kcp_fec_t *fec, const char *buf, int len, kcp_fec_input_t input, void *user)
+{
+    const uint8_t *hdr = (const uint8_t *)buf;
+    uint8_t type = hdr[0];
+
+    if (len < KCP_FEC_HEADER_SIZE || (type != KCP_FEC_TYPE_DATA && type != KCP_FEC_TYPE_PARITY)) {
+        // plain KCP datagram
+        input(buf, len, user);
+        return 0;
+    }
+
+    uint8_t count = hdr[1];
+    uint8_t index = hdr[2];
+    uint16_t group = (hdr[4] << 8) | hdr[5];
+    uint16_t length = (hdr[6] << 8) | hdr[7];
+    const uint8_t *payload = hdr + KCP_FEC_HEADER_SIZE;
+    int payload_len = len - KCP_FEC_HEADER_SIZE;
+
+    if (count == 0 || count > KCP_FEC_MAX_GROUP || index > count || payload_len > KCP_FEC_MTU)
+        return -1;
+
+    if (type == KCP_FEC_TYPE_DATA) {
+        if (length != payload_len || index >= count)
+            return -1;
+        input((const char *)payload, payload_len, user);
+
+        kcp_fec_rx_group_t *g = rx_group(fec, group);
+        if (g == NULL || (g->mask & (1UL << index)))
+            return 0;
+        g->mask |= 1UL << index;
+        g->count++;
+        g->len_xor ^= length;
+        xor_into(g->xor_buf, payload, payload_len);
+        try_recover(fec, g, input, user);
+    } else {
+        kcp_fec_rx_group_t *g = rx_group(fec, group);
+        if (g == NULL || g->parity)
+            return 0;
+        g->parity = 1;
+        g->size = count;
+        g->len_xor ^= length;
+        xor_into(g->xor_buf, payload, payload_len);
+        try_recover(fec, g, input, user);
+    }
+    return 0;
+}
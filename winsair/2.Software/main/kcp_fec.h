@@ -0,0 +1,111 @@
+/**
+ * @file kcp_fec.h
+ * @brief XOR parity FEC between KCP output and the UDP socket
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Every N data datagrams are followed by one parity datagram holding the
+ * XOR of their payloads, so any single loss within a group is repaired
+ * without waiting for a KCP resend. A group is also closed early at the end
+ * of each burst, the last datagram of a response is the one that matters.
+ *
+ * FEC is negotiated per session: the client sends a hello datagram with the
+ * group size it wants and the probe answers with the size it accepted, 0
+ * meaning plain KCP. Datagrams without a FEC header are always accepted.
+ *
+ * This file does not depend on FreeRTOS or lwIP, the host tools link it too.
+ */
+#ifndef __KCP_FEC_H__
+#define __KCP_FEC_H__
+
+#include <stdint.h>
+
+#define KCP_FEC_MTU         768
+#define KCP_FEC_HEADER_SIZE 8
+#define KCP_FEC_MAX_GROUP   16
+// Groups tracked by the decoder, datagrams of older groups are only passed on
+#define KCP_FEC_RX_GROUPS   4
+
+// First header byte, a KCP segment starts with the conversation id (1)
+#define KCP_FEC_TYPE_DATA   0xFE
+#define KCP_FEC_TYPE_PARITY 0xFD
+#define KCP_FEC_TYPE_HELLO  0xFC
+
+typedef int (*kcp_fec_input_t)(const char *buf, int len, void *user);
+
+typedef struct
+{
+    uint16_t group;
+    uint8_t valid;
+    uint8_t size;      // data datagrams in the group, known once parity arrived
+    uint8_t count;     // data datagrams received
+    uint8_t parity;
+    uint8_t recovered;
+    uint16_t len_xor;
+    uint32_t mask;     // received data indexes
+    uint8_t xor_buf[KCP_FEC_MTU];
+} kcp_fec_rx_group_t;
+
+typedef struct
+{
+    uint8_t group_size; // N, 0 when FEC is off for this session
+
+    // encoder
+    uint16_t tx_group;
+    uint8_t tx_index;
+    uint16_t tx_len_xor;
+    uint16_t tx_max_len;
+    uint8_t tx_parity[KCP_FEC_MTU];
+
+    // decoder
+    kcp_fec_rx_group_t rx[KCP_FEC_RX_GROUPS];
+
+    uint32_t parity_sent;
+    uint32_t recovered; // datagrams rebuilt from parity
+} kcp_fec_t;
+
+/**
+ * @brief Reset the state for a new session
+ *
+ * @param group_size data datagrams per parity datagram, 0 disables FEC
+ */
+void kcp_fec_init(kcp_fec_t *fec, int group_size);
+
+/**
+ * @brief Build a hello datagram into `out`
+ *
+ * @return length of the datagram
+ */
+int kcp_fec_hello(int group_size, char *out);
+
+/**
+ * @brief Group size carried by a hello datagram, -1 if `buf` is not one
+ *
+ */
+int kcp_fec_parse_hello(const char *buf, int len);
+
+/**
+ * @brief Wrap one KCP datagram into `out`, which holds at least
+ *        KCP_FEC_HEADER_SIZE + KCP_FEC_MTU bytes.
+ *
+ * @return length of the wrapped datagram, `len` copied as is when FEC is off
+ */
+int kcp_fec_encode(kcp_fec_t *fec, const char *buf, int len, char *out);
+
+/**
+ * @brief Parity datagram of the current group once it holds N datagrams
+ *
+ * @param flush also close a partial group, at the end of a burst
+ * @return length written to `out`, 0 if no parity is due
+ */
+int kcp_fec_parity(kcp_fec_t *fec, int flush, char *out);
+
+/**
+ * @brief Pass a received datagram on to `input`, plus any datagram that it
+ *        allows to rebuild.
+ *
+ * @return 0 on success, -1 on a malformed FEC datagram
+ */
+int kcp_fec_decode(kcp_fec_t *fec, const char *buf, int len, kcp_fec_input_t input, void *user);
+
+#endif
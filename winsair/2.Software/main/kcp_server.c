@@ -1,7 +1,7 @@
 /**
  * @file kcp_server.c
  * @author windows
- * @brief usbip KCP port
+ * @brief KCP transport over UDP
  * @version 0.1
  * @date 2021-10-08
  *
@@ -13,12 +13,19 @@
 
 #include "main/wifi_configuration.h"
 
+#if (USE_KCP == 1)
+
+#include "main/kcp_server.h"
+#include "main/kcp_fec.h"
+#include "main/transport.h"
+
 #include "components/kcp/ikcp.h"
 #include "components/kcp/ikcp_util.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
@@ -29,16 +36,66 @@
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include <lwip/netdb.h>
+#include <sys/param.h>
+
+
+// Upper bound of the KCP flush interval. Acks and new data are flushed as
+// soon as they appear, so this only paces retransmit and window probing.
+#define KCP_INTERVAL_MS 10
+
+#define KCP_MTU KCP_FEC_MTU
 
-extern TaskHandle_t kDAPTaskHandle;
-extern int kRestartDAPHandle;
-extern int kSock;
-extern uint8_t kState;
+// Datagrams waiting for the pacer, ikcp_flush never blocks on the socket
+#define KCP_TX_QUEUE_LEN 16
+// The send window is halved on ENOMEM or a full queue and grows back by one
+// segment every time the queue drains
+#define KCP_SND_WND_MIN 4
+#define KCP_SND_WND_MAX 64
+// Wait before retrying a send that failed for lack of pbufs
+#define KCP_TX_BACKOFF_MS 10
+#define KCP_TX_IDLE 0xFFFFFFFF
 
+// bytes per millisecond
+#define KCP_PACING_RATE  (KCP_PACING_RATE_KBPS / 8)
+#define KCP_PACING_BURST (KCP_MTU * 4)
+
+// A session that has not heard from its client for this long is over
+#define KCP_SESSION_IDLE_MS (60 * 1000)
+
+static int kcp_sock = -1;
 static struct sockaddr_in client_addr = { 0 };
 static char kcp_buffer[MTU_SIZE];
+// Length of the datagram kcp_accept() took, it is the first one of the session
+static int kcp_first_len = 0;
 static ikcpcb *kcp1 = NULL;
 
+// ikcpcb is shared with the send task, which calls kcp_network_send()
+static SemaphoreHandle_t kcp_mux = NULL;
+
+// Loopback socket used to cut the select() wait short when another task
+// queues data that needs an earlier timer than the one being slept on.
+static int kWakeSock = -1;
+static struct sockaddr_in wake_addr = { 0 };
+static volatile int kcp_sleeping = 0;
+static volatile IUINT32 kcp_deadline = 0;
+static TickType_t kcp_last_rx = 0;
+
+typedef struct
+{
+    uint16_t len;
+    char buf[KCP_FEC_HEADER_SIZE + KCP_MTU];
+} kcp_datagram_t;
+
+static kcp_datagram_t kcp_tx_queue[KCP_TX_QUEUE_LEN];
+static uint32_t tx_head = 0;
+static uint32_t tx_count = 0;
+static uint32_t tx_tokens = KCP_PACING_BURST;
+static IUINT32 tx_refill_ts = 0;
+static IUINT32 tx_backoff_until = 0;
+static uint32_t snd_wnd = KCP_SND_WND_MAX;
+static kcp_stats_t kcp_stats = { 0 };
+static kcp_fec_t kcp_fec;
+
 
 static void set_non_blocking(int sockfd) {
     int flag = fcntl(sockfd, F_GETFL, 0);
@@ -51,136 +108,482 @@ static void set_non_blocking(int sockfd) {
     }
 }
 
+static void kcp_window_shrink()
+{
+    uint32_t wnd = MAX(snd_wnd / 2, KCP_SND_WND_MIN);
+    if (wnd != snd_wnd) {
+        snd_wnd = wnd;
+        ikcp_wndsize(kcp1, snd_wnd, 0);
+    }
+}
+
+static void kcp_window_grow()
+{
+    if (snd_wnd < KCP_SND_WND_MAX) {
+        snd_wnd++;
+        ikcp_wndsize(kcp1, snd_wnd, 0);
+    }
+}
+
+static void kcp_tx_reset()
+{
+    tx_head = 0;
+    tx_count = 0;
+    tx_tokens = KCP_PACING_BURST;
+    tx_refill_ts = iclock();
+    tx_backoff_until = tx_refill_ts;
+    snd_wnd = KCP_SND_WND_MAX;
+    kcp_fec_init(&kcp_fec, 0);
+}
+
+// Close the open FEC group, there is always a free slot for its parity
+static void kcp_tx_parity(int flush)
+{
+    kcp_datagram_t *d = &kcp_tx_queue[(tx_head + tx_count) % KCP_TX_QUEUE_LEN];
+    int len = kcp_fec_parity(&kcp_fec, flush, d->buf);
+    if (len > 0) {
+        d->len = len;
+        tx_count++;
+    }
+}
+
+// Called by ikcp_flush with kcp_mux held, must not block
 static int udp_output(const char *buf, int len, ikcpcb *kcp, void *user)
 {
-	int ret = -1;
-    int time = 10;
-    // Unfortunately, esp8266 often fails due to lack of memory
-    while (ret < 0) {
-        ret = sendto(kSock, buf, len, 0, (struct sockaddr *)&client_addr, sizeof(client_addr));
+    // with FEC on, keep a slot for the parity of the group
+    uint32_t room = kcp_fec.group_size ? 2 : 1;
+    if (tx_count + room > KCP_TX_QUEUE_LEN || len > KCP_MTU) {
+        // KCP sends the segment again after its RTO
+        kcp_stats.drops++;
+        kcp_window_shrink();
+        return 0;
+    }
+
+    kcp_datagram_t *d = &kcp_tx_queue[(tx_head + tx_count) % KCP_TX_QUEUE_LEN];
+    d->len = kcp_fec_encode(&kcp_fec, buf, len, d->buf);
+    tx_count++;
+    kcp_tx_parity(0);
+    if (tx_count > kcp_stats.queue_high_water)
+        kcp_stats.queue_high_water = tx_count;
+    return 0;
+}
+
+/**
+ * @brief Send queued datagrams as far as the token bucket allows.
+ *
+ * @return milliseconds until the next datagram may be sent,
+ *         KCP_TX_IDLE when the queue is empty
+ */
+static IUINT32 kcp_tx_drain(IUINT32 now)
+{
+    // the burst is over, protect its tail
+    kcp_tx_parity(1);
+
+    IUINT32 elapsed = now - tx_refill_ts;
+    tx_refill_ts = now;
+    if (elapsed >= KCP_PACING_BURST / KCP_PACING_RATE + 1)
+        tx_tokens = KCP_PACING_BURST;
+    else
+        tx_tokens = MIN(tx_tokens + elapsed * KCP_PACING_RATE, KCP_PACING_BURST);
+
+    if ((IINT32)(tx_backoff_until - now) > 0)
+        return tx_backoff_until - now;
+
+    while (tx_count > 0) {
+        kcp_datagram_t *d = &kcp_tx_queue[tx_head];
+        if (tx_tokens < d->len)
+            return (d->len - tx_tokens + KCP_PACING_RATE - 1) / KCP_PACING_RATE;
+
+        int ret = sendto(kcp_sock, d->buf, d->len, 0, (struct sockaddr *)&client_addr, sizeof(client_addr));
         if (ret < 0) {
-            // os_printf("fail to send, retry\r\n");
             int errcode = errno;
-            if (errno != ENOMEM)
-                os_printf("unknown errcode %d\r\n", errcode);
-            vTaskDelay(pdMS_TO_TICKS(time));
-            time += 10;
+            if (errcode == ENOMEM || errcode == ENOBUFS || errcode == EAGAIN) {
+                // out of pbufs, keep the datagram and slow KCP down
+                kcp_stats.enomem++;
+                kcp_window_shrink();
+                tx_backoff_until = now + KCP_TX_BACKOFF_MS;
+                return KCP_TX_BACKOFF_MS;
+            }
+            os_printf("unknown errcode %d\r\n", errcode);
+            kcp_stats.drops++;
+        } else {
+            tx_tokens -= d->len;
+            kcp_stats.sent++;
         }
+        tx_head = (tx_head + 1) % KCP_TX_QUEUE_LEN;
+        tx_count--;
+    }
+
+    kcp_window_grow();
+    return KCP_TX_IDLE;
+}
+
+/**
+ * @brief Flush the output queue and return the next time the KCP task has
+ *        to run. Called with kcp_mux held.
+ */
+static IUINT32 kcp_next_deadline(IUINT32 now)
+{
+    IUINT32 next = ikcp_check(kcp1, now);
+    IUINT32 tx_wait = kcp_tx_drain(now);
+
+    if (tx_wait != KCP_TX_IDLE && (IINT32)(now + tx_wait - next) < 0)
+        next = now + tx_wait;
+    return next;
+}
+
+void kcp_server_stats(kcp_stats_t *stats)
+{
+    if (kcp_mux)
+        xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    *stats = kcp_stats;
+    stats->queue_depth = tx_count;
+    stats->queue_size = KCP_TX_QUEUE_LEN;
+    stats->pacing_rate = KCP_PACING_RATE_KBPS;
+    stats->snd_wnd = snd_wnd;
+    stats->fec_group = kcp_fec.group_size;
+    stats->fec_parity = kcp_fec.parity_sent;
+    stats->fec_recovered = kcp_fec.recovered;
+    if (kcp_mux)
+        xSemaphoreGive(kcp_mux);
+}
+
+static int kcp_fec_input(const char *buf, int len, void *user)
+{
+    return ikcp_input(kcp1, buf, len);
+}
+
+// The client asked for FEC, a new session starts
+static void kcp_fec_session(int group_size)
+{
+    char hello[KCP_FEC_HEADER_SIZE];
+
+#if (USE_KCP_FEC == 0)
+    group_size = 0;
+#endif
+    if (group_size > KCP_FEC_MAX_GROUP)
+        group_size = KCP_FEC_MAX_GROUP;
+    if (group_size == 1)
+        group_size = 2;
+    kcp_fec_init(&kcp_fec, group_size);
+    os_printf("KCP FEC group size %d\r\n", group_size);
+
+    // the client repeats its hello if this answer gets lost
+    int len = kcp_fec_hello(group_size, hello);
+    sendto(kcp_sock, hello, len, 0, (struct sockaddr *)&client_addr, sizeof(client_addr));
+}
+
+static int wake_socket_create()
+{
+    socklen_t len = sizeof(wake_addr);
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        return -1;
+    }
+
+    memset(&wake_addr, 0, sizeof(wake_addr));
+    wake_addr.sin_family = AF_INET;
+    wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wake_addr.sin_port = 0;
+    if (bind(sock, (struct sockaddr *)&wake_addr, sizeof(wake_addr)) < 0 ||
+        getsockname(sock, (struct sockaddr *)&wake_addr, &len) < 0) {
+        close(sock);
+        return -1;
+    }
+    set_non_blocking(sock);
+    return sock;
+}
+
+// Drop the datagrams of clients that were refused or left
+static void kcp_socket_drain()
+{
+    while (recv(kcp_sock, kcp_buffer, MTU_SIZE, 0) >= 0) {
+    }
+}
+
+static void wake_socket_drain()
+{
+    char dummy[4];
+    while (recv(kWakeSock, dummy, sizeof(dummy), 0) > 0) {
     }
-	return 0;
 }
 
-int kcp_network_send(const char *buffer, int len) {
-    ikcp_send(kcp1, buffer, len);
+static int kcp_sendv(transport_t *t, const transport_iov_t *iov, int iovcnt) {
+    int i, ret = 0;
+    int wake = 0;
+
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    if (kcp1 == NULL) {
+        xSemaphoreGive(kcp_mux);
+        return -1;
+    }
+    // the receiver sees one stream, every buffer may go in its own message
+    for (i = 0; i < iovcnt && ret >= 0; i++)
+        ret = ikcp_send(kcp1, iov[i].ptr, iov[i].len);
     ikcp_flush(kcp1);
-    return 0;
+    IUINT32 next = kcp_next_deadline(iclock());
+    if (kcp_sleeping) {
+        // the KCP task sleeps past the retransmit or pacing timer of this data
+        wake = (IINT32)(next - kcp_deadline) < 0;
+        if (wake)
+            kcp_sleeping = 0;
+    }
+    xSemaphoreGive(kcp_mux);
+
+    if (wake && kWakeSock >= 0) {
+        sendto(kWakeSock, "", 1, 0, (struct sockaddr *)&wake_addr, sizeof(wake_addr));
+    }
+    return ret < 0 ? -1 : 0;
 }
 
-void kcp_server_task()
+/**
+ * @brief Wait until the next KCP timer expires or a datagram arrives.
+ *
+ * The wait is rounded up to whole ticks, select() can not sleep any
+ * shorter and would otherwise return early and spin until the deadline.
+ *
+ * @return > 0 when a socket is readable, 0 on timeout
+ */
+static int kcp_wait(IUINT32 wait_ms, int *wake)
 {
-    TickType_t xLastWakeTime = xTaskGetTickCount();
+    fd_set rfds;
+    struct timeval tv;
+    int maxfd = kcp_sock;
 
-    while (1) {
-        kSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-        if (kSock < 0) {
-            os_printf("Unable to create socket: errno %d", errno);
-            break;
-        }
-        os_printf("Socket created\r\n");
+    if (wait_ms != KCP_TX_IDLE && wait_ms > 0) {
+        wait_ms = (wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS * portTICK_PERIOD_MS;
+    }
+    tv.tv_sec = wait_ms / 1000;
+    tv.tv_usec = (wait_ms % 1000) * 1000;
+
+    FD_ZERO(&rfds);
+    FD_SET(kcp_sock, &rfds);
+    if (kWakeSock >= 0) {
+        FD_SET(kWakeSock, &rfds);
+        maxfd = MAX(maxfd, kWakeSock);
+    }
+
+    // KCP_TX_IDLE waits for the next datagram
+    int ret = select(maxfd + 1, &rfds, NULL, NULL, wait_ms == KCP_TX_IDLE ? NULL : &tv);
+    *wake = ret > 0 && kWakeSock >= 0 && FD_ISSET(kWakeSock, &rfds);
+    return ret;
+}
 
-        set_non_blocking(kSock);
+static int kcp_socket_create()
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        os_printf("Unable to create socket: errno %d", errno);
+        return -1;
+    }
+    os_printf("Socket created\r\n");
 
+    set_non_blocking(sock);
 
-        struct sockaddr_in server_addr;
-        memset(&server_addr, 0, sizeof(server_addr));
-        server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(PORT);
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(PORT);
 
-        socklen_t socklen = sizeof(client_addr);
+    int err = bind(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    if (err < 0) {
+        os_printf("Socket unable to bind: errno %d\r\n", errno);
+        close(sock);
+        return -1;
+    }
+    os_printf("Socket binded\r\n");
+    return sock;
+}
 
+// KCP has no connection, the first datagram starts a session
+static int kcp_accept(transport_t *t)
+{
+    socklen_t socklen = sizeof(client_addr);
+    int wake = 0;
+    int len;
 
-        int err = bind(kSock, (struct sockaddr *)&server_addr, sizeof(server_addr));
-        if (err < 0) {
-            os_printf("Socket unable to bind: errno %d\r\n", errno);
+    if (kcp_mux == NULL) {
+        kcp_mux = xSemaphoreCreateMutex();
+    }
+    if (kcp_sock < 0) {
+        kcp_sock = kcp_socket_create();
+        if (kcp_sock < 0)
+            return -1;
+    }
+    if (kWakeSock < 0) {
+        kWakeSock = wake_socket_create();
+        if (kWakeSock < 0) {
+            os_printf("Unable to create wakeup socket, timers may fire late\r\n");
         }
-        os_printf("Socket binded\r\n");
+    }
+
+    // a datagram is not taken off the socket when the client is refused,
+    // so do not look at them while another transport has the DAP. What
+    // came in meanwhile is stale, the client sends again.
+    transport_wait_idle(t);
+    kcp_socket_drain();
 
-        // KCP init
-        if (kcp1 == NULL) {
-            kcp1 = ikcp_create(1, (void *)0);
+    do {
+        if (kcp_wait(KCP_TX_IDLE, &wake) < 0) {
+            os_printf("select failed: errno %d\r\n", errno);
+            return -1;
         }
-        if (kcp1 == NULL) {
-            os_printf("can not create kcp control block\r\n");
-            break;
+        if (wake) {
+            wake_socket_drain();
         }
-        kcp1->output = udp_output;
-
-        ikcp_wndsize(kcp1, 4096, 4096);
+        len = recvfrom(kcp_sock, kcp_buffer, MTU_SIZE, 0, (struct sockaddr *)&client_addr, &socklen);
+    } while (len < 0);
+
+    // KCP init
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    kcp1 = ikcp_create(1, (void *)0);
+    if (kcp1 == NULL) {
+        xSemaphoreGive(kcp_mux);
+        os_printf("can not create kcp control block\r\n");
+        return -1;
+    }
+    kcp1->output = udp_output;
 
-        ikcp_nodelay(kcp1, 2, 2, 2, 1); // set fast mode
-        kcp1->interval = 0;
-        kcp1->rx_minrto = 1;
-        kcp1->fastresend = 1;
+    kcp_tx_reset();
+    ikcp_wndsize(kcp1, snd_wnd, 4096);
 
-        ikcp_setmtu(kcp1, 768);
+    // set fast mode; interval must stay non-zero or ikcp_check() always
+    // reports an expired timer and the task never sleeps
+    ikcp_nodelay(kcp1, 2, KCP_INTERVAL_MS, 2, 1);
+    kcp1->rx_minrto = 1;
+    kcp1->fastresend = 1;
 
+    ikcp_setmtu(kcp1, KCP_MTU);
+    kcp_last_rx = xTaskGetTickCount();
+    // handed to the session by the first kcp_recv_batch()
+    kcp_first_len = len;
+    xSemaphoreGive(kcp_mux);
 
+    return 0;
+}
 
-        int ret = -1;
-        // KCP task main loop
-        while (1) {
-            vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(1)); // we wanna sleep absolute time
-            ikcp_update(kcp1, iclock());
+// A datagram in kcp_buffer, called with kcp_mux held
+static void kcp_datagram_input(int len)
+{
+    int group_size = kcp_fec_parse_hello(kcp_buffer, len);
+    if (group_size >= 0) {
+        kcp_fec_session(group_size);
+        return;
+    }
+    kcp_fec_decode(&kcp_fec, kcp_buffer, len, kcp_fec_input, NULL);
+}
 
-            // recv data from udp
-            while (1) {
-                ret = recvfrom(kSock, kcp_buffer, MTU_SIZE, 0, (struct sockaddr *)&client_addr, &socklen);
-                if (ret < 0) {
-                    break;
-                }
-                ikcp_input(kcp1, kcp_buffer, ret);
-            }
+// One pass of the KCP loop, driven by ikcp_check() deadlines and socket events
+static int kcp_recv_batch(transport_t *t, transport_input_t input)
+{
+    socklen_t socklen = sizeof(client_addr);
+    int ret = -1;
+    int wake = 0;
+    int total = 0;
+
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    IUINT32 now = iclock();
+    ikcp_update(kcp1, now);
+    kcp_deadline = kcp_next_deadline(now);
+    kcp_sleeping = 1;
+    int dead = kcp1->state == (IUINT32)-1;
+    xSemaphoreGive(kcp_mux);
+
+    if (dead) {
+        os_printf("KCP link is dead\r\n");
+        return -1;
+    }
+    if (xTaskGetTickCount() - kcp_last_rx >= pdMS_TO_TICKS(KCP_SESSION_IDLE_MS)) {
+        os_printf("KCP client is silent\r\n");
+        return -1;
+    }
 
-            // recv data from kdp
-            while (1) {
-                ret = ikcp_recv(kcp1, kcp_buffer, MTU_SIZE);
-                if (ret < 0) {
-                    break;
-                }
-                // recv user data, then handle it
-                switch (kState)
-                {
-                case EMULATING:
-                    emulate((uint8_t *)kcp_buffer, ret);
-                    break;
-
-                case ACCEPTING:
-                    kState = ATTACHING;
-                case ATTACHING:
-                    attach((uint8_t *)kcp_buffer, ret);
-                    break;
-
-                default:
-                    os_printf("unkonw kstate!\r\n");
-                }
-            }
+    // the datagram kcp_accept() took is already here
+    if (kcp_first_len == 0) {
+        IINT32 wait_ms = (IINT32)(kcp_deadline - now);
+        ret = kcp_wait(wait_ms > 0 ? wait_ms : 0, &wake);
+        kcp_sleeping = 0;
+        if (ret < 0) {
+            os_printf("select failed: errno %d\r\n", errno);
+            return -1;
         }
-        if (kcp1) {
-            ikcp_release(kcp1);
+        if (wake) {
+            wake_socket_drain();
         }
-        if (kSock != -1) {
-            os_printf("Shutting down socket and restarting...\r\n");
-            shutdown(kSock, 0);
-            close(kSock);
-
-            if (kState == EMULATING)
-                kState = ACCEPTING;
-            // Restart DAP Handle
-            kRestartDAPHandle = 1;
-            if (kDAPTaskHandle)
-                xTaskNotifyGive(kDAPTaskHandle);
+        if (ret == 0) {
+            return 0;
         }
     }
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+    kcp_sleeping = 0;
+
+    // recv data from udp
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    int received = 0;
+    if (kcp_first_len > 0) {
+        kcp_datagram_input(kcp_first_len);
+        kcp_first_len = 0;
+        received = 1;
+    }
+    while (1) {
+        ret = recvfrom(kcp_sock, kcp_buffer, MTU_SIZE, 0, (struct sockaddr *)&client_addr, &socklen);
+        if (ret < 0) {
+            break;
+        }
+        received = 1;
+        kcp_datagram_input(ret);
+    }
+    // ack right away instead of waiting for the next interval
+    if (received) {
+        kcp_last_rx = xTaskGetTickCount();
+        ikcp_flush(kcp1);
+        kcp_tx_drain(iclock());
+    }
+    xSemaphoreGive(kcp_mux);
+
+    // recv data from kdp
+    while (1) {
+        xSemaphoreTake(kcp_mux, portMAX_DELAY);
+        ret = ikcp_recv(kcp1, kcp_buffer, MTU_SIZE);
+        xSemaphoreGive(kcp_mux);
+        if (ret < 0) {
+            break;
+        }
+        // recv user data, then handle it
+        if (input(t, (uint8_t *)kcp_buffer, ret) < 0) {
+            return -1;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+static void kcp_close(transport_t *t)
+{
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    if (kcp1) {
+        ikcp_release(kcp1);
+        kcp1 = NULL;
+    }
+    kcp_first_len = 0;
+    kcp_tx_reset();
+    // a refused client's datagram is still on the socket
+    kcp_socket_drain();
+    xSemaphoreGive(kcp_mux);
+}
+
+static const transport_ops_t kcp_ops = {
+    .accept = kcp_accept,
+    .recv_batch = kcp_recv_batch,
+    .sendv = kcp_sendv,
+    .close = kcp_close,
+};
+
+transport_t kKcpTransport = {
+    .name = "kcp_server",
+    .id = TRANSPORT_KCP,
+    .ops = &kcp_ops,
+    .enabled = 1,
+};
+
+#endif
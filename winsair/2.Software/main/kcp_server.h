@@ -1,7 +1,23 @@
 #ifndef __KCP_SERVER_H__
 #define __KCP_SERVER_H__
 
-void kcp_server_task();
-int kcp_network_send(const char *buffer, int len);
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t queue_depth;      // datagrams waiting for the pacer
+    uint32_t queue_high_water;
+    uint32_t queue_size;
+    uint32_t sent;             // datagrams handed to the socket
+    uint32_t drops;            // datagrams dropped, KCP resends them
+    uint32_t enomem;           // sends deferred for lack of pbufs
+    uint32_t pacing_rate;      // kbit/s
+    uint32_t snd_wnd;          // current KCP send window in segments
+    uint32_t fec_group;        // data datagrams per parity, 0 when FEC is off
+    uint32_t fec_parity;       // parity datagrams sent
+    uint32_t fec_recovered;    // datagrams rebuilt from parity
+} kcp_stats_t;
+
+void kcp_server_stats(kcp_stats_t *stats);
 
 #endif
\ No newline at end of file
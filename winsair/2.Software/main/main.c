@@ -11,13 +11,19 @@
 #include <sys/param.h>
 
 #include "sdkconfig.h"
-#include "main/tcp_server.h"
-#include "main/tcp_netconn.h"
-#include "main/kcp_server.h"
+#include "main/transport.h"
 #include "main/uart_bridge.h"
 #include "main/timer.h"
 #include "main/wifi_configuration.h"
 #include "main/wifi_handle.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/usbip_server.h"
+#include "main/dap_tcp.h"
+#include "main/observer.h"
+#include "main/net_loop.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
 
 
 
@@ -40,6 +46,7 @@
 
 
 TaskHandle_t kDAPTaskHandle = NULL;
+TaskHandle_t kDAPSendTaskHandle = NULL;
 
 
 static const char *MDNS_TAG = "server_common";
@@ -55,7 +62,30 @@ void app_main() {
     wifi_init();
 
     timer_init();
-    xTaskCreate(tcp_server_task, "tcp_server", 4096, NULL, 14, NULL);
+
+    // every connection buffer comes from here, the heap is left alone after boot.
+    // A connection speaks either elaphureLink or USB/IP.
+    session_arena_init(dap_ringbuf_storage_size() +
+                       MAX(MAX(el_process_buffer_size(), usbip_session_buffer_size()), dap_tcp_session_buffer_size()) + 4 * SESSION_ARENA_ALIGN);
+    malloc_dap_ringbuf(); // kept for the whole uptime
+    session_arena_keep();
+
+    // USB/IP and the elaphureLink pipeline run DAP commands on their own task
+    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    xTaskCreate(transport_send_task, "dap_send", 2048, NULL, 12, &kDAPSendTaskHandle);
+    // a listener task per transport, the first client to connect gets the DAP
+    transport_start();
+#if (USE_OBSERVER == 1)
+    // read-only sessions next to the one that owns the DAP
+    observer_start();
+#endif
+#if (USE_UART_BRIDGE == 1)
+    xTaskCreate(uart_bridge_task, "uart_server", 4096, NULL, 2, NULL);
+#endif
+#if (USE_EVENT_LOOP == 1)
+    // after every service has registered
+    net_loop_start();
+#endif
 
 
 
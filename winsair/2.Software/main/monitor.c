@@ -5,10 +5,63 @@
 #include "freertos/task.h"
 #include "esp_system.h"
 
+#include "main/wifi_configuration.h"
+#include "main/session_arena.h"
+#include "main/kcp_server.h"
+#include "main/transport.h"
+#include "main/observer.h"
+#include "main/net_loop.h"
+#include "main/uart_bridge.h"
+
 void esp_print_tasks(void)
 {
     char *pbuffer = (char *)calloc(1, 2048);
+    session_arena_stats_t stats;
+
+    session_arena_stats(&stats);
     os_printf("--------------- heap:%u ---------------------\r\n", esp_get_free_heap_size());
+    os_printf("heap min free:%u largest block:%u fragmentation:%u%%\r\n",
+              stats.heap_min_free, stats.heap_largest_free, stats.heap_fragmentation);
+    os_printf("arena used:%u/%u high water:%u sessions:%u failures:%u\r\n",
+              stats.used, stats.size, stats.high_water, stats.resets, stats.failures);
+    for (int i = 0; i < TRANSPORT_NUM; i++) {
+        transport_t *t = transport_get(i);
+        if (t == NULL)
+            continue;
+        os_printf("%s%s sessions:%u refused:%u rx:%u/%u tx:%u/%u errors:%u\r\n",
+                  t->name, t->enabled ? "" : " (disabled)", t->stats.sessions, t->stats.rejected,
+                  t->stats.rx_bytes, t->stats.rx_batches, t->stats.tx_bytes, t->stats.tx_calls,
+                  t->stats.tx_errors);
+    }
+#if (USE_KCP == 1)
+    kcp_stats_t kcp;
+    kcp_server_stats(&kcp);
+    os_printf("kcp queue:%u/%u high water:%u sent:%u drops:%u enomem:%u rate:%ukbps wnd:%u\r\n",
+              kcp.queue_depth, kcp.queue_size, kcp.queue_high_water, kcp.sent,
+              kcp.drops, kcp.enomem, kcp.pacing_rate, kcp.snd_wnd);
+    os_printf("kcp fec group:%u parity:%u recovered:%u\r\n",
+              kcp.fec_group, kcp.fec_parity, kcp.fec_recovered);
+#endif
+#if (USE_OBSERVER == 1)
+    observer_stats_t observer;
+    observer_stats(&observer);
+    os_printf("observer sessions:%u reads:%u words:%u busy:%u faults:%u delayed:%u\r\n",
+              observer.sessions, observer.reads, observer.words, observer.busy,
+              observer.faults, observer.delays);
+#endif
+#if (USE_EVENT_LOOP == 1)
+    net_loop_stats_t loop;
+    net_loop_stats(&loop);
+    os_printf("net_loop passes:%u wakes:%u timeouts:%u\r\n", loop.passes, loop.wakes, loop.timeouts);
+#endif
+#if (USE_UART_BRIDGE == 1)
+    uart_bridge_stats_t uart;
+    for (int i = 0; uart_bridge_stats(i, &uart) == 0; i++) {
+        os_printf("uart port:%u clients:%u sessions:%u behind:%u backlog:%u/%u overflow:%u oldest:%ums\r\n",
+                  uart.port, uart.clients, uart.sessions, uart.reader_drops, uart.capture.used,
+                  uart.capture.capacity, uart.capture.overflows, uart.capture.oldest_ms);
+    }
+#endif
     vTaskGetRunTimeStats(pbuffer);
     os_printf("%s", pbuffer);
     os_printf("----------------------------------------------\r\n");
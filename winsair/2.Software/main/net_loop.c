@@ -0,0 +1,158 @@
+/**
+ * @file net_loop.c
+ * @brief One task and one select() for the socket based network services
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include <string.h>
+#include <stdint.h>
+#include <sys/param.h>
+
+#include "main/net_loop.h"
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+#include <lwip/netdb.h>
+
+#if (USE_EVENT_LOOP == 1)
+
+#if (USE_EL_PIPELINE == 0)
+#error USE_EVENT_LOOP needs USE_EL_PIPELINE, elaphureLink would run the DAP commands on the loop task
+#endif
+
+static const net_service_t *kServices[NET_LOOP_SERVICES_MAX];
+static int kServiceNum = 0;
+static net_loop_stats_t kNetLoopStats;
+static TaskHandle_t kNetLoopTask = NULL;
+
+// loopback datagram socket, other tasks wake the loop by sending to it
+static int kWakeSock = -1;
+static struct sockaddr_in wake_addr = { 0 };
+
+
+static int wake_socket_create()
+{
+    socklen_t len = sizeof(wake_addr);
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0)
+        return -1;
+
+    memset(&wake_addr, 0, sizeof(wake_addr));
+    wake_addr.sin_family = AF_INET;
+    wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wake_addr.sin_port = 0;
+    if (bind(sock, (struct sockaddr *)&wake_addr, sizeof(wake_addr)) < 0 ||
+        getsockname(sock, (struct sockaddr *)&wake_addr, &len) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void wake_socket_drain()
+{
+    char dummy[4];
+    while (recv(kWakeSock, dummy, sizeof(dummy), MSG_DONTWAIT) > 0)
+    {
+    }
+}
+
+static void net_loop_task(void *argument)
+{
+    fd_set rfds;
+    struct timeval tv;
+    uint32_t timeout_ms;
+    int i, fd, maxfd, ret;
+
+    kWakeSock = wake_socket_create();
+    if (kWakeSock < 0)
+        os_printf("net_loop: unable to create wakeup socket, completions wait for the next packet\r\n");
+
+    for (;;)
+    {
+        FD_ZERO(&rfds);
+        maxfd = -1;
+        timeout_ms = NET_LOOP_FOREVER;
+        if (kWakeSock >= 0)
+        {
+            FD_SET(kWakeSock, &rfds);
+            maxfd = kWakeSock;
+        }
+        for (i = 0; i < kServiceNum; i++)
+        {
+            fd = kServices[i]->prepare(kServices[i]->ctx, &rfds, &timeout_ms);
+            maxfd = MAX(maxfd, fd);
+        }
+
+        // select() can not sleep shorter than a tick
+        if (timeout_ms != NET_LOOP_FOREVER && timeout_ms > 0)
+            timeout_ms = (timeout_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS * portTICK_PERIOD_MS;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+        ret = select(maxfd + 1, &rfds, NULL, NULL, timeout_ms == NET_LOOP_FOREVER ? NULL : &tv);
+        if (ret < 0)
+        {
+            os_printf("net_loop: select failed: errno %d\r\n", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        kNetLoopStats.passes++;
+        if (ret == 0)
+        {
+            kNetLoopStats.timeouts++;
+            FD_ZERO(&rfds);
+        }
+        else if (kWakeSock >= 0 && FD_ISSET(kWakeSock, &rfds))
+        {
+            kNetLoopStats.wakes++;
+            wake_socket_drain();
+        }
+
+        for (i = 0; i < kServiceNum; i++)
+            kServices[i]->process(kServices[i]->ctx, &rfds);
+    }
+}
+
+
+int net_loop_register(const net_service_t *service)
+{
+    if (kServiceNum >= NET_LOOP_SERVICES_MAX)
+        return -1;
+
+    kServices[kServiceNum++] = service;
+    return 0;
+}
+
+void net_loop_start()
+{
+    if (kServiceNum > 0)
+        xTaskCreate(net_loop_task, "net_loop", 4096, NULL, 14, &kNetLoopTask);
+}
+
+void net_loop_wake()
+{
+    if (kWakeSock >= 0)
+        sendto(kWakeSock, "", 1, 0, (struct sockaddr *)&wake_addr, sizeof(wake_addr));
+}
+
+int net_loop_current()
+{
+    return kNetLoopTask != NULL && xTaskGetCurrentTaskHandle() == kNetLoopTask;
+}
+
+void net_loop_stats(net_loop_stats_t *stats)
+{
+    *stats = kNetLoopStats;
+}
+
+#endif
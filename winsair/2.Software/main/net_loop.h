@@ -0,0 +1,80 @@
+/**
+ * @file net_loop.h
+ * @brief One task and one select() for the socket based network services
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * With USE_EVENT_LOOP the BSD socket transports and the observer sessions
+ * do not get a task each. They register a service instead, the loop task
+ * waits on all of their sockets at once and calls them back when something
+ * is ready. Handlers must not block: DAP requests that do not fit the queue
+ * wait in a backlog and the session socket is not read until it is empty,
+ * sends from the loop task do not wait for buffer space.
+ */
+#ifndef __NET_LOOP_H__
+#define __NET_LOOP_H__
+
+#include <stdint.h>
+
+#include "lwip/sockets.h"
+
+#define NET_LOOP_SERVICES_MAX 4
+#define NET_LOOP_FOREVER      0xFFFFFFFF
+
+typedef struct
+{
+    const char *name;
+
+    /**
+     * @brief Add the sockets to wait on to rfds, lower *timeout_ms to the
+     *        next deadline of the service
+     *
+     * @return largest socket added, -1 if none
+     */
+    int (*prepare)(void *ctx, fd_set *rfds, uint32_t *timeout_ms);
+
+    /**
+     * @brief Serve the sockets that are ready and the deadlines that passed,
+     *        called on every pass of the loop
+     *
+     */
+    void (*process)(void *ctx, fd_set *rfds);
+
+    void *ctx;
+} net_service_t;
+
+typedef struct
+{
+    uint32_t passes; // select() returns
+    uint32_t wakes;  // passes started by net_loop_wake()
+    uint32_t timeouts;
+} net_loop_stats_t;
+
+/**
+ * @brief Add a service, before net_loop_start()
+ *
+ * @return 0 on success
+ */
+int net_loop_register(const net_service_t *service);
+
+/**
+ * @brief Start the loop task
+ *
+ */
+void net_loop_start();
+
+/**
+ * @brief Make the loop run a pass soon, from any task
+ *
+ */
+void net_loop_wake();
+
+/**
+ * @brief Nonzero when called on the loop task, which must not block
+ *
+ */
+int net_loop_current();
+
+void net_loop_stats(net_loop_stats_t *stats);
+
+#endif
@@ -0,0 +1,797 @@
+/**
+ * @file observer.c
+ * @brief Read-only observer sessions next to the controlling debugger
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include <string.h>
+#include <stdint.h>
+#include <sys/param.h>
+
+#include "main/observer.h"
+#include "main/dap_tcp.h"
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/usbip_server.h"
+#include "main/net_loop.h"
+
+#include "components/DAP/include/DAP.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+#include <lwip/netdb.h>
+
+#if (USE_OBSERVER == 1)
+
+extern TaskHandle_t kDAPTaskHandle;
+
+// MEM-AP registers in bank 0, the address bits match DAP_TRANSFER_A2/A3
+#define AP_CSW 0x00
+#define AP_TAR 0x04
+#define AP_DRW 0x0C
+
+#define AP_READ(reg)  (DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | (reg))
+#define AP_WRITE(reg) (DAP_TRANSFER_APnDP | (reg))
+#define DP_WRITE(reg) (reg)
+
+#define CSW_SIZE_MASK      0x07
+#define CSW_SIZE32         0x02
+#define CSW_ADDRINC_MASK   0x30
+#define CSW_ADDRINC_SINGLE 0x10
+
+// STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR
+#define DP_ABORT_CLEAR 0x1E
+
+// TAR auto-increment is only guaranteed inside a 1 KB block
+#define TAR_AUTOINC_BLOCK 0x400
+
+#define OBSERVER_REQUEST_SIZE 7
+#define OBSERVER_RESPONSE_HEADER 3
+
+// Session steps on the event loop
+enum
+{
+    OBSERVER_IDLE,     // reading the next request
+    OBSERVER_DEFERRED, // held back by the rate limit until due
+    OBSERVER_WAITING,  // read handed to the DAP task
+};
+
+typedef struct
+{
+    volatile int sock; // -1 while the slot is free
+    TaskHandle_t task; // session task, NULL on the event loop
+    uint8_t state;
+    uint8_t command;
+    uint16_t rx_len;
+    TickType_t due;
+
+    // read handed to the DAP task, pending is cleared once it is done
+    volatile uint8_t pending;
+    uint8_t ap;
+    uint8_t count;
+    uint8_t status;
+    uint32_t addr;
+
+    // rate limit, in OBSERVER_RATE * ticks, one read costs configTICK_RATE_HZ
+    uint32_t credit;
+    TickType_t refill;
+
+    // request in, then response out
+    uint8_t frame[DAP_TCP_HEADER_SIZE + OBSERVER_RESPONSE_HEADER + 4 * OBSERVER_READ_MAX];
+} observer_t;
+
+static observer_t kObservers[OBSERVER_MAX];
+static observer_stats_t kObserverStats;
+static int observer_next = 0;
+
+// last DP SELECT written by the controller, restored after every observer read.
+// Forgotten when the controller connects, resets the line or aborts, the
+// target may not hold it any more.
+static uint32_t observer_select = 0;
+static uint8_t observer_select_valid = 0;
+
+static uint8_t observer_request[3 + 5 * (OBSERVER_READ_MAX + 5)];
+static uint8_t observer_response[3 + 4 * (OBSERVER_READ_MAX + 2)];
+
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t *put_transfer(uint8_t *p, uint8_t request, uint32_t data)
+{
+    *p++ = request;
+    if (!(request & DAP_TRANSFER_RnW))
+    {
+        *p++ = (uint8_t)(data >> 0);
+        *p++ = (uint8_t)(data >> 8);
+        *p++ = (uint8_t)(data >> 16);
+        *p++ = (uint8_t)(data >> 24);
+    }
+    return p;
+}
+
+
+/*
+ * SELECT tracking, on the DAP task
+ */
+
+// An SWJ sequence with 50 ones in a row resets the SW-DP line
+static int observer_line_reset(const uint8_t *request)
+{
+    uint32_t bits = request[1] ? request[1] : 256;
+    uint32_t i, ones = 0;
+
+    for (i = 0; i < bits; i++)
+    {
+        if (request[2 + i / 8] & (1 << (i % 8)))
+        {
+            if (++ones >= 50)
+                return 1;
+        }
+        else
+        {
+            ones = 0;
+        }
+    }
+    return 0;
+}
+
+static void observer_snoop_command(const uint8_t *request)
+{
+    const uint8_t *p;
+    uint32_t count;
+    uint8_t req;
+    int i;
+
+    switch (request[0])
+    {
+    case ID_DAP_Connect:
+    case ID_DAP_WriteABORT:
+        observer_select_valid = 0;
+        break;
+
+    case ID_DAP_SWJ_Sequence:
+        // [cmd, bit count, data...]
+        if (observer_line_reset(request))
+            observer_select_valid = 0;
+        break;
+
+    case ID_DAP_Transfer:
+        // [cmd, index, count, {request, (data)} * count]
+        p = request + 3;
+        for (i = 0; i < request[2]; i++)
+        {
+            req = *p++;
+            if (!(req & DAP_TRANSFER_RnW))
+            {
+                req &= DAP_TRANSFER_APnDP | DAP_TRANSFER_A2 | DAP_TRANSFER_A3 | DAP_TRANSFER_MATCH_MASK;
+                if (req == DP_SELECT)
+                {
+                    observer_select = get_le32(p);
+                    observer_select_valid = 1;
+                }
+                else if (req == DP_ABORT)
+                {
+                    observer_select_valid = 0;
+                }
+                p += 4;
+            }
+            else if (req & DAP_TRANSFER_MATCH_VALUE)
+            {
+                p += 4;
+            }
+        }
+        break;
+
+    case ID_DAP_TransferBlock:
+        // [cmd, index, count(2), request, (data * count)], the last write stays
+        count = request[2] | (request[3] << 8);
+        req = request[4];
+        if (count && 5 + 4 * count <= kDapPacketSize && !(req & DAP_TRANSFER_RnW))
+        {
+            req &= DAP_TRANSFER_APnDP | DAP_TRANSFER_A2 | DAP_TRANSFER_A3;
+            if (req == DP_SELECT)
+            {
+                observer_select = get_le32(request + 5 + 4 * (count - 1));
+                observer_select_valid = 1;
+            }
+            else if (req == DP_ABORT)
+            {
+                observer_select_valid = 0;
+            }
+        }
+        break;
+    }
+}
+
+void observer_snoop(const uint8_t *request)
+{
+    int i, len, pos;
+
+    if (request[0] != ID_DAP_ExecuteCommands && request[0] != ID_DAP_QueueCommands)
+    {
+        observer_snoop_command(request);
+        return;
+    }
+
+    // [cmd, number, commands...]
+    pos = 2;
+    for (i = 0; i < request[1]; i++)
+    {
+        len = el_dap_request_length(request + pos, kDapPacketSize - pos);
+        if (len <= 0)
+        {
+            // can not tell where the next command starts
+            observer_select_valid = 0;
+            return;
+        }
+        observer_snoop_command(request + pos);
+        pos += len;
+    }
+}
+
+
+/*
+ * Reads, on the DAP task
+ */
+static int observer_transfer(uint8_t count)
+{
+    observer_request[0] = ID_DAP_Transfer;
+    observer_request[1] = 0; // DAP index, JTAG only
+    observer_request[2] = count;
+
+    dap_execute_command(observer_request, observer_response);
+    return (observer_response[1] == count && observer_response[2] == DAP_TRANSFER_OK) ? 0 : -1;
+}
+
+// Clear the sticky errors of a failed read and put the AP back, best effort
+static void observer_recover(int saved, uint32_t csw, uint32_t tar, int restore)
+{
+    uint8_t *p = observer_request + 2;
+    uint8_t count = 0;
+
+    observer_request[0] = ID_DAP_WriteABORT;
+    observer_request[1] = 0;
+    p[0] = DP_ABORT_CLEAR;
+    p[1] = p[2] = p[3] = 0;
+    dap_execute_command(observer_request, observer_response);
+
+    p = observer_request + 3;
+    if (saved)
+    {
+        p = put_transfer(p, AP_WRITE(AP_CSW), csw);
+        p = put_transfer(p, AP_WRITE(AP_TAR), tar);
+        count += 2;
+    }
+    if (restore)
+    {
+        p = put_transfer(p, DP_WRITE(DP_SELECT), observer_select);
+        count++;
+    }
+    if (count)
+        observer_transfer(count);
+}
+
+static uint8_t observer_read(observer_t *o, int restore)
+{
+    uint8_t *p;
+    uint32_t csw, tar;
+    int i;
+
+    // CSW and TAR as the controller left them
+    p = observer_request + 3;
+    p = put_transfer(p, DP_WRITE(DP_SELECT), (uint32_t)o->ap << 24);
+    p = put_transfer(p, AP_READ(AP_CSW), 0);
+    p = put_transfer(p, AP_READ(AP_TAR), 0);
+    if (observer_transfer(3) < 0)
+    {
+        observer_recover(0, 0, 0, restore);
+        return OBSERVER_STATUS_FAULT;
+    }
+    csw = get_le32(observer_response + 3);
+    tar = get_le32(observer_response + 7);
+
+    // 32-bit reads with auto-increment, then put everything back
+    p = observer_request + 3;
+    p = put_transfer(p, AP_WRITE(AP_CSW), (csw & ~(CSW_SIZE_MASK | CSW_ADDRINC_MASK)) | CSW_SIZE32 | CSW_ADDRINC_SINGLE);
+    p = put_transfer(p, AP_WRITE(AP_TAR), o->addr);
+    for (i = 0; i < o->count; i++)
+        p = put_transfer(p, AP_READ(AP_DRW), 0);
+    p = put_transfer(p, AP_WRITE(AP_CSW), csw);
+    p = put_transfer(p, AP_WRITE(AP_TAR), tar);
+    if (restore)
+        p = put_transfer(p, DP_WRITE(DP_SELECT), observer_select);
+
+    if (observer_transfer(o->count + 4 + (restore ? 1 : 0)) < 0)
+    {
+        observer_recover(1, csw, tar, restore);
+        return OBSERVER_STATUS_FAULT;
+    }
+
+    memcpy(o->frame + DAP_TCP_HEADER_SIZE + OBSERVER_RESPONSE_HEADER, observer_response + 3, 4 * o->count);
+    return OBSERVER_STATUS_OK;
+}
+
+int observer_pending()
+{
+    int i;
+
+    for (i = 0; i < OBSERVER_MAX; i++)
+    {
+        if (kObservers[i].pending)
+            return 1;
+    }
+    return 0;
+}
+
+void observer_schedule()
+{
+    observer_t *o = NULL;
+    int i, controller;
+
+    for (i = 0; i < OBSERVER_MAX; i++)
+    {
+        o = &kObservers[(observer_next + i) % OBSERVER_MAX];
+        if (o->pending)
+            break;
+    }
+    if (i == OBSERVER_MAX)
+        return;
+    observer_next = (o - kObservers + 1) % OBSERVER_MAX;
+
+    controller = (kState != ACCEPTING);
+#if (USE_EL_PIPELINE == 0)
+    // elaphureLink runs its commands on the network task, not here
+    if (kState == EL_DATA_PHASE)
+        observer_select_valid = 0;
+#endif
+    if (controller && !observer_select_valid)
+    {
+        o->status = OBSERVER_STATUS_BUSY;
+        kObserverStats.busy++;
+    }
+    else
+    {
+        o->status = observer_read(o, controller);
+        if (!controller)
+            observer_select_valid = 0;
+
+        kObserverStats.reads++;
+        if (o->status == OBSERVER_STATUS_OK)
+            kObserverStats.words += o->count;
+        else
+            kObserverStats.faults++;
+    }
+
+    o->pending = 0;
+#if (USE_EVENT_LOOP == 1)
+    net_loop_wake();
+#else
+    xTaskNotifyGive(o->task);
+#endif
+}
+
+
+/*
+ * Sessions
+ */
+static void observer_rate_refill(observer_t *o)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    o->credit += (now - o->refill) * OBSERVER_RATE;
+    o->refill = now;
+    if (o->credit > OBSERVER_BURST * configTICK_RATE_HZ)
+        o->credit = OBSERVER_BURST * configTICK_RATE_HZ;
+}
+
+// Take one read from the rate limit, 0 if it was there, else the ticks to wait
+static TickType_t observer_rate_take(observer_t *o)
+{
+    const uint32_t cost = configTICK_RATE_HZ;
+
+    observer_rate_refill(o);
+    if (o->credit < cost)
+        return (cost - o->credit + OBSERVER_RATE - 1) / OBSERVER_RATE;
+
+    o->credit -= cost;
+    return 0;
+}
+
+// Check and size the read, the status if it can not be done
+static uint8_t observer_parse(observer_t *o, const uint8_t *payload, int length)
+{
+    uint32_t block_words;
+
+    if (length < OBSERVER_REQUEST_SIZE || payload[0] != OBSERVER_CMD_READ_MEMORY)
+        return OBSERVER_STATUS_ERROR;
+
+    o->ap = payload[1];
+    o->count = payload[2];
+    o->addr = get_le32(payload + 3);
+    if (o->count == 0 || o->count > OBSERVER_READ_MAX || (o->addr & 3))
+        return OBSERVER_STATUS_ERROR;
+
+    block_words = (TAR_AUTOINC_BLOCK - (o->addr & (TAR_AUTOINC_BLOCK - 1))) / 4;
+    if (o->count > block_words)
+        o->count = block_words;
+
+    return OBSERVER_STATUS_OK;
+}
+
+// Take the request in o->frame apart, OBSERVER_STATUS_OK if the DAP task has to read
+static uint8_t observer_request_begin(observer_t *o)
+{
+    uint8_t *payload = o->frame + DAP_TCP_HEADER_SIZE;
+    int length = dap_tcp_request_length(o->frame);
+
+    o->command = length > 0 ? payload[0] : ID_DAP_Invalid;
+    o->status = observer_parse(o, payload, length);
+    return o->status;
+}
+
+static void observer_submit(observer_t *o)
+{
+    o->pending = 1;
+    xTaskNotifyGive(kDAPTaskHandle);
+}
+
+// Build the response in o->frame, returns its length
+static int observer_reply(observer_t *o)
+{
+    uint8_t *payload = o->frame + DAP_TCP_HEADER_SIZE;
+    int length;
+
+    if (o->status != OBSERVER_STATUS_OK)
+        o->count = 0;
+
+    payload[0] = o->command;
+    payload[1] = o->status;
+    payload[2] = o->count;
+    length = OBSERVER_RESPONSE_HEADER + 4 * o->count;
+    dap_tcp_put_header(o->frame, length);
+
+    return DAP_TCP_HEADER_SIZE + length;
+}
+
+static void observer_open(observer_t *o, int sock)
+{
+    o->credit = OBSERVER_BURST * configTICK_RATE_HZ;
+    o->refill = xTaskGetTickCount();
+    o->rx_len = 0;
+    o->state = OBSERVER_IDLE;
+    o->sock = sock;
+    kObserverStats.sessions++;
+}
+
+static void observer_close(observer_t *o)
+{
+    os_printf("observer: session closed\r\n");
+    close(o->sock);
+    o->sock = -1;
+}
+
+static int observer_listen()
+{
+    struct sockaddr_in addr;
+    int sock;
+
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(OBSERVER_PORT);
+
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0)
+        return -1;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(sock, OBSERVER_MAX) != 0)
+    {
+        os_printf("observer: unable to listen: errno %d\r\n", errno);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Hand a new client to a free slot, NULL if all are taken
+static observer_t *observer_accept(int listen_sock)
+{
+    int sock, on = 1, i;
+
+    sock = accept(listen_sock, NULL, NULL);
+    if (sock < 0)
+        return NULL;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
+
+    for (i = 0; i < OBSERVER_MAX; i++)
+    {
+        if (kObservers[i].sock < 0)
+        {
+            observer_open(&kObservers[i], sock);
+            return &kObservers[i];
+        }
+    }
+
+    os_printf("observer: too many observers, client refused\r\n");
+    close(sock);
+    return NULL;
+}
+
+
+#if (USE_EVENT_LOOP == 1)
+/*
+ * Every observer on the event loop, the DAP task wakes it once a read is done
+ */
+static int observer_listen_sock = -1;
+
+// Read what arrived of the request, 1 once it is complete, -1 if the client is gone
+static int observer_rx(observer_t *o)
+{
+    size_t need = DAP_TCP_HEADER_SIZE;
+    int length, ret;
+
+    if (o->rx_len >= DAP_TCP_HEADER_SIZE)
+        need += dap_tcp_request_length(o->frame);
+
+    ret = recv(o->sock, o->frame + o->rx_len, need - o->rx_len, MSG_DONTWAIT);
+    if (ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN))
+        return 0;
+    if (ret <= 0)
+        return -1;
+    o->rx_len += ret;
+
+    if (o->rx_len == DAP_TCP_HEADER_SIZE)
+    {
+        length = dap_tcp_request_length(o->frame);
+        if (length < 0 || length > (int)sizeof(o->frame) - DAP_TCP_HEADER_SIZE)
+        {
+            os_printf("observer: bad packet header\r\n");
+            return -1;
+        }
+        need += length;
+    }
+
+    return o->rx_len == need ? 1 : 0;
+}
+
+static void observer_start_read(observer_t *o)
+{
+    TickType_t wait = observer_rate_take(o);
+
+    if (wait)
+    {
+        kObserverStats.delays++;
+        o->due = xTaskGetTickCount() + wait;
+        o->state = OBSERVER_DEFERRED;
+        return;
+    }
+    o->state = OBSERVER_WAITING;
+    observer_submit(o);
+}
+
+static int observer_prepare(void *ctx, fd_set *rfds, uint32_t *timeout_ms)
+{
+    TickType_t now = xTaskGetTickCount();
+    int i, maxfd = -1;
+
+    if (observer_listen_sock < 0)
+        observer_listen_sock = observer_listen();
+    if (observer_listen_sock < 0)
+    {
+        *timeout_ms = MIN(*timeout_ms, 1000);
+    }
+    else
+    {
+        FD_SET(observer_listen_sock, rfds);
+        maxfd = observer_listen_sock;
+    }
+
+    for (i = 0; i < OBSERVER_MAX; i++)
+    {
+        observer_t *o = &kObservers[i];
+        if (o->sock < 0)
+            continue;
+
+        if (o->state == OBSERVER_IDLE)
+        {
+            FD_SET(o->sock, rfds);
+            maxfd = MAX(maxfd, o->sock);
+        }
+        else if (o->state == OBSERVER_DEFERRED)
+        {
+            TickType_t left = (int32_t)(o->due - now) > 0 ? o->due - now : 0;
+            *timeout_ms = MIN(*timeout_ms, left * portTICK_PERIOD_MS);
+        }
+        // OBSERVER_WAITING: observer_schedule() wakes the loop
+    }
+
+    return maxfd;
+}
+
+static void observer_process(void *ctx, fd_set *rfds)
+{
+    int i, ret;
+
+    if (observer_listen_sock >= 0 && FD_ISSET(observer_listen_sock, rfds))
+        observer_accept(observer_listen_sock);
+
+    for (i = 0; i < OBSERVER_MAX; i++)
+    {
+        observer_t *o = &kObservers[i];
+        if (o->sock < 0)
+            continue;
+
+        switch (o->state)
+        {
+        case OBSERVER_IDLE:
+            if (!FD_ISSET(o->sock, rfds))
+                break;
+            ret = observer_rx(o);
+            if (ret < 0)
+            {
+                observer_close(o);
+                break;
+            }
+            if (ret == 0)
+                break;
+
+            o->rx_len = 0;
+            if (observer_request_begin(o) == OBSERVER_STATUS_OK)
+            {
+                observer_start_read(o);
+                break;
+            }
+            if (send(o->sock, o->frame, observer_reply(o), MSG_DONTWAIT) < 0)
+                observer_close(o);
+            break;
+
+        case OBSERVER_DEFERRED:
+            if ((int32_t)(xTaskGetTickCount() - o->due) >= 0)
+                observer_start_read(o);
+            break;
+
+        case OBSERVER_WAITING:
+            if (o->pending)
+                break;
+            o->state = OBSERVER_IDLE;
+            // the socket buffer is empty, the client waits for this reply
+            if (send(o->sock, o->frame, observer_reply(o), MSG_DONTWAIT) < 0)
+                observer_close(o);
+            break;
+        }
+    }
+}
+
+static const net_service_t observer_service = {
+    .name = "observer",
+    .prepare = observer_prepare,
+    .process = observer_process,
+};
+
+
+void observer_start()
+{
+    int i;
+
+    for (i = 0; i < OBSERVER_MAX; i++)
+        kObservers[i].sock = -1;
+    net_loop_register(&observer_service);
+}
+
+#else
+/*
+ * One task per observer
+ */
+static int observer_recv(int sock, uint8_t *buf, size_t len)
+{
+    int ret;
+
+    while (len > 0)
+    {
+        ret = recv(sock, buf, len, 0);
+        if (ret <= 0)
+            return -1;
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static void observer_session(observer_t *o)
+{
+    TickType_t wait;
+    int length;
+
+    while (observer_recv(o->sock, o->frame, DAP_TCP_HEADER_SIZE) == 0)
+    {
+        length = dap_tcp_request_length(o->frame);
+        if (length < 0 || length > (int)sizeof(o->frame) - DAP_TCP_HEADER_SIZE)
+        {
+            os_printf("observer: bad packet header\r\n");
+            return;
+        }
+        if (observer_recv(o->sock, o->frame + DAP_TCP_HEADER_SIZE, length) < 0)
+            return;
+
+        if (observer_request_begin(o) == OBSERVER_STATUS_OK)
+        {
+            if ((wait = observer_rate_take(o)) > 0)
+            {
+                kObserverStats.delays++;
+                do
+                {
+                    vTaskDelay(wait);
+                } while ((wait = observer_rate_take(o)) > 0);
+            }
+
+            observer_submit(o);
+            while (o->pending)
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+
+        if (send(o->sock, o->frame, observer_reply(o), 0) < 0)
+            return;
+    }
+}
+
+static void observer_task(void *argument)
+{
+    observer_t *o = (observer_t *)argument;
+
+    for (;;)
+    {
+        // handed a client by the listener
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (o->sock < 0)
+            continue;
+
+        observer_session(o);
+        observer_close(o);
+    }
+}
+
+static void observer_listen_task(void *argument)
+{
+    int listen_sock;
+    observer_t *o;
+
+    while ((listen_sock = observer_listen()) < 0)
+        vTaskDelay(pdMS_TO_TICKS(1000));
+
+    for (;;)
+    {
+        o = observer_accept(listen_sock);
+        if (o)
+            xTaskNotifyGive(o->task);
+    }
+}
+
+
+void observer_start()
+{
+    int i;
+
+    for (i = 0; i < OBSERVER_MAX; i++)
+    {
+        kObservers[i].sock = -1;
+        xTaskCreate(observer_task, "observer", 2048, &kObservers[i], 8, &kObservers[i].task);
+    }
+    xTaskCreate(observer_listen_task, "observer_listen", 2048, NULL, 8, NULL);
+}
+#endif
+
+void observer_stats(observer_stats_t *stats)
+{
+    *stats = kObserverStats;
+}
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * @file observer.h
+ * @brief Read-only observer sessions next to the controlling debugger
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * One session owns the DAP (see transport.h). Observers, such as a live
+ * variable monitor next to GDB, connect to OBSERVER_PORT and may only read
+ * target memory through a MEM-AP. Their reads run on the DAP task between
+ * two requests of the controller, one at a time and round robin, and leave
+ * SELECT, CSW and TAR as the controller last wrote them.
+ *
+ * Observers use the framing of dap_tcp.h. Request payload:
+ *
+ *   uint8_t  command;     OBSERVER_CMD_READ_MEMORY
+ *   uint8_t  ap;          MEM-AP index
+ *   uint8_t  count;       words, at most OBSERVER_READ_MAX
+ *   uint32_t address;     word aligned, little endian
+ *
+ * Response payload:
+ *
+ *   uint8_t  command;
+ *   uint8_t  status;      OBSERVER_STATUS_*
+ *   uint8_t  count;       words read, fewer than asked at a 1 KB boundary
+ *   uint32_t data[count];
+ */
+#ifndef __OBSERVER_H__
+#define __OBSERVER_H__
+
+#include <stdint.h>
+
+#define OBSERVER_CMD_READ_MEMORY 0x01
+
+#define OBSERVER_STATUS_OK    0x00
+#define OBSERVER_STATUS_BUSY  0x01 // the controller state is unknown, try again
+#define OBSERVER_STATUS_FAULT 0x02 // the target did not answer with OK
+#define OBSERVER_STATUS_ERROR 0xFF // malformed request
+
+// Words of one read, bounds the time the controller waits for an observer
+#define OBSERVER_READ_MAX 64
+
+typedef struct
+{
+    uint32_t sessions;
+    uint32_t reads;
+    uint32_t words;
+    uint32_t busy;   // refused while the controller state was unknown
+    uint32_t faults;
+    uint32_t delays; // reads held back by the rate limit
+} observer_stats_t;
+
+/**
+ * @brief Start the observer listener and its session tasks
+ *
+ */
+void observer_start();
+
+/**
+ * @brief Follow the DP SELECT writes of a controller request, call before
+ *        the DAP task executes it
+ *
+ */
+void observer_snoop(const uint8_t *request);
+
+/**
+ * @brief A read of some observer is waiting for the DAP task
+ *
+ */
+int observer_pending();
+
+/**
+ * @brief Run the read of the next observer in turn, if any. Called by the
+ *        DAP task between two controller requests.
+ *
+ */
+void observer_schedule();
+
+void observer_stats(observer_stats_t *stats);
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * @file rfc2217.c
+ * @brief Telnet COM port control (RFC 2217) for the UART bridge
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include <string.h>
+
+#include "main/rfc2217.h"
+
+#define TELNET_SE   240
+#define TELNET_SB   250
+#define TELNET_WILL 251
+#define TELNET_WONT 252
+#define TELNET_DO   253
+#define TELNET_DONT 254
+
+#define TELNET_OPT_BINARY   0
+#define TELNET_OPT_SGA      3
+#define TELNET_OPT_COM_PORT 44
+
+// server side commands answer with the client command + 100
+#define COM_PORT_SIGNATURE          0
+#define COM_PORT_SET_BAUDRATE       1
+#define COM_PORT_SET_DATASIZE       2
+#define COM_PORT_SET_PARITY         3
+#define COM_PORT_SET_STOPSIZE       4
+#define COM_PORT_SET_CONTROL        5
+#define COM_PORT_NOTIFY_LINESTATE   6
+#define COM_PORT_FLOWCONTROL_SUSPEND 8
+#define COM_PORT_FLOWCONTROL_RESUME  9
+#define COM_PORT_SET_LINESTATE_MASK  10
+#define COM_PORT_SET_MODEMSTATE_MASK 11
+#define COM_PORT_PURGE_DATA          12
+#define COM_PORT_SERVER              100
+
+#define COM_PORT_SIGNATURE_TEXT "esp-dap uart bridge"
+
+enum parse_state {
+    PARSE_DATA,
+    PARSE_IAC,
+    PARSE_OPTION,
+    PARSE_SB,
+    PARSE_SB_IAC,
+};
+
+// bits of rfc2217_t::options, enabled by us (local) or by the client (remote)
+#define OPTION_LOCAL(n)  (1U << (2 * (n)))
+#define OPTION_REMOTE(n) (1U << (2 * (n) + 1))
+
+static int option_index(uint8_t option)
+{
+    switch (option) {
+    case TELNET_OPT_BINARY:
+        return 0;
+    case TELNET_OPT_SGA:
+        return 1;
+    case TELNET_OPT_COM_PORT:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+static void reply_put(rfc2217_t *r, const uint8_t *data, size_t len)
+{
+    // a client that floods us with commands loses some answers
+    if (r->reply_len + len > sizeof(r->reply))
+        return;
+    memcpy(r->reply + r->reply_len, data, len);
+    r->reply_len += len;
+}
+
+static void reply_option(rfc2217_t *r, uint8_t verb, uint8_t option)
+{
+    uint8_t cmd[3] = {TELNET_IAC, verb, option};
+    reply_put(r, cmd, sizeof(cmd));
+}
+
+static size_t put_subnegotiation(uint8_t *out, uint8_t cmd, const uint8_t *data, size_t len)
+{
+    size_t n = 0;
+
+    out[n++] = TELNET_IAC;
+    out[n++] = TELNET_SB;
+    out[n++] = TELNET_OPT_COM_PORT;
+    out[n++] = cmd;
+    for (size_t i = 0; i < len; i++) {
+        out[n++] = data[i];
+        if (data[i] == TELNET_IAC)
+            out[n++] = TELNET_IAC;
+    }
+    out[n++] = TELNET_IAC;
+    out[n++] = TELNET_SE;
+    return n;
+}
+
+static void reply_subnegotiation(rfc2217_t *r, uint8_t cmd, const uint8_t *data, size_t len)
+{
+    uint8_t buf[sizeof(COM_PORT_SIGNATURE_TEXT) * 2 + 6];
+    reply_put(r, buf, put_subnegotiation(buf, COM_PORT_SERVER + cmd, data, len));
+}
+
+static void negotiate(rfc2217_t *r, uint8_t verb, uint8_t option)
+{
+    int index = option_index(option);
+    uint8_t local = index < 0 ? 0 : OPTION_LOCAL(index);
+    uint8_t remote = index < 0 ? 0 : OPTION_REMOTE(index);
+
+    // only changes are answered, so that neither side loops
+    switch (verb) {
+    case TELNET_WILL:
+        if (index < 0)
+            reply_option(r, TELNET_DONT, option);
+        else if (!(r->options & remote)) {
+            r->options |= remote;
+            reply_option(r, TELNET_DO, option);
+        }
+        break;
+    case TELNET_WONT:
+        if (r->options & remote) {
+            r->options &= ~remote;
+            reply_option(r, TELNET_DONT, option);
+        }
+        break;
+    case TELNET_DO:
+        if (index < 0)
+            reply_option(r, TELNET_WONT, option);
+        else if (!(r->options & local)) {
+            r->options |= local;
+            reply_option(r, TELNET_WILL, option);
+        }
+        break;
+    case TELNET_DONT:
+        if (r->options & local) {
+            r->options &= ~local;
+            reply_option(r, TELNET_WONT, option);
+        }
+        break;
+    }
+
+    index = option_index(TELNET_OPT_COM_PORT);
+    r->com_port = (r->options & (OPTION_LOCAL(index) | OPTION_REMOTE(index))) != 0;
+}
+
+static void com_port_command(rfc2217_t *r)
+{
+    const rfc2217_port_t *port = r->port;
+    const uint8_t *data = r->sb + 2;
+    size_t len = r->sb_len - 2;
+    uint8_t cmd = r->sb[1];
+    uint8_t value[4];
+    uint32_t baudrate;
+
+    if (!r->com_port)
+        return;
+
+    switch (cmd) {
+    case COM_PORT_SIGNATURE:
+        if (len == 0) // the client asks for ours
+            reply_subnegotiation(r, cmd, (const uint8_t *)COM_PORT_SIGNATURE_TEXT,
+                                 sizeof(COM_PORT_SIGNATURE_TEXT) - 1);
+        break;
+    case COM_PORT_SET_BAUDRATE:
+        if (len < 4)
+            break;
+        baudrate = (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+        baudrate = port->set_baudrate(port->ctx, baudrate);
+        value[0] = baudrate >> 24;
+        value[1] = baudrate >> 16;
+        value[2] = baudrate >> 8;
+        value[3] = baudrate;
+        reply_subnegotiation(r, cmd, value, 4);
+        break;
+    case COM_PORT_SET_DATASIZE:
+    case COM_PORT_SET_PARITY:
+    case COM_PORT_SET_STOPSIZE:
+    case COM_PORT_SET_CONTROL:
+        if (len < 1)
+            break;
+        if (cmd == COM_PORT_SET_DATASIZE)
+            value[0] = port->set_datasize(port->ctx, data[0]);
+        else if (cmd == COM_PORT_SET_PARITY)
+            value[0] = port->set_parity(port->ctx, data[0]);
+        else if (cmd == COM_PORT_SET_STOPSIZE)
+            value[0] = port->set_stopsize(port->ctx, data[0]);
+        else
+            value[0] = port->set_control(port->ctx, data[0]);
+        reply_subnegotiation(r, cmd, value, 1);
+        break;
+    case COM_PORT_FLOWCONTROL_SUSPEND:
+        r->suspended = 1;
+        break;
+    case COM_PORT_FLOWCONTROL_RESUME:
+        r->suspended = 0;
+        break;
+    case COM_PORT_SET_LINESTATE_MASK:
+    case COM_PORT_SET_MODEMSTATE_MASK:
+        if (len < 1)
+            break;
+        if (cmd == COM_PORT_SET_LINESTATE_MASK)
+            r->linestate_mask = data[0];
+        else
+            r->modemstate_mask = data[0];
+        reply_subnegotiation(r, cmd, data, 1);
+        break;
+    case COM_PORT_PURGE_DATA:
+        if (len < 1)
+            break;
+        port->purge(port->ctx, data[0]);
+        reply_subnegotiation(r, cmd, data, 1);
+        break;
+    default:
+        break;
+    }
+}
+
+static void subnegotiation_end(rfc2217_t *r)
+{
+    if (r->sb_len >= 2 && r->sb[0] == TELNET_OPT_COM_PORT)
+        com_port_command(r);
+}
+
+static void subnegotiation_put(rfc2217_t *r, uint8_t c)
+{
+    // longer ones are none of ours, they are dropped when they end
+    if (r->sb_len < sizeof(r->sb))
+        r->sb[r->sb_len++] = c;
+    else
+        r->sb[0] = 0;
+}
+
+void rfc2217_init(rfc2217_t *r, const rfc2217_port_t *port)
+{
+    memset(r, 0, sizeof(*r));
+    r->port = port;
+    r->state = PARSE_DATA;
+    r->modemstate_mask = 0xFF; // the RFC 2217 defaults
+    r->linestate_mask = 0;
+}
+
+size_t rfc2217_input(rfc2217_t *r, uint8_t *buf, size_t len)
+{
+    size_t i, n = 0;
+    uint8_t c;
+
+    if (len == 0)
+        return 0;
+    if (!r->started) {
+        r->started = 1;
+        r->telnet = buf[0] == TELNET_IAC;
+    }
+    if (!r->telnet)
+        return len;
+
+    // commands are removed in place, data only moves towards the start
+    for (i = 0; i < len; i++) {
+        c = buf[i];
+        switch (r->state) {
+        case PARSE_DATA:
+            if (c == TELNET_IAC)
+                r->state = PARSE_IAC;
+            else
+                buf[n++] = c;
+            break;
+        case PARSE_IAC:
+            if (c == TELNET_IAC) {
+                buf[n++] = c;
+                r->state = PARSE_DATA;
+            } else if (c >= TELNET_WILL) {
+                r->verb = c;
+                r->state = PARSE_OPTION;
+            } else if (c == TELNET_SB) {
+                r->sb_len = 0;
+                r->state = PARSE_SB;
+            } else {
+                r->state = PARSE_DATA; // NOP, GA and friends
+            }
+            break;
+        case PARSE_OPTION:
+            negotiate(r, r->verb, c);
+            r->state = PARSE_DATA;
+            break;
+        case PARSE_SB:
+            if (c == TELNET_IAC)
+                r->state = PARSE_SB_IAC;
+            else
+                subnegotiation_put(r, c);
+            break;
+        case PARSE_SB_IAC:
+            if (c == TELNET_IAC) {
+                subnegotiation_put(r, c);
+                r->state = PARSE_SB;
+            } else {
+                if (c == TELNET_SE)
+                    subnegotiation_end(r);
+                r->state = PARSE_DATA;
+            }
+            break;
+        }
+    }
+    return n;
+}
+
+size_t rfc2217_escape(const rfc2217_t *r, const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t n = 0;
+
+    if (!r->telnet) {
+        memcpy(out, in, len);
+        return len;
+    }
+    for (size_t i = 0; i < len; i++) {
+        out[n++] = in[i];
+        if (in[i] == TELNET_IAC)
+            out[n++] = TELNET_IAC;
+    }
+    return n;
+}
+
+size_t rfc2217_linestate(const rfc2217_t *r, uint8_t state, uint8_t *out)
+{
+    state &= r->linestate_mask;
+    if (!r->com_port || state == 0)
+        return 0;
+    return put_subnegotiation(out, COM_PORT_SERVER + COM_PORT_NOTIFY_LINESTATE, &state, 1);
+}
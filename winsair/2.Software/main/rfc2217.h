@@ -0,0 +1,127 @@
+/**
+ * @file rfc2217.h
+ * @brief Telnet COM port control (RFC 2217) for the UART bridge
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * A client that opens the bridge with a Telnet command (for example
+ * pyserial's rfc2217:// URL) may change baud rate, data size, parity,
+ * stop bits, flow control and the RTS/DTR lines at any time, and is told
+ * about line errors. Data bytes of value 0xFF are doubled in both
+ * directions for such a client. Any other client gets the raw byte stream.
+ *
+ * This file does not depend on FreeRTOS or lwIP, the host tools link it too.
+ */
+#ifndef __RFC2217_H__
+#define __RFC2217_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELNET_IAC 0xFF
+
+// SET-PARITY values
+#define RFC2217_PARITY_NONE  1
+#define RFC2217_PARITY_ODD   2
+#define RFC2217_PARITY_EVEN  3
+#define RFC2217_PARITY_MARK  4
+#define RFC2217_PARITY_SPACE 5
+
+// SET-STOPSIZE values
+#define RFC2217_STOPSIZE_1   1
+#define RFC2217_STOPSIZE_2   2
+#define RFC2217_STOPSIZE_1_5 3
+
+// SET-CONTROL values
+#define RFC2217_CONTROL_FLOW_REQUEST  0
+#define RFC2217_CONTROL_FLOW_NONE     1
+#define RFC2217_CONTROL_FLOW_XONXOFF  2
+#define RFC2217_CONTROL_FLOW_HARDWARE 3
+#define RFC2217_CONTROL_BREAK_REQUEST 4
+#define RFC2217_CONTROL_BREAK_ON      5
+#define RFC2217_CONTROL_BREAK_OFF     6
+#define RFC2217_CONTROL_DTR_REQUEST   7
+#define RFC2217_CONTROL_DTR_ON        8
+#define RFC2217_CONTROL_DTR_OFF       9
+#define RFC2217_CONTROL_RTS_REQUEST   10
+#define RFC2217_CONTROL_RTS_ON        11
+#define RFC2217_CONTROL_RTS_OFF       12
+
+// NOTIFY-LINESTATE bits
+#define RFC2217_LINESTATE_OVERRUN 0x02
+#define RFC2217_LINESTATE_PARITY  0x04
+#define RFC2217_LINESTATE_FRAMING 0x08
+#define RFC2217_LINESTATE_BREAK   0x10
+
+// PURGE-DATA values
+#define RFC2217_PURGE_RX   1
+#define RFC2217_PURGE_TX   2
+#define RFC2217_PURGE_BOTH 3
+
+// Replies queued by one rfc2217_input() call
+#define RFC2217_REPLY_MAX 128
+
+/**
+ * Serial port operations. Every call returns the setting now in effect,
+ * which is what the client is told; a value of 0 asks for the current one.
+ */
+typedef struct
+{
+    uint32_t (*set_baudrate)(void *ctx, uint32_t baudrate);
+    uint8_t (*set_datasize)(void *ctx, uint8_t bits);
+    uint8_t (*set_parity)(void *ctx, uint8_t parity);
+    uint8_t (*set_stopsize)(void *ctx, uint8_t stopsize);
+    uint8_t (*set_control)(void *ctx, uint8_t control);
+    void (*purge)(void *ctx, uint8_t which);
+    void *ctx;
+} rfc2217_port_t;
+
+typedef struct
+{
+    const rfc2217_port_t *port;
+    int started;         // the first byte was seen
+    int telnet;          // the client speaks Telnet, IAC is escaped
+    int com_port;        // COM-PORT-OPTION was agreed on
+    int suspended;       // the client asked us to stop sending
+    uint8_t options;     // agreed options, see rfc2217.c
+    uint8_t linestate_mask;
+    uint8_t modemstate_mask;
+
+    uint8_t state;       // Telnet parser
+    uint8_t verb;
+    uint8_t sb[16];      // subnegotiation being received
+    uint8_t sb_len;
+
+    uint8_t reply[RFC2217_REPLY_MAX];
+    size_t reply_len;
+} rfc2217_t;
+
+void rfc2217_init(rfc2217_t *r, const rfc2217_port_t *port);
+
+/**
+ * @brief Take the bytes a client sent
+ *
+ * The first byte of a session decides whether the client speaks Telnet.
+ * Commands are carried out and removed, answers are left in reply.
+ *
+ * @return data bytes left in buf, to be written to the UART
+ */
+size_t rfc2217_input(rfc2217_t *r, uint8_t *buf, size_t len);
+
+/**
+ * @brief Prepare UART bytes for the client
+ *
+ * @param out room for 2 * len bytes
+ * @return bytes in out
+ */
+size_t rfc2217_escape(const rfc2217_t *r, const uint8_t *in, size_t len, uint8_t *out);
+
+/**
+ * @brief Report line errors, if the client asked for them
+ *
+ * @param out room for 8 bytes
+ * @return bytes in out, 0 if there is nothing to send
+ */
+size_t rfc2217_linestate(const rfc2217_t *r, uint8_t state, uint8_t *out);
+
+#endif
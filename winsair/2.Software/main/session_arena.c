@@ -0,0 +1,117 @@
+/**
+ * @file session_arena.c
+ * @brief Per-connection buffers carved from one block reserved at boot
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Allocating and freeing the connection buffers on every reconnect slowly
+ * fragments the heap. The arena is allocated once and handed out by bumping
+ * an offset, so a disconnect is a single store and the heap never changes
+ * after boot.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "sdkconfig.h"
+#include "main/session_arena.h"
+#include "main/wifi_configuration.h"
+
+#include "esp_system.h"
+#ifndef CONFIG_IDF_TARGET_ESP8266
+#include "esp_heap_caps.h"
+#endif
+
+#define ARENA_ROUND(x) (((x) + SESSION_ARENA_ALIGN - 1) & ~(SESSION_ARENA_ALIGN - 1))
+
+static uint8_t *arena_base = NULL;
+static size_t arena_size = 0;
+static size_t arena_top = 0;  // next free byte
+static size_t arena_keep = 0; // start of the per-session part
+
+static uint32_t arena_high_water = 0;
+static uint32_t arena_resets = 0;
+static uint32_t arena_failures = 0;
+
+
+int session_arena_init(size_t size)
+{
+    void *block;
+
+    if (arena_base != NULL)
+        return 0;
+
+    size = ARENA_ROUND(size);
+    block = malloc(size + SESSION_ARENA_ALIGN);
+    if (block == NULL)
+    {
+        os_printf("Can not allocate session arena of %u bytes!\r\n", (uint32_t)size);
+        return -1;
+    }
+
+    // never freed, so the unaligned pointer need not be kept
+    arena_base = (uint8_t *)ARENA_ROUND((uintptr_t)block);
+    arena_size = size;
+    arena_top = arena_keep = 0;
+
+    os_printf("Session arena: %u bytes\r\n", (uint32_t)size);
+    return 0;
+}
+
+
+void *session_arena_alloc(size_t size)
+{
+    void *ptr;
+
+    size = ARENA_ROUND(size);
+    if (arena_base == NULL || size > arena_size - arena_top)
+    {
+        arena_failures++;
+        return NULL;
+    }
+
+    ptr = arena_base + arena_top;
+    arena_top += size;
+    if (arena_top > arena_high_water)
+        arena_high_water = arena_top;
+
+    return ptr;
+}
+
+
+void session_arena_keep()
+{
+    arena_keep = arena_top;
+}
+
+
+void session_arena_reset()
+{
+    arena_top = arena_keep;
+    arena_resets++;
+}
+
+
+void session_arena_stats(session_arena_stats_t *stats)
+{
+    stats->size = arena_size;
+    stats->used = arena_top;
+    stats->high_water = arena_high_water;
+    stats->resets = arena_resets;
+    stats->failures = arena_failures;
+
+    stats->heap_free = esp_get_free_heap_size();
+    stats->heap_min_free = esp_get_minimum_free_heap_size();
+#ifndef CONFIG_IDF_TARGET_ESP8266
+    stats->heap_largest_free = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#else
+    stats->heap_largest_free = 0;
+#endif
+
+    if (stats->heap_free && stats->heap_largest_free)
+        stats->heap_fragmentation = 100 - (uint32_t)((uint64_t)stats->heap_largest_free * 100 / stats->heap_free);
+    else
+        stats->heap_fragmentation = 0;
+}
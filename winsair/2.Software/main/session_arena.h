@@ -0,0 +1,59 @@
+/**
+ * @file session_arena.h
+ * @brief Per-connection buffers carved from one block reserved at boot
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#ifndef __SESSION_ARENA_H__
+#define __SESSION_ARENA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Every block is aligned to a cache line
+#define SESSION_ARENA_ALIGN 32
+
+typedef struct
+{
+    uint32_t size;       // bytes reserved at boot
+    uint32_t used;       // bytes carved right now
+    uint32_t high_water; // most bytes ever carved
+    uint32_t resets;     // sessions torn down
+    uint32_t failures;   // requests that did not fit
+
+    uint32_t heap_free;
+    uint32_t heap_min_free;      // low-water mark of the free heap since boot
+    uint32_t heap_largest_free;  // largest free block, 0 if the target can not tell
+    uint32_t heap_fragmentation; // percent of the free heap outside the largest block
+} session_arena_stats_t;
+
+/**
+ * @brief Reserve the arena. Call once at boot, before any session starts.
+ *
+ * @param size bytes needed by every buffer that may be carved at the same time
+ * @return 0 on success
+ */
+int session_arena_init(size_t size);
+
+/**
+ * @brief Carve a block out of the arena, NULL if it does not fit
+ *
+ */
+void *session_arena_alloc(size_t size);
+
+/**
+ * @brief Everything carved so far lives for the whole uptime and survives resets
+ *
+ */
+void session_arena_keep();
+
+/**
+ * @brief Drop every block carved since session_arena_keep(), in O(1)
+ *
+ */
+void session_arena_reset();
+
+void session_arena_stats(session_arena_stats_t *stats);
+
+#endif
@@ -15,16 +15,22 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <sys/param.h>
 
 #include "main/wifi_configuration.h"
-#include "main/usbip_server.h"
-#include "main/tcp_netconn.h"
+
+#if (USE_TCP_NETCONN == 1)
+
+#include "main/transport.h"
+#include "main/dap_configuration.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
@@ -37,11 +43,16 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #include "lwip/netbuf.h"
 #include "lwip/api.h"
 #include "lwip/tcp.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "lwip/priv/tcp_priv.h"
 #include <lwip/netdb.h>
 
-#define PORT 3240
 #define EVENTS_QUEUE_SIZE 50
 
+// Zero-copy transmit buffers, each holds one coalesced batch of responses
+#define TX_BUFFER_NUM  4
+#define TX_BUFFER_SIZE (EL_PROCESS_BUFFER_SIZE + DAP_PACKET_SIZE)
+
 #ifdef CALLBACK_DEBUG
 #define debug(s, ...) os_printf("%s: " s "\n", "Cb:", ##__VA_ARGS__)
 #else
@@ -55,15 +66,260 @@ typedef struct
     uint8_t type;
 } netconn_events;
 
-extern TaskHandle_t kDAPTaskHandle;
-extern int kRestartDAPHandle;
-extern uint8_t kState;
-
 struct netconn *kNetconn = NULL;
+static struct netconn *listen_nc = NULL;
+
+enum tx_buffer_state_t
+{
+    TX_BUFFER_FREE,
+    TX_BUFFER_FILLING, // the writer owns it
+    TX_BUFFER_SENT,    // lwIP owns it until the data is acked or the pcb is gone
+};
+
+typedef struct
+{
+    uint8_t *data;
+    volatile uint8_t state; // FREE <-> FILLING on the writer, SENT -> FREE on the tcpip thread
+    struct tcp_pcb *pcb;    // the pcb that holds it while SENT
+    uint32_t seq_end;       // sequence number after its last byte
+} tx_buffer_t;
+
+static tx_buffer_t tx_buffer_pool[TX_BUFFER_NUM];
+static tx_buffer_t *tx_buffer_filling = NULL;
+// Serializes writes against the connection being torn down
+static SemaphoreHandle_t tx_mux = NULL;
+// sent callback of the netconn, called on after the buffers are released
+static tcp_sent_fn tx_netconn_sent = NULL;
+// pcb of the connection and its ports, the netconn forgets it when it is aborted
+static struct tcp_pcb *tx_netconn_pcb = NULL;
+static u16_t tx_netconn_local_port;
+static u16_t tx_netconn_remote_port;
 
-int tcp_netconn_send(const void *buffer, size_t len)
+static void tx_buffer_pool_init()
 {
-    return netconn_write(kNetconn, buffer, len, NETCONN_COPY);
+    int i;
+    tx_mux = xSemaphoreCreateMutex();
+
+    // One allocation for the lifetime of the server
+    uint8_t *data = malloc(TX_BUFFER_NUM * TX_BUFFER_SIZE);
+    if (data == NULL)
+    {
+        os_printf("Can not allocate zero-copy buffers, fall back to copying.\r\n");
+        return;
+    }
+
+    for (i = 0; i < TX_BUFFER_NUM; i++)
+    {
+        tx_buffer_pool[i].data = data + i * TX_BUFFER_SIZE;
+        tx_buffer_pool[i].state = TX_BUFFER_FREE;
+    }
+}
+
+/*
+ * The pcb belongs to the tcpip thread, everything below that touches it or
+ * releases a SENT buffer runs there.
+ */
+typedef struct
+{
+    struct tcpip_api_call_data call;
+    struct netconn *nc;
+    tx_buffer_t *tx;
+} tx_pcb_call_t;
+
+// Give back the buffers of pcb the peer has acked, or all of them
+static void tx_buffer_release(struct tcp_pcb *pcb, int all)
+{
+    int i;
+
+    for (i = 0; i < TX_BUFFER_NUM; i++)
+    {
+        tx_buffer_t *tx = &tx_buffer_pool[i];
+        if (tx->state != TX_BUFFER_SENT || tx->pcb != pcb)
+            continue;
+        // lwIP frees the acked segments before it reports them sent
+        if (all || (int32_t)(pcb->lastack - tx->seq_end) >= 0)
+            tx->state = TX_BUFFER_FREE;
+    }
+}
+
+static err_t tx_buffer_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+    tx_buffer_release(pcb, 0);
+    return tx_netconn_sent ? tx_netconn_sent(arg, pcb, len) : ERR_OK;
+}
+
+// The netconn is gone, the pcb still sends what was left
+static err_t tx_buffer_closed_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+    tx_buffer_release(pcb, 0);
+    return ERR_OK;
+}
+
+// The pcb was aborted or freed, arg is what it was
+static void tx_buffer_closed_err(void *arg, err_t err)
+{
+    tx_buffer_release((struct tcp_pcb *)arg, 1);
+}
+
+// Hook the sent callback of a new connection
+static err_t tx_buffer_do_attach(struct tcpip_api_call_data *call)
+{
+    struct tcp_pcb *pcb = ((tx_pcb_call_t *)call)->nc->pcb.tcp;
+
+    tx_netconn_pcb = pcb;
+    if (pcb)
+    {
+        tx_netconn_local_port = pcb->local_port;
+        tx_netconn_remote_port = pcb->remote_port;
+        if (pcb->sent != tx_buffer_sent)
+        {
+            tx_netconn_sent = pcb->sent;
+            tcp_sent(pcb, tx_buffer_sent);
+        }
+    }
+    return ERR_OK;
+}
+
+// A buffer was written, it is held until the byte before snd_lbb is acked
+static err_t tx_buffer_do_queued(struct tcpip_api_call_data *call)
+{
+    tx_pcb_call_t *c = (tx_pcb_call_t *)call;
+    struct tcp_pcb *pcb = c->nc->pcb.tcp;
+
+    if (pcb == NULL)
+    {
+        // aborted, lwIP has already freed its segments
+        c->tx->state = TX_BUFFER_FREE;
+        return ERR_OK;
+    }
+    c->tx->pcb = pcb;
+    c->tx->seq_end = pcb->snd_lbb;
+    c->tx->state = TX_BUFFER_SENT;
+    // the ACK may be in already
+    tx_buffer_release(pcb, 0);
+    return ERR_OK;
+}
+
+/*
+ * After netconn_close(), the pcb may still be sending from the buffers. If it
+ * is, keep them until it is acked or the pcb is aborted. Otherwise lwIP has
+ * freed the pcb and its segments, and the buffers are free.
+ */
+static err_t tx_buffer_do_closed(struct tcpip_api_call_data *call)
+{
+    struct tcp_pcb *pcb;
+
+    if (tx_netconn_pcb == NULL)
+        return ERR_OK;
+
+    for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next)
+    {
+        if (pcb == tx_netconn_pcb)
+            break;
+    }
+    // the same pcb, not a new connection in its memory
+    if (pcb && pcb->local_port == tx_netconn_local_port && pcb->remote_port == tx_netconn_remote_port &&
+        (pcb->state == FIN_WAIT_1 || pcb->state == CLOSING || pcb->state == LAST_ACK))
+    {
+        tcp_arg(pcb, pcb);
+        tcp_sent(pcb, tx_buffer_closed_sent);
+        tcp_err(pcb, tx_buffer_closed_err);
+        tx_buffer_release(pcb, 0);
+    }
+    else
+    {
+        tx_buffer_release(tx_netconn_pcb, 1);
+    }
+    tx_netconn_pcb = NULL;
+    return ERR_OK;
+}
+
+static void tx_pcb_call(tcpip_api_call_fn fn, struct netconn *nc, tx_pcb_call_t *c)
+{
+    c->nc = nc;
+    tcpip_api_call(fn, &c->call);
+}
+
+static int tcp_netconn_sendv(transport_t *t, const transport_iov_t *iov, int iovcnt)
+{
+    struct netvector vec[TRANSPORT_IOV_MAX];
+    size_t written;
+    int i, ret = ERR_CONN;
+
+    if (iovcnt > TRANSPORT_IOV_MAX)
+        return ERR_ARG;
+    for (i = 0; i < iovcnt; i++)
+    {
+        vec[i].ptr = iov[i].ptr;
+        vec[i].len = iov[i].len;
+    }
+
+    xSemaphoreTake(tx_mux, portMAX_DELAY);
+    if (kNetconn)
+        ret = netconn_write_vectors_partly(kNetconn, vec, iovcnt, NETCONN_COPY, &written);
+    xSemaphoreGive(tx_mux);
+
+    return ret;
+}
+
+/*
+ * The buffer to write the next batch of responses into. It has room for
+ * EL_PROCESS_BUFFER_SIZE + DAP_PACKET_SIZE bytes, and the same buffer is
+ * returned until it is sent. NULL when every buffer is waiting for its ACK.
+ */
+static uint8_t *tcp_netconn_tx_buffer_get(transport_t *t)
+{
+    int i;
+
+    if (tx_buffer_filling)
+        return tx_buffer_filling->data;
+
+    xSemaphoreTake(tx_mux, portMAX_DELAY);
+    if (kNetconn)
+    {
+        // released on the tcpip thread as the ACKs come in
+        for (i = 0; i < TX_BUFFER_NUM; i++)
+        {
+            if (tx_buffer_pool[i].data && tx_buffer_pool[i].state == TX_BUFFER_FREE)
+            {
+                tx_buffer_pool[i].state = TX_BUFFER_FILLING;
+                tx_buffer_filling = &tx_buffer_pool[i];
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(tx_mux);
+
+    return tx_buffer_filling ? tx_buffer_filling->data : NULL;
+}
+
+/*
+ * Send the first len bytes of the buffer from tcp_netconn_tx_buffer_get()
+ * without copying it. It goes back to the pool once the peer acks it.
+ */
+static int tcp_netconn_tx_buffer_send(transport_t *t, size_t len)
+{
+    int ret = ERR_CONN;
+    tx_buffer_t *tx;
+    tx_pcb_call_t call;
+
+    xSemaphoreTake(tx_mux, portMAX_DELAY);
+    tx = tx_buffer_filling;
+    tx_buffer_filling = NULL;
+    if (tx && kNetconn)
+    {
+        // lwIP references the buffer until the data is acked
+        ret = netconn_write(kNetconn, tx->data, len, NETCONN_NOCOPY);
+        call.tx = tx;
+        tx_pcb_call(tx_buffer_do_queued, kNetconn, &call);
+    }
+    else if (tx)
+    {
+        tx->state = TX_BUFFER_FREE;
+    }
+    xSemaphoreGive(tx_mux);
+
+    return ret;
 }
 
 /*
@@ -125,88 +381,154 @@ static void set_tcp_server_netconn(struct netconn **nc, uint16_t port, netconn_c
  */
 static void close_tcp_netconn(struct netconn *nc)
 {
+    tx_pcb_call_t call;
+    int session = 0;
+
+    xSemaphoreTake(tx_mux, portMAX_DELAY);
+    if (nc == kNetconn)
+    {
+        if (tx_buffer_filling)
+        {
+            tx_buffer_filling->state = TX_BUFFER_FREE;
+            tx_buffer_filling = NULL;
+        }
+        kNetconn = NULL;
+        session = 1;
+    }
+    xSemaphoreGive(tx_mux);
+
     nc->pending_err = ERR_CLSD; // It is hacky way to be sure than callback will don't do treatment on a netconn closed and deleted
     netconn_close(nc);
+    // the buffers stay with the pcb until it is acked, aborted or freed
+    if (session)
+        tx_pcb_call(tx_buffer_do_closed, NULL, &call);
     netconn_delete(nc);
 }
 
-void tcp_netconn_task()
+/*
+ *  Accept the client waiting on the server netconn, NULL if it went away
+ */
+static struct netconn *accept_tcp_netconn(struct netconn *server)
 {
-    xQueue_events = xQueueCreate(EVENTS_QUEUE_SIZE, sizeof(netconn_events));
-    struct netconn *nc = NULL; // To create servers
+    struct netconn *nc_in = NULL;
 
-    set_tcp_server_netconn(&nc, PORT, netCallback);
-    os_printf("Server netconn %u ready on port %u.\n", (uint32_t)nc, PORT);
+    os_printf("Client incoming on server %u.\n", (uint32_t)server);
+    int err = netconn_accept(server, &nc_in);
+    if (err != ERR_OK)
+    {
+        if (nc_in)
+            netconn_delete(nc_in);
+        return NULL;
+    }
+    os_printf("New client is %u.\n", (uint32_t)nc_in);
+    // tcp_nagle_disable(events.nc->pcb.tcp); // crash! DO NOT USE
+    return nc_in;
+}
 
-    struct netbuf *netbuf = NULL; // To store incoming Data
-    struct netconn *nc_in = NULL; // To accept incoming netconn
-    //
-    char *buffer;
-    uint16_t len_buf;
+static int tcp_netconn_accept(transport_t *t)
+{
+    netconn_events events;
+    struct netconn *nc_in;
+    tx_pcb_call_t call;
+
+    if (listen_nc == NULL)
+    {
+        xQueue_events = xQueueCreate(EVENTS_QUEUE_SIZE, sizeof(netconn_events));
+        tx_buffer_pool_init();
+        set_tcp_server_netconn(&listen_nc, NETCONN_PORT, netCallback);
+        if (listen_nc == NULL)
+            return -1;
+        os_printf("Server netconn %u ready on port %u.\n", (uint32_t)listen_nc, NETCONN_PORT);
+    }
 
     while (1)
     {
-        netconn_events events;
         xQueueReceive(xQueue_events, &events, portMAX_DELAY); // Wait here an event on netconn
 
-        if (events.nc->state == NETCONN_LISTEN) // If netconn is a server and receive incoming event on it
+        // left over from a client that is closed already
+        if (events.nc->state != NETCONN_LISTEN)
+            continue;
+
+        nc_in = accept_tcp_netconn(events.nc);
+        if (nc_in == NULL)
+            continue;
+
+        xSemaphoreTake(tx_mux, portMAX_DELAY);
+        kNetconn = nc_in;
+        tx_pcb_call(tx_buffer_do_attach, nc_in, &call);
+        xSemaphoreGive(tx_mux);
+        return 0;
+    }
+}
+
+static int tcp_netconn_recv_batch(transport_t *t, transport_input_t input)
+{
+    netconn_events events;
+    struct netbuf *netbuf = NULL; // To store incoming Data
+    char *buffer;
+    uint16_t len_buf;
+    int total = 0;
+
+    xQueueReceive(xQueue_events, &events, portMAX_DELAY); // Wait here an event on netconn
+
+    if (events.nc->state == NETCONN_LISTEN)
+    {
+        // only one client at a time
+        struct netconn *nc_in = accept_tcp_netconn(events.nc);
+        if (nc_in)
         {
-            os_printf("Client incoming on server %u.\n", (uint32_t)events.nc);
-            int err = netconn_accept(events.nc, &nc_in);
-            if (err != ERR_OK)
-            {
-                if (nc_in)
-                    netconn_delete(nc_in);
-            }
-            os_printf("New client is %u.\n", (uint32_t)nc_in);
-            ip_addr_t client_addr; // Address port
-            uint16_t client_port;  // Client port
-            netconn_peer(nc_in, &client_addr, &client_port);
-            // tcp_nagle_disable(events.nc->pcb.tcp); // crash! DO NOT USE
+            os_printf("Client %u refused, a session is running.\n", (uint32_t)nc_in);
+            t->stats.rejected++;
+            close_tcp_netconn(nc_in);
         }
-        else if (events.nc->state != NETCONN_LISTEN) // If netconn is the client and receive data
+        return 0;
+    }
+    if (events.nc != kNetconn)
+        return 0;
+
+    // tcp_nagle_disable(events.nc->pcb.tcp);
+    int err = netconn_recv(events.nc, &netbuf);
+    if (err == ERR_WOULDBLOCK)
+        return 0;
+    if (err != ERR_OK) // closed or reset
+        return -1;
+
+    // every pbuf of the chain in one batch
+    do
+    {
+        netbuf_data(netbuf, (void *)&buffer, &len_buf);
+        if (input(t, (uint8_t *)buffer, len_buf) < 0)
         {
-            // tcp_nagle_disable(events.nc->pcb.tcp);
-            if ((netconn_recv(events.nc, &netbuf)) == ERR_OK) // data incoming ?
-            {
-                do
-                {
-                    netbuf_data(netbuf, (void *)&buffer, &len_buf);
-                    kNetconn = events.nc;
-                    switch (kState)
-                    {
-                    case ACCEPTING:
-                        kState = ATTACHING;
-
-                    case ATTACHING:
-                        attach((uint8_t *)buffer, len_buf);
-                        kState = EMULATING;
-                        break;
-
-                    case EMULATING:
-                        emulate((uint8_t *)buffer, len_buf);
-                        break;
-                    default:
-                        os_printf("unkonw kstate!\r\n");
-                    }
-                } while (netbuf_next(netbuf) >= 0);
-                netbuf_delete(netbuf);
-            }
-            else
-            {
-                if (events.nc->pending_err == ERR_CLSD)
-                {
-                    continue; // The same hacky way to treat a closed connection
-                }
-                os_printf("Shutting down socket and restarting...\r\n");
-                close_tcp_netconn(events.nc);
-                if (kState == EMULATING)
-                    kState = ACCEPTING;
-                // Restart DAP Handle
-                kRestartDAPHandle = 1;
-                if (kDAPTaskHandle)
-                    xTaskNotifyGive(kDAPTaskHandle);
-            }
+            total = -1;
+            break;
         }
-    }
-}
\ No newline at end of file
+        total += len_buf;
+    } while (netbuf_next(netbuf) >= 0);
+    netbuf_delete(netbuf);
+
+    return total;
+}
+
+static void tcp_netconn_close(transport_t *t)
+{
+    if (kNetconn)
+        close_tcp_netconn(kNetconn);
+}
+
+static const transport_ops_t tcp_netconn_ops = {
+    .accept = tcp_netconn_accept,
+    .recv_batch = tcp_netconn_recv_batch,
+    .sendv = tcp_netconn_sendv,
+    .close = tcp_netconn_close,
+    .tx_buffer_get = tcp_netconn_tx_buffer_get,
+    .tx_buffer_send = tcp_netconn_tx_buffer_send,
+};
+
+transport_t kTcpNetconnTransport = {
+    .name = "tcp_netconn",
+    .id = TRANSPORT_TCP_NETCONN,
+    .ops = &tcp_netconn_ops,
+    .enabled = 1,
+};
+
+#endif
@@ -1,6 +1,6 @@
 /**
  * @file tcp_server.c
- * @brief Handle main tcp tasks
+ * @brief TCP transports on BSD sockets
  * @version 0.1
  * @date 2020-01-22
  *
@@ -12,9 +12,8 @@
 #include <sys/param.h>
 
 #include "main/wifi_configuration.h"
-#include "main/DAP_handle.h"
-
-#include "components/elaphureLink/elaphureLink_protocol.h"
+#include "main/dap_configuration.h"
+#include "main/transport.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -29,156 +28,196 @@
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include <lwip/netdb.h>
-#include "usbip_server.h"
 
-extern TaskHandle_t kDAPTaskHandle;
-extern int kRestartDAPHandle;
+// One listener with its client, every socket transport has its own
+typedef struct
+{
+    uint16_t port;
+    int listen_sock;
+    int sock;
+    uint8_t *rx_buffer;
+} tcp_socket_t;
+
+#define TCP_RX_BUFFER_SIZE 1500
+
+#if (USE_EVENT_LOOP == 1)
+// every instance is served by the event loop task, one buffer will do
+static uint8_t tcp_rx_buffer[1][TCP_RX_BUFFER_SIZE];
+#define TCP_RX_BUFFER(n) tcp_rx_buffer[0]
+#else
+static uint8_t tcp_rx_buffer[1 + USE_DAP_TCP][TCP_RX_BUFFER_SIZE];
+#define TCP_RX_BUFFER(n) tcp_rx_buffer[n]
+#endif
+
+static tcp_socket_t tcp_server = { .port = PORT, .listen_sock = -1, .sock = -1, .rx_buffer = TCP_RX_BUFFER(0) };
+#if (USE_DAP_TCP == 1)
+static tcp_socket_t dap_tcp_server = { .port = DAP_TCP_PORT, .listen_sock = -1, .sock = -1, .rx_buffer = TCP_RX_BUFFER(1) };
+#endif
 
-uint8_t kState = ACCEPTING; 
-int kSock = -1;
 
-void tcp_server_task(void *pvParameters)
+static int tcp_socket_listen(uint16_t port)
 {
-    uint8_t tcp_rx_buffer[1500];
     char addr_str[128];
-    int addr_family;
-    int ip_protocol;
-
     int on = 1;
-    while (1)
+
+    struct sockaddr_in destAddr;
+    destAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    destAddr.sin_family = AF_INET;
+    destAddr.sin_port = htons(port);
+    inet_ntoa_r(destAddr.sin_addr, addr_str, sizeof(addr_str) - 1);
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0)
     {
+        os_printf("Unable to create socket: errno %d\r\n", errno);
+        return -1;
+    }
+    os_printf("Socket created\r\n");
 
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
 
-        struct sockaddr_in destAddr;
-        destAddr.sin_addr.s_addr = htonl(INADDR_ANY);
-        destAddr.sin_family = AF_INET;
-        destAddr.sin_port = htons(PORT);
-        addr_family = AF_INET;
-        ip_protocol = IPPROTO_IP;
-        inet_ntoa_r(destAddr.sin_addr, addr_str, sizeof(addr_str) - 1);
-
-
-        int listen_sock = socket(addr_family, SOCK_STREAM, ip_protocol);
-        if (listen_sock < 0)
-        {
-            os_printf("Unable to create socket: errno %d\r\n", errno);
-            break;
-        }
-        os_printf("Socket created\r\n");
-
-        setsockopt(listen_sock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
-        setsockopt(listen_sock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
-
-        int err = bind(listen_sock, (struct sockaddr *)&destAddr, sizeof(destAddr));
-        if (err != 0)
-        {
-            os_printf("Socket unable to bind: errno %d\r\n", errno);
-            break;
-        }
-        os_printf("Socket binded\r\n");
-
-        err = listen(listen_sock, 1);
-        if (err != 0)
-        {
-            os_printf("Error occured during listen: errno %d\r\n", errno);
-            break;
-        }
-        os_printf("Socket listening\r\n");
+    int err = bind(sock, (struct sockaddr *)&destAddr, sizeof(destAddr));
+    if (err != 0)
+    {
+        os_printf("Socket unable to bind: errno %d\r\n", errno);
+        close(sock);
+        return -1;
+    }
+    os_printf("Socket binded\r\n");
+
+    err = listen(sock, 1);
+    if (err != 0)
+    {
+        os_printf("Error occured during listen: errno %d\r\n", errno);
+        close(sock);
+        return -1;
+    }
+    os_printf("Socket listening\r\n");
+
+    return sock;
+}
+
+static int tcp_socket_accept(transport_t *t)
+{
+    tcp_socket_t *s = t->priv;
+    int on = 1;
+
+    if (s->listen_sock < 0)
+    {
+        s->listen_sock = tcp_socket_listen(s->port);
+        if (s->listen_sock < 0)
+            return -1;
+    }
 
 #ifdef CONFIG_EXAMPLE_IPV6
-        struct sockaddr_in6 sourceAddr; // Large enough for both IPv4 or IPv6
+    struct sockaddr_in6 sourceAddr; // Large enough for both IPv4 or IPv6
 #else
-        struct sockaddr_in sourceAddr;
+    struct sockaddr_in sourceAddr;
 #endif
-        uint32_t addrLen = sizeof(sourceAddr);
-        while (1)
-        {
-            kSock = accept(listen_sock, (struct sockaddr *)&sourceAddr, &addrLen);
-            if (kSock < 0)
-            {
-                os_printf("Unable to accept connection: errno %d\r\n", errno);
-                break;
-            }
-            setsockopt(kSock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
-            setsockopt(kSock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
-            os_printf("Socket accepted\r\n");
-
-            while (1)
-            {
-                int len = recv(kSock, tcp_rx_buffer, sizeof(tcp_rx_buffer), 0);
-                // Error occured during receiving
-                if (len < 0)
-                {
-                    os_printf("recv failed: errno %d\r\n", errno);
-                    break;
-                }
-                // Connection closed
-                else if (len == 0)
-                {
-                    os_printf("Connection closed\r\n");
-                    break;
-                }
-                // Data received
-                else
-                {
-                    // #ifdef CONFIG_EXAMPLE_IPV6
-                    //                     // Get the sender's ip address as string
-                    //                     if (sourceAddr.sin6_family == PF_INET)
-                    //                     {
-                    //                         inet_ntoa_r(((struct sockaddr_in *)&sourceAddr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
-                    //                     }
-                    //                     else if (sourceAddr.sin6_family == PF_INET6)
-                    //                     {
-                    //                         inet6_ntoa_r(sourceAddr.sin6_addr, addr_str, sizeof(addr_str) - 1);
-                    //                     }
-                    // #else
-                    //                     inet_ntoa_r(((struct sockaddr_in *)&sourceAddr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
-                    // #endif
-
-                    switch (kState)
-                    {
-                    case ACCEPTING:
-                        kState = ATTACHING;
-
-                    case ATTACHING:
-                        // elaphureLink handshake
-                        if (el_handshake_process(kSock, tcp_rx_buffer, len) == 0) {
-                            // handshake successed
-                            kState = EL_DATA_PHASE;
-                            kRestartDAPHandle = DELETE_HANDLE;
-                            el_process_buffer_malloc();
-                            break;
-                        }
-                        break;
-                    case EL_DATA_PHASE:
-                        el_dap_data_process(tcp_rx_buffer, len);
-                        break;
-                    default:
-                        os_printf("unkonw kstate!\r\n");
-                    }
-                }
-            }
-            // kState = ACCEPTING;
-            if (kSock != -1)
-            {
-                os_printf("Shutting down socket and restarting...\r\n");
-                //shutdown(kSock, 0);
-                close(kSock);
-                if (kState == EMULATING || kState == EL_DATA_PHASE)
-                    kState = ACCEPTING;
-
-                // Restart DAP Handle
-                el_process_buffer_free();
-
-                kRestartDAPHandle = RESET_HANDLE;
-                if (kDAPTaskHandle)
-                    xTaskNotifyGive(kDAPTaskHandle);
-
-                //shutdown(listen_sock, 0);
-                //close(listen_sock);
-                //vTaskDelay(5);
-            }
-        }
+    uint32_t addrLen = sizeof(sourceAddr);
+    s->sock = accept(s->listen_sock, (struct sockaddr *)&sourceAddr, &addrLen);
+    if (s->sock < 0)
+    {
+        os_printf("Unable to accept connection: errno %d\r\n", errno);
+        close(s->listen_sock);
+        s->listen_sock = -1;
+        return -1;
     }
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+    setsockopt(s->sock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
+    setsockopt(s->sock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
+    os_printf("Socket accepted\r\n");
+
+    return 0;
+}
+
+static int tcp_socket_recv_batch(transport_t *t, transport_input_t input)
+{
+    tcp_socket_t *s = t->priv;
+    int len = recv(s->sock, s->rx_buffer, TCP_RX_BUFFER_SIZE, 0);
+    // Error occured during receiving
+    if (len < 0)
+    {
+        os_printf("recv failed: errno %d\r\n", errno);
+        return -1;
+    }
+    // Connection closed
+    else if (len == 0)
+    {
+        os_printf("Connection closed\r\n");
+        return -1;
+    }
+
+    if (input(t, s->rx_buffer, len) < 0)
+        return -1;
+    return len;
+}
+
+static int tcp_socket_sendv(transport_t *t, const transport_iov_t *iov, int iovcnt)
+{
+    tcp_socket_t *s = t->priv;
+    struct iovec vec[TRANSPORT_IOV_MAX];
+    int i;
+
+    if (iovcnt > TRANSPORT_IOV_MAX)
+        return -1;
+    if (iovcnt == 1)
+        return send(s->sock, iov[0].ptr, iov[0].len, 0);
+
+    // one write, TCP_NODELAY would put every buffer in its own segment
+    for (i = 0; i < iovcnt; i++)
+    {
+        vec[i].iov_base = (void *)iov[i].ptr;
+        vec[i].iov_len = iov[i].len;
+    }
+    return writev(s->sock, vec, iovcnt);
+}
+
+static void tcp_socket_close(transport_t *t)
+{
+    tcp_socket_t *s = t->priv;
+
+    if (s->sock != -1)
+    {
+        //shutdown(s->sock, 0);
+        close(s->sock);
+        s->sock = -1;
+    }
+}
+
+static int tcp_socket_poll_fd(transport_t *t)
+{
+    tcp_socket_t *s = t->priv;
+
+    if (s->sock >= 0)
+        return s->sock;
+    if (s->listen_sock < 0)
+        s->listen_sock = tcp_socket_listen(s->port);
+    return s->listen_sock;
+}
+
+static const transport_ops_t tcp_socket_ops = {
+    .accept = tcp_socket_accept,
+    .recv_batch = tcp_socket_recv_batch,
+    .sendv = tcp_socket_sendv,
+    .close = tcp_socket_close,
+    .poll_fd = tcp_socket_poll_fd,
+};
+
+transport_t kTcpSocketTransport = {
+    .name = "tcp_server",
+    .id = TRANSPORT_TCP_SOCKET,
+    .ops = &tcp_socket_ops,
+    .priv = &tcp_server,
+    .enabled = 1,
+};
+
+#if (USE_DAP_TCP == 1)
+transport_t kDapTcpTransport = {
+    .name = "dap_tcp_server",
+    .id = TRANSPORT_DAP_TCP,
+    .ops = &tcp_socket_ops,
+    .priv = &dap_tcp_server,
+    .enabled = 1,
+};
+#endif
@@ -1,6 +0,0 @@
-#ifndef __TCP_SERVER_H__
-#define __TCP_SERVER_H__
-
-void tcp_server_task(void *pvParameters);
-
-#endif
\ No newline at end of file
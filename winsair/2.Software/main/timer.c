@@ -2,6 +2,7 @@
  * @file timer.c
  * @brief Hardware timer for DAP timestamp
  * @change: 2021-02-18 Using the FRC2 timer
+ *          2026-10-17 esp_timer backend for ESP32/C3/C6, 64-bit count
  *
  * @version 0.2
  * @date 2020-01-22
@@ -17,6 +18,7 @@
 #ifdef CONFIG_IDF_TARGET_ESP8266
     #include "hw_timer.h"
 #endif
+#include "esp_timer.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -34,9 +36,27 @@
 volatile frc2_struct_t * frc2  = (frc2_struct_t *)(TIMER_BASE + (1) * 0x20);
 #endif
 
+#ifdef CONFIG_IDF_TARGET_ESP8266
+// FRC2 wraps after 2^31 counts, the bits above are kept here
+static uint32_t timer_high = 0;
+static uint32_t timer_last = 0;
+static esp_timer_handle_t timer_keepalive = NULL;
+
+static void timer_keepalive_cb(void *arg)
+{
+    // a wrap is only seen if the count is read at least once in between
+    get_timer_count64();
+}
+#endif
+
 void timer_init()
 {
 #ifdef CONFIG_IDF_TARGET_ESP8266
+    const esp_timer_create_args_t keepalive = {
+        .callback = timer_keepalive_cb,
+        .name = "timer_keepalive",
+    };
+
     vPortEnterCritical();
     frc2->ctrl.div = TIMER_CLKDIV_16;  // 80MHz / 16 = 5MHz
     frc2->ctrl.intr_type = TIMER_EDGE_INT;
@@ -44,13 +64,37 @@ void timer_init()
     frc2->load.val = 0x7FFFFFFF;      // 31bit max
     frc2->ctrl.en = 0x01;
     vPortExitCritical();
+
+    // well within the 429s of a wrap
+    esp_timer_create(&keepalive, &timer_keepalive);
+    esp_timer_start_periodic(timer_keepalive, 60 * 1000000ULL);
 #endif
+    // ESP32/C3/C6: esp_timer runs from boot, on the systimer on C3/C6
 }
 
-// Timing up to 2147483647(0x7FFFFFFF) / 5000000(5MHz) = 429s
-// 0.2 micro-second resolution
-uint32_t get_timer_count()
+// ESP8266: 0.2 micro-second resolution, ESP32/C3/C6: 1 micro-second.
+// Does not wrap in the lifetime of the device.
+uint64_t get_timer_count64()
 {
-    return 0;
+#ifdef CONFIG_IDF_TARGET_ESP8266
+    uint32_t now;
+    uint64_t count;
 
-}
\ No newline at end of file
+    vPortEnterCritical();
+    now = frc2->count.data;
+    if (now < timer_last)
+        timer_high++;
+    timer_last = now;
+    count = (uint64_t)timer_high << 31 | now;
+    vPortExitCritical();
+    return count;
+#else
+    return (uint64_t)esp_timer_get_time();
+#endif
+}
+
+// DAP timestamp, TIMER_CLOCK_HZ counts that wrap at 2^32 as the host expects
+uint32_t get_timer_count()
+{
+    return (uint32_t)get_timer_count64();
+}
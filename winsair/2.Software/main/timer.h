@@ -3,6 +3,7 @@
  * @author windowsair
  * @brief esp8266 hardware timer
  * @change: 2021-02-18 Add frc2 timer
+ *          2026-10-17 esp_timer on ESP32/C3/C6, 64-bit count
  * @note
  *  FRC2 is not officially documented. There is no guarantee of its behavior.
  *  FRC2 may be used for RTC functions. May be reserved for other functions in the future.
@@ -66,9 +67,14 @@ typedef struct {
 } frc2_struct_t;
 
 extern volatile frc2_struct_t* frc2;
+
+#define TIMER_CLOCK_HZ 5000000U // FRC2, 80MHz / 16
+#else
+#define TIMER_CLOCK_HZ 1000000U // esp_timer
 #endif
 
 extern void timer_init();
 extern uint32_t get_timer_count();
+extern uint64_t get_timer_count64();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,716 @@
+/**
+ * @file transport.c
+ * @brief Session state machine shared by every network transport
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include <string.h>
+#include <stdint.h>
+#include <sys/param.h>
+
+#include "main/transport.h"
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/usbip_server.h"
+#include "main/dap_tcp.h"
+#include "main/net_loop.h"
+
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+
+extern TaskHandle_t kDAPSendTaskHandle;
+
+uint8_t kState = ACCEPTING;
+
+// Transport of the running session, NULL between sessions. Guarded by session_mux.
+static transport_t *kTransport = NULL;
+static SemaphoreHandle_t session_mux = NULL;
+// Sends in progress on kTransport, session_end() closes it once they are done
+static uint32_t session_users = 0;
+static TaskHandle_t session_closer = NULL;
+// session_end() is still tearing the last session down, no new one may begin
+static uint8_t session_ending = 0;
+// Listener tasks in transport_wait_idle() or session_begin(), woken by session_end()
+static TaskHandle_t session_waiters[TRANSPORT_NUM] = { NULL };
+
+#if (USE_EVENT_LOOP == 1)
+// Replies made on the event loop task, sent by the send task so the loop never
+// waits for the socket. The loop is the only producer and the send task the
+// only consumer, the indices run free.
+#define TRANSPORT_DEFER_SIZE 2048
+
+static uint8_t transport_defer_buffer[TRANSPORT_DEFER_SIZE];
+static volatile uint32_t transport_defer_head = 0;
+static volatile uint32_t transport_defer_tail = 0;
+static uint8_t transport_defer_overflow = 0;       // the loop only
+static volatile uint8_t transport_defer_wake = 0;  // the loop waits for it to empty
+
+static void transport_defer_flush();
+#endif
+
+static transport_t *const kTransports[TRANSPORT_NUM] = {
+    &kTcpSocketTransport,
+#if (USE_TCP_NETCONN == 1)
+    &kTcpNetconnTransport,
+#else
+    NULL,
+#endif
+#if (USE_KCP == 1)
+    &kKcpTransport,
+#else
+    NULL,
+#endif
+#if (USE_DAP_TCP == 1)
+    &kDapTcpTransport,
+#else
+    NULL,
+#endif
+};
+
+
+static int session_begin(transport_t *t)
+{
+    int ret = -1;
+
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    // the buffers of the last session are being reset, that takes a moment
+    while (session_ending)
+    {
+        session_waiters[t->id] = xTaskGetCurrentTaskHandle();
+        xSemaphoreGive(session_mux);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+        xSemaphoreTake(session_mux, portMAX_DELAY);
+    }
+    session_waiters[t->id] = NULL;
+    if (t->enabled && kTransport == NULL)
+    {
+        kTransport = t;
+        kState = ACCEPTING;
+        t->stats.sessions++;
+        ret = 0;
+    }
+    xSemaphoreGive(session_mux);
+
+    return ret;
+}
+
+// Start the session of a client that was just accepted, or turn it away
+static int session_open(transport_t *t)
+{
+    if (session_begin(t) < 0)
+    {
+        os_printf("%s: DAP is busy or the transport is disabled, client refused\r\n", t->name);
+        t->stats.rejected++;
+        t->ops->close(t);
+        return -1;
+    }
+    return 0;
+}
+
+static int session_input(transport_t *t, uint8_t *buf, size_t len)
+{
+    int used;
+
+    t->stats.rx_batches++;
+    t->stats.rx_bytes += len;
+
+    switch (kState)
+    {
+    case ACCEPTING:
+        kState = ATTACHING;
+
+    case ATTACHING:
+        // elaphureLink handshake, a legacy proxy may send its first request with it.
+        // The rest of a DAP-TCP header held back is not the start of one.
+#if (USE_DAP_TCP == 1)
+        used = dap_tcp_handshake_held() ? -1 : el_handshake_process(-1, buf, len);
+#else
+        used = el_handshake_process(-1, buf, len);
+#endif
+        if (used > 0)
+        {
+            kState = EL_DATA_PHASE;
+            el_process_buffer_malloc();
+            if ((size_t)used < len)
+                el_dap_data_process(buf + used, len - used);
+            break;
+        }
+        else if (used == 0)
+        {
+            // the start of a handshake, wait for the rest of it
+            break;
+        }
+#if (USE_DAP_TCP == 1)
+        // OpenOCD cmsis_dap_tcp, the first request is already in the buffer
+        used = dap_tcp_handshake(buf, len);
+        if (used == 0)
+        {
+            kState = DAP_TCP_PHASE;
+            return dap_tcp_data_process(buf, len);
+        }
+        else if (used > 0)
+        {
+            // the start of a header, wait for the rest of it
+            break;
+        }
+#endif
+        // USB/IP, the state becomes EMULATING once the device is imported
+        return attach(buf, len);
+
+    case EMULATING:
+        return emulate(buf, len);
+
+    case EL_DATA_PHASE:
+        el_dap_data_process(buf, len);
+        break;
+
+    case DAP_TCP_PHASE:
+        return dap_tcp_data_process(buf, len);
+
+    default:
+        os_printf("unkonw kstate!\r\n");
+    }
+
+    return 0;
+}
+
+/*
+ * The steps of session_end(). The event loop task takes them one pass at a
+ * time, see session_end_loop(), the other tasks wait in between.
+ */
+static void session_end_start(transport_t *t)
+{
+    os_printf("Shutting down %s session and restarting...\r\n", t->name);
+
+    // nothing is sent on the connection once it is closed, sends already
+    // on their way finish first
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    kTransport = NULL;
+    session_ending = 1;
+    session_closer = xTaskGetCurrentTaskHandle();
+    xSemaphoreGive(session_mux);
+}
+
+// 1 once no send uses the connection any more
+static int session_end_unused()
+{
+    uint32_t users;
+
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    users = session_users;
+    if (users == 0)
+        session_closer = NULL;
+    xSemaphoreGive(session_mux);
+
+    return users == 0;
+}
+
+static void session_end_close(transport_t *t)
+{
+    t->ops->close(t);
+    kState = ACCEPTING;
+
+    // Restart DAP Handle, the send task is done with the session buffers after it
+    dap_ringbuf_resize_start(DAP_PACKET_SIZE_DEFAULT);
+}
+
+// 1 once the DAP queues are laid out again and nothing is left to send
+static int session_end_drained()
+{
+    if (!dap_ringbuf_resize_done())
+        return 0;
+#if (USE_EVENT_LOOP == 1)
+    // replies still deferred are dropped by the send task, there is no session
+    if (transport_defer_tail != transport_defer_head)
+    {
+        xTaskNotifyGive(kDAPSendTaskHandle);
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+static void session_end_finish()
+{
+#if (USE_EVENT_LOOP == 1)
+    transport_defer_overflow = 0;
+#endif
+    el_process_buffer_free();
+    usbip_session_free();
+    dap_tcp_session_free();
+    session_arena_reset();
+
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    session_ending = 0;
+    for (int i = 0; i < TRANSPORT_NUM; i++)
+    {
+        if (session_waiters[i])
+            xTaskNotifyGive(session_waiters[i]);
+        session_waiters[i] = NULL;
+    }
+    xSemaphoreGive(session_mux);
+}
+
+static void session_end(transport_t *t)
+{
+    session_end_start(t);
+    while (!session_end_unused())
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+
+    session_end_close(t);
+    while (!session_end_drained())
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+
+    session_end_finish();
+}
+
+static void transport_task(void *argument)
+{
+    transport_t *t = (transport_t *)argument;
+
+    while (1)
+    {
+        if (t->ops->accept(t) < 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        if (session_open(t) < 0)
+            continue;
+
+        while (t->ops->recv_batch(t, session_input) >= 0)
+        {
+        }
+
+        session_end(t);
+    }
+}
+
+
+void transport_send_task(void *argument)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // the DAP task may wait for the response queue to be laid out again
+        dap_response_sync();
+
+#if (USE_EVENT_LOOP == 1)
+        // replies of the event loop come before the responses made after them
+        transport_defer_flush();
+#endif
+
+        switch (kState)
+        {
+        case EMULATING:
+            // USB/IP session, the responses complete its URBs
+            usbip_complete_urbs();
+            break;
+#if (USE_DAP_TCP == 1)
+        case DAP_TCP_PHASE:
+            // CMSIS-DAP TCP session, every response gets its own header
+            dap_tcp_complete();
+            break;
+#endif
+#if (USE_EL_PIPELINE == 1)
+        case EL_DATA_PHASE:
+            el_dap_complete();
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+}
+
+
+#if (USE_EVENT_LOOP == 1)
+/*
+ * Replies of the event loop, see transport_defer_buffer
+ */
+static int transport_defer(const transport_iov_t *iov, int iovcnt)
+{
+    uint32_t head = transport_defer_head;
+    uint32_t pos, copy;
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        len += iov[i].len;
+    if (kTransport == NULL || transport_defer_overflow)
+        return -1;
+    if (len > TRANSPORT_DEFER_SIZE - (head - __atomic_load_n(&transport_defer_tail, __ATOMIC_ACQUIRE)))
+    {
+        // part of the stream would be missing, the session is ended
+        transport_defer_overflow = 1;
+        return -1;
+    }
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        pos = head % TRANSPORT_DEFER_SIZE;
+        copy = MIN(iov[i].len, TRANSPORT_DEFER_SIZE - pos);
+        memcpy(transport_defer_buffer + pos, iov[i].ptr, copy);
+        memcpy(transport_defer_buffer, (const uint8_t *)iov[i].ptr + copy, iov[i].len - copy);
+        head += iov[i].len;
+    }
+    __atomic_store_n(&transport_defer_head, head, __ATOMIC_RELEASE);
+
+    if (kDAPSendTaskHandle)
+        xTaskNotifyGive(kDAPSendTaskHandle);
+    return len;
+}
+
+// Replies still to be sent, the loop does not read the session meanwhile
+static int transport_defer_pending()
+{
+    if (transport_defer_head == __atomic_load_n(&transport_defer_tail, __ATOMIC_ACQUIRE))
+        return 0;
+
+    // the send task wakes us once they are out
+    transport_defer_wake = 1;
+    if (transport_defer_head == __atomic_load_n(&transport_defer_tail, __ATOMIC_ACQUIRE))
+    {
+        transport_defer_wake = 0;
+        return 0;
+    }
+    return 1;
+}
+
+// The send task side
+static void transport_defer_flush()
+{
+    uint32_t head = __atomic_load_n(&transport_defer_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = transport_defer_tail;
+    uint32_t pos = tail % TRANSPORT_DEFER_SIZE;
+    uint32_t len = head - tail;
+    uint32_t first = MIN(len, TRANSPORT_DEFER_SIZE - pos);
+    transport_iov_t iov[2] = {
+        { transport_defer_buffer + pos, first },
+        { transport_defer_buffer, len - first },
+    };
+
+    if (len == 0)
+        return;
+
+    // not the loop task, this does send
+    transport_sendv(iov, len > first ? 2 : 1);
+    __atomic_store_n(&transport_defer_tail, head, __ATOMIC_RELEASE);
+
+    if (transport_defer_wake)
+    {
+        transport_defer_wake = 0;
+        net_loop_wake();
+    }
+}
+
+
+/*
+ * session_end() on the loop task, which must not wait for the sends, the DAP
+ * task and the send task. Each pass takes the steps that are ready.
+ */
+static transport_t *session_closing = NULL;
+static uint8_t session_closed = 0; // the connection is closed, the queues are laid out
+
+// 1 while the session is still being ended
+static int session_end_loop()
+{
+    transport_t *t = session_closing;
+
+    if (t == NULL)
+        return 0;
+    if (!session_closed)
+    {
+        if (!session_end_unused())
+            return 1;
+        session_end_close(t);
+        session_closed = 1;
+    }
+    if (!session_end_drained())
+        return 1;
+
+    session_end_finish();
+    session_closing = NULL;
+    return 0;
+}
+
+static void session_end_async(transport_t *t)
+{
+    session_end_start(t);
+    session_closing = t;
+    session_closed = 0;
+    session_end_loop();
+}
+
+/*
+ * The same steps as transport_task, each run once its socket is readable
+ */
+static int transport_prepare(void *ctx, fd_set *rfds, uint32_t *timeout_ms)
+{
+    int i, fd, maxfd = -1;
+
+    // no new session before the last one is torn down, nothing wakes us for it
+    if (session_ending)
+    {
+        *timeout_ms = MIN(*timeout_ms, 10);
+        return -1;
+    }
+
+    for (i = 0; i < TRANSPORT_NUM; i++)
+    {
+        transport_t *t = kTransports[i];
+        if (t == NULL || t->ops->poll_fd == NULL)
+            continue;
+
+        fd = t->ops->poll_fd(t);
+        if (fd < 0)
+        {
+            // try to listen again later
+            *timeout_ms = MIN(*timeout_ms, 1000);
+            continue;
+        }
+        if (kTransport == t && (dap_request_flush() != 0 || transport_defer_pending()))
+        {
+            // backpressure, nothing is read until the DAP task took the
+            // backlog and the send task sent the replies. They wake us, or
+            // the session ends on the next pass.
+            *timeout_ms = MIN(*timeout_ms, 10);
+            continue;
+        }
+        FD_SET(fd, rfds);
+        maxfd = MAX(maxfd, fd);
+    }
+
+    return maxfd;
+}
+
+static void transport_process(void *ctx, fd_set *rfds)
+{
+    int i, fd, ret;
+
+    // the end of a session of another task is waited for the same way
+    if (session_end_loop() || session_ending)
+        return;
+
+    for (i = 0; i < TRANSPORT_NUM; i++)
+    {
+        transport_t *t = kTransports[i];
+        if (t == NULL || t->ops->poll_fd == NULL)
+            continue;
+
+        fd = t->ops->poll_fd(t);
+        if (fd < 0)
+            continue;
+
+        // only this task starts and ends the sessions of these transports
+        if (kTransport != t)
+        {
+            if (FD_ISSET(fd, rfds) && t->ops->accept(t) == 0)
+                session_open(t);
+            continue;
+        }
+
+        // the backlog goes first, the socket is only read once it is empty
+        ret = dap_request_flush();
+        if (transport_defer_overflow)
+        {
+            os_printf("%s: too many replies at once\r\n", t->name);
+            session_end_async(t);
+            return;
+        }
+        if (ret == 0 && !transport_defer_pending() && FD_ISSET(fd, rfds))
+        {
+            if (t->ops->recv_batch(t, session_input) < 0)
+            {
+                session_end_async(t);
+                return;
+            }
+            ret = dap_request_flush();
+        }
+        if (ret < 0)
+        {
+            os_printf("%s: backlog full, the client exceeds the DAP packet count\r\n", t->name);
+            session_end_async(t);
+            return;
+        }
+    }
+}
+
+static const net_service_t transport_service = {
+    .name = "transport",
+    .prepare = transport_prepare,
+    .process = transport_process,
+};
+#endif
+
+
+void transport_start()
+{
+    int i;
+
+    session_mux = xSemaphoreCreateMutex();
+    for (i = 0; i < TRANSPORT_NUM; i++)
+    {
+        if (kTransports[i] == NULL)
+            continue;
+        transport_enable(i, TRANSPORT_ENABLE_MASK & (1 << i));
+#if (USE_EVENT_LOOP == 1)
+        // served by the event loop task, see transport_process()
+        if (kTransports[i]->ops->poll_fd)
+            continue;
+#endif
+        xTaskCreate(transport_task, kTransports[i]->name, 4096, kTransports[i], 14, NULL);
+    }
+#if (USE_EVENT_LOOP == 1)
+    net_loop_register(&transport_service);
+#endif
+}
+
+void transport_enable(transport_id_t id, int enable)
+{
+    transport_t *t = transport_get(id);
+    if (t)
+        t->enabled = enable ? 1 : 0;
+}
+
+transport_t *transport_get(transport_id_t id)
+{
+    return id < TRANSPORT_NUM ? kTransports[id] : NULL;
+}
+
+void transport_wait_idle(transport_t *t)
+{
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    while ((kTransport != NULL && kTransport != t) || session_ending)
+    {
+        session_waiters[t->id] = xTaskGetCurrentTaskHandle();
+        xSemaphoreGive(session_mux);
+        // woken by session_end(), the timeout is only a safety net
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+        xSemaphoreTake(session_mux, portMAX_DELAY);
+    }
+    session_waiters[t->id] = NULL;
+    xSemaphoreGive(session_mux);
+}
+
+
+// Take a reference to the transport of the session, the lock is not held
+// while it is used so the blocking sends do not stall session changes
+static transport_t *transport_acquire()
+{
+    transport_t *t;
+
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    t = kTransport;
+    if (t)
+        session_users++;
+    xSemaphoreGive(session_mux);
+
+    return t;
+}
+
+// Drop a reference, call with session_mux held
+static void transport_put(transport_t *t)
+{
+    session_users--;
+    if (session_users == 0 && session_closer)
+        xTaskNotifyGive(session_closer);
+}
+
+static void transport_release(transport_t *t)
+{
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    transport_put(t);
+    xSemaphoreGive(session_mux);
+}
+
+// Count a send and drop the reference it was made with
+static void transport_release_sent(transport_t *t, int ret, size_t len)
+{
+    xSemaphoreTake(session_mux, portMAX_DELAY);
+    t->stats.tx_calls++;
+    if (ret < 0)
+        t->stats.tx_errors++;
+    else
+        t->stats.tx_bytes += len;
+    transport_put(t);
+    xSemaphoreGive(session_mux);
+}
+
+
+int transport_sendv(const transport_iov_t *iov, int iovcnt)
+{
+    int i, ret;
+    size_t len = 0;
+    transport_t *t;
+
+#if (USE_EVENT_LOOP == 1)
+    // the loop must not wait for the socket, the send task sends it
+    if (net_loop_current())
+        return transport_defer(iov, iovcnt);
+#endif
+
+    for (i = 0; i < iovcnt; i++)
+        len += iov[i].len;
+
+    t = transport_acquire();
+    if (t == NULL)
+        return -1;
+
+    ret = t->ops->sendv(t, iov, iovcnt);
+    transport_release_sent(t, ret, len);
+
+    return ret;
+}
+
+int transport_send(const void *buf, size_t len)
+{
+    transport_iov_t iov = { buf, len };
+    return transport_sendv(&iov, 1);
+}
+
+uint8_t *transport_tx_buffer_get()
+{
+    uint8_t *buf = NULL;
+    transport_t *t;
+
+    t = transport_acquire();
+    if (t == NULL)
+        return NULL;
+
+    if (t->ops->tx_buffer_get)
+        buf = t->ops->tx_buffer_get(t);
+    transport_release(t);
+
+    return buf;
+}
+
+int transport_tx_buffer_send(size_t len)
+{
+    int ret;
+    transport_t *t;
+
+    t = transport_acquire();
+    if (t == NULL)
+        return -1;
+
+    if (t->ops->tx_buffer_send == NULL)
+    {
+        transport_release(t);
+        return -1;
+    }
+
+    ret = t->ops->tx_buffer_send(t, len);
+    transport_release_sent(t, ret, len);
+
+    return ret;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file transport.h
+ * @brief Common interface of the network transports and the session on top
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Every transport (BSD socket TCP, netconn TCP, KCP, CMSIS-DAP TCP) runs its own listener
+ * task and only moves bytes. The session state machine, the DAP handle
+ * restart and the statistics live here, once for all of them. Only one
+ * session drives the DAP at a time, clients of other transports are turned
+ * away while it lasts.
+ */
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+    TRANSPORT_TCP_SOCKET,
+    TRANSPORT_TCP_NETCONN,
+    TRANSPORT_KCP,
+    TRANSPORT_DAP_TCP,
+    TRANSPORT_NUM
+} transport_id_t;
+
+// Most buffers in one transport_sendv() call
+#define TRANSPORT_IOV_MAX 4
+
+typedef struct
+{
+    const void *ptr;
+    size_t len;
+} transport_iov_t;
+
+typedef struct
+{
+    uint32_t sessions;   // sessions served
+    uint32_t rejected;   // clients turned away, DAP busy or transport disabled
+    uint32_t rx_batches; // receive calls that returned data
+    uint32_t rx_bytes;
+    uint32_t tx_calls;
+    uint32_t tx_bytes;
+    uint32_t tx_errors;
+} transport_stats_t;
+
+typedef struct transport transport_t;
+
+// Returns < 0 if the stream can not be served, the session is ended then
+typedef int (*transport_input_t)(transport_t *t, uint8_t *buf, size_t len);
+
+typedef struct
+{
+    /**
+     * @brief Wait for the next client
+     *
+     * @return 0 once a client is connected
+     */
+    int (*accept)(transport_t *t);
+
+    /**
+     * @brief Wait for data and hand everything that arrived to input
+     *
+     * @return < 0 once the client is gone or input failed
+     */
+    int (*recv_batch)(transport_t *t, transport_input_t input);
+
+    /**
+     * @brief Send the buffers as one stream write, called from any task
+     *
+     * @return < 0 on error
+     */
+    int (*sendv)(transport_t *t, const transport_iov_t *iov, int iovcnt);
+
+    void (*close)(transport_t *t);
+
+    // Optional zero-copy send, see tcp_netconn_tx_buffer_get(). NULL if the
+    // transport always copies.
+    uint8_t *(*tx_buffer_get)(transport_t *t);
+    int (*tx_buffer_send)(transport_t *t, size_t len);
+
+    // Optional, for the event loop (USE_EVENT_LOOP). The socket that becomes
+    // readable once accept or recv_batch would not block, -1 if it can not
+    // be opened yet. NULL if the transport needs a task of its own.
+    int (*poll_fd)(transport_t *t);
+} transport_ops_t;
+
+struct transport
+{
+    const char *name;
+    transport_id_t id;
+    const transport_ops_t *ops;
+    void *priv; // state of the transport instance, for ops shared by several
+    volatile uint8_t enabled; // new sessions are accepted
+    transport_stats_t stats;
+};
+
+extern transport_t kTcpSocketTransport;
+extern transport_t kTcpNetconnTransport;
+extern transport_t kKcpTransport;
+extern transport_t kDapTcpTransport;
+
+/**
+ * @brief Start the listener task of every transport built in
+ *
+ */
+void transport_start();
+
+/**
+ * @brief Network send stage, sends the responses of the DAP task on the
+ *        session that is running, woken through kDAPSendTaskHandle
+ *
+ */
+void transport_send_task(void *argument);
+
+/**
+ * @brief Allow or refuse new sessions on a transport, the running session
+ *        is not affected. transport_start() applies TRANSPORT_ENABLE_MASK.
+ *
+ */
+void transport_enable(transport_id_t id, int enable);
+
+/**
+ * @brief NULL if the transport is not built in
+ *
+ */
+transport_t *transport_get(transport_id_t id);
+
+/**
+ * @brief Wait until no other transport drives the DAP. For transports whose
+ *        accept() does not take the client off the socket, so that a client
+ *        that would be refused is not accepted over and over.
+ *
+ */
+void transport_wait_idle(transport_t *t);
+
+/**
+ * @brief Send on the transport of the current session. The session lock is
+ *        not held while sending, the session is only closed once the send
+ *        is done.
+ *
+ * @return < 0 if there is no session or the send failed
+ */
+int transport_send(const void *buf, size_t len);
+int transport_sendv(const transport_iov_t *iov, int iovcnt);
+
+/**
+ * @brief Zero-copy send buffer of the current session, NULL when the
+ *        transport has none free and the caller has to copy
+ *
+ */
+uint8_t *transport_tx_buffer_get();
+int transport_tx_buffer_send(size_t len);
+
+#endif
@@ -17,8 +17,12 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
  * @file uart_bridge.c
  * @author windowsair
  * @brief UART TCP bridge
- * @version 0.1
+ * @version 0.2
  * @date 2021-11-16
+ * @change: 2026-10-17 event driven UART to TCP path
+ *          2026-10-17 RFC 2217 port control, RTS/CTS, larger rings
+ *          2026-10-17 capture while no client is connected
+ *          2026-10-17 every UART on its own port, several clients each
  *
  * @copyright Copyright (c) 2021
  *
@@ -31,12 +35,19 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #include <stdatomic.h>
 
 #include "main/wifi_configuration.h"
+#include "main/uart_coalesce.h"
+#include "main/rfc2217.h"
+#include "main/uart_capture.h"
+#include "main/uart_bridge.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
@@ -53,25 +64,29 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #if (USE_UART_BRIDGE == 1)
 
+#define EVENTS_QUEUE_SIZE 10
+#define UART_EVENT_QUEUE_SIZE 20
+// posted to a port by the bridge task and the lwIP callback, a client has
+// something to send or room to send it
+#define UART_EVENT_SEND UART_EVENT_MAX
+
 #ifdef CONFIG_IDF_TARGET_ESP8266
-    #define UART_BRIDGE_TX UART_NUM_0
-    #define UART_BRIDGE_RX UART_NUM_1
-#elif defined CONFIG_IDF_TARGET_ESP32
-    #define UART_BRIDGE_TX UART_NUM_2
-    #define UART_BRIDGE_RX UART_NUM_2
-    #define UART_BRIDGE_TX_PIN 23
-    #define UART_BRIDGE_RX_PIN 22
-#elif defined CONFIG_IDF_TARGET_ESP32C3
-    #define UART_BRIDGE_TX UART_NUM_1
-    #define UART_BRIDGE_RX UART_NUM_1
-    #define UART_BRIDGE_TX_PIN 19
-    #define UART_BRIDGE_RX_PIN 18 // PIN18 has 50000ns glitch during the power-up
+// FIFO level of a FIFO full event (driver default), a partly filled FIFO is
+// only reported on the RX timeout
+#define UART_RX_FULL_THRESH 120
+#define UART_EVENT_IDLE(event) ((event).size < UART_RX_FULL_THRESH)
 #else
-    #error unknown hardware
+// Empty the 128 byte FIFO at half full instead of the default 120 bytes,
+// which leaves the ISR 160 us instead of 20 us at 4 Mbaud
+#define UART_RX_FULL_THRESH 64
+#define UART_EVENT_IDLE(event) ((event).timeout_flag)
 #endif
+// RTS goes inactive at this FIFO level when the RX ring is full
+#define UART_RX_FLOW_THRESH 100
 
-#define EVENTS_QUEUE_SIZE 10
-#define UART_BUF_SIZE     512
+// ring bytes escaped at a time for a Telnet client
+#define UART_ESCAPE_CHUNK 256
+#define UART_CLIENT_PENDING (2 * UART_ESCAPE_CHUNK + RFC2217_REPLY_MAX)
 
 #ifdef CALLBACK_DEBUG
 #define debug(s, ...) os_printf("%s: " s "\n", "Cb:", ##__VA_ARGS__)
@@ -89,38 +104,96 @@ typedef struct
     uint8_t type;
 } netconn_events;
 
-static uint8_t uart_read_buffer[UART_BUF_SIZE];
-// use lwip buffer to write back
-static struct netconn *uart_netconn = NULL;
-static bool is_conn_valid = false; // lock free
-static bool is_first_time_recv = false;
+typedef struct
+{
+    struct netconn *nc; // NULL when the slot is free
+    rfc2217_t rfc2217;
+    uart_capture_reader_t reader;
+    // bytes for this client only: escaped ring data and Telnet answers.
+    // Raw clients are sent straight from the ring.
+    uint8_t pending[UART_CLIENT_PENDING];
+    size_t pending_len;
+    size_t pending_off;
+    volatile bool blocked; // lwIP had no room, SENDPLUS wakes the port
+} uart_client_t;
+
+typedef struct
+{
+    uart_port_t tx_num;
+    uart_port_t rx_num;
+    int tx_pin; // -1 keeps the default pins
+    int rx_pin;
+    int rts_pin;
+    int cts_pin;
+    bool flow_control; // RTS/CTS are wired
+
+    uint16_t port;
+    struct netconn *listen;
+    QueueHandle_t events;  // driver events and UART_EVENT_SEND
+    SemaphoreHandle_t mux; // capture and clients, between the port and the bridge task
+    uart_capture_t capture;
+    uart_coalesce_t coalesce;
+    uart_client_t clients[UART_BRIDGE_CLIENTS];
+    uint32_t sessions;
+    uint32_t reader_drops; // lost by clients that are gone
+
+    // serial settings for RFC 2217 clients
+    rfc2217_port_t ops;
+    uint8_t datasize;
+    uint8_t parity;
+    uint8_t stopsize;
+    uint8_t flow;
+    uint8_t dtr;
+    uint8_t rts;
+} uart_bridge_t;
+
+// Every UART but the console, ports UART_BRIDGE_PORT and up in this order
+static uart_bridge_t kUartBridges[] = {
+#ifdef CONFIG_IDF_TARGET_ESP8266
+    // UART0 RX pins are taken by the console, RX is on UART1
+    {.tx_num = UART_NUM_0, .rx_num = UART_NUM_1, .tx_pin = -1, .rx_pin = -1,
+     .rts_pin = -1, .cts_pin = -1, .flow_control = true},
+#elif defined CONFIG_IDF_TARGET_ESP32
+    {.tx_num = UART_NUM_2, .rx_num = UART_NUM_2, .tx_pin = 23, .rx_pin = 22,
+     .rts_pin = 21, .cts_pin = 4, .flow_control = true},
+    // the default UART1 pins are the flash
+    {.tx_num = UART_NUM_1, .rx_num = UART_NUM_1, .tx_pin = UART_BRIDGE_ESP32_UART1_TX_PIN,
+     .rx_pin = UART_BRIDGE_ESP32_UART1_RX_PIN, .rts_pin = -1, .cts_pin = -1, .flow_control = false},
+#elif defined CONFIG_IDF_TARGET_ESP32C3
+    // PIN18 has 50000ns glitch during the power-up
+    {.tx_num = UART_NUM_1, .rx_num = UART_NUM_1, .tx_pin = 19, .rx_pin = 18,
+     .rts_pin = 0, .cts_pin = 1, .flow_control = true},
+#else
+    #error unknown hardware
+#endif
+};
+
+#define UART_BRIDGE_NUM (sizeof(kUartBridges) / sizeof(kUartBridges[0]))
 
 void uart_bridge_close() {
     netconn_events events;
+    if (uart_server_events == NULL)
+        return; // not started yet
     events.type = NETCONN_EVT_WIFI_DISCONNECTED;
     xQueueSend(uart_server_events, &events, 1000);
 }
 
-static void uart_bridge_reset() {
-    uart_netconn = NULL;
-    is_conn_valid = false;
+static void uart_bridge_wake(uart_bridge_t *b) {
+    uart_event_t event = {.type = UART_EVENT_SEND};
+    // a wake already queued will do
+    xQueueSend(b->events, &event, 0);
 }
 
-static int num_digits(int n) {
-    if (n < 10)
-        return 1;
-    if (n < 100)
-        return 2;
-    if (n < 1000)
-        return 3;
-    if (n < 10000)
-        return 4;
-    if (n < 100000)
-        return 5;
-    if (n < 1000000)
-        return 6;
-
-    return 7;
+static uart_client_t *uart_client_find(struct netconn *nc, uart_bridge_t **bridge) {
+    for (int i = 0; i < UART_BRIDGE_NUM; i++) {
+        for (int j = 0; j < UART_BRIDGE_CLIENTS; j++) {
+            if (kUartBridges[i].clients[j].nc == nc) {
+                *bridge = &kUartBridges[i];
+                return &kUartBridges[i].clients[j];
+            }
+        }
+    }
+    return NULL;
 }
 
 /*
@@ -132,17 +205,24 @@ static void netCallback(struct netconn *conn, enum netconn_evt evt, uint16_t len
           (uint32_t)conn, conn->state, evt, length, conn->type, conn->flags, conn->pending_err);
 
     netconn_events events;
+    uart_bridge_t *b;
+    uart_client_t *cl;
 
     // If netconn got error, it is close or deleted, dont do treatments on it.
     if (conn->pending_err) {
         return;
     }
-    // Treatments only on rcv events.
     switch (evt) {
     case NETCONN_EVT_RCVPLUS:
         events.nc = conn;
         events.type = evt;
         break;
+    case NETCONN_EVT_SENDPLUS:
+        // room again for a client that had to stop
+        cl = uart_client_find(conn, &b);
+        if (cl != NULL && cl->blocked)
+            uart_bridge_wake(b);
+        return;
     default:
         return;
         break;
@@ -153,7 +233,7 @@ static void netCallback(struct netconn *conn, enum netconn_evt evt, uint16_t len
 }
 
 /*
- *  Initialize a server netconn and listen port
+ * This function create a TCP connection
  */
 static void set_tcp_server_netconn(struct netconn **nc, uint16_t port, netconn_callback callback) {
     if (nc == NULL) {
@@ -172,7 +252,7 @@ static void set_tcp_server_netconn(struct netconn **nc, uint16_t port, netconn_c
 }
 
 /*
- *  Close and delete a socket properly
+ * This function close a TCP connection
  */
 static void close_tcp_netconn(struct netconn *nc) {
     nc->pending_err = ERR_CLSD; // It is hacky way to be sure than callback will don't do treatment on a netconn closed and deleted
@@ -180,136 +260,557 @@ static void close_tcp_netconn(struct netconn *nc) {
     netconn_delete(nc);
 }
 
-static void uart_bridge_setup() {
+static void uart_client_close(uart_bridge_t *b, uart_client_t *cl) {
+    // the port task may be sending to it
+    xSemaphoreTake(b->mux, portMAX_DELAY);
+    close_tcp_netconn(cl->nc);
+    b->reader_drops += cl->reader.lost;
+    cl->nc = NULL;
+    xSemaphoreGive(b->mux);
+}
+
+// Bytes for one client only, called with b->mux held
+static void uart_client_queue(uart_client_t *cl, const uint8_t *data, size_t len) {
+    if (cl->pending_off > 0) {
+        memmove(cl->pending, cl->pending + cl->pending_off, cl->pending_len - cl->pending_off);
+        cl->pending_len -= cl->pending_off;
+        cl->pending_off = 0;
+    }
+    // a client that does not read its answers loses some
+    if (cl->pending_len + len > sizeof(cl->pending))
+        return;
+    memcpy(cl->pending + cl->pending_len, data, len);
+    cl->pending_len += len;
+}
+
+static uint32_t uart_clock_ms() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/*
+ * Serial port operations for RFC 2217 clients, applied to both directions
+ */
+static uint32_t uart_port_set_baudrate(void *ctx, uint32_t baudrate) {
+    uart_bridge_t *b = ctx;
+    uint32_t current = UART_BRIDGE_BAUDRATE;
+
+    // the driver refuses rates the clock can not divide down to
+    if (baudrate > 0 && uart_set_baudrate(b->rx_num, baudrate) == ESP_OK) {
+        uart_set_baudrate(b->tx_num, baudrate);
+        ESP_LOGI(UART_TAG, "port %u change baud:%u", b->port, baudrate);
+    }
+    uart_get_baudrate(b->rx_num, &current);
+    return current;
+}
+
+static uint8_t uart_port_set_datasize(void *ctx, uint8_t bits) {
+    uart_bridge_t *b = ctx;
+
+    if (bits >= 5 && bits <= 8) {
+        uart_set_word_length(b->rx_num, UART_DATA_5_BITS + (bits - 5));
+        uart_set_word_length(b->tx_num, UART_DATA_5_BITS + (bits - 5));
+        b->datasize = bits;
+    }
+    return b->datasize;
+}
+
+static uint8_t uart_port_set_parity(void *ctx, uint8_t parity) {
+    uart_bridge_t *b = ctx;
+    uart_parity_t mode;
+
+    switch (parity) {
+    case RFC2217_PARITY_NONE:
+        mode = UART_PARITY_DISABLE;
+        break;
+    case RFC2217_PARITY_ODD:
+        mode = UART_PARITY_ODD;
+        break;
+    case RFC2217_PARITY_EVEN:
+        mode = UART_PARITY_EVEN;
+        break;
+    default: // mark and space are not in the hardware
+        return b->parity;
+    }
+    uart_set_parity(b->rx_num, mode);
+    uart_set_parity(b->tx_num, mode);
+    b->parity = parity;
+    return b->parity;
+}
+
+static uint8_t uart_port_set_stopsize(void *ctx, uint8_t stopsize) {
+    uart_bridge_t *b = ctx;
+    uart_stop_bits_t mode;
+
+    switch (stopsize) {
+    case RFC2217_STOPSIZE_1:
+        mode = UART_STOP_BITS_1;
+        break;
+    case RFC2217_STOPSIZE_2:
+        mode = UART_STOP_BITS_2;
+        break;
+    case RFC2217_STOPSIZE_1_5:
+        mode = UART_STOP_BITS_1_5;
+        break;
+    default:
+        return b->stopsize;
+    }
+    uart_set_stop_bits(b->rx_num, mode);
+    uart_set_stop_bits(b->tx_num, mode);
+    b->stopsize = stopsize;
+    return b->stopsize;
+}
+
+static uint8_t uart_port_set_control(void *ctx, uint8_t control) {
+    uart_bridge_t *b = ctx;
+
+    switch (control) {
+    case RFC2217_CONTROL_FLOW_NONE:
+    case RFC2217_CONTROL_FLOW_HARDWARE:
+        if (control == RFC2217_CONTROL_FLOW_HARDWARE && !b->flow_control)
+            return b->flow; // RTS/CTS are not wired on this port
+        uart_set_hw_flow_ctrl(b->rx_num, control == RFC2217_CONTROL_FLOW_HARDWARE ?
+                              UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE, UART_RX_FLOW_THRESH);
+        b->flow = control;
+        // fall through
+    case RFC2217_CONTROL_FLOW_REQUEST:
+        return b->flow;
+    case RFC2217_CONTROL_BREAK_REQUEST:
+    case RFC2217_CONTROL_BREAK_ON:
+    case RFC2217_CONTROL_BREAK_OFF:
+        return RFC2217_CONTROL_BREAK_OFF;
+#ifndef CONFIG_IDF_TARGET_ESP8266
+    case RFC2217_CONTROL_DTR_ON:
+    case RFC2217_CONTROL_DTR_OFF:
+        // the line is active low
+        if (uart_set_dtr(b->rx_num, control == RFC2217_CONTROL_DTR_OFF) == ESP_OK)
+            b->dtr = control;
+        // fall through
+    case RFC2217_CONTROL_DTR_REQUEST:
+        return b->dtr;
+    case RFC2217_CONTROL_RTS_ON:
+    case RFC2217_CONTROL_RTS_OFF:
+        // refused while the hardware drives RTS
+        if (uart_set_rts(b->rx_num, control == RFC2217_CONTROL_RTS_OFF) == ESP_OK)
+            b->rts = control;
+        // fall through
+    case RFC2217_CONTROL_RTS_REQUEST:
+        return b->rts;
+#else
+    case RFC2217_CONTROL_DTR_REQUEST:
+    case RFC2217_CONTROL_DTR_ON:
+    case RFC2217_CONTROL_DTR_OFF:
+        return b->dtr;
+    case RFC2217_CONTROL_RTS_REQUEST:
+    case RFC2217_CONTROL_RTS_ON:
+    case RFC2217_CONTROL_RTS_OFF:
+        return b->rts;
+#endif
+    default: // XON/XOFF and inbound flow settings are not supported
+        return b->flow;
+    }
+}
+
+static void uart_port_purge(void *ctx, uint8_t which) {
+    uart_bridge_t *b = ctx;
+
+    if (which == RFC2217_PURGE_RX || which == RFC2217_PURGE_BOTH)
+        uart_flush_input(b->rx_num);
+}
+
+static const rfc2217_port_t kUartPortOps = {
+    .set_baudrate = uart_port_set_baudrate,
+    .set_datasize = uart_port_set_datasize,
+    .set_parity = uart_port_set_parity,
+    .set_stopsize = uart_port_set_stopsize,
+    .set_control = uart_port_set_control,
+    .purge = uart_port_purge,
+};
+
+/*
+ * Send what a client has waiting without blocking, called by the port task
+ * with b->mux held. A client lwIP has no room for is left behind and woken
+ * again by SENDPLUS, the others go on.
+ */
+static void uart_client_send(uart_bridge_t *b, uart_client_t *cl) {
+    const uint8_t *data;
+    size_t len, written;
+    err_t err;
+
+    if (cl->nc == NULL)
+        return;
+
+    while (1) {
+        written = 0;
+        if (cl->pending_off < cl->pending_len) {
+            len = cl->pending_len - cl->pending_off;
+            cl->blocked = true; // before the write, SENDPLUS may come right after it
+            err = netconn_write_partly(cl->nc, cl->pending + cl->pending_off, len,
+                                       NETCONN_COPY | NETCONN_DONTBLOCK, &written);
+            cl->pending_off += written;
+            if (cl->pending_off == cl->pending_len)
+                cl->pending_off = cl->pending_len = 0;
+        } else {
+            if (cl->rfc2217.suspended)
+                break;
+            len = uart_capture_read(&b->capture, &cl->reader, &data);
+            if (len == 0)
+                break;
+            if (cl->rfc2217.telnet) {
+                len = MIN(len, UART_ESCAPE_CHUNK);
+                cl->pending_off = 0;
+                cl->pending_len = rfc2217_escape(&cl->rfc2217, data, len, cl->pending);
+                uart_capture_consume(&b->capture, &cl->reader, len);
+                continue;
+            }
+            cl->blocked = true;
+            err = netconn_write_partly(cl->nc, data, len, NETCONN_COPY | NETCONN_DONTBLOCK, &written);
+            uart_capture_consume(&b->capture, &cl->reader, written);
+        }
+
+        // a broken connection is closed by the bridge task on its next receive
+        if ((err != ERR_OK && err != ERR_WOULDBLOCK) || written < len)
+            return;
+        cl->blocked = false;
+    }
+    cl->blocked = false;
+}
+
+static void uart_bridge_fan_out(uart_bridge_t *b) {
+    for (int i = 0; i < UART_BRIDGE_CLIENTS; i++)
+        uart_client_send(b, &b->clients[i]);
+}
+
+// Tell the RFC 2217 clients about line errors
+static void uart_bridge_linestate(uart_bridge_t *b, uint8_t state) {
+    uint8_t buf[8];
+    size_t len;
+
+    xSemaphoreTake(b->mux, portMAX_DELAY);
+    for (int i = 0; i < UART_BRIDGE_CLIENTS; i++) {
+        uart_client_t *cl = &b->clients[i];
+        if (cl->nc == NULL)
+            continue;
+        len = rfc2217_linestate(&cl->rfc2217, state, buf);
+        if (len > 0)
+            uart_client_queue(cl, buf, len);
+    }
+    uart_bridge_fan_out(b);
+    xSemaphoreGive(b->mux);
+}
+
+// Move everything the driver holds into the ring and on to the clients
+static void uart_bridge_flush(uart_bridge_t *b) {
+    size_t len = 0, room;
+    uint8_t *span;
+    int n;
+
+    uart_coalesce_sent(&b->coalesce);
+    uart_get_buffered_data_len(b->rx_num, &len);
+
+    xSemaphoreTake(b->mux, portMAX_DELAY);
+    while (len > 0) {
+        // straight into the ring, the clients read it from there
+        room = uart_capture_write_span(&b->capture, &span);
+        n = uart_read_bytes(b->rx_num, span, MIN(len, room), 0);
+        if (n <= 0)
+            break;
+        uart_capture_commit(&b->capture, n, uart_clock_ms());
+        len -= n;
+    }
+    uart_bridge_fan_out(b);
+    xSemaphoreGive(b->mux);
+}
+
+/*
+ * UART to TCP of one port, woken by the driver instead of polling
+ */
+static void uart_bridge_rx_task(void *argument) {
+    uart_bridge_t *b = argument;
+    uart_event_t event;
+    uint32_t wait;
+    TickType_t ticks;
+
+    uart_coalesce_init(&b->coalesce, UART_BRIDGE_COALESCE_MS, UART_BRIDGE_FLUSH_SIZE);
+
+    while (1) {
+        wait = uart_coalesce_wait(&b->coalesce, uart_clock_ms());
+        if (wait == UART_COALESCE_FOREVER)
+            ticks = portMAX_DELAY;
+        else
+            ticks = (wait + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+
+        if (ticks == 0 || xQueueReceive(b->events, &event, ticks) != pdTRUE) {
+            // nothing more within the coalescing time
+            uart_bridge_flush(b);
+            continue;
+        }
+
+        switch (event.type) {
+        case UART_DATA:
+            if (uart_coalesce_add(&b->coalesce, event.size, UART_EVENT_IDLE(event), uart_clock_ms()))
+                uart_bridge_flush(b);
+            break;
+        case UART_BUFFER_FULL: // make room before the driver drops bytes
+            uart_bridge_flush(b);
+            break;
+        case UART_EVENT_SEND:
+            xSemaphoreTake(b->mux, portMAX_DELAY);
+            uart_bridge_fan_out(b);
+            xSemaphoreGive(b->mux);
+            break;
+        case UART_FIFO_OVF:
+            ESP_LOGW(UART_TAG, "port %u rx fifo overflow", b->port);
+            uart_flush_input(b->rx_num);
+            xQueueReset(b->events);
+            uart_coalesce_sent(&b->coalesce);
+            uart_bridge_linestate(b, RFC2217_LINESTATE_OVERRUN);
+            break;
+        case UART_FRAME_ERR:
+            uart_bridge_linestate(b, RFC2217_LINESTATE_FRAMING);
+            break;
+        case UART_PARITY_ERR:
+            uart_bridge_linestate(b, RFC2217_LINESTATE_PARITY);
+            break;
+#ifndef CONFIG_IDF_TARGET_ESP8266
+        case UART_BREAK:
+            uart_bridge_linestate(b, RFC2217_LINESTATE_BREAK);
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+}
+
+static int uart_capture_setup(uart_bridge_t *b) {
+    size_t size = UART_BRIDGE_CAPTURE_SIZE;
+    uint8_t *buf = NULL;
+
+#if defined CONFIG_SPIRAM || defined CONFIG_ESP32_SPIRAM_SUPPORT
+    buf = heap_caps_malloc(UART_BRIDGE_CAPTURE_PSRAM_SIZE, MALLOC_CAP_SPIRAM);
+    if (buf != NULL)
+        size = UART_BRIDGE_CAPTURE_PSRAM_SIZE;
+#endif
+    if (buf == NULL)
+        buf = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    if (buf == NULL) {
+        ESP_LOGE(UART_TAG, "port %u: no memory for the %u byte ring", b->port, (unsigned)size);
+        return -1;
+    }
+    uart_capture_init(&b->capture, buf, size);
+    return 0;
+}
+
+static void uart_bridge_setup(uart_bridge_t *b) {
+    bool flow = UART_BRIDGE_FLOW_CONTROL && b->flow_control;
     uart_config_t uart_config = {
         .baud_rate = UART_BRIDGE_BAUDRATE,
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE};
-
-    if (UART_BRIDGE_TX == UART_BRIDGE_RX) {
-        uart_param_config(UART_BRIDGE_RX, &uart_config);
-        uart_driver_install(UART_BRIDGE_RX, UART_BUF_SIZE, UART_BUF_SIZE, 0, NULL, 0);
+        .flow_ctrl = flow ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = UART_RX_FLOW_THRESH};
+
+    b->ops = kUartPortOps;
+    b->ops.ctx = b;
+    b->datasize = 8;
+    b->parity = RFC2217_PARITY_NONE;
+    b->stopsize = RFC2217_STOPSIZE_1;
+    b->flow = flow ? RFC2217_CONTROL_FLOW_HARDWARE : RFC2217_CONTROL_FLOW_NONE;
+    b->dtr = RFC2217_CONTROL_DTR_OFF;
+    b->rts = RFC2217_CONTROL_RTS_OFF;
+
+    if (b->tx_num == b->rx_num) {
+        uart_param_config(b->rx_num, &uart_config);
+        uart_driver_install(b->rx_num, UART_BRIDGE_RX_BUFFER_SIZE, UART_BRIDGE_TX_BUFFER_SIZE,
+                            UART_EVENT_QUEUE_SIZE, &b->events, 0);
     } else {
-        uart_param_config(UART_BRIDGE_RX, &uart_config);
-        uart_param_config(UART_BRIDGE_TX, &uart_config);
+        uart_param_config(b->rx_num, &uart_config);
+        uart_param_config(b->tx_num, &uart_config);
 
-        uart_driver_install(UART_BRIDGE_RX, UART_BUF_SIZE, 0, 0, NULL, 0); // RX only
-        uart_driver_install(UART_BRIDGE_TX, 0, UART_BUF_SIZE, 0, NULL, 0); // TX only
+        uart_driver_install(b->rx_num, UART_BRIDGE_RX_BUFFER_SIZE, 0, UART_EVENT_QUEUE_SIZE, &b->events, 0); // RX only
+        uart_driver_install(b->tx_num, 0, UART_BRIDGE_TX_BUFFER_SIZE, 0, NULL, 0); // TX only
     }
 
 #if defined CONFIG_IDF_TARGET_ESP32 || defined CONFIG_IDF_TARGET_ESP32C3
-    uart_set_pin(UART_BRIDGE_TX, UART_BRIDGE_TX_PIN, UART_BRIDGE_RX_PIN, -1, -1);
+    uart_set_rx_full_threshold(b->rx_num, UART_RX_FULL_THRESH);
+    uart_set_pin(b->tx_num, b->tx_pin, b->rx_pin, flow ? b->rts_pin : -1, flow ? b->cts_pin : -1);
 #endif
+}
 
+int uart_bridge_stats(int index, uart_bridge_stats_t *stats) {
+    uart_bridge_t *b;
+
+    if (index < 0 || index >= UART_BRIDGE_NUM)
+        return -1;
+    b = &kUartBridges[index];
+    memset(stats, 0, sizeof(*stats));
+    stats->port = UART_BRIDGE_PORT + index;
+    if (b->mux == NULL)
+        return 0; // not started, or no memory for it
+
+    xSemaphoreTake(b->mux, portMAX_DELAY);
+    stats->sessions = b->sessions;
+    stats->reader_drops = b->reader_drops;
+    for (int i = 0; i < UART_BRIDGE_CLIENTS; i++) {
+        if (b->clients[i].nc == NULL)
+            continue;
+        stats->clients++;
+        stats->reader_drops += b->clients[i].reader.lost;
+    }
+    uart_capture_stats(&b->capture, &stats->capture);
+    xSemaphoreGive(b->mux);
+    return 0;
+}
+
+static void uart_bridge_accept(uart_bridge_t *b) {
+    struct netconn *nc_in = NULL;
+    uart_client_t *cl = NULL;
+
+    int err = netconn_accept(b->listen, &nc_in);
+    if (err != ERR_OK) {
+        if (nc_in)
+            netconn_delete(nc_in);
+        return;
+    }
+
+    for (int i = 0; i < UART_BRIDGE_CLIENTS; i++) {
+        if (b->clients[i].nc == NULL) {
+            cl = &b->clients[i];
+            break;
+        }
+    }
+    if (cl == NULL) {
+        close_tcp_netconn(nc_in);
+        return;
+    }
+
+    xSemaphoreTake(b->mux, portMAX_DELAY);
+    cl->nc = nc_in;
+    rfc2217_init(&cl->rfc2217, &b->ops);
+    // the backlog nobody got yet, if any, then live data
+    uart_capture_reader_open(&b->capture, &cl->reader);
+    cl->pending_len = cl->pending_off = 0;
+    cl->blocked = false;
+    b->sessions++;
+    xSemaphoreGive(b->mux);
+
+    uart_bridge_wake(b);
+}
+
+#if (UART_BRIDGE_BAUD_HACK == 1)
+// A raw client may open with the baud rate in ASCII, "115200" alone in the
+// first packet. It is set and the packet is not written to the UART.
+static bool uart_bridge_baud_hack(uart_bridge_t *b, const char *buf, uint16_t len) {
+    uint32_t baudrate = 0;
+
+    if (len < 2 || len > 7 || buf[0] == '0')
+        return false;
+    for (int i = 0; i < len; i++) {
+        if (buf[i] < '0' || buf[i] > '9')
+            return false;
+        baudrate = baudrate * 10 + (buf[i] - '0');
+    }
+    if (baudrate >= 2000000)
+        return false;
+
+    uart_port_set_baudrate(b, baudrate);
+    return true;
+}
+#endif
+
+static void uart_bridge_receive(uart_bridge_t *b, uart_client_t *cl) {
+    struct netbuf *netbuf = NULL;
+    char *buffer;
+    uint16_t len_buf;
+    int suspended;
+
+    if (netconn_recv(cl->nc, &netbuf) != ERR_OK) {
+        if (cl->nc->pending_err == ERR_CLSD) {
+            return; // The same hacky way to treat a closed connection
+        }
+        uart_client_close(b, cl);
+        return;
+    }
+
+    suspended = cl->rfc2217.suspended;
+    do {
+        netbuf_data(netbuf, (void *)&buffer, &len_buf);
+#if (UART_BRIDGE_BAUD_HACK == 1)
+        if (!cl->rfc2217.started && uart_bridge_baud_hack(b, buffer, len_buf)) {
+            cl->rfc2217.started = 1; // not Telnet, it started with a digit
+            continue;
+        }
+#endif
+        // port control is taken out, the answers go back through the port task
+        len_buf = rfc2217_input(&cl->rfc2217, (uint8_t *)buffer, len_buf);
+        if (cl->rfc2217.reply_len > 0) {
+            xSemaphoreTake(b->mux, portMAX_DELAY);
+            uart_client_queue(cl, cl->rfc2217.reply, cl->rfc2217.reply_len);
+            xSemaphoreGive(b->mux);
+            cl->rfc2217.reply_len = 0;
+        }
+        // write to uart
+        if (len_buf > 0)
+            uart_write_bytes(b->tx_num, (const char *)buffer, len_buf);
+    } while (netbuf_next(netbuf) >= 0);
+    netbuf_delete(netbuf);
+
+    if (cl->pending_len > 0 || suspended != cl->rfc2217.suspended)
+        uart_bridge_wake(b);
 }
 
 void uart_bridge_init() {
     uart_server_events = xQueueCreate(EVENTS_QUEUE_SIZE, sizeof(netconn_events));
 }
 
+/*
+ * Listens on every port and moves TCP data to the UARTs, the port tasks
+ * take care of the other direction
+ */
 void uart_bridge_task() {
-    uart_bridge_setup();
-    uart_server_events = xQueueCreate(EVENTS_QUEUE_SIZE, sizeof(netconn_events));
-
-    struct netconn *nc = NULL; // To create servers
+    uart_bridge_t *b;
+    uart_client_t *cl;
 
-    set_tcp_server_netconn(&nc, UART_BRIDGE_PORT, netCallback);
+    uart_server_events = xQueueCreate(EVENTS_QUEUE_SIZE, sizeof(netconn_events));
 
-    struct netbuf *netbuf = NULL; // To store incoming Data
-    struct netconn *nc_in = NULL; // To accept incoming netconn
-    //
-    char *buffer;
-    uint16_t len_buf;
-    size_t uart_buf_len;
+    for (int i = 0; i < UART_BRIDGE_NUM; i++) {
+        b = &kUartBridges[i];
+        b->port = UART_BRIDGE_PORT + i;
+        if (uart_capture_setup(b) < 0)
+            continue;
+        uart_bridge_setup(b);
+        b->mux = xSemaphoreCreateMutex();
+        set_tcp_server_netconn(&b->listen, b->port, netCallback);
+        xTaskCreate(uart_bridge_rx_task, "uart_rx", 2048, b, 6, NULL);
+    }
 
     while (1) {
         netconn_events events;
-        int ret = xQueueReceive(uart_server_events, &events, pdMS_TO_TICKS(100));
-
-        if (ret != pdTRUE) {
-            // timeout
-            if (is_conn_valid) {
-                ESP_ERROR_CHECK(uart_get_buffered_data_len(UART_BRIDGE_RX, &uart_buf_len));
-                uart_buf_len = uart_buf_len > UART_BUF_SIZE ? UART_BUF_SIZE : uart_buf_len;
-                uart_buf_len = uart_read_bytes(UART_BRIDGE_RX, uart_read_buffer, uart_buf_len, pdMS_TO_TICKS(5));
-                // then send data
-                netconn_write(uart_netconn, uart_read_buffer, uart_buf_len, NETCONN_COPY);
-            }
-        } else if (events.type == NETCONN_EVT_WIFI_DISCONNECTED) { // WIFI disconnected
-            if (is_conn_valid) {
-                close_tcp_netconn(uart_netconn);
-                uart_bridge_reset();
+        // UART data is sent by the port tasks, only the network wakes this task
+        if (xQueueReceive(uart_server_events, &events, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        if (events.type == NETCONN_EVT_WIFI_DISCONNECTED) { // WIFI disconnected
+            for (int i = 0; i < UART_BRIDGE_NUM; i++) {
+                for (int j = 0; j < UART_BRIDGE_CLIENTS; j++) {
+                    if (kUartBridges[i].clients[j].nc != NULL)
+                        uart_client_close(&kUartBridges[i], &kUartBridges[i].clients[j]);
+                }
             }
         } else if (events.nc->state == NETCONN_LISTEN) {
-            if (is_conn_valid) {
-                netconn_accept(events.nc, &nc_in);
-                if (nc_in)
-                    close_tcp_netconn(nc_in);
-                continue;
+            for (int i = 0; i < UART_BRIDGE_NUM; i++) {
+                if (kUartBridges[i].listen == events.nc)
+                    uart_bridge_accept(&kUartBridges[i]);
             }
-
-            int err = netconn_accept(events.nc, &nc_in);
-            if (err != ERR_OK) {
-                if (nc_in)
-                    netconn_delete(nc_in);
-                continue;
-            }
-
-            ip_addr_t client_addr; // Address port
-            uint16_t client_port;  // Client port
-            netconn_peer(nc_in, &client_addr, &client_port);
-
-            uart_netconn = nc_in;
-            is_conn_valid = true;
-            is_first_time_recv = true;
-        } else if (events.nc->state != NETCONN_LISTEN) {
+        } else {
             // if (events.nc && events.nc->pcb.tcp)
             //     tcp_nagle_disable(events.nc->pcb.tcp);
-
-            uart_netconn = events.nc;
-            // read data from UART
-            ESP_ERROR_CHECK(uart_get_buffered_data_len(UART_BRIDGE_RX, &uart_buf_len));
-            uart_buf_len = uart_buf_len > UART_BUF_SIZE ? UART_BUF_SIZE : uart_buf_len;
-            uart_buf_len = uart_read_bytes(UART_BRIDGE_RX, uart_read_buffer, uart_buf_len, pdMS_TO_TICKS(5));
-            // then send data
-            netconn_write(events.nc, uart_read_buffer, uart_buf_len, NETCONN_COPY);
-
-            // try to get data
-            if ((netconn_recv(events.nc, &netbuf)) == ERR_OK) // data incoming ?
-            {
-                do {
-                    netbuf_data(netbuf, (void *)&buffer, &len_buf);
-                    // write to uart
-                    if (is_first_time_recv) { // change bard rate
-                        if (len_buf > 1 && len_buf < 8) {
-                            char tmp_buff[8];
-                            memcpy(tmp_buff, buffer, len_buf);
-                            tmp_buff[len_buf] = '\0';
-                            int baudrate = atoi(tmp_buff);
-                            if (baudrate > 0 && baudrate < 2000000 && num_digits(baudrate) == len_buf) {
-                                ESP_LOGI(UART_TAG, "change baud:%d", baudrate);
-                                uart_set_baudrate(UART_BRIDGE_RX, baudrate);
-                                uart_set_baudrate(UART_BRIDGE_TX, baudrate);
-                                is_first_time_recv = false;
-                                continue;
-                            }
-                        }
-                        is_first_time_recv = false;
-                    }
-                    uart_write_bytes(UART_BRIDGE_TX, (const char *)buffer, len_buf);
-                } while (netbuf_next(netbuf) >= 0);
-                netbuf_delete(netbuf);
-            } else {
-                if (events.nc->pending_err == ERR_CLSD) {
-                    continue; // The same hacky way to treat a closed connection
-                }
-                close_tcp_netconn(events.nc);
-                uart_bridge_reset();
-            }
+            cl = uart_client_find(events.nc, &b);
+            if (cl != NULL)
+                uart_bridge_receive(b, cl);
         }
     }
 }
 
-#endif // (USE_UART_BRIDGE == 1)
\ No newline at end of file
+#endif // (USE_UART_BRIDGE == 1)
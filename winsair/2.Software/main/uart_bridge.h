@@ -1,10 +1,27 @@
 #ifndef _UART_BRIDGE_H_
 #define _UART_BRIDGE_H_
 
+#include "main/uart_capture.h"
 
 void uart_bridge_init();
 void uart_bridge_task();
 void uart_bridge_close();
 
+typedef struct
+{
+    uint16_t port;
+    uint32_t clients;
+    uint32_t sessions;
+    uint32_t reader_drops; // bytes clients skipped because they fell behind
+    uart_capture_stats_t capture;
+} uart_bridge_stats_t;
+
+/**
+ * @brief Stats of the index-th bridged UART
+ *
+ * @return 0, or -1 past the last one
+ */
+int uart_bridge_stats(int index, uart_bridge_stats_t *stats);
+
 
 #endif
\ No newline at end of file
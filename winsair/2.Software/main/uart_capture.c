@@ -0,0 +1,127 @@
+/**
+ * @file uart_capture.c
+ * @brief Receive ring of a bridged UART, shared by all of its clients
+ * @version 0.2
+ * @date 2026-10-17
+ *
+ */
+#include <string.h>
+
+#include "main/uart_capture.h"
+
+
+static uint32_t oldest_pos(const uart_capture_t *c)
+{
+    return c->head - c->filled;
+}
+
+// buf index of a position still in the ring
+static size_t ring_index(const uart_capture_t *c, uint32_t pos)
+{
+    size_t back = c->head - pos;
+
+    return c->head_index >= back ? c->head_index - back : c->head_index + c->size - back;
+}
+
+void uart_capture_init(uart_capture_t *c, uint8_t *buf, size_t size)
+{
+    memset(c, 0, sizeof(*c));
+    c->buf = buf;
+    c->size = buf ? size : 0;
+}
+
+size_t uart_capture_write_span(const uart_capture_t *c, uint8_t **data)
+{
+    *data = c->buf + c->head_index;
+    return c->size - c->head_index;
+}
+
+void uart_capture_commit(uart_capture_t *c, size_t len, uint32_t now_ms)
+{
+    uart_capture_mark_t *mark;
+    uint32_t oldest;
+
+    if (len == 0)
+        return;
+
+    mark = &c->marks[c->mark_count % UART_CAPTURE_MARKS];
+    mark->pos = c->head;
+    mark->time_ms = now_ms;
+    c->mark_count++;
+
+    c->head += len;
+    c->head_index += len;
+    if (c->head_index == c->size)
+        c->head_index = 0;
+    c->filled = c->filled + len > c->size ? c->size : c->filled + len;
+
+    // bytes nobody got are gone once they are overwritten
+    oldest = oldest_pos(c);
+    if ((int32_t)(oldest - c->delivered) > 0) {
+        c->overflows += oldest - c->delivered;
+        c->delivered = oldest;
+    }
+}
+
+void uart_capture_reader_open(const uart_capture_t *c, uart_capture_reader_t *r)
+{
+    r->pos = c->delivered;
+    r->lost = 0;
+}
+
+size_t uart_capture_read(const uart_capture_t *c, uart_capture_reader_t *r, const uint8_t **data)
+{
+    uint32_t oldest = oldest_pos(c);
+    size_t index, len;
+
+    if ((int32_t)(oldest - r->pos) > 0) {
+        // lapped, go on with what is left
+        r->lost += oldest - r->pos;
+        r->pos = oldest;
+    }
+
+    len = c->head - r->pos;
+    if (len == 0)
+        return 0;
+    index = ring_index(c, r->pos);
+    if (len > c->size - index)
+        len = c->size - index;
+    *data = c->buf + index;
+    return len;
+}
+
+void uart_capture_consume(uart_capture_t *c, uart_capture_reader_t *r, size_t len)
+{
+    r->pos += len;
+    if ((int32_t)(r->pos - c->delivered) > 0)
+        c->delivered = r->pos;
+}
+
+void uart_capture_stats(const uart_capture_t *c, uart_capture_stats_t *stats)
+{
+    uint32_t want, age, best = 0, oldest = 0;
+    uint32_t marks = c->mark_count < UART_CAPTURE_MARKS ? c->mark_count : UART_CAPTURE_MARKS;
+    int found = 0;
+
+    stats->capacity = c->size;
+    stats->used = c->head - c->delivered;
+    stats->overflows = c->overflows;
+    stats->oldest_ms = 0;
+    if (stats->used == 0)
+        return;
+
+    // the write that holds the first byte nobody got, or the oldest one
+    // still known if it is further back than the marks reach
+    want = stats->used;
+    for (uint32_t i = 0; i < marks; i++) {
+        age = c->head - c->marks[i].pos;
+        if (age >= want && (!found || age < best)) {
+            best = age;
+            stats->oldest_ms = c->marks[i].time_ms;
+            found = 1;
+        } else if (!found && age > oldest) {
+            oldest = age;
+            stats->oldest_ms = c->marks[i].time_ms;
+        }
+    }
+}
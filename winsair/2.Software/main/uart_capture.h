@@ -0,0 +1,102 @@
+/**
+ * @file uart_capture.h
+ * @brief Receive ring of a bridged UART, shared by all of its clients
+ * @version 0.2
+ * @date 2026-10-17
+ *
+ * Everything read from the UART goes into one ring. Each client reads it
+ * through its own cursor, straight from the ring. The writer never waits:
+ * a client the writer laps skips ahead to the oldest byte still there and
+ * the skipped bytes are counted against it, so a slow client only costs
+ * itself.
+ *
+ * Bytes no client got yet stay in the ring while nobody is connected, and
+ * the next client starts with them.
+ *
+ * This file does not depend on FreeRTOS or lwIP, the host tools link it too.
+ */
+#ifndef __UART_CAPTURE_H__
+#define __UART_CAPTURE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// write times kept, one per write, for the age of the backlog
+#define UART_CAPTURE_MARKS 32
+
+typedef struct
+{
+    uint32_t pos;
+    uint32_t time_ms;
+} uart_capture_mark_t;
+
+// Positions count every byte ever written and wrap at 4 GB
+typedef struct
+{
+    uint8_t *buf;
+    size_t size;
+    size_t filled;      // bytes in the ring
+    size_t head_index;  // buf index of head
+    uint32_t head;      // position of the next byte
+    uint32_t delivered; // bytes before this reached some client
+    uint32_t overflows; // bytes overwritten before any client got them
+    uart_capture_mark_t marks[UART_CAPTURE_MARKS];
+    uint32_t mark_count;
+} uart_capture_t;
+
+typedef struct
+{
+    uint32_t pos;
+    uint32_t lost; // bytes skipped because the writer lapped this reader
+} uart_capture_reader_t;
+
+typedef struct
+{
+    uint32_t capacity;
+    uint32_t used;      // bytes no client got yet
+    uint32_t overflows;
+    uint32_t oldest_ms; // when the oldest of them was read, if any
+} uart_capture_stats_t;
+
+/**
+ * @brief Use buf as the ring
+ *
+ */
+void uart_capture_init(uart_capture_t *c, uint8_t *buf, size_t size);
+
+/**
+ * @brief Room at the head, for reading the UART straight into the ring.
+ *        Writing there overwrites the oldest bytes.
+ *
+ * @return contiguous bytes at *data
+ */
+size_t uart_capture_write_span(const uart_capture_t *c, uint8_t **data);
+
+/**
+ * @brief len bytes were written at the head, read at now_ms
+ *
+ */
+void uart_capture_commit(uart_capture_t *c, size_t len, uint32_t now_ms);
+
+/**
+ * @brief Start a reader at the oldest byte no client got yet
+ *
+ */
+void uart_capture_reader_open(const uart_capture_t *c, uart_capture_reader_t *r);
+
+/**
+ * @brief Bytes waiting for a reader
+ *
+ * @return contiguous bytes at *data, 0 if the reader is up to date
+ */
+size_t uart_capture_read(const uart_capture_t *c, uart_capture_reader_t *r, const uint8_t **data);
+
+/**
+ * @brief The reader sent len bytes
+ *
+ */
+void uart_capture_consume(uart_capture_t *c, uart_capture_reader_t *r, size_t len);
+
+void uart_capture_stats(const uart_capture_t *c, uart_capture_stats_t *stats);
+
+#endif
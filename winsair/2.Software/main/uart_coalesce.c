@@ -0,0 +1,46 @@
+/**
+ * @file uart_coalesce.c
+ * @brief When to hand received UART bytes to the network
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include "main/uart_coalesce.h"
+
+
+void uart_coalesce_init(uart_coalesce_t *c, uint32_t coalesce_ms, size_t flush_size)
+{
+    c->coalesce_ms = coalesce_ms;
+    c->flush_size = flush_size;
+    c->pending = 0;
+    c->since = 0;
+}
+
+int uart_coalesce_add(uart_coalesce_t *c, size_t len, int idle, uint32_t now_ms)
+{
+    if (len == 0)
+        return c->pending > 0 && idle;
+
+    if (c->pending == 0)
+        c->since = now_ms;
+    c->pending += len;
+
+    return idle || c->pending >= c->flush_size ||
+           (uint32_t)(now_ms - c->since) >= c->coalesce_ms;
+}
+
+uint32_t uart_coalesce_wait(const uart_coalesce_t *c, uint32_t now_ms)
+{
+    uint32_t elapsed;
+
+    if (c->pending == 0)
+        return UART_COALESCE_FOREVER;
+
+    elapsed = now_ms - c->since;
+    return elapsed >= c->coalesce_ms ? 0 : c->coalesce_ms - elapsed;
+}
+
+void uart_coalesce_sent(uart_coalesce_t *c)
+{
+    c->pending = 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file uart_coalesce.h
+ * @brief When to hand received UART bytes to the network
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Bytes are sent as soon as the line goes idle, so an interactive console
+ * sees its echo within a few character times, or once flush_size bytes are
+ * waiting, so a bulk log goes out in large segments. A short coalescing
+ * timer bounds the wait when the driver can not tell that the line went idle.
+ *
+ * This file does not depend on FreeRTOS or lwIP, the host tools link it too.
+ */
+#ifndef __UART_COALESCE_H__
+#define __UART_COALESCE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UART_COALESCE_FOREVER 0xFFFFFFFF
+
+typedef struct
+{
+    uint32_t coalesce_ms; // longest wait for more bytes
+    size_t flush_size;    // send right away from this many bytes on
+    size_t pending;       // bytes received and not sent yet
+    uint32_t since;       // when the first of them arrived, in ms
+} uart_coalesce_t;
+
+void uart_coalesce_init(uart_coalesce_t *c, uint32_t coalesce_ms, size_t flush_size);
+
+/**
+ * @brief Account for bytes the driver received
+ *
+ * @param idle the line went quiet after them
+ * @return 1 if everything pending should be sent now
+ */
+int uart_coalesce_add(uart_coalesce_t *c, size_t len, int idle, uint32_t now_ms);
+
+/**
+ * @brief How long to wait for more bytes
+ *
+ * @return ms until the pending bytes are due, 0 if they are due already,
+ *         UART_COALESCE_FOREVER if nothing is pending
+ */
+uint32_t uart_coalesce_wait(const uart_coalesce_t *c, uint32_t now_ms);
+
+/**
+ * @brief The pending bytes were sent
+ *
+ */
+void uart_coalesce_sent(uart_coalesce_t *c);
+
+#endif
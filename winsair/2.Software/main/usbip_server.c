@@ -0,0 +1,523 @@
+/**
+ * @file usbip_server.c
+ * @brief USB/IP server of the CMSIS-DAP device
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Bulk OUT URBs carry DAP requests to the DAP task and complete at once.
+ * Bulk IN URBs wait in a table keyed by seqnum and complete in order as the
+ * DAP task produces responses, so a client can keep several of both in
+ * flight instead of paying one round trip per packet.
+ *
+ * Each bulk IN URB stands for the response of one earlier request. When the
+ * host unlinks a waiting one, that response is dropped as it comes out of the
+ * DAP task rather than handed to the next URB, so later reads stay in step.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "main/usbip_server.h"
+#include "main/DAP_handle.h"
+#include "main/dap_configuration.h"
+#include "main/wifi_configuration.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
+#include "main/net_loop.h"
+
+#include "components/USBIP/usbip_defs.h"
+#include "components/USBIP/usb_descriptor.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "lwip/sockets.h"
+
+// Bulk IN URBs that may wait for a DAP response at the same time
+#define USBIP_URB_NUM 64
+
+#define USBIP_HEADER_SIZE (sizeof(usbip_stage2_header))
+// One message with the largest payload the device accepts
+#define USBIP_RX_BUFFER_SIZE (USBIP_HEADER_SIZE + DAP_PACKET_SIZE)
+// Largest EP0 data stage we answer
+#define USBIP_CONTROL_SIZE 256
+
+typedef struct
+{
+    uint32_t seqnum;
+    uint32_t length;  // transfer_buffer_length requested by the host
+    uint8_t unlinked; // its response is dropped when it comes
+} usbip_urb_t;
+
+extern TaskHandle_t kDAPSendTaskHandle;
+
+// In-flight bulk IN URBs, completed from tail to head. Guarded by urb_mux.
+static usbip_urb_t urb_table[USBIP_URB_NUM];
+static uint32_t urb_head = 0;
+static uint32_t urb_tail = 0;
+static SemaphoreHandle_t urb_mux = NULL;
+// DAP requests handed to the DAP task and responses taken back, a response is owed while they differ
+static volatile uint32_t dap_requests = 0;
+static volatile uint32_t dap_responses = 0;
+// Replies come from the receive task and the send task
+static SemaphoreHandle_t send_mux = NULL;
+
+// Holds a message split across segments, carved from the session arena
+static uint8_t *usbip_rx_buffer = NULL;
+static size_t usbip_rx_len = 0;
+
+static uint8_t usbip_reply_buffer[sizeof(usbip_stage2_header) + USBIP_CONTROL_SIZE];
+static uint8_t usbip_complete_buffer[sizeof(usbip_stage2_header) + DAP_PACKET_SIZE];
+
+
+static void usbip_send(const void *buf, size_t len)
+{
+#if (USE_EVENT_LOOP == 1)
+    // handed to the send task, it can not be cut into by a completion
+    if (net_loop_current())
+    {
+        transport_send(buf, len);
+        return;
+    }
+#endif
+    xSemaphoreTake(send_mux, portMAX_DELAY);
+    transport_send(buf, len);
+    xSemaphoreGive(send_mux);
+}
+
+
+// buf has room for the header, followed by data_length bytes of IN data
+static void usbip_send_ret_submit(uint8_t *buf, uint32_t seqnum, int32_t status,
+                                  uint32_t actual_length, uint32_t data_length)
+{
+    usbip_stage2_header *header = (usbip_stage2_header *)buf;
+
+    memset(header, 0, sizeof(usbip_stage2_header));
+    header->base.command = htonl(USBIP_RET_SUBMIT);
+    header->base.seqnum = htonl(seqnum);
+    header->u.ret_submit.status = htonl(status);
+    header->u.ret_submit.data_length = htonl(actual_length);
+
+    usbip_send(buf, sizeof(usbip_stage2_header) + data_length);
+}
+
+
+static void usbip_send_ret_unlink(uint32_t seqnum, int32_t status)
+{
+    usbip_stage2_header header;
+
+    memset(&header, 0, sizeof(usbip_stage2_header));
+    header.base.command = htonl(USBIP_RET_UNLINK);
+    header.base.seqnum = htonl(seqnum);
+    header.u.ret_unlink.status = htonl(status);
+
+    usbip_send(&header, sizeof(usbip_stage2_header));
+}
+
+
+// Length of the message at the head of buf, 0 if incomplete, -1 if it can not be parsed
+static int usbip_message_length(const uint8_t *buf, size_t len)
+{
+    if (kState != EMULATING)
+    {
+        const usbip_stage1_header *header = (const usbip_stage1_header *)buf;
+        if (len < sizeof(usbip_stage1_header))
+            return 0;
+
+        switch (ntohs(header->command))
+        {
+        case USBIP_OP_REQ_DEVLIST:
+            return sizeof(usbip_stage1_header);
+        case USBIP_OP_REQ_IMPORT:
+            return len < sizeof(usbip_stage1_request_import) ? 0 : sizeof(usbip_stage1_request_import);
+        default:
+            return -1;
+        }
+    }
+    else
+    {
+        const usbip_stage2_header *header = (const usbip_stage2_header *)buf;
+        int32_t data_length;
+        if (len < sizeof(usbip_stage2_header))
+            return 0;
+
+        switch (ntohl(header->base.command))
+        {
+        case USBIP_CMD_SUBMIT:
+            data_length = ntohl(header->u.cmd_submit.data_length);
+            if (ntohl(header->base.direction) == USBIP_DIR_IN)
+                data_length = 0; // the data comes back with RET_SUBMIT
+            if (data_length < 0 || sizeof(usbip_stage2_header) + data_length > USBIP_RX_BUFFER_SIZE)
+                return -1;
+            return len < sizeof(usbip_stage2_header) + data_length ? 0 : (int)(sizeof(usbip_stage2_header) + data_length);
+        case USBIP_CMD_UNLINK:
+            return sizeof(usbip_stage2_header);
+        default:
+            return -1;
+        }
+    }
+}
+
+
+static void usbip_devlist()
+{
+    struct
+    {
+        usbip_stage1_header header;
+        uint32_t device_num;
+        usbip_stage1_usb_device device;
+        usbip_stage1_usb_interface intf;
+    } __attribute__((packed)) reply;
+
+    reply.header.version = htons(USBIP_VERSION);
+    reply.header.command = htons(USBIP_OP_REP_DEVLIST);
+    reply.header.status = 0;
+    reply.device_num = htonl(1);
+    usb_device_info(&reply.device);
+    usb_interface_info(&reply.intf);
+
+    usbip_send(&reply, sizeof(reply));
+}
+
+
+static void usbip_import()
+{
+    struct
+    {
+        usbip_stage1_header header;
+        usbip_stage1_usb_device device;
+    } __attribute__((packed)) reply;
+
+    reply.header.version = htons(USBIP_VERSION);
+    reply.header.command = htons(USBIP_OP_REP_IMPORT);
+    reply.header.status = 0;
+    usb_device_info(&reply.device);
+
+    // drop whatever a previous session left and size the queues for USB packets
+#if (USE_EVENT_LOOP == 1)
+    // the loop does not wait, the size stays the same and its backlog holds
+    // the requests until the queues are ready
+    if (net_loop_current())
+        dap_ringbuf_resize_start(DAP_PACKET_SIZE_DEFAULT);
+    else
+#endif
+        dap_ringbuf_resize(DAP_PACKET_SIZE_DEFAULT);
+    urb_head = urb_tail = 0;
+    dap_requests = dap_responses = 0;
+
+    kState = EMULATING;
+    usbip_send(&reply, sizeof(reply));
+}
+
+
+static void usbip_stage1(const uint8_t *msg)
+{
+    const usbip_stage1_header *header = (const usbip_stage1_header *)msg;
+
+    switch (ntohs(header->command))
+    {
+    case USBIP_OP_REQ_DEVLIST:
+        usbip_devlist();
+        break;
+    case USBIP_OP_REQ_IMPORT:
+        usbip_import();
+        break;
+    }
+}
+
+
+/*
+ * Hand a DAP request to the DAP task, the URB is done once it is queued. One
+ * that was dropped fails at once and owes no response. It is counted first,
+ * so the send task can not take a queued request for one without a response.
+ */
+static void usbip_submit_request(uint32_t seqnum, const uint8_t *data, int32_t length)
+{
+    dap_requests++;
+    if (handle_dap_data_request(data, length > kDapPacketSize ? kDapPacketSize : length))
+    {
+        usbip_send_ret_submit(usbip_reply_buffer, seqnum, USBIP_STATUS_OK, length, 0);
+    }
+    else
+    {
+        dap_requests--;
+        usbip_send_ret_submit(usbip_reply_buffer, seqnum, USBIP_STATUS_EPIPE, 0, 0);
+    }
+}
+
+
+static void usbip_control(const usbip_stage2_header *header, const uint8_t *data)
+{
+    const uint8_t *setup = header->u.cmd_submit.setup;
+    uint32_t seqnum = ntohl(header->base.seqnum);
+    int ret;
+
+#if (USE_WINUSB == 0)
+    // HID reports may also come through SET_REPORT
+    if ((setup[0] & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_CLASS && setup[1] == USB_HID_REQ_SET_REPORT)
+    {
+        int32_t length = ntohl(header->u.cmd_submit.data_length);
+        usbip_submit_request(seqnum, data, length);
+        return;
+    }
+#endif
+
+    ret = usb_handle_control(setup, usbip_reply_buffer + sizeof(usbip_stage2_header), USBIP_CONTROL_SIZE);
+    if (ret < 0)
+        usbip_send_ret_submit(usbip_reply_buffer, seqnum, USBIP_STATUS_EPIPE, 0, 0);
+    else if (ntohl(header->base.direction) == USBIP_DIR_IN)
+        usbip_send_ret_submit(usbip_reply_buffer, seqnum, USBIP_STATUS_OK, ret, ret);
+    else
+        usbip_send_ret_submit(usbip_reply_buffer, seqnum, USBIP_STATUS_OK, 0, 0);
+}
+
+
+static void usbip_submit(const usbip_stage2_header *header, const uint8_t *data)
+{
+    uint32_t seqnum = ntohl(header->base.seqnum);
+    uint32_t ep = ntohl(header->base.ep);
+    int32_t length = ntohl(header->u.cmd_submit.data_length);
+
+    if (ep == 0)
+    {
+        usbip_control(header, data);
+    }
+    else if (ep != (USBD0_EP_DAP_OUT & 0x0F))
+    {
+        usbip_send_ret_submit(usbip_reply_buffer, seqnum, USBIP_STATUS_EPIPE, 0, 0);
+    }
+    else if (ntohl(header->base.direction) == USBIP_DIR_OUT)
+    {
+        usbip_submit_request(seqnum, data, length);
+    }
+    else
+    {
+        int queued = 0;
+
+        xSemaphoreTake(urb_mux, portMAX_DELAY);
+        if (urb_head - urb_tail < USBIP_URB_NUM)
+        {
+            urb_table[urb_head % USBIP_URB_NUM].seqnum = seqnum;
+            urb_table[urb_head % USBIP_URB_NUM].length = length;
+            urb_table[urb_head % USBIP_URB_NUM].unlinked = 0;
+            urb_head++;
+            queued = 1;
+        }
+        xSemaphoreGive(urb_mux);
+
+        if (!queued)
+        {
+            os_printf("Too many URBs in flight!\r\n");
+            usbip_send_ret_submit(usbip_reply_buffer, seqnum, USBIP_STATUS_EPIPE, 0, 0);
+        }
+        // a response may already be waiting for it
+        else if (kDAPSendTaskHandle)
+        {
+            xTaskNotifyGive(kDAPSendTaskHandle);
+        }
+    }
+}
+
+
+static void usbip_unlink(const usbip_stage2_header *header)
+{
+    uint32_t seqnum = ntohl(header->u.cmd_unlink.seqnum);
+    int32_t status = USBIP_STATUS_OK; // not waiting any more, RET_SUBMIT has been sent
+    uint32_t i;
+
+    xSemaphoreTake(urb_mux, portMAX_DELAY);
+    for (i = urb_tail; i != urb_head; i++)
+    {
+        usbip_urb_t *urb = &urb_table[i % USBIP_URB_NUM];
+        if (urb->seqnum == seqnum && !urb->unlinked)
+        {
+            urb->unlinked = 1;
+            status = USBIP_STATUS_ECONNRESET;
+            break;
+        }
+    }
+    // under the lock, so a RET_SUBMIT for it can not follow
+    usbip_send_ret_unlink(ntohl(header->base.seqnum), status);
+    xSemaphoreGive(urb_mux);
+
+    // an unlinked URB at the head may not owe anything
+    if (status != USBIP_STATUS_OK && kDAPSendTaskHandle)
+        xTaskNotifyGive(kDAPSendTaskHandle);
+}
+
+
+static void usbip_stage2(const uint8_t *msg)
+{
+    const usbip_stage2_header *header = (const usbip_stage2_header *)msg;
+
+    switch (ntohl(header->base.command))
+    {
+    case USBIP_CMD_SUBMIT:
+        usbip_submit(header, msg + sizeof(usbip_stage2_header));
+        break;
+
+    case USBIP_CMD_UNLINK:
+        usbip_unlink(header);
+        break;
+    }
+}
+
+
+static void usbip_handle(const uint8_t *msg)
+{
+    if (kState == EMULATING)
+        usbip_stage2(msg);
+    else
+        usbip_stage1(msg);
+}
+
+
+// Split the stream into messages, a message may span several segments
+static int usbip_process(const uint8_t *data, size_t len)
+{
+    size_t copy;
+    int msg_len;
+
+    if (urb_mux == NULL)
+    {
+        urb_mux = xSemaphoreCreateMutex();
+        send_mux = xSemaphoreCreateMutex();
+    }
+
+    if (usbip_rx_buffer == NULL)
+    {
+        usbip_rx_buffer = session_arena_alloc(usbip_session_buffer_size());
+        usbip_rx_len = 0;
+        if (usbip_rx_buffer == NULL)
+            return -1;
+    }
+
+    while (len > 0)
+    {
+        if (usbip_rx_len == 0)
+        {
+            msg_len = usbip_message_length(data, len);
+            if (msg_len > 0)
+            {
+                usbip_handle(data);
+                data += msg_len;
+                len -= msg_len;
+                continue;
+            }
+            else if (msg_len < 0)
+            {
+                os_printf("Unknown USB/IP message!\r\n");
+                return -1;
+            }
+        }
+
+        copy = USBIP_RX_BUFFER_SIZE - usbip_rx_len;
+        copy = copy > len ? len : copy;
+        memcpy(usbip_rx_buffer + usbip_rx_len, data, copy);
+        usbip_rx_len += copy;
+        data += copy;
+        len -= copy;
+
+        msg_len = usbip_message_length(usbip_rx_buffer, usbip_rx_len);
+        if (msg_len < 0)
+        {
+            os_printf("Unknown USB/IP message!\r\n");
+            usbip_rx_len = 0;
+            return -1;
+        }
+        else if (msg_len > 0)
+        {
+            usbip_handle(usbip_rx_buffer);
+            // give back what belongs to the next message
+            data -= usbip_rx_len - msg_len;
+            len += usbip_rx_len - msg_len;
+            usbip_rx_len = 0;
+        }
+    }
+
+    return 0;
+}
+
+
+int attach(uint8_t *buffer, uint32_t length)
+{
+    return usbip_process(buffer, length);
+}
+
+
+int emulate(uint8_t *buffer, uint32_t length)
+{
+    return usbip_process(buffer, length);
+}
+
+
+void usbip_complete_urbs()
+{
+    usbip_urb_t urb;
+    int length;
+
+    for (;;)
+    {
+        xSemaphoreTake(urb_mux, portMAX_DELAY);
+        if (urb_head == urb_tail)
+        {
+            xSemaphoreGive(urb_mux);
+            break;
+        }
+        if (urb_table[urb_tail % USBIP_URB_NUM].unlinked && dap_requests == dap_responses)
+        {
+            // no request behind it, nothing to drop
+            urb_tail++;
+            xSemaphoreGive(urb_mux);
+            continue;
+        }
+        xSemaphoreGive(urb_mux);
+
+        length = dap_response_take(usbip_complete_buffer + sizeof(usbip_stage2_header));
+        if (length < 0)
+            break;
+#if (USE_WINUSB == 0)
+        // a HID report is always a full packet
+        memset(usbip_complete_buffer + sizeof(usbip_stage2_header) + length, 0, kDapPacketSize - length);
+        length = kDapPacketSize;
+#endif
+
+        // it may have been unlinked while the response was taken
+        xSemaphoreTake(urb_mux, portMAX_DELAY);
+        dap_responses++;
+        urb = urb_table[urb_tail % USBIP_URB_NUM];
+        urb_tail++;
+        if (!urb.unlinked)
+        {
+            if (length > urb.length)
+                length = urb.length;
+            usbip_send_ret_submit(usbip_complete_buffer, urb.seqnum, USBIP_STATUS_OK, length, length);
+        }
+        xSemaphoreGive(urb_mux);
+    }
+}
+
+
+size_t usbip_session_buffer_size()
+{
+    return USBIP_RX_BUFFER_SIZE;
+}
+
+
+void usbip_session_free()
+{
+    // handed back by session_arena_reset()
+    usbip_rx_buffer = NULL;
+    usbip_rx_len = 0;
+
+    if (urb_mux)
+    {
+        xSemaphoreTake(urb_mux, portMAX_DELAY);
+        urb_head = urb_tail = 0;
+        dap_requests = dap_responses = 0;
+        xSemaphoreGive(urb_mux);
+    }
+}
@@ -9,10 +9,41 @@ enum state_t
     ACCEPTING,
     ATTACHING,
     EMULATING,
-    EL_DATA_PHASE
+    EL_DATA_PHASE,
+    DAP_TCP_PHASE
 };
 extern uint8_t kState;
-extern int kSock;
+
+/**
+ * @brief Handle OP_REQ_DEVLIST and OP_REQ_IMPORT, the state becomes EMULATING once imported
+ *
+ * @return 0 on success, -1 if the stream can not be parsed
+ */
+int attach(uint8_t *buffer, uint32_t length);
+
+/**
+ * @brief Handle USBIP_CMD_SUBMIT and USBIP_CMD_UNLINK, messages may span several calls
+ *
+ */
+int emulate(uint8_t *buffer, uint32_t length);
+
+/**
+ * @brief Complete waiting bulk IN URBs with the responses of the DAP task (network send stage)
+ *
+ */
+void usbip_complete_urbs();
+
+/**
+ * @brief Session arena bytes taken by one USB/IP connection
+ *
+ */
+size_t usbip_session_buffer_size();
+
+/**
+ * @brief Drop the connection state, the memory returns with session_arena_reset()
+ *
+ */
+void usbip_session_free();
 
 
 
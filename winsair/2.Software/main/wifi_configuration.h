@@ -38,24 +38,93 @@ static struct {
 
 #define USE_OTA              0
 
+#ifndef USE_UART_BRIDGE
 #define USE_UART_BRIDGE      0
-#define UART_BRIDGE_PORT     1234
+#endif
+#define UART_BRIDGE_PORT     1234 // first UART, the others on the ports after it
+#define UART_BRIDGE_CLIENTS  3    // readers per UART
 #define UART_BRIDGE_BAUDRATE 74880
+// Pins of the second UART on ESP32 (UART1, on UART_BRIDGE_PORT + 1), the
+// default UART1 pins are taken by the flash
+#define UART_BRIDGE_ESP32_UART1_TX_PIN 33
+#define UART_BRIDGE_ESP32_UART1_RX_PIN 32
+// UART data is held back at most this long to fill a TCP segment, it goes
+// out at once when the line goes idle or UART_BRIDGE_FLUSH_SIZE bytes wait
+#define UART_BRIDGE_COALESCE_MS 2
+#define UART_BRIDGE_FLUSH_SIZE  256
+// Driver rings, the RX ring covers about 20 ms of a 4 Mbaud stream.
+// Lower them on ESP8266, which has little heap to spare.
+#define UART_BRIDGE_RX_BUFFER_SIZE 8192
+#define UART_BRIDGE_TX_BUFFER_SIZE 2048
+// RTS/CTS towards the target, pins are in uart_bridge.c. RFC 2217 clients
+// can change it too.
+#define UART_BRIDGE_FLOW_CONTROL 0
+// A raw (non-Telnet) client may send the baud rate as ASCII digits in its
+// first packet, "115200" for example
+#define UART_BRIDGE_BAUD_HACK 1
+// Receive ring per UART, its clients read it at their own pace. Output
+// no client got yet is kept for the next one. The PSRAM size is used when
+// the board has PSRAM.
+#define UART_BRIDGE_CAPTURE_SIZE       (16 * 1024)
+#define UART_BRIDGE_CAPTURE_PSRAM_SIZE (1024 * 1024)
 //
 
-// DO NOT CHANGE
+// Transports are built in side by side, the first client to connect to any
+// of them gets the DAP. The BSD socket TCP server on PORT is always built.
+//
+// TCP through the lwIP netconn API on NETCONN_PORT, responses are sent from
+// the DAP buffers without being copied into the TCP send buffer
+#ifndef USE_TCP_NETCONN
 #define USE_TCP_NETCONN 0
+#endif
+#define NETCONN_PORT    3241
+
+// CMSIS-DAP over TCP for OpenOCD ("adapter driver cmsis-dap",
+// "cmsis-dap backend tcp"), no proxy needed. The framing is also
+// recognised on PORT.
+#ifndef USE_DAP_TCP
+#define USE_DAP_TCP  0
+#endif
+#define DAP_TCP_PORT 4441
+
+// Transports that accept sessions, one bit per transport_id_t: TCP socket,
+// netconn, KCP, CMSIS-DAP TCP. The others are built but refuse clients.
+#define TRANSPORT_ENABLE_MASK 0x0F
+
+// Read-only observers, such as a live variable monitor next to the debugger.
+// They read target memory between the requests of the session that owns the
+// DAP, at most OBSERVER_RATE reads per second each, see observer.h
+#ifndef USE_OBSERVER
+#define USE_OBSERVER   0
+#endif
+#define OBSERVER_PORT  3242
+#define OBSERVER_MAX   2
+#define OBSERVER_RATE  100
+#define OBSERVER_BURST 4
+
+// Pacing rate of the KCP transport, should not exceed what the WiFi link
+// can carry or the send path runs out of pbufs
+#define KCP_PACING_RATE_KBPS 12000
+
+// Accept XOR parity FEC on the KCP transport when the client asks for it
+#define USE_KCP_FEC 1
+
+// Serve the BSD socket transports and the observers from one task and one
+// select() instead of a task each, saves their stacks and receive buffers.
+// The netconn transport, KCP and the UART bridge keep their own tasks.
+// Needs USE_EL_PIPELINE.
+#ifndef USE_EVENT_LOOP
+#define USE_EVENT_LOOP 0
+#endif
+
+// DO NOT CHANGE
 
 #define PORT                3240
 #define CONFIG_EXAMPLE_IPV4 1
-#define USE_KCP             0
+#define USE_KCP             0 // UDP on PORT
 #define MTU_SIZE            1500
 //
 
-#if (USE_TCP_NETCONN == 1 && USE_KCP == 1)
-#error Can not use KCP and TCP at the same time!
-#endif
-
 #if (USE_KCP == 1)
 #warning KCP is a very experimental feature, and it should not be used under any circumstances. Please make sure what you are doing. Related usbip version: https://github.com/windowsair/usbip-win
 #endif
@@ -67,6 +67,9 @@ static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*) event_data;
         ESP_LOGI("WIFI", "Disconnect reason : %d", event->reason);
+#if (USE_UART_BRIDGE == 1)
+        uart_bridge_close();
+#endif
         ssid_change();
         esp_wifi_connect();
         xEventGroupClearBits(wifi_event_group, IPV4_GOTIP_BIT);
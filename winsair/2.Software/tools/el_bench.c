@@ -0,0 +1,697 @@
+/**
+ * @file el_bench.c
+ * @brief elaphureLink throughput and latency benchmark client (host tool)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Performs the elaphureLink handshake with a probe (or a host build of the
+ * firmware) and replays a DAP workload, then prints the results as JSON.
+ *
+ * Build (from the 2.Software directory):
+ *   gcc -O2 -I. -o el_bench tools/el_bench.c
+ *
+ * Usage:
+ *   el_bench [-a addr] [-p port] [-w workload] [-n requests] [-q depth] [-s size]
+ *
+ *   workload: read   single word reads from target memory
+ *             block  4KB DAP_TransferBlock memory reads
+ *             write  flash-style DAP_TransferBlock write stream
+ *             mixed  IDE polling pattern (status/register reads + block reads)
+ *   depth:    number of requests kept in flight (1 = strict request/response)
+ *   size:     DAP packet size to request through capability negotiation
+ *             (0 = plain handshake, probe default)
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+#define EL_PROXY_VERSION  0x00000001
+
+// CMSIS-DAP commands used by the workloads
+#define ID_DAP_Info              0x00
+#define ID_DAP_Connect           0x02
+#define ID_DAP_TransferConfigure 0x04
+#define ID_DAP_Transfer          0x05
+#define ID_DAP_TransferBlock     0x06
+#define ID_DAP_SWJ_Sequence      0x12
+
+#define DAP_ID_PACKET_SIZE  0xFF
+#define DAP_ID_PACKET_COUNT 0xFE
+
+#define DAP_TRANSFER_APnDP       (1U << 0)
+#define DAP_TRANSFER_RnW         (1U << 1)
+#define DAP_TRANSFER_MATCH_VALUE (1U << 4)
+#define DAP_TRANSFER_OK          0x01
+
+// MEM-AP registers
+#define AP_CSW 0x00
+#define AP_TAR 0x04
+#define AP_DRW 0x0C
+#define AP_REQ(reg, rnw) (DAP_TRANSFER_APnDP | ((rnw) ? DAP_TRANSFER_RnW : 0) | (reg))
+
+#define CSW_WORD_AUTOINC 0x23000052
+#define TARGET_RAM_BASE  0x20000000
+#define DHCSR_ADDR       0xE000EDF0
+
+#define MAX_PACKET_SIZE 1500
+#define MAX_DEPTH       64
+
+enum workload_t
+{
+    WORKLOAD_READ,
+    WORKLOAD_BLOCK,
+    WORKLOAD_WRITE,
+    WORKLOAD_MIXED,
+};
+
+typedef struct
+{
+    uint8_t buf[MAX_PACKET_SIZE];
+    size_t len;
+    size_t payload;       // target data bytes moved by this request
+    struct timespec sent; // time the request went on the wire
+} dap_request_t;
+
+static int sock = -1;
+static uint32_t request_packet_size = 0;
+static size_t packet_size = 64;
+static int packet_count = 1;
+
+// statistics
+static uint64_t *latency_ns = NULL;
+static size_t latency_num = 0;
+static uint64_t payload_bytes = 0;
+static uint64_t error_count = 0;
+
+
+static uint64_t elapsed_ns(const struct timespec *a, const struct timespec *b)
+{
+    return (uint64_t)(b->tv_sec - a->tv_sec) * 1000000000ULL + (b->tv_nsec - a->tv_nsec);
+}
+
+static int send_all(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t ret = send(sock, p, len, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+
+/*
+ * Receive buffer, responses are parsed out of the TCP stream
+ */
+static uint8_t rx_buf[MAX_PACKET_SIZE * MAX_DEPTH];
+static size_t rx_len = 0;
+
+static int recv_more()
+{
+    ssize_t ret;
+    do {
+        ret = recv(sock, rx_buf + rx_len, sizeof(rx_buf) - rx_len, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret <= 0)
+        return -1;
+    rx_len += ret;
+    return 0;
+}
+
+static void rx_consume(size_t len)
+{
+    memmove(rx_buf, rx_buf + len, rx_len - len);
+    rx_len -= len;
+}
+
+/*
+ * Length of the response to `req`, 0 if more data is needed
+ */
+static size_t response_length(const dap_request_t *req, const uint8_t *res, size_t avail)
+{
+    size_t need, i, done, reads;
+
+    switch (req->buf[0]) {
+    case ID_DAP_Info:
+        need = 2;
+        if (avail >= 2)
+            need += res[1];
+        break;
+
+    case ID_DAP_Transfer:
+        // [cmd, count, ack, read data...]
+        need = 3;
+        if (avail >= 2) {
+            // walk the request to count the reads among the completed transfers
+            size_t pos = 3;
+            done = res[1];
+            reads = 0;
+            for (i = 0; i < req->buf[2]; i++) {
+                uint8_t r = req->buf[pos++];
+                int has_data = !(r & DAP_TRANSFER_RnW) || (r & DAP_TRANSFER_MATCH_VALUE);
+                if (i < done && (r & DAP_TRANSFER_RnW) && !(r & DAP_TRANSFER_MATCH_VALUE))
+                    reads++;
+                if (has_data)
+                    pos += 4;
+            }
+            need += reads * 4;
+        }
+        break;
+
+    case ID_DAP_TransferBlock:
+        // [cmd, count(2), ack, read data...]
+        need = 4;
+        if (avail >= 3 && (req->buf[4] & DAP_TRANSFER_RnW))
+            need += (size_t)(res[1] | (res[2] << 8)) * 4;
+        break;
+
+    default:
+        // Connect, TransferConfigure, SWJ_Sequence...
+        need = 2;
+        break;
+    }
+
+    return avail >= need ? need : 0;
+}
+
+static void check_response(const dap_request_t *req, const uint8_t *res)
+{
+    if (res[0] != req->buf[0]) {
+        error_count++;
+        return;
+    }
+
+    if (req->buf[0] == ID_DAP_Transfer) {
+        if (res[1] != req->buf[2] || res[2] != DAP_TRANSFER_OK)
+            error_count++;
+    } else if (req->buf[0] == ID_DAP_TransferBlock) {
+        if (res[1] != req->buf[2] || res[2] != req->buf[3] || res[3] != DAP_TRANSFER_OK)
+            error_count++;
+    }
+}
+
+/*
+ * Wait for the response of `req`, copy it to `res` if requested
+ */
+static int wait_response(dap_request_t *req, uint8_t *res)
+{
+    size_t len;
+    struct timespec now;
+
+    while ((len = response_length(req, rx_buf, rx_len)) == 0) {
+        if (recv_more() < 0)
+            return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (latency_ns)
+        latency_ns[latency_num++] = elapsed_ns(&req->sent, &now);
+
+    check_response(req, rx_buf);
+    if (res)
+        memcpy(res, rx_buf, len);
+    rx_consume(len);
+    return (int)len;
+}
+
+static int send_request(dap_request_t *req)
+{
+    clock_gettime(CLOCK_MONOTONIC, &req->sent);
+    return send_all(req->buf, req->len);
+}
+
+static int transact(dap_request_t *req, uint8_t *res)
+{
+    if (send_request(req) < 0)
+        return -1;
+    return wait_response(req, res);
+}
+
+
+/*
+ * Request builders
+ */
+static void build_info(dap_request_t *req, uint8_t id)
+{
+    req->buf[0] = ID_DAP_Info;
+    req->buf[1] = id;
+    req->len = 2;
+    req->payload = 0;
+}
+
+static void put_transfer(dap_request_t *req, uint8_t request, uint32_t data)
+{
+    req->buf[req->len++] = request;
+    if (!(request & DAP_TRANSFER_RnW)) {
+        memcpy(&req->buf[req->len], &data, 4); // little endian host assumed
+        req->len += 4;
+    }
+    req->buf[2]++;
+}
+
+static void begin_transfer(dap_request_t *req)
+{
+    req->buf[0] = ID_DAP_Transfer;
+    req->buf[1] = 0; // DAP index
+    req->buf[2] = 0; // transfer count
+    req->len = 3;
+    req->payload = 0;
+}
+
+// set TAR and read one word through DRW
+static void build_word_read(dap_request_t *req, uint32_t addr)
+{
+    begin_transfer(req);
+    put_transfer(req, AP_REQ(AP_TAR, 0), addr);
+    put_transfer(req, AP_REQ(AP_DRW, 1), 0);
+    req->payload = 4;
+}
+
+static size_t block_words(int write)
+{
+    // command header: cmd, index, count(2), request
+    size_t words = (packet_size - 5) / 4;
+    if (!write) {
+        // response header: cmd, count(2), ack
+        words = (packet_size - 4) / 4;
+    }
+    return words;
+}
+
+static void build_block(dap_request_t *req, size_t words, int write)
+{
+    req->buf[0] = ID_DAP_TransferBlock;
+    req->buf[1] = 0;
+    req->buf[2] = words & 0xFF;
+    req->buf[3] = (words >> 8) & 0xFF;
+    req->buf[4] = AP_REQ(AP_DRW, !write);
+    req->len = 5;
+    if (write) {
+        for (size_t i = 0; i < words * 4; i++)
+            req->buf[req->len++] = (uint8_t)rand();
+    }
+    req->payload = words * 4;
+}
+
+static void build_tar(dap_request_t *req, uint32_t addr)
+{
+    begin_transfer(req);
+    put_transfer(req, AP_REQ(AP_CSW, 0), CSW_WORD_AUTOINC);
+    put_transfer(req, AP_REQ(AP_TAR, 0), addr);
+}
+
+
+/*
+ * The workload is a sequence of requests generated one at a time
+ */
+static enum workload_t workload = WORKLOAD_READ;
+static uint32_t workload_step = 0;
+static uint32_t workload_addr = TARGET_RAM_BASE;
+
+static void next_request(dap_request_t *req)
+{
+    size_t words;
+
+    switch (workload) {
+    case WORKLOAD_READ:
+        build_word_read(req, TARGET_RAM_BASE + (workload_step % 1024) * 4);
+        break;
+
+    case WORKLOAD_BLOCK:
+    case WORKLOAD_WRITE:
+        // TAR setup then blocks until 4KB are moved
+        words = block_words(workload == WORKLOAD_WRITE);
+        if (workload_addr >= TARGET_RAM_BASE + 4096)
+            workload_addr = TARGET_RAM_BASE;
+        if (workload_step % 2 == 0) {
+            build_tar(req, workload_addr);
+        } else {
+            size_t left = (TARGET_RAM_BASE + 4096 - workload_addr) / 4;
+            words = words < left ? words : left;
+            build_block(req, words, workload == WORKLOAD_WRITE);
+            workload_addr += words * 4;
+        }
+        break;
+
+    case WORKLOAD_MIXED:
+        // IDE polling: DHCSR, a couple of core registers, then a memory view refresh
+        switch (workload_step % 8) {
+        case 0:
+            build_word_read(req, DHCSR_ADDR);
+            break;
+        case 1:
+        case 2:
+        case 3:
+            build_word_read(req, TARGET_RAM_BASE + (workload_step % 64) * 4);
+            break;
+        case 4:
+            build_tar(req, TARGET_RAM_BASE + 0x400);
+            break;
+        default:
+            words = block_words(0);
+            words = words < 64 ? words : 64;
+            build_block(req, words, 0);
+            break;
+        }
+        break;
+    }
+
+    workload_step++;
+}
+
+
+static const char *capability_name(uint16_t type)
+{
+    switch (type) {
+    case EL_CAP_PACKET_SIZE:
+        return "packet_size";
+    case EL_CAP_PACKET_COUNT:
+        return "packet_count";
+    case EL_CAP_QUEUE_COMMANDS:
+        return "queue_commands";
+    case EL_CAP_COMPRESSION:
+        return "compression";
+    case EL_CAP_PIPELINE_DEPTH:
+        return "pipeline_depth";
+    case EL_CAP_SIDE_CHANNEL:
+        return "side_channel";
+    default:
+        return "unknown";
+    }
+}
+
+static size_t put_capability(uint8_t *buf, uint16_t type, uint32_t value)
+{
+    el_capability *cap = (el_capability *)buf;
+    cap->type = htons(type);
+    cap->length = htons(4);
+    value = htonl(value);
+    memcpy(cap->value, &value, 4);
+    return sizeof(el_capability) + 4;
+}
+
+static int recv_all(void *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t ret = recv(sock, (uint8_t *)buf + got, len - got, 0);
+        if (ret <= 0)
+            return -1;
+        got += ret;
+    }
+    return 0;
+}
+
+static int el_handshake()
+{
+    uint8_t req_buf[sizeof(el_request_handshake_caps) + EL_CAPS_MAX_LENGTH];
+    uint8_t res_buf[sizeof(el_response_handshake_caps) + EL_CAPS_MAX_LENGTH];
+    el_request_handshake_caps *req = (el_request_handshake_caps *)req_buf;
+    el_response_handshake_caps *res = (el_response_handshake_caps *)res_buf;
+    size_t req_len = sizeof(el_request_handshake);
+    size_t caps_len = 0;
+
+    req->base.el_link_identifier = htonl(EL_LINK_IDENTIFIER);
+    req->base.command = htonl(EL_COMMAND_HANDSHAKE);
+    req->base.el_proxy_version = htonl(EL_PROXY_VERSION);
+
+    if (request_packet_size) {
+        // ask for the packet size and everything the benchmark can make use of
+        req->base.el_proxy_version = htonl(EL_PROXY_VERSION_CAPS);
+        caps_len += put_capability(req->el_caps + caps_len, EL_CAP_PACKET_SIZE, request_packet_size);
+        caps_len += put_capability(req->el_caps + caps_len, EL_CAP_PACKET_COUNT, MAX_DEPTH);
+        caps_len += put_capability(req->el_caps + caps_len, EL_CAP_QUEUE_COMMANDS, 1);
+        caps_len += put_capability(req->el_caps + caps_len, EL_CAP_PIPELINE_DEPTH, MAX_DEPTH);
+        req->el_caps_length = htonl(caps_len);
+        req_len = sizeof(el_request_handshake_caps) + caps_len;
+    }
+
+    if (send_all(req_buf, req_len) < 0)
+        return -1;
+
+    if (recv_all(res_buf, sizeof(el_response_handshake)) < 0)
+        return -1;
+
+    if (ntohl(res->base.el_link_identifier) != EL_LINK_IDENTIFIER ||
+        ntohl(res->base.command) != EL_COMMAND_HANDSHAKE)
+        return -1;
+
+    fprintf(stderr, "elaphureLink dap version: %u\n", ntohl(res->base.el_dap_version));
+    if (ntohl(res->base.el_dap_version) < EL_DAP_VERSION_CAPS || !request_packet_size)
+        return 0;
+
+    // capability answer
+    if (recv_all(&res->el_caps_length, sizeof(uint32_t)) < 0)
+        return -1;
+    caps_len = ntohl(res->el_caps_length);
+    if (caps_len > EL_CAPS_MAX_LENGTH || recv_all(res->el_caps, caps_len) < 0)
+        return -1;
+
+    for (size_t pos = 0; pos + sizeof(el_capability) <= caps_len;) {
+        el_capability *cap = (el_capability *)(res->el_caps + pos);
+        uint16_t length = ntohs(cap->length);
+        uint32_t value = 0;
+        if (length == 4) {
+            memcpy(&value, cap->value, 4);
+            value = ntohl(value);
+        }
+        fprintf(stderr, "agreed %s: %u\n", capability_name(ntohs(cap->type)), value);
+        pos += sizeof(el_capability) + length;
+    }
+    return 0;
+}
+
+static int dap_setup()
+{
+    dap_request_t req;
+    uint8_t res[MAX_PACKET_SIZE];
+
+    build_info(&req, DAP_ID_PACKET_SIZE);
+    if (transact(&req, res) < 0)
+        return -1;
+    if (res[1] == 2)
+        packet_size = res[2] | (res[3] << 8);
+
+    build_info(&req, DAP_ID_PACKET_COUNT);
+    if (transact(&req, res) < 0)
+        return -1;
+    if (res[1] == 1)
+        packet_count = res[2];
+
+    if (packet_size > MAX_PACKET_SIZE)
+        packet_size = MAX_PACKET_SIZE;
+    if (packet_size < 64)
+        packet_size = 64;
+
+    // connect SWD
+    req.buf[0] = ID_DAP_Connect;
+    req.buf[1] = 1;
+    req.len = 2;
+    if (transact(&req, res) < 0)
+        return -1;
+
+    // idle cycles, WAIT retry, match retry
+    req.buf[0] = ID_DAP_TransferConfigure;
+    req.buf[1] = 0;
+    req.buf[2] = 0x40;
+    req.buf[3] = 0x00;
+    req.buf[4] = 0x00;
+    req.buf[5] = 0x00;
+    req.len = 6;
+    if (transact(&req, res) < 0)
+        return -1;
+
+    // line reset, JTAG-to-SWD, line reset, idle
+    static const uint8_t swj[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x9E, 0xE7,
+                                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+    req.buf[0] = ID_DAP_SWJ_Sequence;
+    req.buf[1] = sizeof(swj) * 8;
+    memcpy(&req.buf[2], swj, sizeof(swj));
+    req.len = 2 + sizeof(swj);
+    if (transact(&req, res) < 0)
+        return -1;
+
+    // read IDCODE, clear errors, power up debug
+    begin_transfer(&req);
+    put_transfer(&req, DAP_TRANSFER_RnW | 0x00, 0);   // DP IDCODE
+    put_transfer(&req, 0x00, 0x1E);                   // DP ABORT
+    put_transfer(&req, 0x08, 0x00000000);             // DP SELECT
+    put_transfer(&req, 0x04, 0x50000000);             // DP CTRL/STAT
+    if (transact(&req, res) < 0)
+        return -1;
+
+    // setup errors do not count towards the workload
+    error_count = 0;
+    latency_num = 0;
+    return 0;
+}
+
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(double p)
+{
+    if (latency_num == 0)
+        return 0;
+    size_t idx = (size_t)(p * (latency_num - 1) + 0.5);
+    return latency_ns[idx] / 1000.0;
+}
+
+static const char *workload_name[] = {"read", "block", "write", "mixed"};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-a addr] [-p port] [-w read|block|write|mixed] [-n requests] [-q depth] [-s size]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *addr = "127.0.0.1";
+    const char *port = "3240";
+    size_t requests = 10000;
+    int depth = 1;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "a:p:w:n:q:s:h")) != -1) {
+        switch (opt) {
+        case 'a':
+            addr = optarg;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        case 'w':
+            for (i = 0; i < 4; i++) {
+                if (strcmp(optarg, workload_name[i]) == 0)
+                    break;
+            }
+            if (i == 4) {
+                usage(argv[0]);
+                return 1;
+            }
+            workload = (enum workload_t)i;
+            break;
+        case 'n':
+            requests = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            depth = atoi(optarg);
+            break;
+        case 's':
+            request_packet_size = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (depth < 1)
+        depth = 1;
+    if (depth > MAX_DEPTH)
+        depth = MAX_DEPTH;
+
+    struct addrinfo hints = {0}, *ai;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(addr, port, &hints, &ai) != 0) {
+        fprintf(stderr, "can not resolve %s\n", addr);
+        return 1;
+    }
+    sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sock < 0 || connect(sock, ai->ai_addr, ai->ai_addrlen) < 0) {
+        fprintf(stderr, "can not connect to %s:%s: %s\n", addr, port, strerror(errno));
+        return 1;
+    }
+    freeaddrinfo(ai);
+
+    int on = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    latency_ns = calloc(requests + 16, sizeof(uint64_t));
+    if (latency_ns == NULL)
+        return 1;
+
+    if (el_handshake() < 0) {
+        fprintf(stderr, "elaphureLink handshake failed\n");
+        return 1;
+    }
+    if (dap_setup() < 0) {
+        fprintf(stderr, "DAP setup failed\n");
+        return 1;
+    }
+
+    // keep `depth` requests in flight, responses arrive in order
+    static dap_request_t inflight[MAX_DEPTH];
+    size_t sent = 0, done = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (done < requests) {
+        while (sent < requests && sent - done < (size_t)depth) {
+            dap_request_t *req = &inflight[sent % depth];
+            next_request(req);
+            if (send_request(req) < 0)
+                goto disconnected;
+            sent++;
+        }
+
+        dap_request_t *req = &inflight[done % depth];
+        if (wait_response(req, NULL) < 0)
+            goto disconnected;
+        payload_bytes += req->payload;
+        done++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    close(sock);
+
+    double seconds = elapsed_ns(&start, &end) / 1e9;
+    qsort(latency_ns, latency_num, sizeof(uint64_t), compare_u64);
+
+    printf("{\n");
+    printf("  \"workload\": \"%s\",\n", workload_name[workload]);
+    printf("  \"packet_size\": %zu,\n", packet_size);
+    printf("  \"packet_count\": %d,\n", packet_count);
+    printf("  \"depth\": %d,\n", depth);
+    printf("  \"requests\": %zu,\n", done);
+    printf("  \"errors\": %llu,\n", (unsigned long long)error_count);
+    printf("  \"elapsed_s\": %.6f,\n", seconds);
+    printf("  \"requests_per_s\": %.1f,\n", done / seconds);
+    printf("  \"payload_bytes\": %llu,\n", (unsigned long long)payload_bytes);
+    printf("  \"mb_per_s\": %.4f,\n", payload_bytes / seconds / 1e6);
+    printf("  \"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}\n",
+           percentile_us(0.50), percentile_us(0.99), percentile_us(0.999),
+           latency_num ? latency_ns[latency_num - 1] / 1000.0 : 0.0);
+    printf("}\n");
+    return 0;
+
+disconnected:
+    fprintf(stderr, "connection lost after %zu requests\n", done);
+    return 1;
+}
@@ -0,0 +1,539 @@
+/**
+ * @file dap_engine.c
+ * @brief CMSIS-DAP command layer of the host build, on the simulated target
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Takes the place of components/DAP/source/DAP.c with SWD only. The
+ * commands are parsed and answered the way DAP.c does, posted AP reads
+ * and WAIT retries included, and the SWD packets go to swd_target.c
+ * instead of the pins. JTAG and SWO answer DAP_ERROR.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "main/dap_configuration.h"
+#include "main/timer.h"
+#include "components/DAP/include/DAP.h"
+
+#include "swd_target.h"
+
+#define DAP_PACKET_COUNT 20U
+#define DAP_FW_VER       "2.1.0"
+#define TIMESTAMP_CLOCK  5000000U // as DAP_config.h, the firmware reports its own
+
+static struct
+{
+    uint8_t debug_port;
+    uint8_t idle_cycles;
+    uint16_t retry_count;
+    uint16_t match_retry;
+    uint32_t match_mask;
+} kDap = {
+    .retry_count = 100,
+    .match_mask = 0xFFFFFFFF,
+};
+
+static volatile uint8_t kTransferAbort;
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint8_t swd_transfer(uint32_t request, uint32_t *data)
+{
+    uint8_t ack = swd_target_transfer(request, data);
+
+    if (ack == SWD_ACK_OK && (request & DAP_TRANSFER_RnW) == 0)
+        swd_target_idle(kDap.idle_cycles);
+    return ack;
+}
+
+// SWD packet with the WAIT retries of TransferConfigure
+static uint8_t swd_transfer_retry(uint32_t request, uint32_t *data)
+{
+    uint32_t retry = kDap.retry_count;
+    uint8_t ack;
+
+    do {
+        ack = swd_transfer(request, data);
+    } while (ack == DAP_TRANSFER_WAIT && retry-- && !kTransferAbort);
+    return ack;
+}
+
+static uint8_t info_string(const char *s, uint8_t *info)
+{
+    size_t len = strlen(s);
+
+    if (len == 0)
+        return 0;
+    memcpy(info, s, len + 1);
+    return (uint8_t)(len + 1);
+}
+
+static uint32_t dap_info(uint8_t id, uint8_t *info)
+{
+    switch (id) {
+    case DAP_ID_DAP_FW_VER:
+        return info_string(DAP_FW_VER, info);
+    case DAP_ID_CAPABILITIES:
+        info[0] = 0x01; // SWD
+        return 1;
+    case DAP_ID_TIMESTAMP_CLOCK:
+        put_le32(info, TIMESTAMP_CLOCK);
+        return 4;
+    case DAP_ID_SWO_BUFFER_SIZE:
+        put_le32(info, 0);
+        return 4;
+    case DAP_ID_PACKET_COUNT:
+        info[0] = DAP_PACKET_COUNT;
+        return 1;
+    case DAP_ID_PACKET_SIZE:
+        info[0] = (uint8_t)(DAP_PACKET_SIZE_DEFAULT >> 0);
+        info[1] = (uint8_t)(DAP_PACKET_SIZE_DEFAULT >> 8);
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+static void delay_us(uint32_t us)
+{
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+
+    nanosleep(&ts, NULL);
+}
+
+// request and response after the command byte, as the DAP.c helpers
+static uint32_t dap_transfer(const uint8_t *request, uint8_t *response)
+{
+    const uint8_t *request_head = request;
+    uint8_t *response_head = response;
+    uint32_t request_count, request_value, response_count = 0;
+    uint32_t response_value = 0, data, match_value, match_retry;
+    uint32_t timestamp = 0;
+    int post_read = 0, check_write = 0;
+
+    response += 2;
+    kTransferAbort = 0;
+
+    request++; // DAP index, ignored
+    request_count = *request++;
+
+    for (; request_count != 0; request_count--) {
+        request_value = *request++;
+        if (request_value & DAP_TRANSFER_RnW) {
+            if (post_read) {
+                if ((request_value & (DAP_TRANSFER_APnDP | DAP_TRANSFER_MATCH_VALUE)) == DAP_TRANSFER_APnDP) {
+                    // read the previous AP data and post the next AP read
+                    response_value = swd_transfer_retry(request_value, &data);
+                    timestamp = get_timer_count();
+                } else {
+                    response_value = swd_transfer_retry(DP_RDBUFF | DAP_TRANSFER_RnW, &data);
+                    post_read = 0;
+                }
+                if (response_value != DAP_TRANSFER_OK) {
+                    if (request_value & DAP_TRANSFER_MATCH_VALUE)
+                        request += 4;
+                    request_count--;
+                    break;
+                }
+                put_le32(response, data);
+                response += 4;
+            }
+            if (request_value & DAP_TRANSFER_MATCH_VALUE) {
+                match_value = get_le32(request);
+                request += 4;
+                match_retry = kDap.match_retry;
+                if (request_value & DAP_TRANSFER_APnDP) {
+                    response_value = swd_transfer_retry(request_value, NULL);
+                    if (response_value != DAP_TRANSFER_OK) {
+                        request_count--;
+                        break;
+                    }
+                }
+                do {
+                    response_value = swd_transfer_retry(request_value, &data);
+                    if (response_value != DAP_TRANSFER_OK)
+                        break;
+                } while ((data & kDap.match_mask) != match_value && match_retry-- && !kTransferAbort);
+                if (response_value == DAP_TRANSFER_OK && (data & kDap.match_mask) != match_value)
+                    response_value |= DAP_TRANSFER_MISMATCH;
+                if (response_value != DAP_TRANSFER_OK) {
+                    request_count--;
+                    break;
+                }
+            } else if (request_value & DAP_TRANSFER_APnDP) {
+                if (!post_read) {
+                    response_value = swd_transfer_retry(request_value, NULL);
+                    if (response_value != DAP_TRANSFER_OK) {
+                        request_count--;
+                        break;
+                    }
+                    timestamp = get_timer_count();
+                    post_read = 1;
+                }
+                if (request_value & DAP_TRANSFER_TIMESTAMP) {
+                    put_le32(response, timestamp);
+                    response += 4;
+                }
+            } else {
+                response_value = swd_transfer_retry(request_value, &data);
+                if (response_value != DAP_TRANSFER_OK) {
+                    request_count--;
+                    break;
+                }
+                if (request_value & DAP_TRANSFER_TIMESTAMP) {
+                    put_le32(response, get_timer_count());
+                    response += 4;
+                }
+                put_le32(response, data);
+                response += 4;
+            }
+            check_write = 0;
+        } else {
+            if (post_read) {
+                response_value = swd_transfer_retry(DP_RDBUFF | DAP_TRANSFER_RnW, &data);
+                if (response_value != DAP_TRANSFER_OK) {
+                    request += 4;
+                    request_count--;
+                    break;
+                }
+                put_le32(response, data);
+                response += 4;
+                post_read = 0;
+            }
+            data = get_le32(request);
+            request += 4;
+            if (request_value & DAP_TRANSFER_MATCH_MASK) {
+                kDap.match_mask = data;
+                response_value = DAP_TRANSFER_OK;
+            } else {
+                response_value = swd_transfer_retry(request_value, &data);
+                if (response_value != DAP_TRANSFER_OK) {
+                    request_count--;
+                    break;
+                }
+                if (request_value & DAP_TRANSFER_TIMESTAMP) {
+                    put_le32(response, get_timer_count());
+                    response += 4;
+                }
+                check_write = 1;
+            }
+        }
+        response_count++;
+        if (kTransferAbort) {
+            request_count--;
+            break;
+        }
+    }
+
+    // skip what was not done
+    for (; request_count != 0; request_count--) {
+        request_value = *request++;
+        if ((request_value & DAP_TRANSFER_RnW) == 0 || (request_value & DAP_TRANSFER_MATCH_VALUE))
+            request += 4;
+    }
+
+    if (response_value == DAP_TRANSFER_OK) {
+        if (post_read) {
+            response_value = swd_transfer_retry(DP_RDBUFF | DAP_TRANSFER_RnW, &data);
+            if (response_value == DAP_TRANSFER_OK) {
+                put_le32(response, data);
+                response += 4;
+            }
+        } else if (check_write) {
+            response_value = swd_transfer_retry(DP_RDBUFF | DAP_TRANSFER_RnW, NULL);
+        }
+    }
+
+    response_head[0] = (uint8_t)response_count;
+    response_head[1] = (uint8_t)response_value;
+    return ((uint32_t)(request - request_head) << 16) | (uint32_t)(response - response_head);
+}
+
+static uint32_t dap_transfer_block(const uint8_t *request, uint8_t *response)
+{
+    uint32_t request_count = request[1] | ((uint32_t)request[2] << 8);
+    uint32_t request_value = request[3];
+    uint32_t response_count = 0, response_value = 0, data;
+    const uint8_t *data_in = request + 4;
+    uint8_t *data_out = response + 3;
+    uint32_t num;
+
+    kTransferAbort = 0;
+
+    if (request_count == 0)
+        goto end;
+
+    if (request_value & DAP_TRANSFER_RnW) {
+        if (request_value & DAP_TRANSFER_APnDP) {
+            // post the first AP read
+            response_value = swd_transfer_retry(request_value, NULL);
+            if (response_value != DAP_TRANSFER_OK)
+                goto end;
+        }
+        while (request_count--) {
+            if (request_count == 0 && (request_value & DAP_TRANSFER_APnDP))
+                response_value = swd_transfer_retry(DP_RDBUFF | DAP_TRANSFER_RnW, &data);
+            else
+                response_value = swd_transfer_retry(request_value, &data);
+            if (response_value != DAP_TRANSFER_OK)
+                goto end;
+            put_le32(data_out, data);
+            data_out += 4;
+            response_count++;
+            if (kTransferAbort)
+                goto end;
+        }
+    } else {
+        while (request_count--) {
+            data = get_le32(data_in);
+            data_in += 4;
+            response_value = swd_transfer_retry(request_value, &data);
+            if (response_value != DAP_TRANSFER_OK)
+                goto end;
+            response_count++;
+            if (kTransferAbort)
+                goto end;
+        }
+        // check the last write
+        response_value = swd_transfer_retry(DP_RDBUFF | DAP_TRANSFER_RnW, NULL);
+    }
+
+end:
+    response[0] = (uint8_t)response_count;
+    response[1] = (uint8_t)(response_count >> 8);
+    response[2] = (uint8_t)response_value;
+
+    num = (uint32_t)(data_out - response);
+    if (request_value & DAP_TRANSFER_RnW)
+        num |= 4U << 16;
+    else
+        num |= (4U + (request[1] | ((uint32_t)request[2] << 8)) * 4) << 16;
+    return num;
+}
+
+static uint32_t swj_sequence(const uint8_t *request, uint8_t *response)
+{
+    uint32_t bits = request[0] ? request[0] : 256;
+
+    swd_target_sequence(bits, request + 1);
+    response[0] = DAP_OK;
+    return ((1U + (bits + 7) / 8) << 16) | 1U;
+}
+
+static uint32_t swd_sequence(const uint8_t *request, uint8_t *response)
+{
+    const uint8_t *request_head = request;
+    uint8_t *response_head = response;
+    uint32_t count = *request++;
+    uint32_t info, bits, bytes;
+
+    *response++ = DAP_OK;
+    while (count--) {
+        info = *request++;
+        bits = info & 0x3F ? info & 0x3F : 64;
+        bytes = (bits + 7) / 8;
+        if (info & 0x80) {
+            // input, the target drives nothing we model
+            swd_target_idle(bits);
+            memset(response, 0, bytes);
+            response += bytes;
+        } else {
+            swd_target_sequence(bits, request);
+            request += bytes;
+        }
+    }
+    return ((uint32_t)(request - request_head) << 16) | (uint32_t)(response - response_head);
+}
+
+static uint32_t jtag_sequence_length(const uint8_t *request)
+{
+    const uint8_t *p = request;
+    uint32_t count = *p++;
+    uint32_t bits;
+
+    while (count--) {
+        bits = *p & 0x3F ? *p & 0x3F : 64;
+        p += 1 + (bits + 7) / 8;
+    }
+    return (uint32_t)(p - request);
+}
+
+void DAP_Setup(void)
+{
+    kDap.debug_port = DAP_PORT_DISABLED;
+    kDap.idle_cycles = 0;
+    kDap.retry_count = 100;
+    kDap.match_retry = 0;
+    kDap.match_mask = 0xFFFFFFFF;
+}
+
+uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response)
+{
+    uint32_t num;
+
+    if (request[0] >= ID_DAP_Vendor0 && request[0] <= ID_DAP_Vendor31) {
+        response[0] = ID_DAP_Invalid;
+        return (1U << 16) | 1U;
+    }
+
+    *response++ = *request;
+    switch (*request++) {
+    case ID_DAP_Info:
+        response[0] = (uint8_t)dap_info(request[0], response + 1);
+        num = (1U << 16) | (1U + response[0]);
+        break;
+    case ID_DAP_HostStatus:
+        response[0] = DAP_OK;
+        num = (2U << 16) | 1U;
+        break;
+    case ID_DAP_Connect:
+        kDap.debug_port = request[0] == DAP_PORT_AUTODETECT || request[0] == DAP_PORT_SWD ? DAP_PORT_SWD : DAP_PORT_DISABLED;
+        response[0] = kDap.debug_port;
+        num = (1U << 16) | 1U;
+        break;
+    case ID_DAP_Disconnect:
+        kDap.debug_port = DAP_PORT_DISABLED;
+        response[0] = DAP_OK;
+        num = 1U;
+        break;
+    case ID_DAP_TransferConfigure:
+        kDap.idle_cycles = request[0];
+        kDap.retry_count = request[1] | (request[2] << 8);
+        kDap.match_retry = request[3] | (request[4] << 8);
+        response[0] = DAP_OK;
+        num = (5U << 16) | 1U;
+        break;
+    case ID_DAP_Transfer:
+        num = dap_transfer(request, response);
+        break;
+    case ID_DAP_TransferBlock:
+        num = dap_transfer_block(request, response);
+        break;
+    case ID_DAP_TransferAbort:
+        // nothing runs in parallel here, just drop the flag
+        kTransferAbort = 0;
+        return 1U;
+    case ID_DAP_WriteABORT: {
+        uint32_t data = get_le32(request + 1);
+
+        response[0] = swd_transfer(DP_ABORT, &data) == DAP_TRANSFER_OK ? DAP_OK : DAP_ERROR;
+        num = (5U << 16) | 1U;
+        break;
+    }
+    case ID_DAP_Delay:
+        delay_us(request[0] | (request[1] << 8));
+        response[0] = DAP_OK;
+        num = (2U << 16) | 1U;
+        break;
+    case ID_DAP_ResetTarget:
+        response[0] = DAP_OK;
+        response[1] = 0; // no device specific reset sequence
+        num = 2U;
+        break;
+    case ID_DAP_SWJ_Pins:
+        response[0] = 0;
+        num = (6U << 16) | 1U;
+        break;
+    case ID_DAP_SWJ_Clock: {
+        uint32_t clock = get_le32(request);
+
+        if (clock)
+            swd_target_set_clock(clock);
+        response[0] = clock ? DAP_OK : DAP_ERROR;
+        num = (4U << 16) | 1U;
+        break;
+    }
+    case ID_DAP_SWJ_Sequence:
+        num = swj_sequence(request, response);
+        break;
+    case ID_DAP_SWD_Configure:
+        swd_target_set_turnaround((request[0] & 0x03) + 1);
+        response[0] = DAP_OK;
+        num = (1U << 16) | 1U;
+        break;
+    case ID_DAP_SWD_Sequence:
+        num = swd_sequence(request, response);
+        break;
+
+    case ID_DAP_JTAG_Sequence:
+        response[0] = DAP_ERROR;
+        num = (jtag_sequence_length(request) << 16) | 1U;
+        break;
+    case ID_DAP_JTAG_Configure:
+        response[0] = DAP_ERROR;
+        num = ((1U + request[0]) << 16) | 1U;
+        break;
+    case ID_DAP_JTAG_IDCODE:
+        response[0] = DAP_ERROR;
+        memset(response + 1, 0, 4);
+        num = (1U << 16) | 5U;
+        break;
+
+    case ID_DAP_SWO_Transport:
+    case ID_DAP_SWO_Mode:
+    case ID_DAP_SWO_Control:
+        response[0] = DAP_ERROR;
+        num = (1U << 16) | 1U;
+        break;
+    case ID_DAP_SWO_Baudrate:
+        put_le32(response, 0);
+        num = (4U << 16) | 4U;
+        break;
+    case ID_DAP_SWO_Status:
+        response[0] = 0;
+        put_le32(response + 1, 0);
+        num = 5U;
+        break;
+    case ID_DAP_SWO_ExtendedStatus:
+        response[0] = 0;
+        memset(response + 1, 0, 12);
+        num = (1U << 16) | 13U;
+        break;
+    case ID_DAP_SWO_Data:
+        response[0] = 0;
+        response[1] = 0;
+        response[2] = 0;
+        num = (2U << 16) | 3U;
+        break;
+
+    default:
+        response[-1] = ID_DAP_Invalid;
+        return (1U << 16) | 1U;
+    }
+
+    return (1U << 16) + 1U + num;
+}
+
+uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response)
+{
+    uint32_t cnt, num, n;
+
+    if (request[0] == ID_DAP_ExecuteCommands) {
+        *response++ = *request++;
+        cnt = *request++;
+        *response++ = (uint8_t)cnt;
+        num = (2U << 16) | 2U;
+        while (cnt--) {
+            n = DAP_ProcessCommand(request, response);
+            num += n;
+            request += (uint16_t)(n >> 16);
+            response += (uint16_t)n;
+        }
+        return num;
+    }
+
+    return DAP_ProcessCommand(request, response);
+}
@@ -0,0 +1,112 @@
+/**
+ * @file dap_host.c
+ * @brief The firmware core as a Linux program (host tool)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Starts the same tasks as app_main() in main/main.c on top of the POSIX
+ * shim in this directory and serves elaphureLink, USB/IP and CMSIS-DAP TCP
+ * on the ports of wifi_configuration.h, so el_bench and the other tools
+ * can run against it on localhost. WiFi, mDNS, OTA, KCP and the UART bridge
+ * are left out.
+ *
+ * The DAP commands run on the simulated target of swd_target.c.
+ *
+ * Build and run (from this directory):
+ *   make dap_host && ./dap_host [-c swclk_hz] [-o overhead_ns]
+ *                               [-w every[:count]] [-f every]
+ *
+ *   -c  SWCLK until the client sets one, 1 MHz by default
+ *   -o  cost of a packet on top of its bits, for the bit-bang loop
+ *   -w  every n-th MEM-AP access answers WAIT count times first
+ *   -f  every n-th MEM-AP access ends in a bus fault
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/param.h>
+
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
+#include "main/usbip_server.h"
+#include "main/dap_tcp.h"
+#include "main/net_loop.h"
+#include "main/observer.h"
+#include "main/timer.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+#include "components/DAP/include/DAP.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "swd_target.h"
+
+TaskHandle_t kDAPTaskHandle = NULL;
+TaskHandle_t kDAPSendTaskHandle = NULL;
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-c swclk_hz] [-o overhead_ns] [-w every[:count]] [-f every]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    swd_target_config_t target = {.clock_hz = 1000000};
+    char *end;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:o:w:f:")) != -1) {
+        switch (opt) {
+        case 'c':
+            target.clock_hz = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            target.overhead_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            target.wait_every = strtoul(optarg, &end, 0);
+            target.wait_count = *end == ':' ? strtoul(end + 1, NULL, 0) : 1;
+            break;
+        case 'f':
+            target.fault_every = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    // a client that goes away must not end the program
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    timer_init();
+    swd_target_init(&target);
+    DAP_Setup();
+
+    session_arena_init(dap_ringbuf_storage_size() +
+                       MAX(MAX(el_process_buffer_size(), usbip_session_buffer_size()), dap_tcp_session_buffer_size()) + 4 * SESSION_ARENA_ALIGN);
+    malloc_dap_ringbuf();
+    session_arena_keep();
+
+    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    xTaskCreate(transport_send_task, "dap_send", 2048, NULL, 12, &kDAPSendTaskHandle);
+    transport_start();
+#if (USE_OBSERVER == 1)
+    observer_start();
+#endif
+#if (USE_EVENT_LOOP == 1)
+    net_loop_start();
+#endif
+
+    printf("dap_host: elaphureLink and USB/IP on port %d\n", PORT);
+    for (;;)
+        pause();
+}
@@ -0,0 +1,482 @@
+/**
+ * @file el_framer_test.c
+ * @brief elaphureLink framing of randomly split and merged streams (host test)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * A client on mem_transport.c does the elaphureLink handshake and sends a
+ * random mix of CMSIS-DAP requests: transfers, blocks, SWJ/SWD/JTAG
+ * sequences, fixed size commands, and ID_DAP_QueueCommands and
+ * ID_DAP_ExecuteCommands packets that carry several of them. The stream is
+ * cut into segments of random size, from single bytes to several requests
+ * in one segment, and every segment reaches el_dap_data_process() as one
+ * receive. The handshake itself comes in pieces of a few bytes, its end in
+ * one segment with the first requests. Rounds take turns between a legacy
+ * proxy and one that sends a capability block.
+ *
+ * The DAP engine is replaced by one that checks every command against the
+ * one it expects next, byte for byte, and answers with its sequence number.
+ * The client checks the response stream the same way, so a request that is
+ * lost, run twice, cut at the wrong place or answered out of order fails.
+ *
+ * A last round sends a segment of small requests while the sends are held.
+ * They have to run all the same, and their responses have to go out
+ * together once the network is back, not in a send each.
+ *
+ *   el_framer_test [-r rounds] [-n requests] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
+#include "main/usbip_server.h"
+#include "main/dap_tcp.h"
+#include "main/timer.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+#include "components/DAP/include/DAP.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "mem_transport.h"
+
+TaskHandle_t kDAPTaskHandle = NULL;
+TaskHandle_t kDAPSendTaskHandle = NULL;
+
+// answer of the test engine: [command, sequence number(4)]
+#define RESPONSE_LEN 5
+// largest command of the generator, several fit in one packet
+#define COMMAND_MAX 160
+
+typedef struct
+{
+    uint8_t buf[COMMAND_MAX];
+    size_t len;
+} command_t;
+
+static command_t *commands; // every command the engine should run, in order
+static uint32_t command_count;
+static volatile uint32_t executed;
+static volatile uint32_t failures;
+static uint32_t rng;
+
+
+static uint32_t next_random(void)
+{
+    // xorshift32, the seed makes a run repeatable
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static uint32_t random_range(uint32_t lo, uint32_t hi)
+{
+    return lo + next_random() % (hi - lo + 1);
+}
+
+static void fail(const char *what, uint32_t at)
+{
+    if (failures++ < 10)
+        printf("  FAIL %s at %u\n", what, at);
+}
+
+void DAP_Setup(void)
+{
+}
+
+uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response)
+{
+    uint32_t seq = executed;
+    uint32_t len = 1;
+
+    if (seq >= command_count) {
+        fail("command past the end", seq);
+    } else {
+        len = commands[seq].len;
+        if (memcmp(request, commands[seq].buf, len) != 0)
+            fail("command", seq);
+    }
+
+    response[0] = request[0];
+    memcpy(response + 1, &seq, 4);
+    __atomic_store_n(&executed, seq + 1, __ATOMIC_RELEASE);
+    return (len << 16) | RESPONSE_LEN;
+}
+
+uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response)
+{
+    return dap_execute_command(request, response);
+}
+
+
+static void random_bytes(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        buf[i] = (uint8_t)next_random();
+}
+
+// One command the framer has to find the end of
+static void random_command(command_t *c)
+{
+    uint8_t *p = c->buf;
+    uint32_t count, bits, i;
+    size_t len = 0;
+
+    switch (next_random() % 10) {
+    case 0:
+        // [cmd, index, count, {request, (data)} * count]
+        count = random_range(1, 12);
+        p[len++] = ID_DAP_Transfer;
+        p[len++] = 0;
+        p[len++] = count;
+        for (i = 0; i < count; i++) {
+            p[len] = next_random() & 0x3F;
+            if (!(p[len] & DAP_TRANSFER_RnW) || (p[len] & DAP_TRANSFER_MATCH_VALUE)) {
+                random_bytes(p + len + 1, 4);
+                len += 4;
+            }
+            len++;
+        }
+        break;
+    case 1:
+        // [cmd, index, count(2), request, (data * count)]
+        count = random_range(1, 24);
+        p[len++] = ID_DAP_TransferBlock;
+        p[len++] = 0;
+        p[len++] = count;
+        p[len++] = 0;
+        p[len++] = next_random() & 0x0F;
+        if (!(p[4] & DAP_TRANSFER_RnW)) {
+            random_bytes(p + len, count * 4);
+            len += count * 4;
+        }
+        break;
+    case 2:
+        bits = random_range(1, 256);
+        p[len++] = ID_DAP_SWJ_Sequence;
+        p[len++] = (uint8_t)bits;
+        random_bytes(p + len, (bits + 7) / 8);
+        len += (bits + 7) / 8;
+        break;
+    case 3:
+        // [cmd, count, {info, (data)} * count], no data when SWDIO is input
+        count = random_range(1, 4);
+        p[len++] = ID_DAP_SWD_Sequence;
+        p[len++] = count;
+        for (i = 0; i < count; i++) {
+            p[len] = (uint8_t)next_random();
+            bits = p[len] & 0x3F ? p[len] & 0x3F : 64;
+            len++;
+            if (!(p[len - 1] & 0x80)) {
+                random_bytes(p + len, (bits + 7) / 8);
+                len += (bits + 7) / 8;
+            }
+        }
+        break;
+    case 4:
+        count = random_range(1, 4);
+        p[len++] = ID_DAP_JTAG_Sequence;
+        p[len++] = count;
+        for (i = 0; i < count; i++) {
+            p[len] = (uint8_t)next_random();
+            bits = p[len] & 0x3F ? p[len] & 0x3F : 64;
+            len++;
+            random_bytes(p + len, (bits + 7) / 8);
+            len += (bits + 7) / 8;
+        }
+        break;
+    case 5:
+        p[len++] = ID_DAP_SWJ_Clock;
+        random_bytes(p + len, 4);
+        len += 4;
+        break;
+    case 6:
+        p[len++] = next_random() & 1 ? ID_DAP_TransferConfigure : ID_DAP_WriteABORT;
+        random_bytes(p + len, 5);
+        len += 5;
+        break;
+    case 7:
+        p[len++] = ID_DAP_SWJ_Pins;
+        random_bytes(p + len, 6);
+        len += 6;
+        break;
+    case 8:
+        p[len++] = next_random() & 1 ? ID_DAP_Delay : ID_DAP_HostStatus;
+        random_bytes(p + len, 2);
+        len += 2;
+        break;
+    default:
+        p[len++] = ID_DAP_Disconnect;
+        break;
+    }
+    c->len = len;
+}
+
+static void put_response(uint8_t *out, size_t *out_len, uint8_t cmd, uint32_t seq)
+{
+    out[(*out_len)++] = cmd;
+    memcpy(out + *out_len, &seq, 4);
+    *out_len += 4;
+}
+
+/*
+ * n requests, after the commands already expected. The stream goes to
+ * stream, the responses the client should get to expect.
+ */
+static void generate(uint32_t n, uint8_t *stream, size_t *stream_len, uint8_t *expect, size_t *expect_len)
+{
+    uint32_t i, j, count;
+    size_t len;
+    uint8_t *p;
+
+    *stream_len = *expect_len = 0;
+    for (i = 0; i < n; i++) {
+        p = stream + *stream_len;
+        // the last one is not queued, or the queue would never be run
+        if (next_random() % 5 == 0 && i + 1 < n) {
+            // a packet of several commands, answered as ID_DAP_ExecuteCommands
+            count = random_range(1, 3);
+            p[0] = next_random() & 1 ? ID_DAP_QueueCommands : ID_DAP_ExecuteCommands;
+            p[1] = count;
+            len = 2;
+            expect[(*expect_len)++] = ID_DAP_ExecuteCommands;
+            expect[(*expect_len)++] = count;
+            for (j = 0; j < count; j++) {
+                random_command(&commands[command_count]);
+                memcpy(p + len, commands[command_count].buf, commands[command_count].len);
+                len += commands[command_count].len;
+                put_response(expect, expect_len, commands[command_count].buf[0], command_count);
+                command_count++;
+            }
+        } else {
+            random_command(&commands[command_count]);
+            len = commands[command_count].len;
+            memcpy(p, commands[command_count].buf, len);
+            put_response(expect, expect_len, p[0], command_count);
+            command_count++;
+        }
+        *stream_len += len;
+    }
+}
+
+// Handshake of a legacy proxy, or of one with a capability block
+static size_t put_handshake(uint8_t *buf, int caps)
+{
+    static const uint8_t legacy[12] = { 0x8a, 0x65, 0x6c, 0x70, 0, 0, 0, 0, 0, 0, 0, 1 };
+    static const uint8_t with_caps[] = {
+        0x8a, 0x65, 0x6c, 0x70, 0, 0, 0, 0, 0, 0, 0, 2,
+        0, 0, 0, 20,                                    // length of the block
+        0, 3, 0, 4, 0, 0, 0, 1,                         // queue commands
+        0x7f, 0xff, 0, 8, 1, 2, 3, 4, 5, 6, 7, 8,       // unknown, left out of the answer
+    };
+
+    if (caps) {
+        memcpy(buf, with_caps, sizeof(with_caps));
+        return sizeof(with_caps);
+    }
+    memcpy(buf, legacy, sizeof(legacy));
+    return sizeof(legacy);
+}
+
+static void check_handshake(int caps)
+{
+    uint8_t res[16 + 256];
+    size_t len = caps ? 16 : 12;
+
+    if (mem_transport_read(&kTcpSocketTransport, res, len, 1000) != len ||
+        memcmp(res, "\x8a\x65\x6c\x70\0\0\0\0\0\0\0", 11) != 0 || res[11] != (caps ? 2 : 1)) {
+        fail("handshake", caps);
+        return;
+    }
+    if (caps) {
+        len = res[12] << 24 | res[13] << 16 | res[14] << 8 | res[15];
+        if (len > 256 || mem_transport_read(&kTcpSocketTransport, res + 16, len, 1000) != len)
+            fail("capability block", len);
+    }
+}
+
+static void handshake(void)
+{
+    uint8_t req[64];
+
+    mem_transport_connect(&kTcpSocketTransport);
+    mem_transport_write(&kTcpSocketTransport, req, put_handshake(req, 0));
+    check_handshake(0);
+}
+
+// Every byte of the stream in segments of random size
+static uint32_t send_split(const uint8_t *stream, size_t len)
+{
+    uint32_t segments = 0;
+    size_t pos = 0, n;
+
+    while (pos < len) {
+        switch (next_random() % 3) {
+        case 0:
+            n = random_range(1, 8); // requests split up
+            break;
+        case 1:
+            n = random_range(1, 100);
+            break;
+        default:
+            n = random_range(100, 1460); // several requests in one
+            break;
+        }
+        n = MIN(n, len - pos);
+        mem_transport_write(&kTcpSocketTransport, stream + pos, n);
+        pos += n;
+        segments++;
+    }
+    return segments;
+}
+
+static void check_responses(const uint8_t *expect, size_t len)
+{
+    uint8_t *got = malloc(len + 1);
+    size_t n, i;
+
+    n = mem_transport_read(&kTcpSocketTransport, got, len, 5000);
+    for (i = 0; i < n && got[i] == expect[i]; i++) {
+    }
+    if (i < n)
+        fail("response byte", i);
+    else if (n < len)
+        fail("response missing, bytes received", n);
+    else if (mem_transport_read(&kTcpSocketTransport, got, 1, 10) != 0)
+        fail("response past the end", len);
+    free(got);
+}
+
+static void run_round(uint32_t round, uint32_t n, uint8_t *stream, uint8_t *expect)
+{
+    size_t stream_len, expect_len, hs_len, pos, len;
+    uint32_t first = command_count, segments = 0, sends;
+    int caps = round & 1;
+
+    // the handshake goes first, in the same buffer as the requests
+    hs_len = put_handshake(stream, caps);
+    generate(n, stream + hs_len, &stream_len, expect, &expect_len);
+
+    mem_transport_connect(&kTcpSocketTransport);
+    // the handshake cut in pieces, its last one in a segment with the first requests
+    for (pos = 0; pos < hs_len - 1; pos += len, segments++) {
+        len = random_range(1, 5);
+        len = MIN(len, hs_len - 1 - pos);
+        mem_transport_write(&kTcpSocketTransport, stream + pos, len);
+    }
+    segments += send_split(stream + pos, hs_len - pos + stream_len);
+    check_handshake(caps);
+    check_responses(expect, expect_len);
+    sends = mem_transport_sends(&kTcpSocketTransport) - 1;
+    mem_transport_disconnect(&kTcpSocketTransport);
+
+    if (executed != command_count)
+        fail("commands run", executed);
+    printf("round %2u: %s handshake, %u requests, %u commands, %zu bytes in %u segments, %u sends\n",
+           round, caps ? "caps" : "legacy", n, command_count - first, stream_len, segments, sends);
+}
+
+// Small requests in one segment while the network can not send
+static void run_batch(uint8_t *stream, uint8_t *expect)
+{
+    size_t stream_len, expect_len;
+    uint32_t n, target, sends;
+    int i;
+
+    handshake();
+    // the DAP task must not run out of response slots, one is with the send stage
+    n = dap_ringbuf_slots(kDapPacketSize);
+    n = MIN(n, 64);
+    mem_transport_hold(&kTcpSocketTransport, 1);
+
+    target = command_count + n;
+    stream_len = expect_len = 0;
+    for (uint32_t j = 0; j < n; j++) {
+        commands[command_count].buf[0] = ID_DAP_Delay;
+        commands[command_count].buf[1] = commands[command_count].buf[2] = 0;
+        commands[command_count].len = 3;
+        memcpy(stream + stream_len, commands[command_count].buf, 3);
+        stream_len += 3;
+        put_response(expect, &expect_len, ID_DAP_Delay, command_count);
+        command_count++;
+    }
+    mem_transport_write(&kTcpSocketTransport, stream, stream_len);
+
+    for (i = 0; i < 1000 && executed < target; i++)
+        usleep(1000);
+    if (executed < target)
+        fail("requests run while the sends are held", executed);
+
+    mem_transport_hold(&kTcpSocketTransport, 0);
+    check_responses(expect, expect_len);
+    sends = mem_transport_sends(&kTcpSocketTransport) - 1;
+    mem_transport_disconnect(&kTcpSocketTransport);
+
+    printf("batch: %u requests in one segment, %u sends\n", n, sends);
+    // the first response may be on its way alone, the others go together
+    if (sends > 2)
+        fail("responses not batched, sends", sends);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t rounds = 20, n = 400, seed = 0;
+    uint8_t *stream, *expect;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:s:")) != -1) {
+        switch (opt) {
+        case 'r':
+            rounds = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-n requests] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (n < 1) {
+        fprintf(stderr, "need at least one request\n");
+        return 2;
+    }
+    rng = seed ? seed : (uint32_t)time(NULL) | 1;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("seed %u\n", rng);
+    // a wrapper carries up to 3 commands
+    commands = calloc((size_t)(rounds * n * 3 + 64), sizeof(command_t));
+    stream = malloc((size_t)n * 3 * COMMAND_MAX + 2 * n + 64);
+    expect = malloc((size_t)n * 3 * RESPONSE_LEN + 2 * n);
+
+    timer_init();
+    DAP_Setup();
+    session_arena_init(dap_ringbuf_storage_size() +
+                       MAX(MAX(el_process_buffer_size(), usbip_session_buffer_size()), dap_tcp_session_buffer_size()) + 4 * SESSION_ARENA_ALIGN);
+    malloc_dap_ringbuf();
+    session_arena_keep();
+
+    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    xTaskCreate(transport_send_task, "dap_send", 2048, NULL, 12, &kDAPSendTaskHandle);
+    transport_start();
+
+    for (uint32_t r = 0; r < rounds; r++)
+        run_round(r, n, stream, expect);
+    run_batch(stream, expect);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
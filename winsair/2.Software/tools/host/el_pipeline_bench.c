@@ -0,0 +1,297 @@
+/**
+ * @file el_pipeline_bench.c
+ * @brief elaphureLink memory reads against a slow target, pipelined or not
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * A client on mem_transport.c does the elaphureLink handshake, connects
+ * to the simulated target of swd_target.c and reads its RAM the way a
+ * debugger reads a memory window: every read sets TAR and reads a
+ * TransferBlock of a full packet, as one segment. Up to depth reads are
+ * on the way at a time.
+ *
+ * The target runs at a low SWCLK and every receive and send of the
+ * firmware takes time like on the air, without using the CPU. With
+ * USE_EL_PIPELINE the DAP runs the next request while the network moves
+ * the others, without it the three take turns. The Makefile builds the
+ * bench both ways, el_pipeline_bench_seq has USE_EL_PIPELINE 0.
+ *
+ * Every response is checked. With -b, the rate of the sequential build,
+ * the bench fails unless it reads at least gain times as fast. -q prints
+ * the rate alone, on the last line of the output.
+ *
+ *   el_pipeline_bench [-n reads] [-d depth] [-c swclk_hz]
+ *                     [-r recv_us] [-t send_us] [-b baseline] [-g gain] [-q]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
+#include "main/usbip_server.h"
+#include "main/dap_tcp.h"
+#include "main/timer.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+#include "components/DAP/include/DAP.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "mem_transport.h"
+#include "swd_target.h"
+
+TaskHandle_t kDAPTaskHandle = NULL;
+TaskHandle_t kDAPSendTaskHandle = NULL;
+
+// MEM-AP registers
+#define AP_CSW 0x00
+#define AP_TAR 0x04
+#define AP_DRW 0x0C
+#define AP_REQ(reg, rnw) (DAP_TRANSFER_APnDP | ((rnw) ? DAP_TRANSFER_RnW : 0) | (reg))
+
+#define CSW_WORD_AUTOINC 0x23000052
+
+#define RESPONSE_TIMEOUT_MS 5000
+
+typedef struct
+{
+    uint8_t buf[64];
+    size_t len;
+} request_t;
+
+static uint32_t failures;
+static int quiet;
+
+
+static void fail(const char *what, uint32_t at)
+{
+    if (failures++ < 10)
+        fprintf(quiet ? stderr : stdout, "  FAIL %s at %u\n", what, at);
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void begin_transfer(request_t *req)
+{
+    req->buf[0] = ID_DAP_Transfer;
+    req->buf[1] = 0; // index
+    req->buf[2] = 0; // count
+    req->len = 3;
+}
+
+static void put_transfer(request_t *req, uint8_t request, uint32_t data)
+{
+    req->buf[req->len++] = request;
+    if (!(request & DAP_TRANSFER_RnW)) {
+        memcpy(req->buf + req->len, &data, 4);
+        req->len += 4;
+    }
+    req->buf[2]++;
+}
+
+// One request and its response, both of known length
+static void exchange(const uint8_t *req, size_t len, uint8_t *res, size_t res_len, const char *what)
+{
+    mem_transport_write(&kTcpSocketTransport, req, len);
+    if (mem_transport_read(&kTcpSocketTransport, res, res_len, RESPONSE_TIMEOUT_MS) != res_len ||
+        res[0] != req[0])
+        fail(what, 0);
+}
+
+static void handshake(void)
+{
+    // legacy proxy, el_proxy_version 1
+    static const uint8_t req[12] = { 0x8a, 0x65, 0x6c, 0x70, 0, 0, 0, 0, 0, 0, 0, 1 };
+    uint8_t res[12];
+
+    mem_transport_connect(&kTcpSocketTransport);
+    mem_transport_write(&kTcpSocketTransport, req, sizeof(req));
+    if (mem_transport_read(&kTcpSocketTransport, res, sizeof(res), RESPONSE_TIMEOUT_MS) != sizeof(res) ||
+        memcmp(res, req, 4) != 0)
+        fail("handshake", 0);
+}
+
+// What a debugger does before it touches memory, not timed
+static void connect_target(void)
+{
+    static const uint8_t dap_connect[] = { ID_DAP_Connect, DAP_PORT_SWD };
+    static const uint8_t configure[] = { ID_DAP_TransferConfigure, 0, 0x40, 0, 0, 0 };
+    static const uint8_t line_reset[] = { ID_DAP_SWJ_Sequence, 136,
+                                          0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x9E, 0xE7,
+                                          0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+    request_t req;
+    uint8_t res[16];
+
+    exchange(dap_connect, sizeof(dap_connect), res, 2, "DAP_Connect");
+    exchange(configure, sizeof(configure), res, 2, "DAP_TransferConfigure");
+    exchange(line_reset, sizeof(line_reset), res, 2, "line reset");
+
+    begin_transfer(&req);
+    put_transfer(&req, DAP_TRANSFER_RnW, 0);   // DPIDR
+    put_transfer(&req, 0, 0x1E);               // ABORT, clear the sticky errors
+    put_transfer(&req, DP_SELECT, 0);
+    put_transfer(&req, DP_CTRL_STAT, 0x50000000); // power up
+    exchange(req.buf, req.len, res, 7, "DP setup");
+    if (res[1] != 4 || res[2] != DAP_TRANSFER_OK)
+        fail("DP setup ack", res[2]);
+}
+
+/*
+ * A read of words from addr: CSW and TAR, then the block, sent together.
+ * The two responses are [cmd, count, ack] and [cmd, count(2), ack, data].
+ */
+static size_t build_read(uint8_t *buf, uint32_t addr, uint32_t words)
+{
+    request_t req;
+
+    begin_transfer(&req);
+    put_transfer(&req, AP_REQ(AP_CSW, 0), CSW_WORD_AUTOINC);
+    put_transfer(&req, AP_REQ(AP_TAR, 0), addr);
+    memcpy(buf, req.buf, req.len);
+
+    buf[req.len + 0] = ID_DAP_TransferBlock;
+    buf[req.len + 1] = 0;
+    buf[req.len + 2] = words & 0xFF;
+    buf[req.len + 3] = (words >> 8) & 0xFF;
+    buf[req.len + 4] = AP_REQ(AP_DRW, 1);
+    return req.len + 5;
+}
+
+static void check_read(const uint8_t *res, uint32_t words, uint32_t at)
+{
+    if (res[0] != ID_DAP_Transfer || res[1] != 2 || res[2] != DAP_TRANSFER_OK)
+        fail("TAR setup", at);
+    res += 3;
+    if (res[0] != ID_DAP_TransferBlock || (res[1] | res[2] << 8) != words ||
+        res[3] != DAP_TRANSFER_OK)
+        fail("block read", at);
+}
+
+int main(int argc, char **argv)
+{
+    swd_target_config_t target = {.clock_hz = 2000000};
+    uint32_t reads = 200, depth = 4, recv_us = 2000, send_us = 2000;
+    uint32_t words, sent, done, sends;
+    double baseline = 0, gain = 1.5, rate;
+    uint8_t req[64], *res;
+    size_t req_len, res_len;
+    uint64_t start, elapsed;
+    char *end;
+    int opt, usage = 0;
+
+    while ((opt = getopt(argc, argv, "n:d:c:r:t:b:g:q")) != -1) {
+        switch (opt) {
+        case 'n':
+            reads = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            depth = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            target.clock_hz = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            recv_us = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            send_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            baseline = strtod(optarg, &end);
+            if (*end != '\0' || baseline <= 0) {
+                fprintf(stderr, "bad baseline rate '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'g':
+            gain = strtod(optarg, NULL);
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            usage = 1;
+            break;
+        }
+    }
+    if (usage || optind < argc) {
+        fprintf(stderr, "usage: %s [-n reads] [-d depth] [-c swclk_hz] [-r recv_us] [-t send_us]"
+                        " [-b baseline] [-g gain] [-q]\n", argv[0]);
+        return 2;
+    }
+    if (reads < 1 || depth < 1 || target.clock_hz < 1) {
+        fprintf(stderr, "need at least one read, a depth and a clock\n");
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    timer_init();
+    swd_target_init(&target);
+    DAP_Setup();
+    session_arena_init(dap_ringbuf_storage_size() +
+                       MAX(MAX(el_process_buffer_size(), usbip_session_buffer_size()), dap_tcp_session_buffer_size()) + 4 * SESSION_ARENA_ALIGN);
+    malloc_dap_ringbuf();
+    session_arena_keep();
+
+    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    xTaskCreate(transport_send_task, "dap_send", 2048, NULL, 12, &kDAPSendTaskHandle);
+    transport_start();
+
+    handshake();
+    connect_target();
+
+    // a full response packet: cmd, count(2), ack, data
+    words = (kDapPacketSize - 4) / 4;
+    res_len = 3 + 4 + words * 4;
+    res = malloc(res_len);
+
+    mem_transport_delay(&kTcpSocketTransport, recv_us, send_us);
+    sends = mem_transport_sends(&kTcpSocketTransport);
+    start = now_us();
+    for (sent = done = 0; done < reads && !failures; done++) {
+        for (; sent < reads && sent - done < depth; sent++) {
+            req_len = build_read(req, SWD_TARGET_RAM_BASE + (sent * words * 4) % SWD_TARGET_RAM_SIZE, words);
+            mem_transport_write(&kTcpSocketTransport, req, req_len);
+        }
+        if (mem_transport_read(&kTcpSocketTransport, res, res_len, RESPONSE_TIMEOUT_MS) != res_len)
+            fail("response missing", done);
+        else
+            check_read(res, words, done);
+    }
+    elapsed = now_us() - start;
+    sends = mem_transport_sends(&kTcpSocketTransport) - sends;
+    mem_transport_disconnect(&kTcpSocketTransport);
+
+    rate = done * 1e6 / MAX(elapsed, 1);
+    if (quiet) {
+        printf("%.1f\n", rate);
+        return failures ? 1 : 0;
+    }
+
+    printf("pipeline %d, swclk %u Hz, network %u/%u us, depth %u\n",
+           USE_EL_PIPELINE, target.clock_hz, recv_us, send_us, depth);
+    printf("%u reads of %u words in %.1f ms, %u sends: %.1f reads/s, %.1f KB/s\n",
+           done, words, elapsed / 1000.0, sends, rate, rate * words * 4 / 1024);
+    if (baseline > 0) {
+        printf("%.2fx the sequential %.1f reads/s, %.2fx needed\n", rate / baseline, baseline, gain);
+        if (rate < baseline * gain)
+            fail("pipeline gain too low", (uint32_t)rate);
+    }
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
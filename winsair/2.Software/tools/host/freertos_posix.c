@@ -0,0 +1,393 @@
+/**
+ * @file freertos_posix.c
+ * @brief FreeRTOS and ESP-IDF calls of the firmware core on POSIX threads
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    TaskFunction_t code;
+    void *parameters;
+    const char *name;
+} host_task_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+} host_sem_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // an item was sent or taken
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+} host_queue_t;
+
+static __thread host_task_t *current_task = NULL;
+static pthread_mutex_t critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static uint32_t heap_min_free = 0xFFFFFFFF;
+
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Absolute CLOCK_MONOTONIC time ticks from now
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    uint64_t ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ns = (uint64_t)ts.tv_nsec + (uint64_t)ticks * (1000000000 / configTICK_RATE_HZ);
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Wait on cond until woken or ticks pass, 0 once the time is up
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *until)
+{
+    if (ticks == portMAX_DELAY)
+        return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, until) != ETIMEDOUT;
+}
+
+static host_task_t *task_new(const char *name)
+{
+    host_task_t *task = calloc(1, sizeof(host_task_t));
+
+    pthread_mutex_init(&task->lock, NULL);
+    cond_init(&task->cond);
+    task->name = name;
+    return task;
+}
+
+static void *task_entry(void *argument)
+{
+    host_task_t *task = argument;
+
+    current_task = task;
+    task->code(task->parameters);
+    return NULL;
+}
+
+
+void vPortEnterCritical(void)
+{
+    pthread_mutex_lock(&critical_lock);
+}
+
+void vPortExitCritical(void)
+{
+    pthread_mutex_unlock(&critical_lock);
+}
+
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *created)
+{
+    host_task_t *task = task_new(name);
+
+    task->code = code;
+    task->parameters = parameters;
+    // the handle is set before the task can use it
+    if (created)
+        *created = task;
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0)
+    {
+        if (created)
+            *created = NULL;
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // only a task ending itself is supported
+    if (task == NULL || task == current_task)
+        pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec until = deadline(ticks);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(monotonic_us() / (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // threads not started by xTaskCreate, main() for one
+    if (current_task == NULL)
+        current_task = task_new("main");
+    return current_task;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    host_task_t *task = handle;
+
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    host_task_t *task = xTaskGetCurrentTaskHandle();
+    struct timespec until = deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    uint32_t value;
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks != 0)
+    {
+        if (!cond_wait(&task->cond, &task->lock, ticks, &until))
+            break;
+    }
+    value = task->notify;
+    if (value)
+        task->notify = clear_on_exit ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+
+    return value;
+}
+
+
+static SemaphoreHandle_t semaphore_new(UBaseType_t max, UBaseType_t initial)
+{
+    host_sem_t *sem = calloc(1, sizeof(host_sem_t));
+
+    pthread_mutex_init(&sem->lock, NULL);
+    cond_init(&sem->cond);
+    sem->max = max;
+    sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_new(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_new(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return semaphore_new(max, initial);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle)
+{
+    host_sem_t *sem = handle;
+
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks)
+{
+    host_sem_t *sem = handle;
+    struct timespec until = deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0 && ticks != 0)
+    {
+        if (!cond_wait(&sem->cond, &sem->lock, ticks, &until))
+            break;
+    }
+    if (sem->count > 0)
+    {
+        sem->count--;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    host_sem_t *sem = handle;
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max)
+    {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    return ret;
+}
+
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue_t *queue = calloc(1, sizeof(host_queue_t));
+
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->cond);
+    queue->items = calloc(length, item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t ticks)
+{
+    host_queue_t *queue = handle;
+    struct timespec until = deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    BaseType_t ret = pdFALSE;
+    UBaseType_t tail;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length && ticks != 0)
+    {
+        if (!cond_wait(&queue->cond, &queue->lock, ticks, &until))
+            break;
+    }
+    if (queue->count < queue->length)
+    {
+        tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t ticks)
+{
+    host_queue_t *queue = handle;
+    struct timespec until = deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && ticks != 0)
+    {
+        if (!cond_wait(&queue->cond, &queue->lock, ticks, &until))
+            break;
+    }
+    if (queue->count > 0)
+    {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return ret;
+}
+
+BaseType_t xQueueReset(QueueHandle_t handle)
+{
+    host_queue_t *queue = handle;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->head = queue->count = 0;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+
+uint32_t esp_get_free_heap_size(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    uint32_t free_bytes = info.fordblks > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)info.fordblks;
+
+    if (free_bytes < heap_min_free)
+        heap_min_free = free_bytes;
+    return free_bytes;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    esp_get_free_heap_size();
+    return heap_min_free;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    // no PSRAM on the host
+    if (caps & MALLOC_CAP_SPIRAM)
+        return NULL;
+    return malloc(size);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    // malloc can always grow the process, there is no such block
+    return 0;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)monotonic_us();
+}
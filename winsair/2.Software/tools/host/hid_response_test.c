@@ -0,0 +1,327 @@
+/**
+ * @file hid_response_test.c
+ * @brief Response lengths of every transport in a USB HID build (host test)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * The Makefile builds this test with USE_WINUSB 0. A client on
+ * mem_transport.c runs the same requests over elaphureLink, CMSIS-DAP TCP
+ * and USB/IP, one session after the other.
+ *
+ * The DAP engine is replaced by one that answers with as many bytes as the
+ * request asks for. elaphureLink has to send them and nothing more, the
+ * DAP-TCP header has to announce that length. Only USB/IP pads them, as a
+ * HID report is always a full packet, and the padding has to be zeros.
+ *
+ *   hid_response_test [-n requests] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/param.h>
+
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
+#include "main/usbip_server.h"
+#include "main/dap_tcp.h"
+#include "main/timer.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+#include "components/DAP/include/DAP.h"
+#include "components/USBIP/usbip_defs.h"
+#include "components/USBIP/usb_descriptor.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "mem_transport.h"
+
+#if (USE_WINUSB != 0)
+#error "hid_response_test is built with USE_WINUSB 0"
+#endif
+
+TaskHandle_t kDAPTaskHandle = NULL;
+TaskHandle_t kDAPSendTaskHandle = NULL;
+
+#define HEADER_SIZE sizeof(usbip_stage2_header)
+// request of the client: [ID_DAP_Delay, response length, 0]
+#define REQUEST_LEN 3
+#define RESPONSE_MAX 64
+#define READ_TIMEOUT_MS 5000
+
+static uint8_t *lengths; // response length of every request, the same in each session
+static uint32_t count;
+static volatile uint32_t executed;
+static uint32_t answered; // responses the client checked
+static uint32_t failures;
+static uint32_t rng;
+
+
+static uint32_t next_random(void)
+{
+    // xorshift32, the seed makes a run repeatable
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void fail(const char *what, uint32_t at)
+{
+    if (failures++ < 10)
+        printf("  FAIL %s at %u\n", what, at);
+}
+
+void DAP_Setup(void)
+{
+}
+
+// [command, bytes that follow from the sequence number]
+static void put_response(uint8_t *buf, uint32_t seq, uint8_t len)
+{
+    buf[0] = ID_DAP_Delay;
+    for (uint32_t i = 1; i < len; i++)
+        buf[i] = (uint8_t)(seq + i);
+}
+
+uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response)
+{
+    uint32_t seq = executed;
+
+    put_response(response, seq, request[1]);
+    __atomic_store_n(&executed, seq + 1, __ATOMIC_RELEASE);
+    return (REQUEST_LEN << 16) | request[1];
+}
+
+uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response)
+{
+    return dap_execute_command(request, response);
+}
+
+
+static void put_request(uint8_t *buf, uint32_t i)
+{
+    buf[0] = ID_DAP_Delay;
+    buf[1] = lengths[i];
+    buf[2] = 0;
+}
+
+// The response of the next request, len bytes of it read already
+static void check_response(const uint8_t *got, size_t len, const char *what)
+{
+    uint8_t expect[RESPONSE_MAX];
+
+    put_response(expect, answered, lengths[answered % count]);
+    if (len != lengths[answered % count])
+        fail(what, answered);
+    else if (memcmp(got, expect, len) != 0)
+        fail("response bytes", answered);
+    answered++;
+}
+
+static void check_end(transport_t *t, const char *what)
+{
+    uint8_t extra;
+
+    if (mem_transport_read(t, &extra, 1, 10) != 0)
+        fail(what, answered);
+    mem_transport_disconnect(t);
+}
+
+// All requests in one segment, the responses back to back
+static void run_elaphurelink(void)
+{
+    static const uint8_t req[12] = { 0x8a, 0x65, 0x6c, 0x70, 0, 0, 0, 0, 0, 0, 0, 1 };
+    uint8_t res[RESPONSE_MAX], *stream;
+    uint32_t i;
+
+    mem_transport_connect(&kTcpSocketTransport);
+    mem_transport_write(&kTcpSocketTransport, req, sizeof(req));
+    if (mem_transport_read(&kTcpSocketTransport, res, sizeof(req), READ_TIMEOUT_MS) != sizeof(req) ||
+        memcmp(res, req, 4) != 0)
+        fail("handshake", 0);
+
+    stream = malloc((size_t)count * REQUEST_LEN);
+    for (i = 0; i < count; i++)
+        put_request(stream + i * REQUEST_LEN, i);
+    mem_transport_write(&kTcpSocketTransport, stream, (size_t)count * REQUEST_LEN);
+    free(stream);
+
+    for (i = 0; i < count && !failures; i++) {
+        if (mem_transport_read(&kTcpSocketTransport, res, lengths[i], READ_TIMEOUT_MS) != lengths[i])
+            fail("elaphureLink response missing", answered);
+        else
+            check_response(res, lengths[i], "elaphureLink response length");
+    }
+    check_end(&kTcpSocketTransport, "elaphureLink bytes past the responses");
+}
+
+// A header in front of every request and response
+static void run_dap_tcp(void)
+{
+    uint8_t buf[DAP_TCP_HEADER_SIZE + RESPONSE_MAX];
+    uint32_t i;
+    uint16_t len;
+
+    mem_transport_connect(&kDapTcpTransport);
+    for (i = 0; i < count && !failures; i++) {
+        memcpy(buf, "DAP\0", 4);
+        buf[4] = REQUEST_LEN;
+        buf[5] = 0;
+        buf[6] = DAP_TCP_TYPE_REQUEST;
+        buf[7] = 0;
+        put_request(buf + DAP_TCP_HEADER_SIZE, i);
+        mem_transport_write(&kDapTcpTransport, buf, DAP_TCP_HEADER_SIZE + REQUEST_LEN);
+
+        if (mem_transport_read(&kDapTcpTransport, buf, DAP_TCP_HEADER_SIZE, READ_TIMEOUT_MS) != DAP_TCP_HEADER_SIZE ||
+            memcmp(buf, "DAP\0", 4) != 0 || buf[6] != DAP_TCP_TYPE_RESPONSE) {
+            fail("DAP-TCP header", answered);
+            break;
+        }
+        len = buf[4] | buf[5] << 8;
+        if (len > RESPONSE_MAX) {
+            fail("DAP-TCP response length", len);
+            break;
+        }
+        if (mem_transport_read(&kDapTcpTransport, buf, len, READ_TIMEOUT_MS) != len)
+            fail("DAP-TCP response missing", answered);
+        else
+            check_response(buf, len, "DAP-TCP response length");
+    }
+    check_end(&kDapTcpTransport, "DAP-TCP bytes past the responses");
+}
+
+static void submit(uint32_t seqnum, uint32_t direction, const uint8_t *data, uint32_t len)
+{
+    uint8_t buf[HEADER_SIZE + REQUEST_LEN];
+    usbip_stage2_header *header = (usbip_stage2_header *)buf;
+
+    memset(header, 0, HEADER_SIZE);
+    header->base.command = htonl(USBIP_CMD_SUBMIT);
+    header->base.seqnum = htonl(seqnum);
+    header->base.devid = htonl(0x10002);
+    header->base.direction = htonl(direction);
+    header->base.ep = htonl(USBD0_EP_DAP_OUT & 0x0F);
+    header->u.cmd_submit.data_length = htonl(len);
+    if (direction == USBIP_DIR_OUT)
+        memcpy(buf + HEADER_SIZE, data, len);
+    mem_transport_write(&kTcpSocketTransport, buf, HEADER_SIZE + (direction == USBIP_DIR_OUT ? len : 0));
+}
+
+static int32_t read_ret_submit(uint32_t seqnum)
+{
+    usbip_stage2_header header;
+
+    if (mem_transport_read(&kTcpSocketTransport, &header, HEADER_SIZE, READ_TIMEOUT_MS) != HEADER_SIZE ||
+        ntohl(header.base.command) != USBIP_RET_SUBMIT || ntohl(header.base.seqnum) != seqnum ||
+        ntohl(header.u.ret_submit.status) != USBIP_STATUS_OK) {
+        fail("RET_SUBMIT", seqnum);
+        return -1;
+    }
+    return ntohl(header.u.ret_submit.data_length);
+}
+
+// An interrupt OUT and IN URB per request, the IN one gets a full report
+static void run_usbip(void)
+{
+    usbip_stage1_request_import req;
+    uint8_t res[sizeof(usbip_stage1_header) + sizeof(usbip_stage1_usb_device)];
+    uint8_t request[REQUEST_LEN], *report;
+    uint32_t i, seqnum = 1, j;
+    int32_t len;
+
+    memset(&req, 0, sizeof(req));
+    req.header.version = htons(USBIP_VERSION);
+    req.header.command = htons(USBIP_OP_REQ_IMPORT);
+    strcpy(req.busid, "1-1");
+
+    mem_transport_connect(&kTcpSocketTransport);
+    mem_transport_write(&kTcpSocketTransport, &req, sizeof(req));
+    if (mem_transport_read(&kTcpSocketTransport, res, sizeof(res), READ_TIMEOUT_MS) != sizeof(res) ||
+        ntohs(((usbip_stage1_header *)res)->command) != USBIP_OP_REP_IMPORT)
+        fail("import", 0);
+
+    report = malloc(DAP_PACKET_SIZE);
+    for (i = 0; i < count && !failures; i++) {
+        put_request(request, i);
+        submit(seqnum, USBIP_DIR_OUT, request, REQUEST_LEN);
+        if (read_ret_submit(seqnum++) != REQUEST_LEN)
+            fail("OUT URB length", i);
+
+        submit(seqnum, USBIP_DIR_IN, NULL, kDapPacketSize);
+        len = read_ret_submit(seqnum++);
+        if (len != kDapPacketSize) {
+            fail("HID report length", len);
+            break;
+        }
+        if (mem_transport_read(&kTcpSocketTransport, report, len, READ_TIMEOUT_MS) != (size_t)len) {
+            fail("HID report missing", answered);
+            break;
+        }
+        for (j = lengths[i]; j < (uint32_t)len && report[j] == 0; j++) {
+        }
+        if (j < (uint32_t)len)
+            fail("HID report padding", j);
+        check_response(report, lengths[i], "HID report");
+    }
+    free(report);
+    check_end(&kTcpSocketTransport, "USB/IP bytes past the reports");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seed = 0, i;
+    int opt;
+
+    count = 200;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count < 1) {
+        fprintf(stderr, "need at least one request\n");
+        return 2;
+    }
+    rng = seed ? seed : (uint32_t)time(NULL) | 1;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("seed %u\n", rng);
+    lengths = malloc(count);
+    for (i = 0; i < count; i++)
+        lengths[i] = 1 + next_random() % RESPONSE_MAX;
+
+    timer_init();
+    DAP_Setup();
+    session_arena_init(dap_ringbuf_storage_size() +
+                       MAX(MAX(el_process_buffer_size(), usbip_session_buffer_size()), dap_tcp_session_buffer_size()) + 4 * SESSION_ARENA_ALIGN);
+    malloc_dap_ringbuf();
+    session_arena_keep();
+
+    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    xTaskCreate(transport_send_task, "dap_send", 2048, NULL, 12, &kDAPSendTaskHandle);
+    transport_start();
+
+    run_elaphurelink();
+    printf("elaphureLink: %u responses\n", answered);
+    run_dap_tcp();
+    printf("DAP-TCP: %u responses\n", answered - count);
+    run_usbip();
+    printf("USB/IP: %u reports of %u bytes\n", answered - 2 * count, kDapPacketSize);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
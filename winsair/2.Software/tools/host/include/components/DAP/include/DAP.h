@@ -0,0 +1,118 @@
+/**
+ * @file DAP.h
+ * @brief CMSIS-DAP command interface for the host build
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * components/DAP is not part of this tree. The command and field values
+ * below are the ones of the CMSIS-DAP specification, the engine behind
+ * DAP_ExecuteCommand() comes from tools/host.
+ */
+#ifndef __DAP_H__
+#define __DAP_H__
+
+#include <stdint.h>
+
+// DAP Command IDs
+#define ID_DAP_Info               0x00U
+#define ID_DAP_HostStatus         0x01U
+#define ID_DAP_Connect            0x02U
+#define ID_DAP_Disconnect         0x03U
+#define ID_DAP_TransferConfigure  0x04U
+#define ID_DAP_Transfer           0x05U
+#define ID_DAP_TransferBlock      0x06U
+#define ID_DAP_TransferAbort      0x07U
+#define ID_DAP_WriteABORT         0x08U
+#define ID_DAP_Delay              0x09U
+#define ID_DAP_ResetTarget        0x0AU
+#define ID_DAP_SWJ_Pins           0x10U
+#define ID_DAP_SWJ_Clock          0x11U
+#define ID_DAP_SWJ_Sequence       0x12U
+#define ID_DAP_SWD_Configure      0x13U
+#define ID_DAP_SWD_Sequence       0x1DU
+#define ID_DAP_JTAG_Sequence      0x14U
+#define ID_DAP_JTAG_Configure     0x15U
+#define ID_DAP_JTAG_IDCODE        0x16U
+#define ID_DAP_SWO_Transport      0x17U
+#define ID_DAP_SWO_Mode           0x18U
+#define ID_DAP_SWO_Baudrate       0x19U
+#define ID_DAP_SWO_Control        0x1AU
+#define ID_DAP_SWO_Status         0x1BU
+#define ID_DAP_SWO_ExtendedStatus 0x1EU
+#define ID_DAP_SWO_Data           0x1CU
+
+#define ID_DAP_QueueCommands      0x7EU
+#define ID_DAP_ExecuteCommands    0x7FU
+
+#define ID_DAP_Vendor0            0x80U
+#define ID_DAP_Vendor31           0x9FU
+
+#define ID_DAP_Invalid            0xFFU
+
+// DAP Status Code
+#define DAP_OK                    0U
+#define DAP_ERROR                 0xFFU
+
+// DAP ID
+#define DAP_ID_VENDOR             1U
+#define DAP_ID_PRODUCT            2U
+#define DAP_ID_SER_NUM            3U
+#define DAP_ID_DAP_FW_VER         4U
+#define DAP_ID_DEVICE_VENDOR      5U
+#define DAP_ID_DEVICE_NAME        6U
+#define DAP_ID_BOARD_VENDOR       7U
+#define DAP_ID_BOARD_NAME         8U
+#define DAP_ID_PRODUCT_FW_VER     9U
+#define DAP_ID_CAPABILITIES       0xF0U
+#define DAP_ID_TIMESTAMP_CLOCK    0xF1U
+#define DAP_ID_SWO_BUFFER_SIZE    0xFDU
+#define DAP_ID_PACKET_COUNT       0xFEU
+#define DAP_ID_PACKET_SIZE        0xFFU
+
+// DAP Port
+#define DAP_PORT_AUTODETECT       0U
+#define DAP_PORT_DISABLED         0U
+#define DAP_PORT_SWD              1U
+#define DAP_PORT_JTAG             2U
+
+// DAP Transfer Request
+#define DAP_TRANSFER_APnDP        (1U<<0)
+#define DAP_TRANSFER_RnW          (1U<<1)
+#define DAP_TRANSFER_A2           (1U<<2)
+#define DAP_TRANSFER_A3           (1U<<3)
+#define DAP_TRANSFER_MATCH_VALUE  (1U<<4)
+#define DAP_TRANSFER_MATCH_MASK   (1U<<5)
+#define DAP_TRANSFER_TIMESTAMP    (1U<<7)
+
+// DAP Transfer Response
+#define DAP_TRANSFER_OK           (1U<<0)
+#define DAP_TRANSFER_WAIT         (1U<<1)
+#define DAP_TRANSFER_FAULT        (1U<<2)
+#define DAP_TRANSFER_ERROR        (1U<<3)
+#define DAP_TRANSFER_MISMATCH     (1U<<4)
+
+// Debug Port Register Addresses
+#define DP_IDCODE                 0x00U
+#define DP_ABORT                  0x00U
+#define DP_CTRL_STAT              0x04U
+#define DP_SELECT                 0x08U
+#define DP_RESEND                 0x08U
+#define DP_RDBUFF                 0x0CU
+
+/**
+ * @brief Run one command
+ *
+ * @return request bytes taken in the upper 16 bits, response bytes written
+ *         in the lower 16 bits
+ */
+extern uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response);
+
+/**
+ * @brief DAP_ProcessCommand(), ID_DAP_ExecuteCommands runs every command it carries
+ *
+ */
+extern uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response);
+
+extern void DAP_Setup(void);
+
+#endif
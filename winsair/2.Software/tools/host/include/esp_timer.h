@@ -0,0 +1,9 @@
+#ifndef __HOST_ESP_TIMER_H__
+#define __HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+
+// Microseconds of CLOCK_MONOTONIC
+int64_t esp_timer_get_time(void);
+
+#endif
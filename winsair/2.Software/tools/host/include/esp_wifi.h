@@ -0,0 +1,6 @@
+#ifndef __HOST_ESP_WIFI_H__
+#define __HOST_ESP_WIFI_H__
+
+// Included by the firmware, nothing of it is used on the host
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ * @file FreeRTOS.h
+ * @brief FreeRTOS on POSIX threads, only what the firmware core uses
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Every task is a thread and runs at the same time as the others. Task
+ * priorities are accepted and ignored, so code that relies on one task
+ * preempting another shows up as a race here.
+ */
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  0
+#define pdPASS  1
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portMAX_DELAY      ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS   portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)  ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+
+#define IRAM_ATTR
+
+// One lock for every critical section
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __HOST_EVENT_GROUPS_H__
+#define __HOST_EVENT_GROUPS_H__
+
+#include "freertos/FreeRTOS.h"
+
+// Included by the firmware, event groups are not used on the host
+typedef void *EventGroupHandle_t;
+
+#endif
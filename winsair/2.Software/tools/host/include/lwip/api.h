@@ -0,0 +1,97 @@
+/**
+ * @file api.h
+ * @brief lwIP netconn calls of the UART bridge
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * Only uart_bridge_sim.c implements these, with a simulated client in
+ * place of the TCP stack. main/tcp_netconn.c is compiled against them and
+ * lwip/tcp.h, it is not linked into a program.
+ */
+#ifndef __HOST_LWIP_API_H__
+#define __HOST_LWIP_API_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lwip/err.h"
+#include "lwip/netbuf.h"
+
+enum netconn_type
+{
+    NETCONN_INVALID,
+    NETCONN_TCP = 0x10,
+};
+
+enum netconn_state
+{
+    NETCONN_NONE,
+    NETCONN_WRITE,
+    NETCONN_LISTEN,
+    NETCONN_CONNECT,
+    NETCONN_CLOSE,
+};
+
+enum netconn_evt
+{
+    NETCONN_EVT_RCVPLUS,
+    NETCONN_EVT_RCVMINUS,
+    NETCONN_EVT_SENDPLUS,
+    NETCONN_EVT_SENDMINUS,
+    NETCONN_EVT_ERROR,
+};
+
+struct netconn;
+typedef void (*netconn_callback)(struct netconn *conn, enum netconn_evt evt, uint16_t len);
+
+struct tcp_pcb;
+
+// The fields the bridge and tcp_netconn.c read, the simulation keeps its own state behind them
+struct netconn
+{
+    enum netconn_type type;
+    enum netconn_state state;
+    union
+    {
+        struct tcp_pcb *tcp;
+    } pcb;
+    err_t pending_err;
+    uint8_t flags;
+    netconn_callback callback;
+    void *sim;
+};
+
+struct netvector
+{
+    const void *ptr;
+    size_t len;
+};
+
+typedef struct
+{
+    uint32_t addr;
+} ip_addr_t;
+
+extern const ip_addr_t ip_addr_any;
+#define IP_ADDR_ANY (&ip_addr_any)
+
+#define NETCONN_FLAG_NON_BLOCKING 0x02
+#define NETCONN_NOCOPY            0x00
+#define NETCONN_COPY              0x01
+#define NETCONN_DONTBLOCK         0x04
+
+struct netconn *netconn_new_with_callback(enum netconn_type type, netconn_callback callback);
+void netconn_set_nonblocking(struct netconn *conn, int nonblocking);
+err_t netconn_bind(struct netconn *conn, const ip_addr_t *addr, uint16_t port);
+err_t netconn_listen(struct netconn *conn);
+err_t netconn_accept(struct netconn *conn, struct netconn **new_conn);
+err_t netconn_recv(struct netconn *conn, struct netbuf **buf);
+err_t netconn_write_partly(struct netconn *conn, const void *data, size_t size, uint8_t flags,
+                           size_t *bytes_written);
+err_t netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, uint16_t vectorcnt,
+                                   uint8_t flags, size_t *bytes_written);
+#define netconn_write(conn, data, size, flags) netconn_write_partly(conn, data, size, flags, NULL)
+err_t netconn_close(struct netconn *conn);
+err_t netconn_delete(struct netconn *conn);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __HOST_LWIP_ERR_H__
+#define __HOST_LWIP_ERR_H__
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+
+#define ERR_OK         0
+#define ERR_MEM        -1
+#define ERR_WOULDBLOCK -7
+#define ERR_CONN       -11
+#define ERR_CLSD       -15
+#define ERR_ARG        -16
+
+#endif
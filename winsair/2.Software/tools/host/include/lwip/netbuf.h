@@ -0,0 +1,15 @@
+#ifndef __HOST_LWIP_NETBUF_H__
+#define __HOST_LWIP_NETBUF_H__
+
+#include <stdint.h>
+
+#include "lwip/err.h"
+
+// A received packet, see lwip/api.h
+struct netbuf;
+
+err_t netbuf_data(struct netbuf *buf, void **data, uint16_t *len);
+int8_t netbuf_next(struct netbuf *buf);
+void netbuf_delete(struct netbuf *buf);
+
+#endif
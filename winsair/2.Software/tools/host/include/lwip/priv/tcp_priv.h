@@ -0,0 +1,9 @@
+#ifndef __HOST_LWIP_TCP_PRIV_H__
+#define __HOST_LWIP_TCP_PRIV_H__
+
+#include "lwip/tcp.h"
+
+// The connections that are not listening or in TIME_WAIT
+extern struct tcp_pcb *tcp_active_pcbs;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __HOST_LWIP_TCPIP_PRIV_H__
+#define __HOST_LWIP_TCPIP_PRIV_H__
+
+#include "lwip/err.h"
+
+// A call run on the tcpip thread, declared for tcp_netconn.c
+struct tcpip_api_call_data
+{
+    err_t err;
+};
+
+typedef err_t (*tcpip_api_call_fn)(struct tcpip_api_call_data *call);
+
+err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call);
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file sockets.h
+ * @brief lwIP socket API on the BSD sockets of the host
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * The lwIP socket API follows BSD sockets, so the firmware calls go
+ * straight to the host. The netconn API has no counterpart here, build
+ * with USE_TCP_NETCONN 0. lwip/api.h only serves uart_bridge_sim.
+ */
+#ifndef __HOST_LWIP_SOCKETS_H__
+#define __HOST_LWIP_SOCKETS_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define inet_ntoa_r(addr, buf, len) inet_ntop(AF_INET, &(addr), buf, len)
+
+// A restarted host build would find its ports in TIME_WAIT, the probe
+// never does as it reboots. See lwip_posix.c.
+int lwip_host_bind(int sock, const struct sockaddr *addr, socklen_t len);
+#define bind lwip_host_bind
+
+#endif
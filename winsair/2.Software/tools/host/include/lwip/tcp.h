@@ -0,0 +1,46 @@
+#ifndef __HOST_LWIP_TCP_H__
+#define __HOST_LWIP_TCP_H__
+
+#include <stdint.h>
+
+#include "lwip/err.h"
+#include "lwip/api.h"
+
+typedef uint16_t u16_t;
+
+enum tcp_state
+{
+    CLOSED,
+    LISTEN,
+    SYN_SENT,
+    SYN_RCVD,
+    ESTABLISHED,
+    FIN_WAIT_1,
+    FIN_WAIT_2,
+    CLOSE_WAIT,
+    CLOSING,
+    LAST_ACK,
+    TIME_WAIT,
+};
+
+struct tcp_pcb;
+typedef err_t (*tcp_sent_fn)(void *arg, struct tcp_pcb *tpcb, u16_t len);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+
+// The fields tcp_netconn.c reads, the raw TCP API is not run on the host
+struct tcp_pcb
+{
+    struct tcp_pcb *next;
+    enum tcp_state state;
+    u16_t local_port;
+    u16_t remote_port;
+    uint32_t lastack;
+    uint32_t snd_lbb;
+    tcp_sent_fn sent;
+};
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg);
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent);
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_NVS_FLASH_H__
+#define __HOST_NVS_FLASH_H__
+
+// Included by the firmware, nothing of it is used on the host
+
+#endif
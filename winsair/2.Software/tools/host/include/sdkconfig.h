@@ -0,0 +1,16 @@
+/**
+ * @file sdkconfig.h
+ * @brief Host build configuration, stands in for the one ESP-IDF generates
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * No CONFIG_IDF_TARGET_* is defined, so the firmware takes the code paths
+ * of the ESP32 family wherever it tells the targets apart.
+ */
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LWIP_TCP_WND_DEFAULT 5744
+
+#endif
@@ -0,0 +1,367 @@
+/**
+ * @file kcp_fec_test.c
+ * @brief Loss cases of the XOR parity FEC of main/kcp_fec.c (host test)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * An encoder wraps datagrams of random length and content into groups the
+ * way kcp_server.c does, and a decoder gets them back with some left out
+ * and the rest in random order:
+ *
+ *   - one data datagram lost in a group, it has to be rebuilt
+ *   - the parity lost, the data passes as is
+ *   - a partial group closed by a flushed parity, as kcp_tx_parity(1) does
+ *     at the end of a burst, with one loss
+ *   - two losses in a group, nothing can be rebuilt and nothing made up
+ *   - groups out of order, one of them a group count ahead and so in the
+ *     slot of an older one that is still open
+ *   - datagrams without a FEC header, and FEC off
+ *
+ * Every datagram that comes out of the decoder has to be one that was
+ * sent, byte for byte, and none may come out twice. The group numbers of
+ * some rounds start just below the 16-bit wrap.
+ *
+ * main/kcp_fec.c does not depend on ikcp, tools/kcp_fec_sim.c runs it with
+ * KCP over a lossy link where the kcp component is present.
+ *
+ *   kcp_fec_test [-r rounds] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "main/kcp_fec.h"
+
+#define WIRE_SIZE (KCP_FEC_HEADER_SIZE + KCP_FEC_MTU)
+// datagrams of one case: the groups of the slot reuse case and their parity
+#define CASE_MAX ((KCP_FEC_RX_GROUPS + 1) * (KCP_FEC_MAX_GROUP + 1))
+
+typedef struct
+{
+    char buf[WIRE_SIZE];
+    int len;
+} wire_t;
+
+typedef struct
+{
+    char buf[KCP_FEC_MTU];
+    int len;
+    uint8_t received;
+} sent_t;
+
+static kcp_fec_t tx, rx;
+static sent_t *sent;      // by id, the first 4 bytes of the payload
+static uint32_t sent_num;
+static wire_t wire[CASE_MAX];
+static int wire_num;
+
+static uint32_t failures;
+static uint32_t rng;
+static uint32_t recovered_expected;
+
+
+static uint32_t next_random(void)
+{
+    // xorshift32, the seed makes a run repeatable
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static uint32_t random_range(uint32_t lo, uint32_t hi)
+{
+    return lo + next_random() % (hi - lo + 1);
+}
+
+static void fail(const char *what, uint32_t at)
+{
+    if (failures++ < 10)
+        printf("  FAIL %s at %u\n", what, at);
+}
+
+static int input(const char *buf, int len, void *user)
+{
+    uint32_t id;
+
+    if (len < 4) {
+        fail("datagram too short", len);
+        return -1;
+    }
+    memcpy(&id, buf, 4);
+    if (id >= sent_num || sent[id].len != len || memcmp(sent[id].buf, buf, len) != 0)
+        fail("datagram that was not sent", id);
+    else if (sent[id].received++)
+        fail("datagram passed on twice", id);
+    return 0;
+}
+
+// One data datagram of random length onto the wire, the parity after it once due
+static void send_data(void)
+{
+    sent_t *s = &sent[sent_num];
+    int i;
+
+    s->len = random_range(4, KCP_FEC_MTU);
+    memcpy(s->buf, &sent_num, 4);
+    for (i = 4; i < s->len; i++)
+        s->buf[i] = (char)next_random();
+    s->received = 0;
+    sent_num++;
+
+    wire[wire_num].len = kcp_fec_encode(&tx, s->buf, s->len, wire[wire_num].buf);
+    if (wire[wire_num].len != KCP_FEC_HEADER_SIZE + s->len)
+        fail("encoded length", sent_num - 1);
+    wire_num++;
+
+    wire[wire_num].len = kcp_fec_parity(&tx, 0, wire[wire_num].buf);
+    if (wire[wire_num].len > 0)
+        wire_num++;
+}
+
+// A full group, wire[first + i] is data i and wire[first + n] its parity
+static int send_group(void)
+{
+    int first = wire_num;
+
+    for (int i = 0; i < tx.group_size; i++)
+        send_data();
+    if (wire_num != first + tx.group_size + 1)
+        fail("parity missing after a full group", tx.tx_group);
+    return first;
+}
+
+static void shuffle(int *order, int n)
+{
+    for (int i = n - 1; i > 0; i--) {
+        int j = next_random() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+// wire[first, first + n) except the lost ones, in random order
+static void deliver(int first, int n, uint32_t lost)
+{
+    int order[CASE_MAX], count = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (!(lost & (1UL << i)))
+            order[count++] = first + i;
+    }
+    shuffle(order, count);
+    for (int i = 0; i < count; i++) {
+        if (kcp_fec_decode(&rx, wire[order[i]].buf, wire[order[i]].len, input, NULL) != 0)
+            fail("datagram refused", order[i]);
+    }
+}
+
+// Every data datagram since `first_id` came out, except the ones of `missing`
+static void check_received(uint32_t first_id, const uint32_t *missing, int missing_num)
+{
+    for (uint32_t id = first_id; id < sent_num; id++) {
+        int expect = 1;
+        for (int i = 0; i < missing_num; i++) {
+            if (missing[i] == id)
+                expect = 0;
+        }
+        if (sent[id].received != expect)
+            fail(expect ? "datagram lost" : "datagram made up", id);
+    }
+    if (rx.recovered != recovered_expected)
+        fail("datagrams rebuilt", rx.recovered);
+}
+
+static void case_single_loss(void)
+{
+    uint32_t first_id = sent_num;
+    int first, k = random_range(0, tx.group_size - 1);
+
+    wire_num = 0;
+    first = send_group();
+    deliver(first, tx.group_size + 1, 1UL << k);
+    recovered_expected++;
+    check_received(first_id, NULL, 0);
+}
+
+static void case_parity_lost(void)
+{
+    uint32_t first_id = sent_num;
+    int first;
+
+    wire_num = 0;
+    first = send_group();
+    deliver(first, tx.group_size + 1, 1UL << tx.group_size);
+    check_received(first_id, NULL, 0);
+}
+
+static void case_flushed_group(void)
+{
+    uint32_t first_id = sent_num;
+    int m = random_range(1, tx.group_size - 1), k = random_range(0, m - 1);
+    int len;
+
+    wire_num = 0;
+    for (int i = 0; i < m; i++)
+        send_data();
+    if (wire_num != m)
+        fail("parity of a partial group without a flush", tx.tx_group);
+    len = kcp_fec_parity(&tx, 1, wire[wire_num].buf);
+    if (len <= 0) {
+        fail("no parity for a flushed group", tx.tx_group);
+        return;
+    }
+    wire[wire_num++].len = len;
+    if (kcp_fec_parity(&tx, 1, wire[wire_num].buf) != 0)
+        fail("parity of an empty group", tx.tx_group);
+
+    deliver(0, m + 1, 1UL << k);
+    recovered_expected++;
+    check_received(first_id, NULL, 0);
+}
+
+static void case_two_lost(void)
+{
+    uint32_t first_id = sent_num, missing[2];
+    int first, a, b;
+
+    a = random_range(0, tx.group_size - 1);
+    do {
+        b = random_range(0, tx.group_size - 1);
+    } while (b == a);
+
+    wire_num = 0;
+    first = send_group();
+    deliver(first, tx.group_size + 1, 1UL << a | 1UL << b);
+    missing[0] = first_id + a;
+    missing[1] = first_id + b;
+    check_received(first_id, missing, 2);
+}
+
+/*
+ * Group 0 of the case loses a datagram and waits for its parity while the
+ * groups after it arrive, the last one in the same decoder slot. That one
+ * takes the slot over: the late parity of group 0 must rebuild nothing and
+ * must leave the slot alone, the parity of the new group comes after it.
+ * The groups in between lose one each and come in backwards.
+ */
+static void case_slot_reuse(void)
+{
+    uint32_t first_id = sent_num, missing;
+    int n = tx.group_size + 1, first[KCP_FEC_RX_GROUPS + 1];
+    int g, k;
+
+    wire_num = 0;
+    for (g = 0; g <= KCP_FEC_RX_GROUPS; g++)
+        first[g] = send_group();
+
+    // group 0 without its parity and one datagram
+    k = random_range(0, tx.group_size - 1);
+    deliver(first[0], tx.group_size, 1UL << k);
+    missing = first_id + k;
+
+    // a group count ahead, same slot, its parity held back
+    deliver(first[KCP_FEC_RX_GROUPS], tx.group_size, 1UL << random_range(0, tx.group_size - 1));
+
+    // the parity of group 0 comes too late, then the one of the new group
+    deliver(first[0] + tx.group_size, 1, 0);
+    deliver(first[KCP_FEC_RX_GROUPS] + tx.group_size, 1, 0);
+    recovered_expected++;
+
+    for (g = KCP_FEC_RX_GROUPS - 1; g > 0; g--) {
+        deliver(first[g], n, 1UL << random_range(0, tx.group_size - 1));
+        recovered_expected++;
+    }
+    check_received(first_id, &missing, 1);
+}
+
+static int plain_input(const char *buf, int len, void *user)
+{
+    const wire_t *expect = user;
+
+    if (len != expect->len || memcmp(buf, expect->buf, len) != 0)
+        fail("plain datagram changed", len);
+    return 0;
+}
+
+// Without a FEC header a datagram passes as it is, and with FEC off it is sent as it is
+static void case_plain(void)
+{
+    kcp_fec_t off;
+    wire_t plain;
+
+    // a KCP segment starts with the conversation id
+    plain.len = random_range(24, KCP_FEC_MTU);
+    for (int i = 0; i < plain.len; i++)
+        plain.buf[i] = (char)next_random();
+    plain.buf[0] = 1;
+
+    kcp_fec_init(&off, 0);
+    if (kcp_fec_encode(&off, plain.buf, plain.len, wire[0].buf) != plain.len ||
+        memcmp(wire[0].buf, plain.buf, plain.len) != 0)
+        fail("datagram changed with FEC off", plain.len);
+    if (kcp_fec_parity(&off, 1, wire[0].buf) != 0)
+        fail("parity with FEC off", 0);
+    if (kcp_fec_decode(&rx, plain.buf, plain.len, plain_input, &plain) != 0)
+        fail("plain datagram refused", plain.len);
+}
+
+static void run_round(uint32_t round)
+{
+    int group_size = random_range(2, KCP_FEC_MAX_GROUP);
+    uint32_t first_id = sent_num;
+    uint16_t first_group = 0;
+
+    kcp_fec_init(&tx, group_size);
+    kcp_fec_init(&rx, 0);
+    recovered_expected = 0;
+    // near the wrap of the group number now and then
+    if (round % 4 == 3)
+        first_group = tx.tx_group = 0x10000 - random_range(1, 2 * KCP_FEC_RX_GROUPS);
+
+    case_single_loss();
+    case_parity_lost();
+    case_flushed_group();
+    case_two_lost();
+    case_slot_reuse();
+    case_single_loss();
+    case_plain();
+
+    printf("round %2u: groups of %d from %u, %u datagrams, %u rebuilt\n",
+           round, group_size, first_group, sent_num - first_id, rx.recovered);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t rounds = 40, seed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+        switch (opt) {
+        case 'r':
+            rounds = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    rng = seed ? seed : (uint32_t)time(NULL) | 1;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("seed %u\n", rng);
+    // ten groups a round at most
+    sent = calloc((size_t)rounds * 10 * KCP_FEC_MAX_GROUP, sizeof(sent_t));
+
+    for (uint32_t r = 0; r < rounds; r++)
+        run_round(r);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+/**
+ * @file lwip_posix.c
+ * @brief lwIP socket calls that behave differently on the host
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+
+int lwip_host_bind(int sock, const struct sockaddr *addr, socklen_t len)
+{
+    int on = 1;
+
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    return bind(sock, addr, len);
+}
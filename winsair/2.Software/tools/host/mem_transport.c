@@ -0,0 +1,322 @@
+/**
+ * @file mem_transport.c
+ * @brief In-process stand-in for the socket transports of tcp_server.c
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * See mem_transport.h. There is no poll_fd, the transports run on tasks of
+ * their own, so the tests need USE_EVENT_LOOP 0.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#include "main/wifi_configuration.h"
+#include "mem_transport.h"
+
+typedef struct mem_segment
+{
+    struct mem_segment *next;
+    size_t len;
+    uint8_t data[];
+} mem_segment_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // any change below
+    int connected;       // from mem_transport_connect() until close()
+    int accepted;
+    int closing;         // the client went away
+    mem_segment_t *head; // written and not taken yet
+    mem_segment_t *tail;
+    int busy;            // a segment is in the session
+    uint8_t *rx;         // sent by the firmware and not read yet
+    size_t rx_len;
+    size_t rx_size;
+    uint32_t sends;
+    int hold;
+    uint32_t recv_us;
+    uint32_t send_us;
+} mem_client_t;
+
+static mem_client_t mem_clients[2];
+static pthread_once_t mem_once = PTHREAD_ONCE_INIT;
+
+
+static void mem_init(void)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    for (size_t i = 0; i < sizeof(mem_clients) / sizeof(mem_clients[0]); i++) {
+        pthread_mutex_init(&mem_clients[i].lock, NULL);
+        pthread_cond_init(&mem_clients[i].cond, &attr);
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+static mem_client_t *mem_client(transport_t *t)
+{
+    pthread_once(&mem_once, mem_init);
+    return t->priv;
+}
+
+static struct timespec mem_deadline(uint32_t ms)
+{
+    struct timespec ts;
+    uint64_t ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ns = (uint64_t)ts.tv_nsec + (uint64_t)ms * 1000000;
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+static void mem_drop_segments(mem_client_t *c)
+{
+    mem_segment_t *seg;
+
+    while ((seg = c->head) != NULL) {
+        c->head = seg->next;
+        free(seg);
+    }
+    c->tail = NULL;
+}
+
+
+static int mem_accept(transport_t *t)
+{
+    mem_client_t *c = mem_client(t);
+
+    pthread_mutex_lock(&c->lock);
+    while (!c->connected || c->accepted)
+        pthread_cond_wait(&c->cond, &c->lock);
+    c->accepted = 1;
+    pthread_mutex_unlock(&c->lock);
+    return 0;
+}
+
+static int mem_recv_batch(transport_t *t, transport_input_t input)
+{
+    mem_client_t *c = mem_client(t);
+    mem_segment_t *seg;
+    int len;
+
+    pthread_mutex_lock(&c->lock);
+    while (c->head == NULL && !c->closing)
+        pthread_cond_wait(&c->cond, &c->lock);
+    seg = c->head;
+    if (seg == NULL) {
+        pthread_mutex_unlock(&c->lock);
+        return -1;
+    }
+    c->head = seg->next;
+    if (c->head == NULL)
+        c->tail = NULL;
+    c->busy = 1;
+    pthread_mutex_unlock(&c->lock);
+
+    if (c->recv_us)
+        usleep(c->recv_us);
+    len = input(t, seg->data, seg->len) < 0 ? -1 : (int)seg->len;
+    free(seg);
+
+    pthread_mutex_lock(&c->lock);
+    c->busy = 0;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    return len;
+}
+
+static int mem_sendv(transport_t *t, const transport_iov_t *iov, int iovcnt)
+{
+    mem_client_t *c = mem_client(t);
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        len += iov[i].len;
+    if (c->send_us)
+        usleep(c->send_us);
+
+    pthread_mutex_lock(&c->lock);
+    c->sends++;
+    while (c->hold)
+        pthread_cond_wait(&c->cond, &c->lock);
+    if (c->rx_len + len > c->rx_size) {
+        c->rx_size = (c->rx_len + len) * 2;
+        c->rx = realloc(c->rx, c->rx_size);
+    }
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(c->rx + c->rx_len, iov[i].ptr, iov[i].len);
+        c->rx_len += iov[i].len;
+    }
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    return len;
+}
+
+static void mem_close(transport_t *t)
+{
+    mem_client_t *c = mem_client(t);
+
+    pthread_mutex_lock(&c->lock);
+    c->connected = c->accepted = c->closing = 0;
+    mem_drop_segments(c);
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+}
+
+
+void mem_transport_connect(transport_t *t)
+{
+    mem_client_t *c = mem_client(t);
+
+    pthread_mutex_lock(&c->lock);
+    while (c->connected)
+        pthread_cond_wait(&c->cond, &c->lock);
+    c->connected = 1;
+    c->rx_len = 0;
+    c->sends = 0;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void mem_transport_disconnect(transport_t *t)
+{
+    mem_client_t *c = mem_client(t);
+
+    pthread_mutex_lock(&c->lock);
+    c->closing = 1;
+    c->hold = 0;
+    pthread_cond_broadcast(&c->cond);
+    while (c->connected)
+        pthread_cond_wait(&c->cond, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+}
+
+int mem_transport_write(transport_t *t, const void *buf, size_t len)
+{
+    mem_client_t *c = mem_client(t);
+    mem_segment_t *seg = malloc(sizeof(mem_segment_t) + len);
+    int ret = -1;
+
+    seg->next = NULL;
+    seg->len = len;
+    memcpy(seg->data, buf, len);
+
+    pthread_mutex_lock(&c->lock);
+    if (c->connected && !c->closing) {
+        if (c->tail)
+            c->tail->next = seg;
+        else
+            c->head = seg;
+        c->tail = seg;
+        seg = NULL;
+        ret = 0;
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    free(seg);
+    return ret;
+}
+
+int mem_transport_drain(transport_t *t, uint32_t timeout_ms)
+{
+    mem_client_t *c = mem_client(t);
+    struct timespec until = mem_deadline(timeout_ms);
+    int ret = 0;
+
+    pthread_mutex_lock(&c->lock);
+    while (c->head != NULL || c->busy) {
+        if (pthread_cond_timedwait(&c->cond, &c->lock, &until) == ETIMEDOUT) {
+            ret = c->head != NULL || c->busy ? -1 : 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return ret;
+}
+
+size_t mem_transport_read(transport_t *t, void *buf, size_t len, uint32_t timeout_ms)
+{
+    mem_client_t *c = mem_client(t);
+    struct timespec until = mem_deadline(timeout_ms);
+
+    pthread_mutex_lock(&c->lock);
+    while (c->rx_len < len) {
+        if (pthread_cond_timedwait(&c->cond, &c->lock, &until) == ETIMEDOUT)
+            break;
+    }
+    if (len > c->rx_len)
+        len = c->rx_len;
+    memcpy(buf, c->rx, len);
+    memmove(c->rx, c->rx + len, c->rx_len - len);
+    c->rx_len -= len;
+    pthread_mutex_unlock(&c->lock);
+    return len;
+}
+
+void mem_transport_hold(transport_t *t, int hold)
+{
+    mem_client_t *c = mem_client(t);
+
+    pthread_mutex_lock(&c->lock);
+    c->hold = hold;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void mem_transport_delay(transport_t *t, uint32_t recv_us, uint32_t send_us)
+{
+    mem_client_t *c = mem_client(t);
+
+    pthread_mutex_lock(&c->lock);
+    c->recv_us = recv_us;
+    c->send_us = send_us;
+    pthread_mutex_unlock(&c->lock);
+}
+
+uint32_t mem_transport_sends(transport_t *t)
+{
+    mem_client_t *c = mem_client(t);
+    uint32_t sends;
+
+    pthread_mutex_lock(&c->lock);
+    sends = c->sends;
+    pthread_mutex_unlock(&c->lock);
+    return sends;
+}
+
+
+static const transport_ops_t mem_ops = {
+    .accept = mem_accept,
+    .recv_batch = mem_recv_batch,
+    .sendv = mem_sendv,
+    .close = mem_close,
+};
+
+transport_t kTcpSocketTransport = {
+    .name = "tcp_server",
+    .id = TRANSPORT_TCP_SOCKET,
+    .ops = &mem_ops,
+    .priv = &mem_clients[0],
+    .enabled = 1,
+};
+
+#if (USE_DAP_TCP == 1)
+transport_t kDapTcpTransport = {
+    .name = "dap_tcp_server",
+    .id = TRANSPORT_DAP_TCP,
+    .ops = &mem_ops,
+    .priv = &mem_clients[1],
+    .enabled = 1,
+};
+#endif
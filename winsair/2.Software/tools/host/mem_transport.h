@@ -0,0 +1,82 @@
+/**
+ * @file mem_transport.h
+ * @brief In-process stand-in for the socket transports of tcp_server.c
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * The tests link this in place of tcp_server.c. It defines
+ * kTcpSocketTransport and kDapTcpTransport, and the test plays the client
+ * through the calls below. transport.c runs its sessions over them as
+ * usual, so the handshakes, the framers and the DAP pipeline are the real
+ * ones.
+ *
+ * Each mem_transport_write() is one segment and goes to the session in
+ * one recv_batch() call, so the test decides exactly how the stream is
+ * split and merged. Each sendv() of the firmware is counted as one send.
+ * Sends can be held with mem_transport_hold() to let responses pile up,
+ * and receives and sends can be made to take time like on the air.
+ *
+ * One client per transport at a time.
+ */
+#ifndef __MEM_TRANSPORT_H__
+#define __MEM_TRANSPORT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "main/transport.h"
+
+/**
+ * @brief Connect a client, the transport task accepts it
+ *
+ */
+void mem_transport_connect(transport_t *t);
+
+/**
+ * @brief Close the client side and wait until the session is over
+ *
+ */
+void mem_transport_disconnect(transport_t *t);
+
+/**
+ * @brief Queue one segment for the session
+ *
+ * @return 0, or -1 if there is no client
+ */
+int mem_transport_write(transport_t *t, const void *buf, size_t len);
+
+/**
+ * @brief Wait until the session took every segment written so far
+ *
+ * @return 0, or -1 on timeout
+ */
+int mem_transport_drain(transport_t *t, uint32_t timeout_ms);
+
+/**
+ * @brief Read what the firmware sent, waiting up to timeout_ms for len bytes
+ *
+ * @return bytes read, less than len on timeout
+ */
+size_t mem_transport_read(transport_t *t, void *buf, size_t len, uint32_t timeout_ms);
+
+/**
+ * @brief Hold sendv() calls of the firmware until released
+ *
+ */
+void mem_transport_hold(transport_t *t, int hold);
+
+/**
+ * @brief Time the firmware task spends in each recv_batch() and sendv(),
+ *        standing in for the network stack and the radio
+ *
+ */
+void mem_transport_delay(transport_t *t, uint32_t recv_us, uint32_t send_us);
+
+/**
+ * @brief sendv() calls of the firmware since the client connected, the
+ *        ones waiting on mem_transport_hold() included
+ *
+ */
+uint32_t mem_transport_sends(transport_t *t);
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ * @file queue_bench.c
+ * @brief Request and response queues of DAP_handle.c under load (host test)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * The main thread queues requests like a network task, DAP_Thread runs them
+ * and a send task takes the responses, the same three stages as on the
+ * probe. The DAP engine is replaced by one that echoes a sequence number
+ * and answers as many bytes as the request asks for, so the queues are all
+ * that is measured.
+ *
+ * Every round starts with dap_ringbuf_resize() to another packet size and
+ * checks that each response arrives once, in order and intact, responses
+ * larger than the packet size included, which are cut to it. Fails if a
+ * check fails or the rate is below -r requests per second.
+ *
+ *   queue_bench [-n requests] [-r min_rate]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/timer.h"
+#include "components/DAP/include/DAP.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+TaskHandle_t kDAPTaskHandle = NULL;
+TaskHandle_t kDAPSendTaskHandle = NULL;
+
+// [ID_DAP_Vendor0, seq(4), length(2)], answered with length bytes
+#define REQUEST_LEN 7
+
+static volatile uint32_t received;
+static volatile uint32_t failures;
+static uint16_t packet_size;
+static uint32_t big_every;
+
+void DAP_Setup(void)
+{
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response)
+{
+    uint32_t seq = get_le32(request + 1);
+    uint32_t len = request[5] | (request[6] << 8);
+
+    memcpy(response, request, 5);
+    for (uint32_t i = 5; i < len; i++)
+        response[i] = (uint8_t)(seq + i);
+    return (REQUEST_LEN << 16) | len;
+}
+
+uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response)
+{
+    return DAP_ProcessCommand(request, response);
+}
+
+static uint32_t response_len(uint32_t seq)
+{
+    return big_every && seq % big_every == 0 ? DAP_PACKET_SIZE : 5;
+}
+
+static void fail(const char *what, uint32_t seq)
+{
+    if (failures++ < 10)
+        printf("  FAIL %s at %u\n", what, seq);
+}
+
+static void check(const uint8_t *buf, int len)
+{
+    uint32_t seq = received;
+    uint32_t want = response_len(seq);
+
+    if (want > packet_size)
+        want = packet_size;
+    if ((uint32_t)len != want)
+        fail("length", seq);
+    else if (buf[0] != ID_DAP_Vendor0 || get_le32(buf + 1) != seq)
+        fail("order", seq);
+    else {
+        for (uint32_t i = 5; i < want; i++) {
+            if (buf[i] != (uint8_t)(seq + i)) {
+                fail("data", seq);
+                break;
+            }
+        }
+    }
+    __atomic_store_n(&received, seq + 1, __ATOMIC_RELEASE);
+}
+
+static void send_task(void *argument)
+{
+    static uint8_t buf[DAP_PACKET_SIZE];
+    int len;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        dap_response_sync();
+        while ((len = dap_response_take(buf)) >= 0)
+            check(buf, len);
+    }
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run_round(uint16_t size, uint32_t n, uint32_t big)
+{
+    uint8_t request[REQUEST_LEN];
+    uint32_t len;
+    double start, timeout;
+
+    dap_ringbuf_resize(size);
+    if (kDapPacketSize != size)
+        fail("resize", 0);
+    packet_size = size;
+    big_every = big;
+    received = 0;
+
+    start = now_s();
+    for (uint32_t seq = 0; seq < n; seq++) {
+        len = response_len(seq);
+        request[0] = ID_DAP_Vendor0;
+        request[1] = (uint8_t)seq;
+        request[2] = (uint8_t)(seq >> 8);
+        request[3] = (uint8_t)(seq >> 16);
+        request[4] = (uint8_t)(seq >> 24);
+        request[5] = (uint8_t)len;
+        request[6] = (uint8_t)(len >> 8);
+        handle_dap_data_request(request, sizeof(request));
+    }
+
+    timeout = now_s() + 10;
+    while (__atomic_load_n(&received, __ATOMIC_ACQUIRE) < n && now_s() < timeout)
+        usleep(100);
+    if (received != n)
+        fail("lost", received);
+
+    return n / (now_s() - start);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint16_t sizes[] = { 512, 64, 1400, 1024, 255, 512 };
+    uint32_t n = 200000;
+    double min_rate = 20000, rate, slowest = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            min_rate = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-r min_rate]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    timer_init();
+    session_arena_init(dap_ringbuf_storage_size() + 4 * SESSION_ARENA_ALIGN);
+    malloc_dap_ringbuf();
+    session_arena_keep();
+
+    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    xTaskCreate(send_task, "dap_send", 2048, NULL, 12, &kDAPSendTaskHandle);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        // every 97th response asks for a full DAP_PACKET_SIZE
+        rate = run_round(sizes[i], n, i % 2 ? 97 : 0);
+        printf("packet size %4u, %3u slots: %8.0f requests/s%s\n", sizes[i],
+               dap_ringbuf_slots(sizes[i]), rate, i % 2 ? ", oversized responses" : "");
+        if (slowest == 0 || rate < slowest)
+            slowest = rate;
+    }
+
+    if (slowest < min_rate) {
+        printf("  FAIL %.0f requests/s is below %.0f\n", slowest, min_rate);
+        failures++;
+    }
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
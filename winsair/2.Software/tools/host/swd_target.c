@@ -0,0 +1,455 @@
+/**
+ * @file swd_target.c
+ * @brief Simulated Cortex-M debug port for the host build
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "swd_target.h"
+
+// request bits, as DAP_TRANSFER_*
+#define REQ_APnDP 0x01
+#define REQ_RnW   0x02
+#define REQ_A32   0x0C
+
+// DP registers
+#define DP_ABORT_DAPABORT    (1U << 0)
+#define DP_ABORT_STKCMPCLR   (1U << 1)
+#define DP_ABORT_STKERRCLR   (1U << 2)
+#define DP_ABORT_WDERRCLR    (1U << 3)
+#define DP_ABORT_ORUNERRCLR  (1U << 4)
+
+#define CTRL_STICKYORUN  (1U << 1)
+#define CTRL_STICKYCMP   (1U << 4)
+#define CTRL_STICKYERR   (1U << 5)
+#define CTRL_WDATAERR    (1U << 7)
+#define CTRL_CDBGPWRUPREQ (1U << 28)
+#define CTRL_CSYSPWRUPREQ (1U << 30)
+#define CTRL_STICKY (CTRL_STICKYORUN | CTRL_STICKYCMP | CTRL_STICKYERR | CTRL_WDATAERR)
+#define CTRL_WRITABLE (0xFFFFFF01U & ~CTRL_STICKY & ~((1U << 29) | (1U << 31)))
+
+// MEM-AP registers, APBANKSEL and A[3:2]
+#define AP_CSW  0x00
+#define AP_TAR  0x04
+#define AP_DRW  0x0C
+#define AP_BD0  0x10
+#define AP_BD3  0x1C
+#define AP_CFG  0xF4
+#define AP_BASE 0xF8
+#define AP_IDR  0xFC
+
+#define CSW_SIZE_MASK  0x07
+#define CSW_ADDRINC    (3U << 4)
+#define CSW_ADDRINC_SINGLE (1U << 4)
+#define CSW_DEVICEEN   (1U << 6)
+#define CSW_WRITABLE   0xFF00FF3FU
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE  (1U << PAGE_SHIFT)
+#define PAGE_SLOTS 1024 // hash buckets
+
+#define PACKET_BITS(trn) (8 + (trn) + 3 + 33 + (trn))
+#define WAIT_BITS(trn)   (8 + (trn) + 3 + (trn))
+
+typedef struct page
+{
+    struct page *next;
+    uint32_t base;
+    uint8_t data[PAGE_SIZE];
+} page_t;
+
+static swd_target_config_t kConfig = {
+    .clock_hz = 1000000,
+};
+static swd_target_stats_t kStats;
+
+static struct
+{
+    int reset;        // line reset seen, only DPIDR answers
+    uint32_t ones;    // SWDIO high in a row, for the line reset
+    uint32_t turnaround;
+    uint32_t ctrl_stat;
+    uint32_t select;
+    uint32_t rdbuff;  // result of the last AP read
+    uint32_t csw;
+    uint32_t tar;
+    uint32_t ap_accesses;
+    uint32_t waits_left;
+    int retry;        // the AP access that got WAIT comes again
+    uint64_t busy_until;
+} kDP;
+
+static page_t *kPages[PAGE_SLOTS];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Take the wire for bits cycles. Back-to-back packets queue up on the
+// wire time, so that the clock is kept on average even when the host
+// wakes up late.
+static void spend(uint32_t bits, int packet)
+{
+    uint64_t ns = (uint64_t)bits * 1000000000ULL / kConfig.clock_hz;
+    uint64_t now = now_ns();
+
+    if (packet)
+        ns += kConfig.overhead_ns;
+    kStats.bits += bits;
+    kStats.busy_ns += ns;
+    if (kDP.busy_until < now)
+        kDP.busy_until = now;
+    kDP.busy_until += ns;
+    while (now_ns() < kDP.busy_until)
+        ;
+}
+
+static int mapped(uint32_t addr)
+{
+    if (addr - SWD_TARGET_FLASH_BASE < SWD_TARGET_FLASH_SIZE ||
+        addr - SWD_TARGET_FLASH_ALIAS < SWD_TARGET_FLASH_SIZE)
+        return 1;
+    if (addr - SWD_TARGET_RAM_BASE < SWD_TARGET_RAM_SIZE)
+        return 1;
+    return addr - SWD_TARGET_PPB_BASE < SWD_TARGET_PPB_SIZE;
+}
+
+static page_t *page_of(uint32_t addr, int create)
+{
+    uint32_t base;
+    page_t **slot, *p;
+
+    // the flash alias is the same memory
+    if (addr - SWD_TARGET_FLASH_ALIAS < SWD_TARGET_FLASH_SIZE)
+        addr = addr - SWD_TARGET_FLASH_ALIAS + SWD_TARGET_FLASH_BASE;
+    base = addr & ~(PAGE_SIZE - 1);
+    slot = &kPages[(base >> PAGE_SHIFT) % PAGE_SLOTS];
+    for (p = *slot; p; p = p->next) {
+        if (p->base == base)
+            return p;
+    }
+    if (!create)
+        return NULL;
+
+    p = calloc(1, sizeof(*p));
+    if (p == NULL)
+        abort();
+    p->base = base;
+    // erased flash reads as ones
+    if (base - SWD_TARGET_FLASH_BASE < SWD_TARGET_FLASH_SIZE)
+        memset(p->data, 0xFF, PAGE_SIZE);
+    p->next = *slot;
+    *slot = p;
+    return p;
+}
+
+static uint32_t mem_read(uint32_t addr)
+{
+    page_t *p = page_of(addr, 0);
+    uint32_t value;
+
+    if (p == NULL)
+        return addr - SWD_TARGET_FLASH_BASE < SWD_TARGET_FLASH_SIZE ||
+                       addr - SWD_TARGET_FLASH_ALIAS < SWD_TARGET_FLASH_SIZE
+                   ? 0xFFFFFFFF
+                   : 0;
+    memcpy(&value, p->data + (addr & (PAGE_SIZE - 4)), 4);
+    return value;
+}
+
+static void mem_write(uint32_t addr, uint32_t value, uint32_t mask)
+{
+    page_t *p = page_of(addr, 1);
+    uint32_t old;
+
+    memcpy(&old, p->data + (addr & (PAGE_SIZE - 4)), 4);
+    value = (old & ~mask) | (value & mask);
+    memcpy(p->data + (addr & (PAGE_SIZE - 4)), &value, 4);
+}
+
+// One DRW/BDn access at addr, data lanes as the AHB-AP puts them
+static int mem_access(uint32_t addr, int read, uint32_t *value)
+{
+    uint32_t size = kDP.csw & CSW_SIZE_MASK;
+    uint32_t shift = (addr & 3) * 8;
+    uint32_t mask;
+
+    if (size > 2 || !mapped(addr))
+        return -1;
+    if ((size == 1 && (addr & 1)) || (size == 2 && (addr & 3)))
+        return -1;
+
+    mask = size == 0 ? 0xFFU << shift : size == 1 ? 0xFFFFU << shift : 0xFFFFFFFFU;
+    if (read)
+        *value = mem_read(addr & ~3U) & mask;
+    else
+        mem_write(addr & ~3U, *value, mask);
+    return 0;
+}
+
+static void tar_increment(void)
+{
+    uint32_t step;
+
+    if ((kDP.csw & CSW_ADDRINC) != CSW_ADDRINC_SINGLE)
+        return;
+    // auto-increment stays within a 1 KB block, as the ADI allows
+    step = 1U << (kDP.csw & CSW_SIZE_MASK);
+    kDP.tar = (kDP.tar & ~0x3FFU) | ((kDP.tar + step) & 0x3FFU);
+}
+
+static int ap_access(uint32_t addr, int read, uint32_t *value)
+{
+    uint32_t apsel = kDP.select >> 24;
+    int ret = 0;
+
+    if (apsel != 0) {
+        // nothing there, reads as zero
+        if (read)
+            *value = 0;
+        return 0;
+    }
+
+    switch (addr) {
+    case AP_CSW:
+        if (read)
+            *value = kDP.csw | CSW_DEVICEEN;
+        else
+            kDP.csw = *value & CSW_WRITABLE;
+        break;
+    case AP_TAR:
+        if (read)
+            *value = kDP.tar;
+        else
+            kDP.tar = *value;
+        break;
+    case AP_DRW:
+        ret = mem_access(kDP.tar, read, value);
+        if (ret == 0)
+            tar_increment();
+        break;
+    case AP_CFG:
+        if (read)
+            *value = 0; // little endian, 32-bit addresses
+        break;
+    case AP_BASE:
+        if (read)
+            *value = 0xE00FF003;
+        break;
+    case AP_IDR:
+        if (read)
+            *value = SWD_TARGET_APIDR;
+        break;
+    default:
+        if (addr >= AP_BD0 && addr <= AP_BD3)
+            ret = mem_access((kDP.tar & ~0xFU) | (addr - AP_BD0), read, value);
+        else if (read)
+            *value = 0;
+        break;
+    }
+    return ret;
+}
+
+static uint8_t dp_access(uint32_t request, uint32_t *data)
+{
+    uint32_t a = request & REQ_A32;
+    uint32_t value = data ? *data : 0;
+
+    if (request & REQ_RnW) {
+        switch (a) {
+        case 0x00:
+            value = SWD_TARGET_DPIDR;
+            break;
+        case 0x04:
+            value = kDP.ctrl_stat;
+            // power-up requests are acknowledged at once
+            value |= (value & CTRL_CDBGPWRUPREQ) << 1;
+            value |= (value & CTRL_CSYSPWRUPREQ) << 1;
+            break;
+        case 0x08: // RESEND
+        case 0x0C: // RDBUFF
+            value = kDP.rdbuff;
+            break;
+        }
+        if (data)
+            *data = value;
+        return SWD_ACK_OK;
+    }
+
+    switch (a) {
+    case 0x00:
+        if (value & DP_ABORT_STKCMPCLR)
+            kDP.ctrl_stat &= ~CTRL_STICKYCMP;
+        if (value & DP_ABORT_STKERRCLR)
+            kDP.ctrl_stat &= ~CTRL_STICKYERR;
+        if (value & DP_ABORT_WDERRCLR)
+            kDP.ctrl_stat &= ~CTRL_WDATAERR;
+        if (value & DP_ABORT_ORUNERRCLR)
+            kDP.ctrl_stat &= ~CTRL_STICKYORUN;
+        if (value & DP_ABORT_DAPABORT) {
+            kDP.waits_left = 0;
+            kDP.retry = 0;
+        }
+        break;
+    case 0x04:
+        kDP.ctrl_stat = (kDP.ctrl_stat & CTRL_STICKY) | (value & CTRL_WRITABLE);
+        break;
+    case 0x08:
+        kDP.select = value;
+        break;
+    case 0x0C: // ROUTESEL, not used
+        break;
+    }
+    return SWD_ACK_OK;
+}
+
+void swd_target_init(const swd_target_config_t *config)
+{
+    page_t *p, *next;
+
+    if (config)
+        kConfig = *config;
+    if (kConfig.clock_hz == 0)
+        kConfig.clock_hz = 1000000;
+
+    for (int i = 0; i < PAGE_SLOTS; i++) {
+        for (p = kPages[i]; p; p = next) {
+            next = p->next;
+            free(p);
+        }
+        kPages[i] = NULL;
+    }
+    memset(&kDP, 0, sizeof(kDP));
+    memset(&kStats, 0, sizeof(kStats));
+    kDP.reset = 1;
+    kDP.turnaround = 1;
+    kDP.csw = 0x23000002; // 32-bit, no increment, as after reset
+}
+
+void swd_target_config(swd_target_config_t *config)
+{
+    *config = kConfig;
+}
+
+void swd_target_set_clock(uint32_t clock_hz)
+{
+    if (clock_hz)
+        kConfig.clock_hz = clock_hz;
+}
+
+void swd_target_set_turnaround(uint32_t cycles)
+{
+    kDP.turnaround = cycles ? cycles : 1;
+}
+
+uint8_t swd_target_transfer(uint32_t request, uint32_t *data)
+{
+    uint32_t value;
+    int fault;
+
+    kStats.packets++;
+    kDP.ones = 0;
+
+    // after a line reset the DP only answers a DPIDR read
+    if (kDP.reset) {
+        if ((request & (REQ_APnDP | REQ_RnW | REQ_A32)) != REQ_RnW) {
+            spend(WAIT_BITS(kDP.turnaround), 1);
+            return SWD_ACK_NONE;
+        }
+        kDP.reset = 0;
+    }
+
+    // a sticky error faults all but DPIDR, CTRL/STAT reads and ABORT
+    if ((kDP.ctrl_stat & CTRL_STICKYERR) &&
+        (request & (REQ_APnDP | REQ_RnW | REQ_A32)) != (REQ_RnW | 0x00) &&
+        (request & (REQ_APnDP | REQ_RnW | REQ_A32)) != (REQ_RnW | 0x04) &&
+        (request & (REQ_APnDP | REQ_RnW | REQ_A32)) != 0x00) {
+        kStats.faults++;
+        spend(WAIT_BITS(kDP.turnaround), 1);
+        return SWD_ACK_FAULT;
+    }
+
+    if ((request & REQ_APnDP) == 0) {
+        spend(PACKET_BITS(kDP.turnaround), 1);
+        return dp_access(request, data);
+    }
+
+    if (!kDP.retry) {
+        kDP.ap_accesses++;
+        if (kConfig.wait_every && kDP.ap_accesses % kConfig.wait_every == 0)
+            kDP.waits_left = kConfig.wait_count ? kConfig.wait_count : 1;
+    }
+    if (kDP.waits_left) {
+        kDP.waits_left--;
+        kDP.retry = 1;
+        kStats.waits++;
+        spend(WAIT_BITS(kDP.turnaround), 1);
+        return SWD_ACK_WAIT;
+    }
+    kDP.retry = 0;
+
+    spend(PACKET_BITS(kDP.turnaround), 1);
+
+    fault = kConfig.fault_every && kDP.ap_accesses % kConfig.fault_every == 0;
+    if (request & REQ_RnW) {
+        // posted: the data phase carries the previous AP read
+        value = 0;
+        if (!fault && ap_access((kDP.select & 0xF0) | (request & REQ_A32), 1, &value) < 0)
+            fault = 1;
+        if (data)
+            *data = kDP.rdbuff;
+        kDP.rdbuff = value;
+    } else {
+        value = data ? *data : 0;
+        if (!fault && ap_access((kDP.select & 0xF0) | (request & REQ_A32), 0, &value) < 0)
+            fault = 1;
+    }
+    // the bus error shows up on the next packet, as on a real AHB-AP
+    if (fault)
+        kDP.ctrl_stat |= CTRL_STICKYERR;
+    return SWD_ACK_OK;
+}
+
+void swd_target_sequence(uint32_t bits, const uint8_t *data)
+{
+    for (uint32_t i = 0; i < bits; i++) {
+        if (data[i / 8] & (1U << (i % 8))) {
+            if (++kDP.ones == 50) {
+                kDP.reset = 1;
+                kStats.line_resets++;
+            }
+        } else {
+            kDP.ones = 0;
+        }
+    }
+    spend(bits, 0);
+}
+
+void swd_target_idle(uint32_t cycles)
+{
+    if (cycles)
+        spend(cycles, 0);
+}
+
+uint32_t swd_target_peek(uint32_t addr)
+{
+    return mem_read(addr & ~3U);
+}
+
+void swd_target_poke(uint32_t addr, uint32_t value)
+{
+    mem_write(addr & ~3U, value, 0xFFFFFFFF);
+}
+
+void swd_target_stats(swd_target_stats_t *stats)
+{
+    *stats = kStats;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file swd_target.h
+ * @brief Simulated Cortex-M debug port for the host build
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * The model sits where the SWD pin layer of the CMSIS-DAP engine would:
+ * one call is one SWD packet, request in and ACK (and data) out. Behind
+ * it are an SW-DP and a MEM-AP (AHB-AP) with TAR auto-increment on top
+ * of a sparse memory with flash, RAM and the PPB.
+ *
+ * Time is spent like on the wire. Every packet busy-waits for the SWCLK
+ * cycles it takes at the configured clock, plus a fixed cost standing in
+ * for the bit-bang loop of the firmware. WAIT and FAULT answers can be
+ * injected every n-th MEM-AP access.
+ *
+ * Not thread safe, the DAP task is the only caller.
+ */
+#ifndef __SWD_TARGET_H__
+#define __SWD_TARGET_H__
+
+#include <stdint.h>
+
+// ACK of a packet, the same bits as the DAP_TRANSFER_* response
+#define SWD_ACK_OK     0x01
+#define SWD_ACK_WAIT   0x02
+#define SWD_ACK_FAULT  0x04
+#define SWD_ACK_NONE   0x07 // nothing drives the line, protocol error
+
+#define SWD_TARGET_DPIDR 0x2BA01477 // ADIv5.2 SW-DP of a Cortex-M4
+#define SWD_TARGET_APIDR 0x24770011 // AHB-AP
+
+// Memory map, everything else answers a bus fault
+#define SWD_TARGET_FLASH_BASE 0x00000000
+#define SWD_TARGET_FLASH_SIZE (512 * 1024)
+#define SWD_TARGET_FLASH_ALIAS 0x08000000
+#define SWD_TARGET_RAM_BASE   0x20000000
+#define SWD_TARGET_RAM_SIZE   (256 * 1024)
+#define SWD_TARGET_PPB_BASE   0xE0000000
+#define SWD_TARGET_PPB_SIZE   (1024 * 1024)
+
+typedef struct
+{
+    uint32_t clock_hz;    // SWCLK, DAP_SWJ_Clock changes it
+    uint32_t overhead_ns; // per packet, on top of the bits
+    uint32_t wait_every;  // every n-th MEM-AP access answers WAIT first, 0 never
+    uint32_t wait_count;  // WAIT answers in a row when it does
+    uint32_t fault_every; // every n-th MEM-AP access ends in a bus fault, 0 never
+} swd_target_config_t;
+
+typedef struct
+{
+    uint64_t packets;
+    uint64_t bits; // SWCLK cycles, sequences and idle cycles included
+    uint64_t waits;
+    uint64_t faults;
+    uint64_t line_resets;
+    uint64_t busy_ns; // time spent on the wire
+} swd_target_stats_t;
+
+void swd_target_init(const swd_target_config_t *config);
+void swd_target_config(swd_target_config_t *config);
+void swd_target_set_clock(uint32_t clock_hz);
+void swd_target_set_turnaround(uint32_t cycles);
+
+/**
+ * @brief One SWD packet
+ *
+ * @param request DAP_TRANSFER_APnDP, RnW, A2 and A3 bits
+ * @param data written for a write, read back for a read, may be NULL
+ * @return SWD_ACK_*
+ */
+uint8_t swd_target_transfer(uint32_t request, uint32_t *data);
+
+/**
+ * @brief Clock out a sequence on SWDIO, 50 or more ones are a line reset
+ *
+ */
+void swd_target_sequence(uint32_t bits, const uint8_t *data);
+
+/**
+ * @brief SWCLK cycles with nothing on SWDIO
+ *
+ */
+void swd_target_idle(uint32_t cycles);
+
+// Back door to the memory for tests, no time is spent
+uint32_t swd_target_peek(uint32_t addr);
+void swd_target_poke(uint32_t addr, uint32_t value);
+
+void swd_target_stats(swd_target_stats_t *stats);
+
+#endif
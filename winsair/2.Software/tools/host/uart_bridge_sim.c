@@ -0,0 +1,597 @@
+/**
+ * @file uart_bridge_sim.c
+ * @brief The UART bridge on a simulated UART and TCP client (host test)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * main/uart_bridge.c runs unchanged, built for the ESP32-C3 (one UART).
+ * The ESP-IDF UART driver and the lwIP netconn calls it makes are
+ * implemented here. The driver posts the events the hardware would, one
+ * UART_DATA per FIFO threshold of bytes and one with timeout_flag set when
+ * the line goes idle, and the netconn client keeps every segment the bridge
+ * writes.
+ *
+ * The client connects and sends the baud rate in ASCII, the target then
+ * plays an interactive console, single keystrokes with gaps between them,
+ * followed by a bulk log at that baud rate. Per byte latency p50/p99 of the
+ * interactive part, counted from the RX timeout event, and throughput and segment size of the bulk part are
+ * printed as JSON. Fails if the keystroke p99 is over INTERACTIVE_BOUND_MS,
+ * the bulk part is carried below BULK_MIN_RATE of the line rate or in
+ * segments under half UART_BRIDGE_FLUSH_SIZE, or a byte is lost, changed or
+ * out of order.
+ *
+ *   uart_bridge_sim [-n keystrokes] [-k bulk_bytes] [-b baud]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#include "main/wifi_configuration.h"
+#include "main/uart_bridge.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+#include "lwip/api.h"
+
+#define KEYSTROKE_GAP_MS 20
+// the RX timeout of the driver, in character times
+#define RX_TIMEOUT_CHARS 10
+
+// interactive p99 bound: a wakeup and a flush, with room for the host
+// scheduler. Waiting out a tick for the coalescing timer misses it.
+#define INTERACTIVE_BOUND_MS 5
+// share of the line rate the bulk part has to be carried at
+#define BULK_MIN_RATE 0.9
+
+// The UART, one port is all the bridge has on the ESP32-C3
+static struct
+{
+    pthread_mutex_t lock;
+    QueueHandle_t events;
+    uint8_t *ring;
+    size_t size;
+    size_t head;
+    size_t count;
+    int threshold; // FIFO level of a UART_DATA event
+    uint32_t baudrate;
+    uint32_t dropped; // the ring was full
+    uint32_t tx_bytes;
+} uart = { .lock = PTHREAD_MUTEX_INITIALIZER, .threshold = 120, .baudrate = 115200 };
+
+struct netbuf
+{
+    uint8_t *data;
+    uint16_t len;
+};
+
+// The TCP client, written to by the bridge port task
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct netconn *listen;
+    struct netconn *conn;
+    int accepted;
+    int closed;
+    struct netbuf rx; // the next packet from the client, if len > 0
+
+    size_t received;
+    uint32_t segments; // interactive part
+    uint32_t bulk_segments;
+    uint32_t corrupt;
+    uint64_t done_us;
+} client = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+const ip_addr_t ip_addr_any = { 0 };
+
+static int keystrokes = 200;
+static size_t bulk_bytes = 64 * 1024;
+static uint32_t baud = 921600;
+
+static uint64_t *sent_us; // when each byte was on the line
+static double *latency_ms; // per interactive byte
+static uint64_t bulk_start_us;
+
+
+static uint64_t clock_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts = { .tv_sec = t / 1000000, .tv_nsec = t % 1000000 * 1000 };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static size_t total_bytes(void)
+{
+    return keystrokes + bulk_bytes;
+}
+
+static uint8_t pattern(size_t i)
+{
+    return i < (size_t)keystrokes ? 'a' + i % 26 : (uint8_t)(i % 251);
+}
+
+// Microseconds of n characters at the current baud rate, 10 bits each
+static uint64_t char_us(size_t n)
+{
+    return (uint64_t)n * 10 * 1000000 / uart.baudrate;
+}
+
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *queue, int intr_flags)
+{
+    pthread_mutex_lock(&uart.lock);
+    uart.ring = calloc(1, rx_buffer_size);
+    uart.size = rx_buffer_size;
+    uart.events = xQueueCreate(queue_size, sizeof(uart_event_t));
+    pthread_mutex_unlock(&uart.lock);
+    if (queue)
+        *queue = uart.events;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    return uart_set_baudrate(port, config->baud_rate);
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold)
+{
+    uart.threshold = threshold;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baudrate)
+{
+    pthread_mutex_lock(&uart.lock);
+    uart.baudrate = baudrate;
+    pthread_mutex_unlock(&uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baudrate)
+{
+    pthread_mutex_lock(&uart.lock);
+    *baudrate = uart.baudrate;
+    pthread_mutex_unlock(&uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_word_length(uart_port_t port, uart_word_length_t data_bits)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_parity(uart_port_t port, uart_parity_t parity)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_stop_bits(uart_port_t port, uart_stop_bits_t stop_bits)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_hw_flow_ctrl(uart_port_t port, uart_hw_flowcontrol_t flow, uint8_t rx_thresh)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_dtr(uart_port_t port, int level)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rts(uart_port_t port, int level)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    pthread_mutex_lock(&uart.lock);
+    *size = uart.count;
+    pthread_mutex_unlock(&uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    pthread_mutex_lock(&uart.lock);
+    uart.count = 0;
+    pthread_mutex_unlock(&uart.lock);
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+    size_t n, first;
+
+    pthread_mutex_lock(&uart.lock);
+    n = length < uart.count ? length : uart.count;
+    first = uart.size - uart.head < n ? uart.size - uart.head : n;
+    memcpy(buf, uart.ring + uart.head, first);
+    memcpy((uint8_t *)buf + first, uart.ring, n - first);
+    uart.head = (uart.head + n) % uart.size;
+    uart.count -= n;
+    pthread_mutex_unlock(&uart.lock);
+    return n;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    pthread_mutex_lock(&uart.lock);
+    uart.tx_bytes += size;
+    pthread_mutex_unlock(&uart.lock);
+    return size;
+}
+
+// The FIFO reached its threshold, or the line went idle: the driver moves
+// the bytes into its ring and posts UART_DATA, as its ISR would
+static void uart_line_rx(const uint8_t *data, size_t len, bool idle)
+{
+    uart_event_t event = { .type = UART_DATA, .size = len, .timeout_flag = idle };
+    size_t i;
+
+    pthread_mutex_lock(&uart.lock);
+    for (i = 0; i < len && uart.count < uart.size; i++)
+        uart.ring[(uart.head + uart.count++) % uart.size] = data[i];
+    uart.dropped += len - i;
+    pthread_mutex_unlock(&uart.lock);
+
+    if (i < len)
+        event.type = UART_BUFFER_FULL;
+    xQueueSend(uart.events, &event, 0);
+}
+
+
+struct netconn *netconn_new_with_callback(enum netconn_type type, netconn_callback callback)
+{
+    struct netconn *conn = calloc(1, sizeof(struct netconn));
+
+    conn->type = type;
+    conn->callback = callback;
+    return conn;
+}
+
+void netconn_set_nonblocking(struct netconn *conn, int nonblocking)
+{
+    if (nonblocking)
+        conn->flags |= NETCONN_FLAG_NON_BLOCKING;
+}
+
+err_t netconn_bind(struct netconn *conn, const ip_addr_t *addr, uint16_t port)
+{
+    return ERR_OK;
+}
+
+err_t netconn_listen(struct netconn *conn)
+{
+    pthread_mutex_lock(&client.lock);
+    conn->state = NETCONN_LISTEN;
+    client.listen = conn;
+    pthread_cond_broadcast(&client.cond);
+    pthread_mutex_unlock(&client.lock);
+    return ERR_OK;
+}
+
+err_t netconn_accept(struct netconn *conn, struct netconn **new_conn)
+{
+    err_t err = ERR_WOULDBLOCK;
+
+    pthread_mutex_lock(&client.lock);
+    if (client.conn != NULL && !client.accepted) {
+        *new_conn = client.conn;
+        client.accepted = 1;
+        err = ERR_OK;
+    }
+    pthread_mutex_unlock(&client.lock);
+    return err;
+}
+
+err_t netconn_recv(struct netconn *conn, struct netbuf **buf)
+{
+    err_t err = ERR_WOULDBLOCK;
+
+    pthread_mutex_lock(&client.lock);
+    if (client.rx.len > 0) {
+        *buf = &client.rx;
+        err = ERR_OK;
+    }
+    pthread_mutex_unlock(&client.lock);
+    return err;
+}
+
+err_t netbuf_data(struct netbuf *buf, void **data, uint16_t *len)
+{
+    *data = buf->data;
+    *len = buf->len;
+    return ERR_OK;
+}
+
+int8_t netbuf_next(struct netbuf *buf)
+{
+    return -1; // one piece per packet
+}
+
+void netbuf_delete(struct netbuf *buf)
+{
+    pthread_mutex_lock(&client.lock);
+    buf->len = 0;
+    pthread_cond_broadcast(&client.cond);
+    pthread_mutex_unlock(&client.lock);
+}
+
+// Every call is one TCP segment, all of it is taken
+err_t netconn_write_partly(struct netconn *conn, const void *data, size_t size, uint8_t flags,
+                           size_t *bytes_written)
+{
+    const uint8_t *p = data;
+    uint64_t now = clock_us();
+    size_t i, pos;
+
+    pthread_mutex_lock(&client.lock);
+    pos = client.received;
+    if (pos < (size_t)keystrokes)
+        client.segments++;
+    else
+        client.bulk_segments++;
+
+    for (i = 0; i < size; i++, pos++) {
+        if (pos >= total_bytes() || p[i] != pattern(pos)) {
+            client.corrupt++;
+            continue;
+        }
+        if (pos < (size_t)keystrokes)
+            latency_ms[pos] = (now - sent_us[pos]) / 1000.0;
+    }
+    client.received = pos;
+    if (client.received >= total_bytes()) {
+        client.done_us = now;
+        pthread_cond_broadcast(&client.cond);
+    }
+    pthread_mutex_unlock(&client.lock);
+
+    *bytes_written = size;
+    return ERR_OK;
+}
+
+err_t netconn_close(struct netconn *conn)
+{
+    pthread_mutex_lock(&client.lock);
+    if (conn == client.conn)
+        client.closed = 1;
+    conn->state = NETCONN_CLOSE;
+    pthread_mutex_unlock(&client.lock);
+    return ERR_OK;
+}
+
+err_t netconn_delete(struct netconn *conn)
+{
+    // kept, the client is looked at once the run is over
+    return ERR_OK;
+}
+
+
+// Wait on the client with a limit, 0 once it is up
+static int client_wait(int (*done)(void), uint32_t ms)
+{
+    struct timespec until;
+    int ok;
+
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    until.tv_sec += ms / 1000;
+    until.tv_nsec += ms % 1000 * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&client.lock);
+    while (!(ok = done())) {
+        if (pthread_cond_timedwait(&client.cond, &client.lock, &until) == ETIMEDOUT) {
+            ok = done();
+            break;
+        }
+    }
+    pthread_mutex_unlock(&client.lock);
+    return ok;
+}
+
+static int listening(void)
+{
+    return client.listen != NULL;
+}
+
+static int packet_taken(void)
+{
+    return client.rx.len == 0;
+}
+
+static int all_received(void)
+{
+    return client.received >= total_bytes();
+}
+
+// Connect, like lwIP: the new netconn gets the callback of the listener
+static void client_connect(void)
+{
+    struct netconn *conn;
+
+    pthread_mutex_lock(&client.lock);
+    conn = netconn_new_with_callback(NETCONN_TCP, client.listen->callback);
+    conn->state = NETCONN_NONE;
+    client.conn = conn;
+    pthread_mutex_unlock(&client.lock);
+    client.listen->callback(client.listen, NETCONN_EVT_RCVPLUS, 0);
+}
+
+static void client_send(const char *data)
+{
+    pthread_mutex_lock(&client.lock);
+    client.rx.data = (uint8_t *)data;
+    client.rx.len = strlen(data);
+    pthread_mutex_unlock(&client.lock);
+    client.conn->callback(client.conn, NETCONN_EVT_RCVPLUS, client.rx.len);
+}
+
+static void target_run(void)
+{
+    uint8_t buf[256];
+    size_t i, j, n, chunk;
+    uint64_t next;
+
+    for (i = 0; i < (size_t)keystrokes; i++) {
+        buf[0] = pattern(i);
+        sleep_until(clock_us() + char_us(RX_TIMEOUT_CHARS));
+        // from the RX timeout on, the wait for it is the same for any bridge
+        sent_us[i] = clock_us();
+        uart_line_rx(buf, 1, true);
+        usleep(KEYSTROKE_GAP_MS * 1000);
+    }
+
+    // back to back characters, an event per FIFO threshold
+    chunk = uart.threshold < (int)sizeof(buf) ? uart.threshold : sizeof(buf);
+    next = bulk_start_us = clock_us();
+    while (i < total_bytes()) {
+        n = total_bytes() - i < chunk ? total_bytes() - i : chunk;
+        next += char_us(n);
+        sleep_until(next);
+        for (j = 0; j < n; j++) {
+            buf[j] = pattern(i + j);
+            sent_us[i + j] = next;
+        }
+        i += n;
+        if (i == total_bytes())
+            sleep_until(next + char_us(RX_TIMEOUT_CHARS));
+        uart_line_rx(buf, n, i == total_bytes());
+    }
+}
+
+static void bridge_task(void *argument)
+{
+    uart_bridge_task();
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_condattr_t attr;
+    char baud_text[16];
+    double p50, p99, seconds, segment, rate;
+    uart_bridge_stats_t stats;
+    int opt, fail = 0;
+
+    while ((opt = getopt(argc, argv, "n:k:b:")) != -1) {
+        switch (opt) {
+        case 'n':
+            keystrokes = atoi(optarg);
+            break;
+        case 'k':
+            bulk_bytes = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            baud = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n keystrokes] [-k bulk_bytes] [-b baud]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (keystrokes < 1 || bulk_bytes < 1) {
+        fprintf(stderr, "need at least one keystroke and one bulk byte\n");
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&client.cond, &attr);
+    sent_us = calloc(total_bytes(), sizeof(uint64_t));
+    latency_ms = calloc(keystrokes, sizeof(double));
+
+    xTaskCreate(bridge_task, "uart_server", 4096, NULL, 5, NULL);
+    if (!client_wait(listening, 1000)) {
+        printf("  FAIL the bridge does not listen\n");
+        return 1;
+    }
+
+    // a raw client, its first packet sets the baud rate
+    client_connect();
+    snprintf(baud_text, sizeof(baud_text), "%u", baud);
+    client_send(baud_text);
+    if (!client_wait(packet_taken, 1000) || uart.baudrate != baud) {
+        printf("  FAIL baud rate %u, the client asked for %u\n", uart.baudrate, baud);
+        return 1;
+    }
+
+    target_run();
+    if (!client_wait(all_received, 2000)) {
+        printf("  FAIL %zu of %zu bytes received\n", client.received, total_bytes());
+        fail = 1;
+    }
+
+    pthread_mutex_lock(&client.lock);
+    qsort(latency_ms, keystrokes, sizeof(double), compare_double);
+    p50 = latency_ms[keystrokes / 2];
+    p99 = latency_ms[keystrokes * 99 / 100];
+    seconds = (client.done_us - bulk_start_us) / 1e6;
+    segment = client.bulk_segments ? (double)bulk_bytes / client.bulk_segments : 0;
+    rate = seconds > 0 ? bulk_bytes / seconds : 0;
+    pthread_mutex_unlock(&client.lock);
+    uart_bridge_stats(0, &stats);
+
+    printf("{\"baud\":%u,\"threshold\":%d,\"flush_size\":%d,\"coalesce_ms\":%d,"
+           "\"interactive\":{\"bytes\":%d,\"segments\":%u,\"p50_ms\":%.2f,\"p99_ms\":%.2f},"
+           "\"bulk\":{\"bytes\":%zu,\"segments\":%u,\"avg_segment\":%.1f,\"kbps\":%.1f,\"line_kbps\":%.1f},"
+           "\"sessions\":%u,\"dropped\":%u,\"corrupt\":%u}\n",
+           baud, uart.threshold, UART_BRIDGE_FLUSH_SIZE, UART_BRIDGE_COALESCE_MS,
+           keystrokes, client.segments, p50, p99, bulk_bytes, client.bulk_segments, segment,
+           rate * 8 / 1000, baud / 10 * 8 / 1000.0, stats.sessions, uart.dropped, client.corrupt);
+
+    if (p99 > INTERACTIVE_BOUND_MS) {
+        printf("  FAIL interactive p99 %.2f ms over %d ms\n", p99, INTERACTIVE_BOUND_MS);
+        fail = 1;
+    }
+    if (rate < BULK_MIN_RATE * baud / 10) {
+        printf("  FAIL bulk at %.0f bytes/s, the line carries %u\n", rate, baud / 10);
+        fail = 1;
+    }
+    // FIFO sized pieces would mean the coalescing did not happen
+    if (segment < UART_BRIDGE_FLUSH_SIZE / 2) {
+        printf("  FAIL bulk segments of %.1f bytes, flush size %d\n", segment, UART_BRIDGE_FLUSH_SIZE);
+        fail = 1;
+    }
+    if (client.corrupt || uart.dropped || client.closed || stats.sessions != 1) {
+        printf("  FAIL %u bytes corrupt, %u dropped, client %s, %u sessions\n", client.corrupt,
+               uart.dropped, client.closed ? "closed" : "open", stats.sessions);
+        fail = 1;
+    }
+    printf("%s\n", fail ? "FAIL" : "PASS");
+    return fail;
+}
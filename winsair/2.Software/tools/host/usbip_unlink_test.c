@@ -0,0 +1,426 @@
+/**
+ * @file usbip_unlink_test.c
+ * @brief USB/IP bulk IN URBs unlinked at random while they complete (host test)
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * A client on mem_transport.c imports the device and runs DAP the way
+ * usbip-win does: a bulk OUT URB per request and a few bulk IN URBs
+ * waiting ahead for the responses. Now and then it unlinks one of the last
+ * IN URBs, which may still be waiting, be completing right then or be
+ * done. The stream goes to the session in segments of random size.
+ *
+ * The DAP engine is replaced by one that answers with the sequence number
+ * of the request and takes a random while to do so. Every IN URB has to
+ * end exactly once: with the response of its own request, or with an
+ * unlink that returned -ECONNRESET and no response after it. An unlink
+ * that returned 0 has to come after the response. A response that went to
+ * the wrong URB, or that is missing, fails the test.
+ *
+ *   usbip_unlink_test [-r rounds] [-n requests] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/param.h>
+
+#include "main/wifi_configuration.h"
+#include "main/dap_configuration.h"
+#include "main/DAP_handle.h"
+#include "main/session_arena.h"
+#include "main/transport.h"
+#include "main/usbip_server.h"
+#include "main/dap_tcp.h"
+#include "main/timer.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+#include "components/DAP/include/DAP.h"
+#include "components/USBIP/usbip_defs.h"
+#include "components/USBIP/usb_descriptor.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "mem_transport.h"
+
+TaskHandle_t kDAPTaskHandle = NULL;
+TaskHandle_t kDAPSendTaskHandle = NULL;
+
+#define HEADER_SIZE sizeof(usbip_stage2_header)
+// request of the client: [command, index(2), tag], answer: [command, sequence number(4)]
+#define REQUEST_LEN  4
+#define RESPONSE_LEN 5
+#define REQUEST_TAG  0x77
+// IN URBs the client keeps waiting ahead of its requests
+#define IN_AHEAD 4
+#define READ_TIMEOUT_MS 5000
+
+enum urb_kind_t
+{
+    URB_OUT,
+    URB_IN,
+    URB_UNLINK
+};
+
+typedef struct
+{
+    uint8_t kind;
+    uint32_t index; // request of an OUT or IN URB, seqnum of the IN URB an unlink targets
+} urb_t;
+
+typedef struct
+{
+    uint8_t submitted; // RET_SUBMIT of the IN URB
+    uint8_t cancelled; // RET_UNLINK -ECONNRESET for it
+    uint8_t unlinked;  // the client sent an unlink for it
+    uint8_t out_done;  // RET_SUBMIT of the OUT URB
+} request_state_t;
+
+static urb_t *urbs; // by seqnum
+static uint32_t next_seqnum;
+static request_state_t *requests;
+static uint32_t base; // sequence number of the engine for request 0 of the round
+
+static uint8_t *stream;
+static size_t stream_len;
+
+static volatile uint32_t executed;
+static uint32_t failures;
+static uint32_t rng;
+static uint32_t engine_rng; // the DAP task has its own
+
+
+static uint32_t xorshift(uint32_t *state)
+{
+    // xorshift32, the seed makes a run repeatable
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint32_t next_random(void)
+{
+    return xorshift(&rng);
+}
+
+static void fail(const char *what, uint32_t at)
+{
+    if (failures++ < 10)
+        printf("  FAIL %s at %u\n", what, at);
+}
+
+void DAP_Setup(void)
+{
+}
+
+uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response)
+{
+    uint32_t seq = executed;
+
+    // long enough for unlinks to catch URBs on both sides of completion
+    usleep(xorshift(&engine_rng) % 200);
+    if (request[3] != REQUEST_TAG || (uint16_t)(request[1] | request[2] << 8) != (uint16_t)(seq - base))
+        fail("request run out of order", seq);
+
+    response[0] = request[0];
+    memcpy(response + 1, &seq, 4);
+    __atomic_store_n(&executed, seq + 1, __ATOMIC_RELEASE);
+    return (REQUEST_LEN << 16) | RESPONSE_LEN;
+}
+
+uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response)
+{
+    return dap_execute_command(request, response);
+}
+
+
+static uint32_t new_urb(uint8_t kind, uint32_t index)
+{
+    urbs[next_seqnum].kind = kind;
+    urbs[next_seqnum].index = index;
+    return next_seqnum++;
+}
+
+static void put_header(const usbip_stage2_header *header)
+{
+    memcpy(stream + stream_len, header, HEADER_SIZE);
+    stream_len += HEADER_SIZE;
+}
+
+static void put_submit(uint32_t seqnum, uint32_t direction, const uint8_t *data, uint32_t len)
+{
+    usbip_stage2_header header;
+
+    memset(&header, 0, sizeof(header));
+    header.base.command = htonl(USBIP_CMD_SUBMIT);
+    header.base.seqnum = htonl(seqnum);
+    header.base.devid = htonl(0x10002);
+    header.base.direction = htonl(direction);
+    header.base.ep = htonl(USBD0_EP_DAP_OUT & 0x0F);
+    header.u.cmd_submit.data_length = htonl(len);
+    put_header(&header);
+    if (direction == USBIP_DIR_OUT) {
+        memcpy(stream + stream_len, data, len);
+        stream_len += len;
+    }
+}
+
+static void put_request(uint32_t i)
+{
+    uint8_t req[REQUEST_LEN] = { ID_DAP_Vendor0, (uint8_t)i, (uint8_t)(i >> 8), REQUEST_TAG };
+
+    put_submit(new_urb(URB_OUT, i), USBIP_DIR_OUT, req, sizeof(req));
+}
+
+static void put_read(uint32_t i)
+{
+    put_submit(new_urb(URB_IN, i), USBIP_DIR_IN, NULL, kDapPacketSize);
+}
+
+static void put_unlink(uint32_t target)
+{
+    usbip_stage2_header header;
+
+    memset(&header, 0, sizeof(header));
+    header.base.command = htonl(USBIP_CMD_UNLINK);
+    header.base.seqnum = htonl(new_urb(URB_UNLINK, target));
+    header.base.devid = htonl(0x10002);
+    header.u.cmd_unlink.seqnum = htonl(target);
+    put_header(&header);
+}
+
+// What was built so far, in segments of random size with pauses between
+static void feed(void)
+{
+    size_t pos = 0, n;
+
+    while (pos < stream_len) {
+        n = 1 + next_random() % 1500;
+        n = MIN(n, stream_len - pos);
+        mem_transport_write(&kTcpSocketTransport, stream + pos, n);
+        pos += n;
+        if (next_random() % 4 == 0)
+            usleep(next_random() % 100);
+    }
+    stream_len = 0;
+}
+
+static void import_device(void)
+{
+    usbip_stage1_request_import req;
+    uint8_t res[sizeof(usbip_stage1_header) + sizeof(usbip_stage1_usb_device)];
+
+    memset(&req, 0, sizeof(req));
+    req.header.version = htons(USBIP_VERSION);
+    req.header.command = htons(USBIP_OP_REQ_IMPORT);
+    strcpy(req.busid, "1-1");
+
+    mem_transport_connect(&kTcpSocketTransport);
+    mem_transport_write(&kTcpSocketTransport, &req, sizeof(req));
+    if (mem_transport_read(&kTcpSocketTransport, res, sizeof(res), READ_TIMEOUT_MS) != sizeof(res) ||
+        ntohs(((usbip_stage1_header *)res)->command) != USBIP_OP_REP_IMPORT)
+        fail("import", 0);
+}
+
+static void check_ret_submit(const usbip_stage2_header *header, uint32_t seqnum)
+{
+    request_state_t *r = &requests[urbs[seqnum].index];
+    int32_t status = ntohl(header->u.ret_submit.status);
+    int32_t len = ntohl(header->u.ret_submit.data_length);
+    uint8_t data[RESPONSE_LEN];
+    uint32_t seq;
+
+    if (status != USBIP_STATUS_OK)
+        fail("URB status", seqnum);
+
+    if (urbs[seqnum].kind == URB_OUT) {
+        if (r->out_done++ || len != REQUEST_LEN)
+            fail("OUT URB completion", seqnum);
+        return;
+    }
+
+    if (len != RESPONSE_LEN ||
+        mem_transport_read(&kTcpSocketTransport, data, len, READ_TIMEOUT_MS) != (size_t)len) {
+        fail("IN URB length", seqnum);
+        return;
+    }
+    memcpy(&seq, data + 1, 4);
+    if (data[0] != ID_DAP_Vendor0 || seq != base + urbs[seqnum].index)
+        fail("response of another request", seqnum);
+    if (r->submitted++)
+        fail("IN URB completed twice", seqnum);
+    if (r->cancelled)
+        fail("IN URB completed after its unlink", seqnum);
+}
+
+static void check_ret_unlink(const usbip_stage2_header *header, uint32_t seqnum)
+{
+    uint32_t target = urbs[seqnum].index;
+    request_state_t *r = &requests[urbs[target].index];
+    int32_t status = ntohl(header->u.ret_unlink.status);
+
+    if (status == USBIP_STATUS_ECONNRESET) {
+        if (r->submitted)
+            fail("unlink of a completed IN URB reset", target);
+        r->cancelled = 1;
+    } else if (status == USBIP_STATUS_OK) {
+        if (!r->submitted)
+            fail("unlink found no IN URB that had not completed", target);
+    } else {
+        fail("unlink status", seqnum);
+    }
+}
+
+// Read and check replies until every URB of the round has its own
+static void check_replies(uint32_t first_seqnum, uint32_t n, uint32_t unlinks)
+{
+    usbip_stage2_header header;
+    uint32_t seqnum, outs = 0, unlinked = 0, i;
+
+    for (;;) {
+        for (i = 0; i < n && (requests[i].submitted || requests[i].cancelled); i++) {
+        }
+        if (i == n && outs == n && unlinked == unlinks)
+            break;
+
+        if (mem_transport_read(&kTcpSocketTransport, &header, HEADER_SIZE, READ_TIMEOUT_MS) != HEADER_SIZE) {
+            fail("replies missing, IN URB", i);
+            return;
+        }
+        seqnum = ntohl(header.base.seqnum);
+        if (seqnum < first_seqnum || seqnum >= next_seqnum) {
+            fail("reply to an unknown seqnum", seqnum);
+            return;
+        }
+
+        switch (ntohl(header.base.command)) {
+        case USBIP_RET_SUBMIT:
+            if (urbs[seqnum].kind == URB_UNLINK) {
+                fail("RET_SUBMIT for an unlink", seqnum);
+                return;
+            }
+            outs += urbs[seqnum].kind == URB_OUT;
+            check_ret_submit(&header, seqnum);
+            break;
+        case USBIP_RET_UNLINK:
+            if (urbs[seqnum].kind != URB_UNLINK) {
+                fail("RET_UNLINK for a submit", seqnum);
+                return;
+            }
+            unlinked++;
+            check_ret_unlink(&header, seqnum);
+            break;
+        default:
+            fail("reply command", ntohl(header.base.command));
+            return;
+        }
+    }
+
+    if (mem_transport_read(&kTcpSocketTransport, &header, 1, 10) != 0)
+        fail("reply past the end", next_seqnum);
+}
+
+static void run_round(uint32_t round, uint32_t n)
+{
+    uint32_t first_seqnum, in_seqnum[IN_AHEAD * 4], unlinks = 0, cancelled = 0, i, k;
+    int j;
+
+    memset(requests, 0, n * sizeof(request_state_t));
+    base = executed;
+
+    import_device();
+    first_seqnum = next_seqnum;
+    for (i = 0; i < n + IN_AHEAD; i++) {
+        if (i < n)
+            put_request(i);
+        if (i >= IN_AHEAD) {
+            in_seqnum[(i - IN_AHEAD) % (IN_AHEAD * 4)] = next_seqnum;
+            put_read(i - IN_AHEAD);
+        }
+        // one of the last IN URBs, it may be waiting, completing or done
+        if (i >= IN_AHEAD && i < n && next_random() % 8 == 0) {
+            k = i - IN_AHEAD - next_random() % MIN(IN_AHEAD * 3, i - IN_AHEAD + 1);
+            if (!requests[k].unlinked) {
+                requests[k].unlinked = 1;
+                put_unlink(in_seqnum[k % (IN_AHEAD * 4)]);
+                unlinks++;
+            }
+        }
+        if (next_random() % 8 == 0)
+            feed();
+    }
+    feed();
+
+    check_replies(first_seqnum, n, unlinks);
+    // the session may be stuck on a response nobody takes, do not wait for it
+    if (failures)
+        return;
+    for (i = 0; i < n; i++)
+        cancelled += requests[i].cancelled;
+
+    // the responses of cancelled URBs are dropped as they come
+    for (j = 0; j < 1000 && executed != base + n; j++)
+        usleep(1000);
+    if (executed != base + n)
+        fail("requests run", executed - base);
+    mem_transport_disconnect(&kTcpSocketTransport);
+
+    printf("round %2u: %u requests, %u unlinks, %u URBs cancelled\n", round, n, unlinks, cancelled);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t rounds = 5, n = 2000, seed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:s:")) != -1) {
+        switch (opt) {
+        case 'r':
+            rounds = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-n requests] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (n < 1 || n > 0x10000) {
+        fprintf(stderr, "requests must be 1 to 65536\n");
+        return 2;
+    }
+    rng = seed ? seed : (uint32_t)time(NULL) | 1;
+    engine_rng = rng ^ 0x5A5A5A5A;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("seed %u\n", rng);
+    // an OUT and an IN URB per request, an unlink for some
+    urbs = calloc((size_t)rounds * n * 3 + 1, sizeof(urb_t));
+    requests = calloc(n, sizeof(request_state_t));
+    stream = malloc((size_t)n * 3 * (HEADER_SIZE + REQUEST_LEN) + IN_AHEAD * HEADER_SIZE);
+    next_seqnum = 1;
+
+    timer_init();
+    DAP_Setup();
+    session_arena_init(dap_ringbuf_storage_size() +
+                       MAX(MAX(el_process_buffer_size(), usbip_session_buffer_size()), dap_tcp_session_buffer_size()) + 4 * SESSION_ARENA_ALIGN);
+    malloc_dap_ringbuf();
+    session_arena_keep();
+
+    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    xTaskCreate(transport_send_task, "dap_send", 2048, NULL, 12, &kDAPSendTaskHandle);
+    transport_start();
+
+    for (uint32_t r = 0; r < rounds && !failures; r++)
+        run_round(r, n);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}